@@ -0,0 +1,462 @@
+#include "assets/asset_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace vcl;
+
+namespace assets {
+
+static_assert(sizeof(vec3)==3*sizeof(float) && sizeof(vec2)==2*sizeof(float) && sizeof(uint3)==3*sizeof(uint32_t),
+	"the cache files store the vertex buffers as packed floats");
+
+// ****************************************** //
+// File layouts
+// ****************************************** //
+
+// Mesh: header, then positions, normals, colors (3 floats per vertex), uvs (2 floats per vertex), triangles (3 uint32)
+struct mesh_file_header
+{
+	char magic[4];  // "RKAM"
+	uint32_t version;
+	uint64_t key;
+	uint32_t vertex_count;
+	uint32_t triangle_count;
+	float bound[4]; // bounding sphere center and radius
+};
+
+// Texture: header, then the texels of each mipmap level, from the full resolution to 1x1
+struct texture_file_header
+{
+	char magic[4];  // "RKAT"
+	uint32_t version;
+	uint64_t key;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels; // 3 (rgb) or 4 (rgba)
+	uint32_t levels;
+};
+
+static_assert(sizeof(mesh_file_header)==40, "mesh_file_header must not be padded");
+static_assert(sizeof(texture_file_header)==32, "texture_file_header must not be padded");
+
+static size_t mesh_file_size(uint32_t vertex_count, uint32_t triangle_count)
+{
+	return sizeof(mesh_file_header) + size_t(vertex_count)*11*sizeof(float) + size_t(triangle_count)*3*sizeof(uint32_t);
+}
+
+// Read-only mapping of a whole file (read in memory where mmap is not available)
+class mapped_file
+{
+public:
+	mapped_file() = default;
+	~mapped_file() { close(); }
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	bool open(std::string const& filename)
+	{
+#ifdef _WIN32
+		std::ifstream in(filename, std::ios::binary);
+		if(!in)
+			return false;
+		buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		data = reinterpret_cast<uint8_t const*>(buffer.data());
+		size = buffer.size();
+		return true;
+#else
+		int const fd = ::open(filename.c_str(), O_RDONLY);
+		if(fd<0)
+			return false;
+		struct stat st;
+		if(fstat(fd, &st)!=0 || st.st_size<=0){
+			::close(fd);
+			return false;
+		}
+		void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(p==MAP_FAILED)
+			return false;
+		data = static_cast<uint8_t const*>(p);
+		size = size_t(st.st_size);
+		return true;
+#endif
+	}
+
+	void close()
+	{
+#ifndef _WIN32
+		if(data!=nullptr)
+			munmap(const_cast<uint8_t*>(data), size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	uint8_t const* data = nullptr;
+	size_t size = 0;
+
+private:
+#ifdef _WIN32
+	std::vector<char> buffer;
+#endif
+};
+
+// Write to a temporary file renamed at the end, so that an interrupted start never leaves a truncated entry
+// Size and levels of a cached texture, checked before they size the level chain: a corrupt entry
+// is a miss instead of shifts out of range (levels: at most the full chain down to 1x1)
+static uint32_t const max_texture_size = 16384;
+static bool texture_header_valid(texture_file_header const& header)
+{
+	if(header.width==0 || header.height==0 || header.width>max_texture_size || header.height>max_texture_size)
+		return false;
+	uint32_t full_chain = 1;
+	for(uint32_t size=std::max(header.width, header.height); size>1; size/=2)
+		full_chain++;
+	return header.levels>=1 && header.levels<=full_chain;
+}
+
+static bool write_file(std::string const& filename, std::vector<std::pair<void const*, size_t>> const& parts)
+{
+	std::string const temporary = filename + ".tmp";
+	FILE* f = std::fopen(temporary.c_str(), "wb");
+	if(f==nullptr)
+		return false;
+	bool ok = true;
+	for(auto const& part : parts)
+		ok = ok && std::fwrite(part.first, 1, part.second, f)==part.second;
+	ok = std::fclose(f)==0 && ok;
+	std::remove(filename.c_str());
+	if(!ok || std::rename(temporary.c_str(), filename.c_str())!=0){
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+// ****************************************** //
+// GPU upload
+// ****************************************** //
+
+// Same buffers and vertex attributes as the mesh_drawable constructor, filled from raw arrays
+cached_mesh upload_mesh(mesh_data const& data)
+{
+	cached_mesh result;
+	result.bound_center = data.bound_center;
+	result.bound_radius = data.bound_radius;
+	mesh_drawable& drawable = result.drawable;
+	drawable.shader = mesh_drawable::default_shader;
+	drawable.texture = mesh_drawable::default_texture;
+
+	glGenVertexArrays(1, &drawable.vao);
+	glBindVertexArray(drawable.vao);
+	struct attribute { char const* name; float const* values; GLint components; };
+	attribute const attributes[] = { {"position",data.position,3}, {"normal",data.normal,3}, {"color",data.color,3}, {"uv",data.uv,2} };
+	for(GLuint k=0; k<4; ++k){
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(data.vertex_count)*attributes[k].components*sizeof(float), attributes[k].values, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(k);
+		glVertexAttribPointer(k, attributes[k].components, GL_FLOAT, GL_FALSE, 0, nullptr);
+		drawable.vbo[attributes[k].name] = buffer;
+	}
+	GLuint index_buffer = 0;
+	glGenBuffers(1, &index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(data.triangle_count)*3*sizeof(uint32_t), data.index, GL_STATIC_DRAW);
+	drawable.vbo["index"] = index_buffer;
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	drawable.number_triangles = data.triangle_count;
+	return result;
+}
+
+// All the mipmap levels are given: no glGenerateMipmap
+GLuint upload_texture(texture_data const& data, GLint wrap_s, GLint wrap_t)
+{
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rgb rows are not aligned on 4 bytes
+	GLenum const format = data.channels==4 ? GL_RGBA : GL_RGB;
+	for(uint32_t l=0; l<data.levels; ++l)
+		glTexImage2D(GL_TEXTURE_2D, GLint(l), data.channels==4 ? GL_RGBA8 : GL_RGB8, GLsizei(data.level_width(l)), GLsizei(data.level_height(l)), 0,
+			format, GL_UNSIGNED_BYTE, data.texels + data.level_offset(l));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(data.levels)-1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return id;
+}
+
+size_t texture_data::level_offset(uint32_t level) const
+{
+	size_t offset = 0;
+	for(uint32_t l=0; l<level; ++l)
+		offset += size_t(level_width(l))*level_height(l)*channels;
+	return offset;
+}
+
+// Mipmap chain down to 1x1, each level being the 2x2 box filter of the previous one
+static std::vector<uint8_t> build_mipmaps(uint8_t const* image, uint32_t width, uint32_t height, uint32_t channels, uint32_t& levels)
+{
+	std::vector<uint8_t> texels;
+	texels.reserve(size_t(width)*height*channels*4/3 + 64*channels); // all the levels
+	texels.assign(image, image + size_t(width)*height*channels);
+	levels = 1;
+	size_t level_begin = 0;
+	while(width>1 || height>1){
+		uint32_t const w = std::max(1u, width/2);
+		uint32_t const h = std::max(1u, height/2);
+		size_t const next_begin = texels.size();
+		texels.resize(next_begin + size_t(w)*h*channels);
+		uint8_t const* src = texels.data() + level_begin;
+		uint8_t* dst = texels.data() + next_begin;
+		for(uint32_t y=0; y<h; ++y){
+			uint32_t const y0 = std::min(2*y, height-1), y1 = std::min(2*y+1, height-1);
+			for(uint32_t x=0; x<w; ++x){
+				uint32_t const x0 = std::min(2*x, width-1), x1 = std::min(2*x+1, width-1);
+				for(uint32_t c=0; c<channels; ++c){
+					unsigned int const sum = src[(size_t(y0)*width+x0)*channels+c] + src[(size_t(y0)*width+x1)*channels+c]
+						+ src[(size_t(y1)*width+x0)*channels+c] + src[(size_t(y1)*width+x1)*channels+c];
+					dst[(size_t(y)*w+x)*channels+c] = uint8_t((sum+2)/4);
+				}
+			}
+		}
+		level_begin = next_begin;
+		width = w;
+		height = h;
+		levels++;
+	}
+	return texels;
+}
+
+// ****************************************** //
+// Keys
+// ****************************************** //
+
+uint64_t hash_bytes(uint64_t h, void const* data, size_t size)
+{
+	unsigned char const* bytes = static_cast<unsigned char const*>(data);
+	for(size_t k=0; k<size; ++k){
+		h ^= bytes[k];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+asset_key::asset_key(char const* generator)
+	: h(hash_seed)
+{
+	h = hash_bytes(h, &asset_cache_version, sizeof(asset_cache_version));
+	h = hash_bytes(h, generator, std::strlen(generator));
+}
+
+void mesh_bounding_sphere(mesh const& shape, vec3& center, float& radius)
+{
+	center = vec3(0,0,0);
+	radius = 0;
+	if(shape.position.size()==0)
+		return;
+	vec3 p_min = shape.position[0], p_max = shape.position[0];
+	for(vec3 const& p : shape.position)
+		for(int k=0; k<3; ++k){
+			p_min[k] = std::min(p_min[k], p[k]);
+			p_max[k] = std::max(p_max[k], p[k]);
+		}
+	center = 0.5f*(p_min+p_max);
+	for(vec3 const& p : shape.position)
+		radius = std::max(radius, norm(p-center));
+}
+
+// ****************************************** //
+// Cache
+// ****************************************** //
+
+bool asset_cache::open(std::string const& directory)
+{
+	path.clear();
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	// the directory is usable if a file can be created in it
+	std::string const probe = directory + "/.probe";
+	FILE* f = std::fopen(probe.c_str(), "wb");
+	if(f==nullptr)
+		return false;
+	std::fclose(f);
+	std::remove(probe.c_str());
+	path = directory;
+	return true;
+}
+
+std::string asset_cache::filename(uint64_t key, char const* extension) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+	return path + "/" + name + extension;
+}
+
+asset_cache_statistics asset_cache::statistics() const
+{
+	asset_cache_statistics stats;
+	stats.mesh_hits = mesh_hits;
+	stats.mesh_misses = mesh_misses;
+	stats.texture_hits = texture_hits;
+	stats.texture_misses = texture_misses;
+	stats.bytes_mapped = bytes_mapped;
+	stats.bytes_written = bytes_written;
+	return stats;
+}
+
+bool asset_cache::load_mesh(uint64_t key, mesh_data& data)
+{
+	if(!is_open())
+		return false;
+	std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>();
+	if(!file->open(filename(key, ".mesh")) || file->size<sizeof(mesh_file_header)){
+		mesh_misses++;
+		return false;
+	}
+	mesh_file_header header;
+	std::memcpy(&header, file->data, sizeof(header));
+	if(std::memcmp(header.magic, "RKAM", 4)!=0 || header.version!=asset_cache_version || header.key!=key
+		|| file->size!=mesh_file_size(header.vertex_count, header.triangle_count)){
+		mesh_misses++;
+		return false;
+	}
+
+	size_t const n = header.vertex_count;
+	data.vertex_count = header.vertex_count;
+	data.triangle_count = header.triangle_count;
+	data.position = reinterpret_cast<float const*>(file->data + sizeof(mesh_file_header));
+	data.normal = data.position + 3*n;
+	data.color = data.normal + 3*n;
+	data.uv = data.color + 3*n;
+	data.index = reinterpret_cast<uint32_t const*>(data.uv + 2*n);
+	data.bound_center = vec3(header.bound[0], header.bound[1], header.bound[2]);
+	data.bound_radius = header.bound[3];
+	data.storage = file;
+	mesh_hits++;
+	bytes_mapped += file->size;
+	return true;
+}
+
+mesh_data asset_cache::store_mesh(uint64_t key, vcl::mesh shape)
+{
+	std::shared_ptr<vcl::mesh> generated = std::make_shared<vcl::mesh>(std::move(shape));
+	vcl::mesh& m = *generated;
+	m.fill_empty_field();
+
+	mesh_data data;
+	data.vertex_count = static_cast<uint32_t>(m.position.size());
+	data.triangle_count = static_cast<uint32_t>(m.connectivity.size());
+	mesh_bounding_sphere(m, data.bound_center, data.bound_radius);
+	if(data.vertex_count>0){
+		data.position = &m.position[0][0];
+		data.normal = &m.normal[0][0];
+		data.color = &m.color[0][0];
+		data.uv = &m.uv[0][0];
+	}
+	if(data.triangle_count>0)
+		data.index = &m.connectivity[0][0];
+	data.storage = generated;
+
+	if(is_open()){
+		mesh_file_header header;
+		std::memcpy(header.magic, "RKAM", 4);
+		header.version = asset_cache_version;
+		header.key = key;
+		header.vertex_count = data.vertex_count;
+		header.triangle_count = data.triangle_count;
+		header.bound[0] = data.bound_center.x;
+		header.bound[1] = data.bound_center.y;
+		header.bound[2] = data.bound_center.z;
+		header.bound[3] = data.bound_radius;
+		size_t const vertex_bytes = size_t(data.vertex_count)*sizeof(float);
+		if(write_file(filename(key, ".mesh"), {{&header, sizeof(header)}, {data.position, 3*vertex_bytes}, {data.normal, 3*vertex_bytes},
+			{data.color, 3*vertex_bytes}, {data.uv, 2*vertex_bytes}, {data.index, size_t(data.triangle_count)*3*sizeof(uint32_t)}}))
+			bytes_written += mesh_file_size(data.vertex_count, data.triangle_count);
+	}
+	return data;
+}
+
+texture_data asset_cache::prepare_texture(std::string const& png_filename)
+{
+	// the key is the content of the PNG file: reading it is much faster than decoding it
+	std::ifstream in(png_filename, std::ios::binary);
+	std::vector<char> const png((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	uint64_t key = hash_bytes(hash_seed, &asset_cache_version, sizeof(asset_cache_version));
+	key = hash_bytes(key, png.data(), png.size());
+
+	texture_data data;
+	if(is_open()){
+		std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>();
+		if(file->open(filename(key, ".texture")) && file->size>=sizeof(texture_file_header)){
+			texture_file_header header;
+			std::memcpy(&header, file->data, sizeof(header));
+			bool valid = std::memcmp(header.magic, "RKAT", 4)==0 && header.version==asset_cache_version && header.key==key
+				&& (header.channels==3 || header.channels==4) && texture_header_valid(header);
+			if(valid){
+				data.width = header.width;
+				data.height = header.height;
+				data.channels = header.channels;
+				data.levels = header.levels;
+				valid = file->size==sizeof(header) + data.bytes();
+			}
+			if(valid){
+				data.texels = file->data + sizeof(header);
+				data.storage = file;
+				texture_hits++;
+				bytes_mapped += file->size;
+				return data;
+			}
+		}
+		texture_misses++;
+	}
+
+	image_raw const image = image_load_png(png_filename);
+	std::shared_ptr<std::vector<uint8_t>> texels = std::make_shared<std::vector<uint8_t>>();
+	data.width = image.width;
+	data.height = image.height;
+	data.channels = image.color_type==image_color_type::rgba ? 4 : 3;
+	*texels = build_mipmaps(&image.data[0], image.width, image.height, data.channels, data.levels);
+	data.texels = texels->data();
+	data.storage = texels;
+
+	if(is_open()){
+		texture_file_header header;
+		std::memcpy(header.magic, "RKAT", 4);
+		header.version = asset_cache_version;
+		header.key = key;
+		header.width = data.width;
+		header.height = data.height;
+		header.channels = data.channels;
+		header.levels = data.levels;
+		if(write_file(filename(key, ".texture"), {{&header, sizeof(header)}, {texels->data(), texels->size()}}))
+			bytes_written += sizeof(header) + texels->size();
+	}
+	return data;
+}
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+/**
+On-disk cache of the generated meshes and of the decoded textures.
+The first start tessellates the primitives and decodes the PNG files as before, and writes the
+results next to the assets (assets/cache/): vertex and index buffers ready to be uploaded, and
+texels with their whole mipmap chain. The next starts map these files in memory and give the
+mapped bytes straight to glBufferData/glTexImage2D, without tessellation nor PNG decoding.
+The preparation (file mapping, or generation) and the upload are separate steps, so that the
+asynchronous loader (assets/async_loader.hpp) prepares the assets on its worker threads.
+
+Each file is named after a 64-bit key:
+ - meshes: hash of the name of the generator and of its parameters,
+ - textures: hash of the content of the PNG file,
+both combined with asset_cache_version, to be increased when the file layout or the generators
+(e.g. a new version of VCL) change. A missing, truncated or mismatching file is regenerated.
+*/
+
+#include "vcl/vcl.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace assets {
+
+uint32_t const asset_cache_version = 1;
+
+// FNV-1a on raw bytes
+uint64_t hash_bytes(uint64_t h, void const* data, size_t size);
+uint64_t const hash_seed = 14695981039346656037ull;
+
+// Key of a generated asset: name of the generator and values of its parameters
+class asset_key
+{
+public:
+	explicit asset_key(char const* generator);
+
+	template <typename T>
+	asset_key& operator<<(T const& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "asset keys hash the bytes of the parameters");
+		h = hash_bytes(h, &value, sizeof(T));
+		return *this;
+	}
+
+	uint64_t value() const { return h; }
+
+private:
+	uint64_t h;
+};
+
+// Bounding sphere around the center of the bounding box of the vertices
+void mesh_bounding_sphere(vcl::mesh const& shape, vcl::vec3& center, float& radius);
+
+struct cached_mesh
+{
+	vcl::mesh_drawable drawable;
+	vcl::vec3 bound_center; // bounding sphere, stored with the buffers
+	float bound_radius = 0;
+};
+
+// CPU side of a mesh, mapped from the cache or just generated, ready to be uploaded
+struct mesh_data
+{
+	uint32_t vertex_count = 0;
+	uint32_t triangle_count = 0;
+	float const* position = nullptr; // 3 floats per vertex
+	float const* normal = nullptr;
+	float const* color = nullptr;
+	float const* uv = nullptr;       // 2 floats per vertex
+	uint32_t const* index = nullptr; // 3 indices per triangle
+	vcl::vec3 bound_center;
+	float bound_radius = 0;
+	std::shared_ptr<void const> storage; // mapping or generated mesh holding the arrays
+
+	size_t bytes() const { return size_t(vertex_count)*11*sizeof(float) + size_t(triangle_count)*3*sizeof(uint32_t); }
+};
+
+// CPU side of a texture with all its mipmap levels, from the full resolution to 1x1
+struct texture_data
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t channels = 4; // 3 (rgb) or 4 (rgba)
+	uint32_t levels = 0;
+	uint8_t const* texels = nullptr; // the levels one after the other, rows packed without alignment
+	std::shared_ptr<void const> storage;
+
+	uint32_t level_width(uint32_t level) const { return std::max(1u, width>>level); }
+	uint32_t level_height(uint32_t level) const { return std::max(1u, height>>level); }
+	size_t level_offset(uint32_t level) const;
+	size_t bytes() const { return level_offset(levels); }
+};
+
+// Upload to the GPU (OpenGL thread), with the vertex attributes of mesh_drawable and the
+// sampling of opengl_texture_to_gpu (mipmaps, linear filtering)
+cached_mesh upload_mesh(mesh_data const& data);
+GLuint upload_texture(texture_data const& data, GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE);
+
+struct asset_cache_statistics
+{
+	unsigned int mesh_hits = 0;
+	unsigned int mesh_misses = 0;
+	unsigned int texture_hits = 0;
+	unsigned int texture_misses = 0;
+	uint64_t bytes_mapped = 0;
+	uint64_t bytes_written = 0;
+};
+
+class asset_cache
+{
+public:
+	// Use (and create if needed) the cache directory. Without it, assets are generated every time.
+	bool open(std::string const& directory);
+	bool is_open() const { return !path.empty(); }
+
+	// Mesh returned by generate(args...), e.g. mesh("mesh_primitive_disc", mesh_primitive_disc, 5.0f, center, normal, 60)
+	template <typename F, typename... Args>
+	cached_mesh mesh(char const* generator, F generate, Args const&... args)
+	{
+		return upload_mesh(prepare_mesh(generator, generate, args...));
+	}
+
+	// Texture of a PNG file
+	GLuint texture(std::string const& png_filename, GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE)
+	{
+		return upload_texture(prepare_texture(png_filename), wrap_s, wrap_t);
+	}
+
+	// CPU part only (mapping, or generation and writing of the file): safe to call from several threads
+	template <typename F, typename... Args>
+	mesh_data prepare_mesh(char const* generator, F generate, Args const&... args)
+	{
+		asset_key key(generator);
+		hash_arguments(key, args...);
+		mesh_data data;
+		if(load_mesh(key.value(), data))
+			return data;
+		return store_mesh(key.value(), generate(args...));
+	}
+	texture_data prepare_texture(std::string const& png_filename);
+
+	asset_cache_statistics statistics() const;
+
+private:
+	static void hash_arguments(asset_key&) {}
+	template <typename T, typename... Args>
+	static void hash_arguments(asset_key& key, T const& value, Args const&... args)
+	{
+		key << value;
+		hash_arguments(key, args...);
+	}
+
+	bool load_mesh(uint64_t key, mesh_data& data);
+	mesh_data store_mesh(uint64_t key, vcl::mesh shape);
+	std::string filename(uint64_t key, char const* extension) const;
+
+	std::string path;
+	std::atomic<unsigned int> mesh_hits{0}, mesh_misses{0}, texture_hits{0}, texture_misses{0};
+	std::atomic<uint64_t> bytes_mapped{0}, bytes_written{0};
+};
+
+}
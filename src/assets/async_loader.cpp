@@ -0,0 +1,217 @@
+#include "assets/async_loader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace assets {
+
+async_loader::~async_loader()
+{
+	stop();
+}
+
+void async_loader::start(unsigned int thread_count)
+{
+	if(!workers.empty())
+		return;
+	if(thread_count==0){
+		unsigned int const hardware = std::thread::hardware_concurrency();
+		thread_count = std::max(1u, std::min(4u, hardware>1 ? hardware-1 : 1u));
+	}
+	stopping = false;
+	for(unsigned int k=0; k<thread_count; ++k)
+		workers.emplace_back(&async_loader::worker_loop, this);
+}
+
+void async_loader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		waiting.clear();
+	}
+	wake_up.notify_all();
+	for(std::thread& t : workers)
+		t.join();
+	workers.clear();
+
+	job* list = prepared.exchange(nullptr);
+	while(list!=nullptr){
+		job* next = list->next;
+		delete list;
+		list = next;
+	}
+	ready.clear();
+}
+
+void async_loader::load_texture(std::string const& png_filename, GLint wrap_s, GLint wrap_t, std::function<void(GLuint)> ready_callback)
+{
+	asset_cache* c = &cache;
+	std::unique_ptr<job> j(new job());
+	j->is_texture = true;
+	j->prepare = [c, png_filename](job& self){ self.texture = c->prepare_texture(png_filename); };
+	j->wrap_s = wrap_s;
+	j->wrap_t = wrap_t;
+	j->texture_ready = std::move(ready_callback);
+	enqueue(std::move(j));
+}
+
+void async_loader::enqueue(std::unique_ptr<job> j)
+{
+	requested++;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		waiting.push_back(std::move(j));
+	}
+	wake_up.notify_one();
+}
+
+void async_loader::worker_loop()
+{
+	while(true){
+		std::unique_ptr<job> j;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_up.wait(lock, [this]{ return stopping || !waiting.empty(); });
+			if(stopping)
+				return;
+			j = std::move(waiting.front());
+			waiting.pop_front();
+		}
+		j->prepare(*j);
+
+		// push on the list of prepared jobs, without lock
+		job* const raw = j.release();
+		raw->next = prepared.load(std::memory_order_relaxed);
+		while(!prepared.compare_exchange_weak(raw->next, raw, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+}
+
+void async_loader::update(size_t byte_budget)
+{
+	// jobs prepared since the last frame, the list being in reverse order of arrival
+	job* list = prepared.exchange(nullptr, std::memory_order_acquire);
+	size_t const first_new = ready.size();
+	for(; list!=nullptr; list=list->next)
+		ready.emplace_back(list);
+	std::reverse(ready.begin()+first_new, ready.end());
+	if(ready.empty())
+		return;
+
+	size_t used = 0;
+	while(!ready.empty() && (used==0 || used<byte_budget)){
+		job& j = *ready.front();
+		if(j.is_texture){
+			used += upload_texture_rows(j, byte_budget>used ? byte_budget-used : 0);
+			if(j.level<j.texture.levels)
+				break; // budget exhausted in the middle of the texture
+			if(j.texture_ready)
+				j.texture_ready(j.texture_id);
+		}
+		else{
+			cached_mesh const m = upload_mesh(j.mesh);
+			used += j.mesh.bytes();
+			if(j.mesh_ready)
+				j.mesh_ready(m);
+		}
+		ready.pop_front();
+		uploaded++;
+	}
+	stats.bytes_uploaded += used;
+	stats.upload_frames++;
+}
+
+size_t async_loader::upload_texture_rows(job& j, size_t byte_budget)
+{
+	texture_data const& t = j.texture;
+	GLenum const format = t.channels==4 ? GL_RGBA : GL_RGB;
+	if(j.texture_id==0){
+		// storage of all the levels, filled by the following frames
+		glGenTextures(1, &j.texture_id);
+		glBindTexture(GL_TEXTURE_2D, j.texture_id);
+		for(uint32_t l=0; l<t.levels; ++l)
+			glTexImage2D(GL_TEXTURE_2D, GLint(l), t.channels==4 ? GL_RGBA8 : GL_RGB8, GLsizei(t.level_width(l)), GLsizei(t.level_height(l)), 0, format, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(t.levels)-1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, j.wrap_s);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, j.wrap_t);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// rows fitting in the budget, at least one
+	slices.clear();
+	size_t size = 0;
+	while(j.level<t.levels){
+		size_t const row_bytes = size_t(t.level_width(j.level))*t.channels;
+		uint32_t const height = t.level_height(j.level);
+		size_t rows = byte_budget>size ? (byte_budget-size)/row_bytes : 0;
+		if(rows==0){
+			if(size>0)
+				break;
+			rows = 1;
+		}
+		rows = std::min(rows, size_t(height-j.row));
+		slices.push_back({j.level, j.row, uint32_t(rows), size});
+		size += rows*row_bytes;
+		j.row += uint32_t(rows);
+		if(j.row==height){
+			j.level++;
+			j.row = 0;
+		}
+	}
+	if(slices.empty())
+		return 0;
+
+	// copy in a pixel buffer (orphaned: no wait on the transfers of the previous frame), then let the driver transfer it
+	if(pixel_buffer==0)
+		glGenBuffers(1, &pixel_buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);
+	uint8_t* mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if(mapped!=nullptr){
+		for(texture_slice const& s : slices){
+			size_t const row_bytes = size_t(t.level_width(s.level))*t.channels;
+			std::memcpy(mapped + s.offset, t.texels + t.level_offset(s.level) + s.row*row_bytes, s.rows*row_bytes);
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // upload from the CPU copy instead
+
+	glBindTexture(GL_TEXTURE_2D, j.texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for(texture_slice const& s : slices){
+		size_t const row_bytes = size_t(t.level_width(s.level))*t.channels;
+		void const* source = mapped!=nullptr ? reinterpret_cast<void const*>(s.offset) : t.texels + t.level_offset(s.level) + s.row*row_bytes;
+		glTexSubImage2D(GL_TEXTURE_2D, GLint(s.level), 0, GLint(s.row), GLsizei(t.level_width(s.level)), GLsizei(s.rows), format, GL_UNSIGNED_BYTE, source);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return size;
+}
+
+async_loader_statistics async_loader::statistics() const
+{
+	async_loader_statistics s = stats;
+	s.requested = static_cast<unsigned int>(requested);
+	s.uploaded = static_cast<unsigned int>(uploaded);
+	return s;
+}
+
+std::function<void(cached_mesh const&)> assign_to(std::vector<vcl::mesh_drawable*> targets)
+{
+	return [targets](cached_mesh const& m){
+		for(vcl::mesh_drawable* d : targets){
+			d->vao = m.drawable.vao;
+			d->vbo = m.drawable.vbo;
+			d->number_triangles = m.drawable.number_triangles;
+			if(d->shader==0)
+				d->shader = vcl::mesh_drawable::default_shader;
+			if(d->texture==0)
+				d->texture = vcl::mesh_drawable::default_texture;
+		}
+	};
+}
+
+}
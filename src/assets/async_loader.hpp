@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+Asynchronous loading of the meshes and textures of the scene.
+Worker threads prepare the assets (asset_cache::prepare_*: mapping of the cache files, or
+tessellation and PNG decoding) and push them on a lock-free list. The OpenGL thread calls update()
+once per frame, which uploads them within a byte budget: meshes at once, textures a few rows at a
+time through a pixel buffer object, so that a large planet texture is spread over several frames
+instead of stalling one.
+Until its upload is complete, an asset is not given to the scene: drawables keep vao 0 (skipped
+by the render queue) and textures keep their placeholder (e.g. the white texture).
+*/
+
+#include "assets/asset_cache.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace assets {
+
+struct async_loader_statistics
+{
+	unsigned int requested = 0;
+	unsigned int uploaded = 0;
+	uint64_t bytes_uploaded = 0;
+	unsigned int upload_frames = 0; // calls of update() that uploaded something
+};
+
+class async_loader
+{
+public:
+	explicit async_loader(asset_cache& cache_arg) : cache(cache_arg) {}
+	~async_loader();
+
+	async_loader(async_loader const&) = delete;
+	async_loader& operator=(async_loader const&) = delete;
+
+	// Start the worker threads (0: hardware threads - 1, at most 4)
+	void start(unsigned int thread_count = 0);
+	// Stop the workers; assets not uploaded yet are dropped
+	void stop();
+
+	// ready(mesh) is called on the OpenGL thread, during update(), once the mesh is uploaded
+	template <typename F, typename... Args>
+	void load_mesh(std::function<void(cached_mesh const&)> ready, char const* generator, F generate, Args const&... args)
+	{
+		asset_cache* c = &cache;
+		std::unique_ptr<job> j(new job());
+		j->prepare = [=](job& self){ self.mesh = c->prepare_mesh(generator, generate, args...); };
+		j->mesh_ready = std::move(ready);
+		enqueue(std::move(j));
+	}
+
+	// ready(texture) is called on the OpenGL thread once all the mipmap levels are uploaded
+	void load_texture(std::string const& png_filename, GLint wrap_s, GLint wrap_t, std::function<void(GLuint)> ready);
+
+	// OpenGL thread, once per frame: upload the prepared assets, about byte_budget bytes
+	// (at least one mesh or one texture row, whatever the budget)
+	void update(size_t byte_budget);
+
+	// Requested assets not uploaded yet
+	size_t pending() const { return requested - uploaded; }
+	async_loader_statistics statistics() const;
+
+private:
+	struct job
+	{
+		std::function<void(job&)> prepare; // worker thread
+		bool is_texture = false;
+
+		mesh_data mesh;
+		std::function<void(cached_mesh const&)> mesh_ready;
+
+		texture_data texture;
+		GLint wrap_s = GL_CLAMP_TO_EDGE;
+		GLint wrap_t = GL_CLAMP_TO_EDGE;
+		std::function<void(GLuint)> texture_ready;
+		GLuint texture_id = 0;  // allocated at the first upload
+		uint32_t level = 0;     // next rows to upload
+		uint32_t row = 0;
+
+		job* next = nullptr;    // in the list of prepared jobs
+	};
+
+	void enqueue(std::unique_ptr<job> j);
+	void worker_loop();
+	// uploads of a texture for this frame: returns the bytes used
+	size_t upload_texture_rows(job& j, size_t byte_budget);
+
+	asset_cache& cache;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake_up;
+	std::deque<std::unique_ptr<job>> waiting; // to prepare
+	bool stopping = false;
+
+	std::atomic<job*> prepared{nullptr};      // lock-free list pushed by the workers, taken by update()
+	std::deque<std::unique_ptr<job>> ready;   // OpenGL thread: prepared, in order of arrival
+
+	GLuint pixel_buffer = 0;
+	struct texture_slice { uint32_t level, row, rows; size_t offset; }; // rows of a level in the pixel buffer
+	std::vector<texture_slice> slices;
+
+	size_t requested = 0;
+	size_t uploaded = 0;
+	async_loader_statistics stats;
+};
+
+// Callback giving the uploaded buffers to drawables declared (and shaded, placed) beforehand.
+// Drawables without shader or texture get the default ones of mesh_drawable.
+std::function<void(cached_mesh const&)> assign_to(std::vector<vcl::mesh_drawable*> targets);
+
+}
@@ -6,9 +6,39 @@ Hadi EL HAJJ
 
 
 #include "vcl/vcl.hpp"
+#include "simulation/mission.hpp"
+#include "simulation/timeline.hpp"
+#include "simulation/simulation_thread.hpp"
+#include "simulation/control_thread.hpp"
+#include "simulation/trajectory_optimization.hpp"
+#include "simulation/constellation.hpp"
+#include "simulation/fleet.hpp"
+#include "simulation/particles.hpp"
+#include "simulation/thread_pool.hpp"
+#include "assets/asset_cache.hpp"
+#include "assets/async_loader.hpp"
+#include "render/culling.hpp"
+#include "render/lod.hpp"
+#include "render/render_queue.hpp"
+#include "render/gpu_timer.hpp"
+#include "render/headless_context.hpp"
+#include "render/offscreen.hpp"
+#include "render/constellation_renderer.hpp"
+#include "render/particle_renderer.hpp"
+#include "render/terrain_mesh.hpp"
+#include "profiling/profiler.hpp"
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 #include <math.h> 
 #include <algorithm>    // std::max
+#include <cfloat>       // FLT_MAX
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
 
 using namespace vcl;
 
@@ -31,49 +61,6 @@ struct scene_environment
 };
 scene_environment scene; // Generic elements of the scene (camera, light, etc.)
 
-// Structure for the rocket which contains properties of the rocket (position and velocity)
-struct rocket_structure
-{
-	vec3 p0;  // Initial position
-	vec3 v0;  // Initial velocity
-};
-
-// First stage of the rocket
-struct first_Stage
-{
-	vec3 p0;  // Initial position
-	vec3 v0;  // Initial velocity
-	vec3 p;   // Position at time t 
-	vec3 v;   // Velocity at time t
-};
-
-// Second stage of the rocket 
-struct second_stage
-{
-	vec3 p0;  // Initial position
-	vec3 v0;  // Initial velocity
-	vec3 p;   // Position at time t 
-	vec3 v;   // Velocity at time t
-};
-
-// Stage carrying the payload of the rocket 
-struct payload_fairing
-{
-	vec3 p0;  // Initial position
-	vec3 v0;  // Initial velocity
-	vec3 p;   // Position at time t 
-	vec3 v;   // Velocity at time t
-};
-
-
-// Satellite, payload of the rocket
-struct satellite
-{
-	vec3 p;   // Position at time t 
-	vec3 v;   // Velocity at time t
-};
-
-
 // ****************************************** //
 // Functions signatures
 // ****************************************** //
@@ -85,28 +72,83 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
 
 void initialize_data(); // Initialize the data of this scene
-void display_scene(float current_time);   
+void clear_sky();       // sky color following the altitude of the rocket
+void display_scene();   
+void initialize_culling();            // objects of the scene in the culling hierarchy
+// assets::assign_to, also giving the bounding sphere of the mesh to the culling objects of the drawables
+std::function<void(assets::cached_mesh const&)> assign_bounded(std::vector<mesh_drawable*> targets, std::vector<size_t> objects);
+render::cull_view cull_scene(vec3 const& eye); // visibility of the objects for this frame
+void set_depth_mode();                // logarithmic or standard depth in all the shaders of the scene
+void display_gui_flight_model(); // choice of the flight model and integrator counters
+void restart_mission();          // restart the launch from t=0
+void display_gui_timeline();     // mission time scrubber, event times and markers
+void display_gui_render_statistics(); // draw calls, state changes and frame time
+void display_gui_simulation_thread(); // rate of the simulation thread, jitter of both loops
+void display_gui_time_warp();         // warp presets up to 10000x, requested and achieved warp
+void display_gui_control();           // attitude error and torque, deadlines and latency of the control loop
+void display_gui_constellation();     // size of the satellite constellation, time warp and J2
+void build_constellation();           // Walker pattern of the GUI settings
+void display_constellation();         // propagation and instanced drawing of the constellation
+void update_particles(vec3 const& nozzle, bool engine_on); // exhaust at the nozzle, debris at the separations
+void display_particles();             // back to front point sprites, after the opaque objects
+void display_gui_particles();         // exhaust rate, live particles and timings
+void update_fleet();                  // systems of the fleet at the time of the frame
+void display_fleet(render::cull_view const& view, vec3 const& eye); // vehicles of the fleet, by mesh and level
+void display_gui_fleet();             // number of vehicles, pads and cadence, phases and timings
+void follow_camera_target();          // camera on the part of the vehicle chosen with the keys 1 to 4
+#ifdef ROCKET_PROFILER
+void display_gui_profiler();          // frame times, flame view of a frame and export of the scopes
+#endif
+
+vec3 to_vcl(sim::vec3 const& v); // conversion from the simulation vector type
+rotation to_vcl(sim::quaternion const& q);
+void place_part(affine_rts& transform, vec3 const& origin, sim::rigid_body_attitude const& body, sim::vec3 const& pivot); // attitude around the pivot (mesh coordinates)
+
+// Offscreen recording of the launch to an image sequence (--record)
+struct record_options
+{
+	std::string directory;
+	int width = 1920;
+	int height = 1080;
+	int samples = 4;
+	float fps = 60;
+	float duration = 30;  // seconds of simulated time
+	render::frame_format format = render::frame_format::png;
+	bool headless = false;
+	render::headless_api api = render::headless_api::egl;
+};
+bool parse_record_option(int argc, char* argv[], int& k, record_options& options);
+int record_launch(record_options const& options, GLFWwindow* window); // window: preview, or nullptr when headless
 
 
 // ****************************************** //
 // Global variables
 // ****************************************** //
 
-//the rocket visualised in the scene 
-rocket_structure rocket;    
+// parameters and state of the simulated mission (see simulation/mission.hpp)
+sim::mission_parameters mission_parameters;
+sim::mission_state mission;
 
-//three parts of the rocket
-first_Stage firstStage;     
-second_stage secondStage;
-payload_fairing payloadFairing;
+// mission precomputed ahead of the current time, sampled when seeking or rewinding (see simulation/timeline.hpp)
+sim::mission_timeline timeline;
+float const timeline_duration = 60.0f; // range of the scrubber, at least
 
-//the payload
-satellite satellite; 
+// mission advanced at 1 kHz on its own thread (see simulation/simulation_thread.hpp). mission and
+// timer.t are the state interpolated for the frame, the changes go back through its command queue
+// (including the binary telemetry of the mission, recorded while the GUI checkbox is on)
+sim::simulation_thread simulation(timeline);
+sim::simulation_thread_settings simulation_settings;
+sim::jitter_meter frame_jitter;  // period of the render loop
+float resume_scale = 1.0f;       // time scale given back by the space key
 
-//meshes representing objects in the scene
-mesh_drawable ground;     // Visual representation of the ground
+// guidance and autopilot at 1 kHz on their own pinned thread (see simulation/control_thread.hpp), and
+// the attitudes of the frame. The recording (--record) steps the same autopilot between its frames
+sim::control_thread control(simulation);
+sim::control_thread_settings control_settings;
+sim::attitude_state attitude;
 
-mesh_drawable water;     //water surrounding launch pad
+//meshes representing objects in the scene
+mesh_drawable terrain;    // ground, hills and water around the launch pad, the surface the stages land on (see simulation/terrain.hpp)
 
 mesh_drawable launch_space;  // Launch space
 
@@ -114,13 +156,14 @@ mesh_drawable road;     //road
 
 mesh_drawable rocket_position_marker; // balck disc used to represent initial launch position of the rocket
 
-mesh_drawable rocket_first_stage;  // first stage body part of the rocket
+// the parts of the rocket have several tessellations, chosen from their size on screen (see render/lod.hpp)
+render::lod_chain rocket_first_stage;  // first stage body part of the rocket
 
-mesh_drawable rocket_second_stage; // second stage body part of the rocket 
+render::lod_chain rocket_second_stage; // second stage body part of the rocket 
 
-mesh_drawable rocket_payload_fairing;  // body part of the rocket transporting the payload to be sent into space
+render::lod_chain rocket_payload_fairing;  // body part of the rocket transporting the payload to be sent into space
 
-mesh_drawable satellite_mesh;   // mesh representing the satellite 
+render::lod_chain satellite_mesh;   // mesh representing the satellite 
 
 mesh_drawable launch_complex; //building positioned next to rocket on launch pad
 
@@ -135,30 +178,130 @@ mesh_drawable tower_4;
 // Thrust 
 mesh_drawable thrust;   // display rocket thrust
 
-// Normal direction of the thrust
-vec3 thrust_normal = vec3(0,1,0); 
-
-// booleans to check for separations
-bool first_stage_separated = false ; 
-bool second_stage_separated = false ; 
+// Normal direction of the thrust: axis of the stack, from its attitude
+vec3 thrust_normal = vec3(0,0,1); 
 
 // bool to lock camera on rocket when L is pressed
 bool lock_camera = false ; 
 
-// stage separation times 
-float t_separation_first; 
-float t_separation_second; 
-float t_Satellite_orbit_start; 
+// part followed by the camera: keys 1 to 4 (first stage, second stage, fairing, satellite), N and P
+// for the next and previous vehicle of the fleet, 0 being the rocket of the mission
+struct camera_target
+{
+	bool follow = false;
+	size_t vehicle = 0;
+	sim::vehicle_part part = sim::part_first_stage;
+};
+camera_target camera_follow;
+
+// generated meshes and decoded textures kept on disk between two starts (see assets/asset_cache.hpp)
+assets::asset_cache asset_cache;
+// prepared on worker threads and uploaded a few MB per frame (see assets/async_loader.hpp)
+assets::async_loader asset_loader(asset_cache);
+size_t const asset_upload_budget = 4 << 20;
+
+// sorted and instanced drawing of the meshes of the scene (see render/render_queue.hpp)
+render::render_queue draw_queue;
+
+// screen-space error tolerated by the levels of detail
+render::lod_view lod_view;
 
-// satellite rotation radius - rotation phase around the earth
-bool radius_set = false ; 
-float angle_of_rotation = 0.0f ; 
-float radius ; 
+// projection of the scene: the far plane keeps the rocket visible from afar, which the
+// logarithmic depth makes possible without z-fighting on the pad (see render/render_queue.hpp)
+float const field_of_view = 50.0f*pi/180.0f;
+float const near_plane = 0.1f;
+float const far_plane = 10000000000.0f;
 
-// drawable depicting earth for the orbit phase
-mesh_drawable earth ; 
+// objects not submitted when outside the view, too small or behind the earth (see render/culling.hpp)
+struct culling_settings
+{
+	bool frustum = true;
+	bool earth_occlusion = true;
+	float min_pixels = 1.0f;      // projected diameter
+	bool logarithmic_depth = true;
+};
+culling_settings culling_gui;
+render::scene_culling scene_culling;
+// indices of the objects in scene_culling
+struct culled_objects
+{
+	size_t terrain, launch_space, road, marker;
+	size_t first_stage, second_stage, fairing, satellite;
+	size_t launch_complex, towers[4], thrust, frame;
+};
+culled_objects culled;
+
+// CPU time of the last frames, to compare the rendering paths (e.g. under llvmpipe)
+float frame_time_ms = 0;
+
+#ifdef ROCKET_PROFILER
+// GPU time of the profiled draw groups (see render/gpu_timer.hpp)
+render::gpu_timer gpu_times;
+// frame of the profiler history shown in the flame view, counted from the last one
+int profiler_frame_offset = 0;
+#endif
+
+// drawable depicting earth for the orbit phase: cube-sphere quadtree refined around the camera
+render::planet_lod earth ; 
 float earth_radius = 1000 ; 
 
+// satellite constellation around the earth, hidden by default (see simulation/constellation.hpp)
+struct constellation_settings
+{
+	bool show = false;
+	int satellites = 50000;
+	int planes = 250;
+	float time_warp = 60.0f;   // seconds on the orbits per second of the launch
+	float propagation_ms = 0;  // smoothed for display
+};
+constellation_settings constellation_gui;
+sim::constellation constellation;
+render::constellation_renderer constellation_renderer;
+
+// exhaust of the active stage and debris of the separations (see simulation/particles.hpp)
+struct particle_settings
+{
+	bool show = true;
+	float exhaust_rate = 20000;   // particles per second
+	int debris_burst = 4000;      // particles per separation
+	float update_ms = 0;
+	float last_t = 0;             // time of the last update
+	bool first_separated = false; // to detect the separations
+	bool second_separated = false;
+};
+particle_settings particles_gui;
+sim::particle_pool exhaust_particles(1 << 19);
+sim::particle_pool debris_particles(1 << 16);
+sim::particle_emitter exhaust_emitter;
+sim::particle_parameters exhaust_physics;
+sim::particle_parameters debris_physics;
+render::particle_style exhaust_style;
+render::particle_style debris_style;
+render::particle_renderer particle_renderer;
+sim::random_stream particle_random(1, 0);
+
+// vehicles launched from the pads beside the complex, the rocket of the mission being vehicle 0
+// (see simulation/fleet.hpp). Drawn with the meshes of the rocket, one instanced batch per part and level
+struct fleet_gui_settings
+{
+	sim::fleet_settings settings;
+	float update_ms = 0;
+	unsigned int drawn = 0;      // visible parts of the last frame
+};
+fleet_gui_settings fleet_gui;
+sim::fleet fleet;
+std::vector<std::vector<vec3>> fleet_instances[sim::vehicle_part_count]; // positions, by level of the chain
+
+// threads of the constellation propagation and of the particle update, created by initialize_data
+std::unique_ptr<sim::thread_pool> worker_pool;
+
+// height of the framebuffer in pixels, for the size of the point sprites
+float viewport_height = 1024;
+float viewport_aspect = 1.25f;
+
+// offset of 7 on the z axis of the satellite mesh (see satellite_mesh in initialize_data)
+float const satellite_mesh_offset = 7.0f ; 
+
 timer_event_periodic timer(0.01f);  // Timer with periodic event
 
 // ****************************************** //
@@ -166,15 +309,84 @@ timer_event_periodic timer(0.01f);  // Timer with periodic event
 // ****************************************** //
 
 // Main function with creation of the scene and animation loop
-int main(int, char* argv[])
+int main(int argc, char* argv[])
 {
 	std::cout << "Run " << argv[0] << std::endl;
 
+	// --frames N: follow the launch with the locked camera for N frames, print the render statistics and quit
+	// --record DIR [...]: render the launch offscreen to an image sequence, faster than real time
+	// --constellation N: show a constellation of N satellites from the start
+	// --no-culling, --standard-depth: draw every object, with the standard depth buffer (comparisons)
+	// --mission FILE: separation times and ascent found by rocket_optimize instead of the defaults
+	// --fleet N: N more vehicles launched from the pads beside the complex
+	// --shared-memory NAME: publish the state and the events for the other processes (e.g. /rocket_telemetry)
+	// --control-cpu N, --realtime: core of the control thread (-2: not pinned), SCHED_FIFO priority
+	int benchmark_frames = 0;
+	bool recording = false;
+	record_options record;
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--frames")==0 && k+1<argc){
+			benchmark_frames = std::atoi(argv[++k]);
+			lock_camera = true;
+		}
+		else if(std::strcmp(argv[k],"--record")==0 && k+1<argc){
+			record.directory = argv[++k];
+			recording = true;
+		}
+		else if(std::strcmp(argv[k],"--constellation")==0 && k+1<argc){
+			constellation_gui.satellites = std::max(1, std::atoi(argv[++k]));
+			constellation_gui.show = true;
+		}
+		else if(std::strcmp(argv[k],"--no-culling")==0){
+			culling_gui.frustum = culling_gui.earth_occlusion = false;
+			culling_gui.min_pixels = 0;
+		}
+		else if(std::strcmp(argv[k],"--standard-depth")==0)
+			culling_gui.logarithmic_depth = false;
+		else if(std::strcmp(argv[k],"--mission")==0 && k+1<argc){
+			if(!sim::load_mission_design(argv[++k], mission_parameters)){
+				std::cerr << "Cannot read the mission parameters of " << argv[k] << std::endl;
+				return 1;
+			}
+		}
+		else if(std::strcmp(argv[k],"--fleet")==0 && k+1<argc)
+			fleet_gui.settings.vehicles = std::max(0, std::atoi(argv[++k]));
+		else if(std::strcmp(argv[k],"--shared-memory")==0 && k+1<argc)
+			simulation_settings.shared_memory = argv[++k];
+		else if(std::strcmp(argv[k],"--control-cpu")==0 && k+1<argc)
+			control_settings.cpu = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--realtime")==0)
+			control_settings.realtime = true;
+		else if(!parse_record_option(argc, argv, k, record)){
+			std::cout << "Usage: " << argv[0] << " [--frames N] [--constellation N] [--no-culling] [--standard-depth] [--mission FILE] [--fleet N] [--shared-memory NAME] [--control-cpu N] [--realtime]" << std::endl
+				<< "       " << argv[0] << " --record DIR [--size WxH] [--fps N] [--duration S] [--samples N] [--format png|raw] [--headless egl|osmesa]" << std::endl;
+			return 1;
+		}
+	}
+
+	if(recording && record.headless){
+		// no window nor display server
+		render::headless_context context;
+		if(!context.create(record.api))
+			return 1;
+		std::cout << opengl_info_display() << std::endl;
+		return record_launch(record, nullptr);
+	}
+
 	// create GLFW window and initialize OpenGL
 	GLFWwindow* window = create_window(1280,1024); 
 	window_size_callback(window, 1280, 1024);
 	std::cout << opengl_info_display() << std::endl;;
 
+	if(recording){
+		// the window only shows a preview: no synchronization with the display
+		glfwSwapInterval(0);
+		int const result = record_launch(record, window);
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return result;
+	}
+
 	imgui_init(window); // Initialize GUI library
 
 	// Set GLFW callback functions
@@ -183,56 +395,134 @@ int main(int, char* argv[])
 	glfwSetWindowSizeCallback(window, window_size_callback);
 	
 	std::cout<<"Initialize data ..."<<std::endl;
+	double const initialize_start = glfwGetTime();
 	initialize_data();
+	std::cout << "Data initialized in " << 1000*(glfwGetTime()-initialize_start) << " ms, assets loading in the background" << std::endl;
+	bool assets_loaded = false;
 
 	std::cout<<"Start animation loop ..."<<std::endl;
 	timer.start();
+	simulation.start(mission_parameters, simulation_settings);
+	simulation.set_time_scale(timer.scale);
+	control.start(control_settings);
 	glEnable(GL_DEPTH_TEST);
+	int frame_count = 0;
+	double benchmark_time = 0;
+	double benchmark_max_time = 0;
 	while (!glfwWindowShouldClose(window))
 	{
+		double const frame_start = glfwGetTime();
+		PROFILE_FRAME_BEGIN();
 		scene.light = scene.camera.position();
-		timer.update();
+		{
+			// state of the frame, between the two latest states published by the simulation thread
+			PROFILE_SCOPE("simulation.interpolate");
+			frame_jitter.tick(simulation.now());
+			simulation.interpolate(mission, timer.t);
+			attitude = control.latest().attitude;
+		}
 
 		// Clear screen
-
-		// Start with a blue sky color then go all the way to black as the rocket gains altitude
-		glClearColor(std::max(0.529f-(timer.t/t_Satellite_orbit_start)*0.529f,0.0f), std::max(0.808f-(timer.t/t_Satellite_orbit_start)*0.888f, 0.0f), std::max(0.922f-(timer.t/t_Satellite_orbit_start)*0.922f,0.0f), 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		clear_sky();
 
 		// Create GUI interface for the current frame
 		imgui_create_frame();
 		ImGui::Begin("GUI",NULL,ImGuiWindowFlags_AlwaysAutoResize);
 		user.cursor_on_gui = ImGui::IsAnyWindowFocused();
 		ImGui::Checkbox("Display frame", &user.display_frame);
-		ImGui::SliderFloat("Time Scale", &timer.scale, 0.0f, 3.0f, "%.1f");
+		if(ImGui::SliderFloat("Time Scale", &timer.scale, 0.0f, 3.0f, "%.1f"))
+			simulation.set_time_scale(timer.scale);
+		display_gui_time_warp();
+		display_gui_flight_model();
+		display_gui_timeline();
+		display_gui_render_statistics();
+		display_gui_simulation_thread();
+		display_gui_control();
+		display_gui_constellation();
+		display_gui_particles();
+		display_gui_fleet();
+#ifdef ROCKET_PROFILER
+		display_gui_profiler();
+#endif
 
 
 		//display_scene();
-		if(user.display_frame)
-			draw(global_frame, scene);
 		
 		// ****************************************** //
 		// Specific calls of this scene
 		// ****************************************** //
 
-		// Display the scene (includes the computation of the particle position at current time)
-		display_scene(timer.t);
+		// The simulation advances on its own thread: display the scene at the interpolated state
+		display_scene();
 
 		// ****************************************** //
 		// ****************************************** //
 
 		// Display GUI
 		ImGui::End();
-		imgui_render_frame(window);
+		{
+			PROFILE_SCOPE("imgui_render_frame");
+			PROFILE_GPU_SCOPE(gpu_times, "imgui_render_frame");
+			imgui_render_frame(window);
+		}
 
 		// Swap buffer and handle GLFW events
-		glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
 		glfwPollEvents();
+		{
+			// after the swap: the uploads overlap with the GPU work of the next frame
+			PROFILE_SCOPE("asset_loader.update");
+			asset_loader.update(asset_upload_budget);
+		}
+#ifdef ROCKET_PROFILER
+		gpu_times.frame_end(profiling::frame_index());
+#endif
+		PROFILE_FRAME_END();
+
+		double const frame_time = glfwGetTime() - frame_start;
+		frame_time_ms = 0.9f*frame_time_ms + 0.1f*static_cast<float>(1000*frame_time); // smoothed for display
+		frame_count++;
+		if(frame_count==1)
+			std::cout << "First frame after " << 1000*(glfwGetTime()-initialize_start) << " ms" << std::endl;
+		if(!assets_loaded && asset_loader.pending()==0){
+			assets_loaded = true;
+			assets::asset_cache_statistics const cache_stats = asset_cache.statistics();
+			assets::async_loader_statistics const loader_stats = asset_loader.statistics();
+			std::cout << "Assets loaded after " << 1000*(glfwGetTime()-initialize_start) << " ms, " << frame_count << " frames ("
+				<< (cache_stats.mesh_misses+cache_stats.texture_misses==0 ? "warm" : "cold") << " start: "
+				<< cache_stats.mesh_hits << "/" << cache_stats.mesh_hits+cache_stats.mesh_misses << " meshes and "
+				<< cache_stats.texture_hits << "/" << cache_stats.texture_hits+cache_stats.texture_misses << " textures from the asset cache, "
+				<< loader_stats.bytes_uploaded/1024 << " KB uploaded in " << loader_stats.upload_frames << " frames)" << std::endl;
+		}
+		benchmark_time += frame_time;
+		benchmark_max_time = std::max(benchmark_max_time, frame_time);
+		if(benchmark_frames>0 && frame_count==benchmark_frames){
+			render::render_statistics const& stats = draw_queue.statistics();
+			render::cull_statistics const& cull_stats = scene_culling.statistics();
+			std::cout << frame_count << " frames, " << 1000*benchmark_time/frame_count << " ms per frame (max " << 1000*benchmark_max_time << " ms), last frame: "
+				<< stats.items << " items, " << stats.draw_calls << " draw calls, " << stats.state_changes << " state changes, " << stats.triangles << " triangles, "
+				<< cull_stats.drawn << "/" << cull_stats.objects << " objects drawn (" << cull_stats.culled_frustum << " outside the frustum, "
+				<< cull_stats.culled_small << " too small, " << cull_stats.culled_occluded << " behind the earth), "
+				<< earth.statistics().culled << " earth leaves outside the frustum" << std::endl;
+			sim::jitter_statistics const sim_jitter = simulation.snapshot().jitter;
+			std::cout << "simulation thread: " << sim_jitter.ticks << " ticks, period " << sim_jitter.period_mean << " ms (stddev " << sim_jitter.period_stddev
+				<< " ms, max " << sim_jitter.period_max << " ms), " << sim_jitter.overruns << " overruns" << std::endl;
+			sim::control_statistics const& control_stats = control.latest().statistics;
+			std::cout << "control thread: " << control_stats.ticks << " ticks, " << control_stats.deadline_misses << " deadline misses, latency p50 < "
+				<< control_stats.latency.percentile(50) << " us, p99 < " << control_stats.latency.percentile(99) << " us, max " << control_stats.latency.max << " us" << std::endl;
+			glfwSetWindowShouldClose(window, true);
+		}
 	}
 
 
 	imgui_cleanup();
+	asset_loader.stop();
+	control.stop();
+	simulation.stop();
+	timeline.stop_worker();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 
@@ -245,6 +535,11 @@ void initialize_data()
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// Meshes and textures are read from the cache when a previous start already generated them,
+	// on the worker threads of the loader: the scene is drawn while they arrive
+	asset_cache.open("assets/cache");
+	asset_loader.start();
+
 	// Load and set the common shaders
 	GLuint const shader_mesh = opengl_create_shader_program(opengl_shader_preset("mesh_vertex"), opengl_shader_preset("mesh_fragment"));
 	GLuint const shader_single_color = opengl_create_shader_program(opengl_shader_preset("single_color_vertex"), opengl_shader_preset("single_color_fragment"));
@@ -253,183 +548,235 @@ void initialize_data()
 	mesh_drawable::default_shader = shader_mesh;
 	mesh_drawable::default_texture = texture_white;
 	curve_drawable::default_shader = shader_single_color;
-	global_frame = mesh_drawable(mesh_primitive_frame());
+	assets::cached_mesh const frame = asset_cache.mesh("mesh_primitive_frame", mesh_primitive_frame);
+	global_frame = frame.drawable;
 	scene.camera.look_at({10,15,10}, {0,0,0}, {0,0,1});
 
-	// prepare the ground mesh
-	ground = mesh_drawable(mesh_primitive_quadrangle(vec3(10,10,0),vec3(10,-10,0),vec3(-10,-10,0),vec3(-10,10,0)));
-	ground.shading.color = {0.0f,1.f,0.5f}; 
+	// before the loads: their callbacks give the bounds of the meshes to these objects
+	initialize_culling();
+	scene_culling.set_bounds(culled.frame, {frame.bound_center, frame.bound_radius});
 
-	// water mesh 
-	water = mesh_drawable(mesh_primitive_quadrangle(vec3(10,20,-0.01),vec3(10,-20,-0.01),vec3(-20,-20,-0.01),vec3(-20,20,-0.01)));
-	water.shading.color = {0.0f, 0.467f, 0.745f};
+	// terrain mesh: the heightfield of the missions, colored per vertex (its skirt reaches the earth sphere)
+	float const terrain_skirt = 40.0f;
+	asset_loader.load_mesh(assign_bounded({&terrain}, {culled.terrain}), "terrain_mesh", render::terrain_mesh, sim::launch_site_terrain().settings(), terrain_skirt);
+	terrain.shading.color = {1.0f,1.0f,1.0f};
 
 	// circular space depicting the launch space of the rocket
-	launch_space = mesh_drawable(mesh_primitive_disc(5.f,vec3(0,0,0.01),vec3(0,0,1),60));
+	asset_loader.load_mesh(assign_bounded({&launch_space}, {culled.launch_space}), "mesh_primitive_disc", mesh_primitive_disc, 5.f,vec3(0,0,0.01),vec3(0,0,1),60);
 	launch_space.shading.color = {0.517f,0.407f,0.439f};
 
 	// road for a bit more realistic rendering
-	road = mesh_drawable(mesh_primitive_quadrangle(vec3(10,-2.5,0.01),vec3(10,2.5,0.01),vec3(4,2.5,0.01),vec3(4,-2.5,0.01))); 
+	asset_loader.load_mesh(assign_bounded({&road}, {culled.road}), "mesh_primitive_quadrangle", mesh_primitive_quadrangle, vec3(10,-2.5,0.01),vec3(10,2.5,0.01),vec3(4,2.5,0.01),vec3(4,-2.5,0.01)); 
 	road.shading.color = {0.517f,0.407f,0.439f};
 
 	// circular space depicting the launch position of the rocket
-	rocket_position_marker = mesh_drawable(mesh_primitive_disc(1.f,vec3(0,0,0.1),vec3(0,0,1),60)); 
+	asset_loader.load_mesh(assign_bounded({&rocket_position_marker}, {culled.marker}), "mesh_primitive_disc", mesh_primitive_disc, 1.f,vec3(0,0,0.1),vec3(0,0,1),60); 
 	rocket_position_marker.shading.color = {0.0f,0.0f,0.0f}; 
 	
 	// rocket body on top of the rocket position marker
-	rocket_first_stage = mesh_drawable(mesh_primitive_cylinder(0.4f,vec3(0,0,0.001),vec3(0,0,5),60,60,true)); 
-	rocket_second_stage = mesh_drawable(mesh_primitive_cylinder(0.4f,vec3(0,0,5.001),vec3(0,0,7),60,60,true)); 
+	render::load_lod_chain_cylinder(rocket_first_stage,asset_loader,0.4f,vec3(0,0,0.001),vec3(0,0,5),60,true); 
+	render::load_lod_chain_cylinder(rocket_second_stage,asset_loader,0.4f,vec3(0,0,5.001),vec3(0,0,7),60,true); 
 	rocket_second_stage.shading.color = {0.0f,0.0f,0.0f};
-	rocket_payload_fairing = mesh_drawable(mesh_primitive_cone(0.6f,1.f,vec3(0,0,7),vec3(0,0,1),true,60,60)); 
-	satellite_mesh = mesh_drawable(mesh_primitive_cone(12.f,20.f,vec3(0,0,7),vec3(0,0,1),true,60,60));
-
-	//initialize rocket global data
-	rocket.p0 = vec3(0,0,0); 
-	rocket.v0 = vec3(0,0,0); 
+	render::load_lod_chain_cone(rocket_payload_fairing,asset_loader,0.6f,1.f,vec3(0,0,7),vec3(0,0,1),true,60); 
+	render::load_lod_chain_cone(satellite_mesh,asset_loader,12.f,20.f,vec3(0,0,7),vec3(0,0,1),true,60);
 
-	//initialize body parts data 
-	firstStage.p0 = vec3(0,0,0); 
-	firstStage.v0 = vec3(0,0,0); 
-
-	secondStage.p0 = vec3(0,0,0); 
-	secondStage.v0 = vec3(0,0,0); 
-
-	payloadFairing.p0 = vec3(0,0,0); 
-	payloadFairing.v0 = vec3(0,0,0); 
+	//initialize mission data (positions and velocities of the rocket and its body parts)
+	mission_parameters.earth_radius = earth_radius; 
+	sim::mission_initialize(mission, mission_parameters); 
+	timeline.reset(mission_parameters);
+	timeline.start_worker();
+	fleet.reset(fleet_gui.settings, mission_parameters);
 
 	//prepare the pad infrastructure (buildings and towers around the rocket)
-	launch_complex = mesh_drawable(mesh_primitive_cuboid(vec3(-2.f,0,0),2.f,7.f));
+	asset_loader.load_mesh(assign_bounded({&launch_complex}, {culled.launch_complex}), "mesh_primitive_cuboid", mesh_primitive_cuboid, vec3(-2.f,0,0),2.f,7.f);
 
 	//prepare towers
-	tower_1 = mesh_drawable(mesh_primitive_pentahedron(vec3(-10,-10,0),vec3(-9.5,-10,0),vec3(-9.5,-9.5,0),vec3(-10,-9.5,0),vec3(-9.75,-9.75,10)));
-	tower_2 = tower_1 ; 
+	// the copies share the buffers of tower_1 and only differ by their transform: the render queue draws them with one instanced call
+	asset_loader.load_mesh(assign_bounded({&tower_1,&tower_2,&tower_3,&tower_4}, {culled.towers[0],culled.towers[1],culled.towers[2],culled.towers[3]}), "mesh_primitive_pentahedron", mesh_primitive_pentahedron, vec3(-10,-10,0),vec3(-9.5,-10,0),vec3(-9.5,-9.5,0),vec3(-10,-9.5,0),vec3(-9.75,-9.75,10));
 	tower_2.transform.translate = {0,19.5f,0}; 
-	tower_3 = tower_1 ; 
 	tower_3.transform.translate = {19.5f,0,0}; 
-	tower_4 = tower_1 ; 
 	tower_4.transform.translate = {19.5f,19.5f,0}; 
 
 	//rocket thrust billboard
 
-	//import the image
-	GLuint const texture_billboard = opengl_texture_to_gpu(image_load_png("assets/thrust.png"));
+	//import the image (white quad until it is loaded)
+	thrust.texture = texture_white;
+	asset_loader.load_texture("assets/thrust.png", GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, [](GLuint texture){ thrust.texture = texture; });
 	float const L = 0.8f; //size of the quad depicting the billboard
-	thrust = mesh_drawable(mesh_primitive_quadrangle({0,-1.5L,-2L},{0,1.5L,-2L},{0,1.5L,0},{0,-1.5L,0}));
-	thrust.texture = texture_billboard;
+	asset_loader.load_mesh(assign_bounded({&thrust}, {culled.thrust}), "mesh_primitive_quadrangle", mesh_primitive_quadrangle, vec3(0,-1.5L,-2L),vec3(0,1.5L,-2L),vec3(0,1.5L,0),vec3(0,-1.5L,0));
 
-	//set stage separation times 
-	t_separation_first = 10 ;
-	t_separation_second = 15 ; 
-
-	//set time to start satellite orbit phase
-	t_Satellite_orbit_start = 20 ; 
+	//stage separation times and the time to start the satellite orbit phase are part of
+	//mission_parameters (t_separation_first = 10, t_separation_second = 15, t_satellite_orbit_start = 20)
 
 	// earth
 
-	//import earth texture image
-	GLuint const earthtexture = opengl_texture_to_gpu(image_load_png("assets/earth.png"));
-	earth =  mesh_drawable(mesh_primitive_sphere(earth_radius, vec3{0,0,-earth_radius}, 120, 60));
-	earth.texture = earthtexture ; 
+	//import earth texture image (repeated in longitude: the quadtree nodes crossing the seam have u > 1)
+	earth.initialize(earth_radius, vec3{0,0,-earth_radius});
+	earth.texture = texture_white;
+	asset_loader.load_texture("assets/earth.png", GL_REPEAT, GL_CLAMP_TO_EDGE, [](GLuint texture){ earth.texture = texture; });
+
+	draw_queue.initialize();
+	constellation_renderer.initialize();
+	particle_renderer.initialize();
+	set_depth_mode();
+	worker_pool.reset(new sim::thread_pool());
+
+	// gases: light, slowed down quickly, spreading on the pad. Debris: falling, bouncing
+	exhaust_emitter.speed = 30.0f;
+	exhaust_emitter.cone = 0.15f;
+	exhaust_emitter.lifetime = 2.5f;
+	exhaust_physics.gravity_scale = 0.1f;
+	exhaust_physics.drag = 1.5f;
+	exhaust_physics.restitution = 0.1f;
+	exhaust_physics.friction = 0.9f;
+	exhaust_style.color_start = {1.0f, 0.85f, 0.5f};
+	exhaust_style.color_end = {0.6f, 0.6f, 0.6f};
+	exhaust_style.alpha_start = 0.5f;
+	exhaust_style.size_start = 0.3f;
+	exhaust_style.size_end = 2.5f;
+	debris_physics.drag = 0.1f;
+	debris_style.color_start = {0.3f, 0.3f, 0.3f};
+	debris_style.color_end = {0.2f, 0.2f, 0.2f};
+	debris_style.alpha_start = 1.0f;
+	debris_style.alpha_end = 0.6f;
+	debris_style.size_start = 0.1f;
+	debris_style.size_end = 0.1f;
+#ifdef ROCKET_PROFILER
+	gpu_times.initialize();
+#endif
 }
 
 
-void display_scene(float current_time)
+void clear_sky()
 {
-	vec3 const g = {0,0,9.81f}; // gravity constant
-
-	//rocket 
-	vec3 p = vec3(0,0,0) ;
-	vec3 v = vec3(0,0,0) ; 
-
-	// MAKE TRAJECTORY CALCULATIONS
+	// Start with a blue sky color then go all the way to black as the rocket gains altitude
+	float const t_orbit_start = mission_parameters.t_satellite_orbit_start;
+	glClearColor(std::max(0.529f-(timer.t/t_orbit_start)*0.529f,0.0f), std::max(0.808f-(timer.t/t_orbit_start)*0.888f, 0.0f), std::max(0.922f-(timer.t/t_orbit_start)*0.922f,0.0f), 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
 
-	//rocket 
+void initialize_culling()
+{
+	// the pad does not move: static objects, in the hierarchy
+	culled.terrain = scene_culling.add(terrain.transform, false);
+	culled.launch_space = scene_culling.add(launch_space.transform, false);
+	culled.road = scene_culling.add(road.transform, false);
+	culled.marker = scene_culling.add(rocket_position_marker.transform, false);
+	culled.launch_complex = scene_culling.add(launch_complex.transform, false);
+	mesh_drawable* const towers[4] = {&tower_1, &tower_2, &tower_3, &tower_4};
+	for(int k=0; k<4; ++k)
+		culled.towers[k] = scene_culling.add(towers[k]->transform, false);
+	culled.frame = scene_culling.add(global_frame.transform, false);
+	// the rocket and its parts
+	culled.first_stage = scene_culling.add(rocket_first_stage.transform, true);
+	culled.second_stage = scene_culling.add(rocket_second_stage.transform, true);
+	culled.fairing = scene_culling.add(rocket_payload_fairing.transform, true);
+	culled.satellite = scene_culling.add(satellite_mesh.transform, true);
+	culled.thrust = scene_culling.add(thrust.transform, true);
+}
 
-	/* simple trajectory and velocity. In a more realistic simulation, these parameters should be 
-	replaced by equations depicting rocket propulsion */ 
-	v = vec3(0,0,5.f) ; 
-	p = rocket.p0 + vec3(0,0,v.z*current_time); 
+std::function<void(assets::cached_mesh const&)> assign_bounded(std::vector<mesh_drawable*> targets, std::vector<size_t> objects)
+{
+	std::function<void(assets::cached_mesh const&)> const assign = assets::assign_to(targets);
+	return [assign, objects](assets::cached_mesh const& m){
+		assign(m);
+		for(size_t object : objects)
+			scene_culling.set_bounds(object, {m.bound_center, m.bound_radius});
+	};
+}
 
+render::cull_view cull_scene(vec3 const& eye)
+{
+	PROFILE_SCOPE("culling");
+	render::cull_view view;
+	view.eye = eye;
+	view.planes.set(eye, scene.camera.matrix_view(), field_of_view, viewport_aspect, near_plane, far_plane);
+	view.frustum_culling = culling_gui.frustum;
+	view.projection_scale = lod_view.projection_scale;
+	view.min_pixels = culling_gui.min_pixels;
+	if(culling_gui.earth_occlusion){
+		// slightly inside the sphere: the tessellated earth is below it between its vertices
+		view.occluder.center = {0,0,-earth_radius};
+		view.occluder.radius = 0.995f*earth_radius;
+	}
+	// the chains get their bounds when their finest level is loaded
+	scene_culling.set_bounds(culled.first_stage, rocket_first_stage.bounds());
+	scene_culling.set_bounds(culled.second_stage, rocket_second_stage.bounds());
+	scene_culling.set_bounds(culled.fairing, rocket_payload_fairing.bounds());
+	scene_culling.set_bounds(culled.satellite, satellite_mesh.bounds());
+	scene_culling.cull(view);
+	return view;
+}
 
-	if(current_time < t_Satellite_orbit_start){   // pre satellite orbit stage, i.e. rocket launch
-		//first stage 
-		if(current_time >= t_separation_first && !first_stage_separated ){  //handle separation 
-			//reinitialize parameters to use in separation phase
-			firstStage.v0  = firstStage.v ; 
-			firstStage.p0 = firstStage.p ;
-			first_stage_separated = true ; 
-		}
-		else{ 
-			if(first_stage_separated){
-				//separation stage dynamics (gravity pull)
-				if(firstStage.p.z>0){   
-					//simple collision with floor detection  
-					firstStage.v = -g*(current_time-t_separation_first) + firstStage.v0; 
-					firstStage.p = -0.5*g*(current_time-t_separation_first)*(current_time-t_separation_first) + firstStage.v0*(current_time-t_separation_first) + firstStage.p0; 
-				}
-				else{  
-					//if collision set position (position correction for collision detection and handling)
-					firstStage.v = vec3(0,0,0);  
-					firstStage.p = vec3(0,0,0); 
-				}
-			}
-			else{
-				//pre-separation stage dynamics 
-				firstStage.v = v ; //the velocity of the first stage is equal to the velocity of the rocket
-				firstStage.p = firstStage.p0 + v*current_time ;
-			}
-		}
+// Submit the drawable when its object is visible in this frame
+static void submit_visible(size_t object, mesh_drawable const& drawable, render::render_state const& state = render::render_state())
+{
+	if(scene_culling.visible(object))
+		draw_queue.submit(drawable, state);
+}
 
-		// second stage - same exact steps as for the first stage
-		if(current_time >= t_separation_second && !second_stage_separated ){
-			secondStage.v0  = secondStage.v ; 
-			secondStage.p0 = secondStage.p ;
-			second_stage_separated = true ; 
-		}
-		else{ 
-			if(second_stage_separated){
-				if(secondStage.p.z>0){   //simple collision with floor detection  
-					secondStage.v = -g*(current_time-t_separation_second) + secondStage.v0; 
-					secondStage.p = -0.5*g*(current_time-t_separation_second)*(current_time-t_separation_second) + secondStage.v0*(current_time-t_separation_second) + secondStage.p0; 
-				}
-				else{
-					secondStage.v = vec3(0,0,0); 
-					secondStage.p = vec3(0,0,0); 
-				}
-			}
-			else{
-				secondStage.v = v ; //the velocity of the first stage is equal to the velocity of the rocket
-				secondStage.p = secondStage.p0 + v*current_time ; 
-			}
-		}
+// Same for a chain: the level is only selected when it is drawn
+static void submit_visible(size_t object, render::lod_chain& chain, vec3 const& eye)
+{
+	if(scene_culling.visible(object))
+		draw_queue.submit(chain.select(eye, lod_view));
+}
 
-		/*payload fairing - no separating. For the sake of simplification, the payload fairing is taken here
-		as the payload itself*/  
-		payloadFairing.v = v ; //the velocity of the first stage is equal to the velocity of the rocket
-		payloadFairing.p = payloadFairing.p0 + v*current_time ; 
+void set_depth_mode()
+{
+	render::depth_mode const mode = culling_gui.logarithmic_depth ? render::depth_mode::logarithmic : render::depth_mode::standard;
+	draw_queue.set_depth(mode, far_plane);
+	constellation_renderer.set_depth_mode(mode);
+	particle_renderer.set_depth_mode(mode);
+}
 
-		//APPLY TRANSFORMS - translate to the new positions
-		rocket_first_stage.transform.translate={firstStage.p.x,firstStage.p.y,firstStage.p.z}; 
-		rocket_second_stage.transform.translate={secondStage.p.x,secondStage.p.y,secondStage.p.z}; 
-		rocket_payload_fairing.transform.translate={payloadFairing.p.x,payloadFairing.p.y,payloadFairing.p.z};
+void display_scene()
+{
+	PROFILE_SCOPE("display_scene");
+	update_fleet();
+	// positions computed by the simulation engine (see simulation/mission.cpp)
+	vec3 const p = to_vcl(mission.rocket_p);
+	vec3 const first_stage_p = to_vcl(sim::mission_position(mission, sim::body_first_stage));
+	vec3 const second_stage_p = to_vcl(sim::mission_position(mission, sim::body_second_stage));
+	vec3 const payload_fairing_p = to_vcl(sim::mission_position(mission, sim::body_payload_fairing));
+	bool const in_orbit = sim::mission_in_orbit(mission, mission_parameters);
+
+	if(!in_orbit){   // pre satellite orbit stage, i.e. rocket launch
+
+		//APPLY TRANSFORMS - positions computed by the simulation, attitudes by the autopilot (see simulation/attitude.hpp)
+		// every part turns around the point the mission moves, the base of the rocket
+		place_part(rocket_first_stage.transform, first_stage_p, attitude.bodies[sim::body_first_stage], sim::vec3(0,0,0));
+		place_part(rocket_second_stage.transform, second_stage_p, attitude.bodies[sim::body_second_stage], sim::vec3(0,0,0));
+		place_part(rocket_payload_fairing.transform, payload_fairing_p, attitude.stack, sim::vec3(0,0,0));
 
 		// /* translation and rotation of the billboard
-		// 	- the translation follows the rocket, so it is a translation upwards (along z-axis)
-		// 	  with the same velocity of the rocket
-		// 	- the rotation should not be done according to camera's orientation, but should always 
-		// 	  happen along the vertical axis of the rocket, in this case the chosen axis z */
+		// 	- the translation follows the nozzle of the active engine, along the axis of the stack
+		// 	- the rotation is not done according to camera's orientation, but always happens around
+		// 	  the axis of the rocket, the quad turned to face the camera as much as it can */
 
 		/* translation */ 
+		bool const first_stage_separated = sim::mission_separated(mission, sim::body_first_stage);
+		bool const second_stage_separated = sim::mission_separated(mission, sim::body_second_stage);
+		sim::quaternion const& stack_q = attitude.stack.q;
 		if(!first_stage_separated){
-			thrust.transform.translate = {firstStage.p.x,firstStage.p.y,firstStage.p.z} ; //thrust follows first stage 
+			thrust.transform.translate = first_stage_p ; //thrust follows first stage 
 		}else if(first_stage_separated && !second_stage_separated){
-			thrust.transform.translate = {secondStage.p.x,secondStage.p.y,secondStage.p.z+5} ; //thrust is now coming from second stage 
+			thrust.transform.translate = second_stage_p + to_vcl(sim::rotate(stack_q, sim::vec3(0,0,5))) ; //thrust is now coming from second stage 
 		}else if(first_stage_separated && second_stage_separated){
-			thrust.transform.translate = {payloadFairing.p.x,payloadFairing.p.y,payloadFairing.p.z+7} ; //thrust is now coming from payload fairing
+			thrust.transform.translate = payload_fairing_p + to_vcl(sim::rotate(stack_q, sim::vec3(0,0,7))) ; //thrust is now coming from payload fairing
 		}
 
 		/* rotation */ 
-		//no attempts were made for the rotation part
+		// the quad lies in the plane x=0 of the stack: turned around z towards the camera
+		vec3 const to_eye = scene.camera.position() - thrust.transform.translate;
+		sim::vec3 const eye_body = sim::rotate(sim::conjugate(stack_q), sim::vec3(to_eye.x, to_eye.y, to_eye.z));
+		float const facing = std::atan2(eye_body.y, eye_body.x);
+		thrust.transform.rotate = to_vcl(stack_q*sim::quaternion_from_rotation_vector(sim::vec3(0,0,facing)));
+		thrust_normal = to_vcl(sim::rotate(stack_q, sim::vec3(0,0,1)));
+
+		// exhaust particles leave the same nozzle
+		update_particles(thrust.transform.translate, true);
 
 
 		if(lock_camera){  // if L button is pressed lock camera in animation view
@@ -437,102 +784,706 @@ void display_scene(float current_time)
 			scene.camera.look_at({10,15,10}, p , {0,0,1}) ; 
 			
 			//rocket soaring through the sky 
-			if (current_time >=6){
+			if (mission.t >=6){
 				//follow the rocket on the z axis
 				scene.camera.look_at({10,15,p.z}, p , {0,0,1}); 
 			}
 		}
-
-		//DISPLAY ELEMENTS
-
-		// Display the ground
-		draw(ground, scene);
-		draw(water, scene); 
-		draw(launch_space,scene); 
-		draw(road,scene); 
-		// Display the rocket's initial position marker
-		draw(rocket_position_marker,scene); 
-		// Display the rocket by displaying its parts one by one
-		draw(rocket_first_stage,scene); 
-		draw(rocket_second_stage,scene);
-		draw(rocket_payload_fairing,scene);
-		// Display the launch pad complex
-		draw(launch_complex, scene);
-		// Display towers
-		draw(tower_1,scene);  
-		draw(tower_2,scene);  
-		draw(tower_3,scene);  
-		draw(tower_4,scene);  
-		// Display thrust billboard
-		glDepthMask(false); 
-		draw(thrust,scene); 
-		glDepthMask(true); 
-		draw(earth, scene); 
 	}
 	else{   //satellite orbit phase 
 
-		if(!radius_set){
-			//set radius once only
-			//radius of rotation 
-			radius = payloadFairing.p.z + earth_radius; 
-			radius_set = true; 
-		}
-
-		//calulate trajectory/rotation 
 		/* 
-		having taken the center of the earth at (0,0,-earth_radius), the rotation matrix applied should be
-		one  of a rotation around an arbitrary point in space as seen in class, here the arbitrary point being 
-		(0,0,-earth_radius) 
-		*/ 
+		the orbit itself (rotation around the earth center (0,0,-earth_radius)) is computed by the engine.
+		The -7 takes out the offset of 7 on the z axis defined when the mesh was first configured:
 
-		//angle 
-		angle_of_rotation = 0.5*(current_time - t_Satellite_orbit_start); 
-
-		/* 
-		here the rotation is coded manually. Here are some explanations: 
-			-rotation is done around the y axis, which explains why the y component of the position stays the same
-			-to render a rotation around the point c_earth = (0,0,-earth_radius), we first have to translate the satellite center of rotation to
-			 the center of the world space, thus translating the point c_earth from its original position to the origin
-			-then we code the rotation, which is given here by (Rsin(theta), y, Rcos(theta)) 
-			-last, we translate again to go back to the original center of rotation, which explains the -earth_radius on the z component
-			-the -7 is taken into account to take out the offset of 7 on the z axis defined when the mesh was first configured on line 284 :
-
-			 satellite_mesh = mesh_drawable(mesh_primitive_cone(12.f,20.f,vec3(0,0,7),vec3(0,0,1),true,60,60));
-			 																	   ^  
+		 satellite_mesh = mesh_drawable(mesh_primitive_cone(12.f,20.f,vec3(0,0,7),vec3(0,0,1),true,60,60));
+		 																	   ^  
 		*/
-		satellite.p = vec3(radius*std::sin(angle_of_rotation),satellite.p.y,radius*std::cos(angle_of_rotation)-7 -earth_radius); 
-		// do the transform 
-		satellite_mesh.transform.translate= satellite.p ; 
+		// the satellite turns around its point of the orbit, prograde (see simulation/attitude.hpp)
+		place_part(satellite_mesh.transform, to_vcl(sim::mission_position(mission, sim::body_satellite)) - vec3(0,0,satellite_mesh_offset), attitude.bodies[sim::body_satellite], sim::vec3(0,0,satellite_mesh_offset)); 
+		update_particles(vec3(0,0,0), false); // the last debris keep falling
 
 		if(lock_camera){
 			// give the camera a steady position on the y axis for better global view
 			scene.camera.look_at({0,-3000,-earth_radius}, {0,0,-earth_radius} , {0,0,1}); 
 		}
+	}
 
-		//DISPLAY ELEMENTS
-
-		// Display the ground
-		draw(ground, scene);
-		draw(water, scene); 
-		draw(launch_space,scene); 
-		draw(road,scene); 
-		// Display the rocket's initial position marker
-		draw(rocket_position_marker,scene); 
-		// Display the rocket by displaying its parts one by one
-		draw(rocket_first_stage,scene); 
-		draw(rocket_second_stage,scene);
-		draw(satellite_mesh,scene);
-		// Display the launch pad complex
-		draw(launch_complex, scene);
-		// Display towers
-		draw(tower_1,scene);  
-		draw(tower_2,scene);  
-		draw(tower_3,scene);  
-		draw(tower_4,scene);  
-		draw(earth, scene); 
+	if(camera_follow.follow)
+		follow_camera_target();
+
+	//DISPLAY ELEMENTS
+	PROFILE_SCOPE("submit");
+	draw_queue.begin_frame(scene.projection, scene.camera.matrix_view(), scene.light);
+	vec3 const eye = scene.camera.position();
+	render::cull_view const view = cull_scene(eye);
+
+	// Display the terrain
+	submit_visible(culled.terrain, terrain);
+	submit_visible(culled.launch_space, launch_space); 
+	submit_visible(culled.road, road); 
+	// Display the rocket's initial position marker
+	submit_visible(culled.marker, rocket_position_marker); 
+	// Display the rocket by displaying its parts one by one (the fairing is replaced by the satellite in orbit)
+	submit_visible(culled.first_stage, rocket_first_stage, eye); 
+	submit_visible(culled.second_stage, rocket_second_stage, eye);
+	if(!in_orbit)
+		submit_visible(culled.fairing, rocket_payload_fairing, eye);
+	else
+		submit_visible(culled.satellite, satellite_mesh, eye);
+	// Display the launch pad complex
+	submit_visible(culled.launch_complex, launch_complex);
+	// Display towers
+	submit_visible(culled.towers[0], tower_1);  
+	submit_visible(culled.towers[1], tower_2);  
+	submit_visible(culled.towers[2], tower_3);  
+	submit_visible(culled.towers[3], tower_4);  
+	if(user.display_frame)
+		submit_visible(culled.frame, global_frame);
+	if(!in_orbit){
+		// Display thrust billboard (drawn after the opaque objects, without depth write)
+		render::render_state billboard;
+		billboard.depth_write = false;
+		submit_visible(culled.thrust, thrust, billboard); 
+	}
+	display_fleet(view, eye);
+	{
+		PROFILE_SCOPE("earth lod");
+		earth.update(eye, lod_view);
+		earth.submit(draw_queue, &view); 
 	}
+
+	// sort, batch and draw everything submitted above
+	{
+		PROFILE_SCOPE("draw_queue.flush");
+		PROFILE_GPU_SCOPE(gpu_times, "draw_queue.flush");
+		draw_queue.flush();
+	}
+	// after the flush: the satellites use the frame uniforms of the queue
+	if(constellation_gui.show)
+		display_constellation();
+	display_particles();
+}
+
+// Particles in a cone around the vertical, with the velocity of a separated stage
+static void debris_burst(sim::mission_body body, vec3 const& position)
+{
+	sim::particle_emitter burst;
+	burst.position = {position.x, position.y, position.z};
+	burst.velocity = sim::mission_velocity(mission, body);
+	burst.direction = {0,0,1};
+	burst.cone = 1.5f;
+	burst.speed = 4.0f;
+	burst.speed_spread = 0.8f;
+	burst.lifetime = 6.0f;
+	debris_particles.emit(burst, static_cast<size_t>(particles_gui.debris_burst), particle_random);
+}
+
+void update_particles(vec3 const& nozzle, bool engine_on)
+{
+	PROFILE_SCOPE("particles update");
+	auto const start = std::chrono::steady_clock::now();
+	float const dt = timer.t - particles_gui.last_t;
+	particles_gui.last_t = timer.t;
+	if(dt<0){
+		// the launch restarted
+		exhaust_particles.clear();
+		debris_particles.clear();
+		particles_gui.first_separated = particles_gui.second_separated = false;
+		return;
+	}
+
+	// bursts at the interface between the stages, when they separate
+	bool const first_separated = sim::mission_separated(mission, sim::body_first_stage);
+	bool const second_separated = sim::mission_separated(mission, sim::body_second_stage);
+	if(particles_gui.show && first_separated && !particles_gui.first_separated)
+		debris_burst(sim::body_first_stage, to_vcl(sim::mission_position(mission, sim::body_first_stage)) + vec3(0,0,5));
+	if(particles_gui.show && second_separated && !particles_gui.second_separated)
+		debris_burst(sim::body_second_stage, to_vcl(sim::mission_position(mission, sim::body_second_stage)) + vec3(0,0,7));
+	particles_gui.first_separated = first_separated;
+	particles_gui.second_separated = second_separated;
+
+	if(particles_gui.show && engine_on){
+		exhaust_emitter.position = {nozzle.x, nozzle.y, nozzle.z};
+		exhaust_emitter.velocity = mission.rocket_v;
+		exhaust_emitter.rate = particles_gui.exhaust_rate;
+		exhaust_particles.emit_continuous(exhaust_emitter, dt, particle_random);
+	}
+	exhaust_particles.update(dt, exhaust_physics, worker_pool.get());
+	debris_particles.update(dt, debris_physics, worker_pool.get());
+	float const ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count();
+	particles_gui.update_ms = 0.9f*particles_gui.update_ms + 0.1f*ms;
 }
 
+void display_particles()
+{
+	if(!particles_gui.show)
+		return;
+	// view direction: opposite of the z axis of the camera (third row of the view matrix)
+	mat4 const view = scene.camera.matrix_view();
+	vec3 const forward = {-view(2,0), -view(2,1), -view(2,2)};
+	vec3 const eye = scene.camera.position();
+	PROFILE_SCOPE("particles draw");
+	PROFILE_GPU_SCOPE(gpu_times, "particles draw");
+	particle_renderer.draw(debris_particles, debris_style, eye, forward, viewport_height, worker_pool.get());
+	particle_renderer.draw(exhaust_particles, exhaust_style, eye, forward, viewport_height, worker_pool.get());
+}
+
+void build_constellation()
+{
+	sim::walker_pattern pattern;
+	pattern.satellites = constellation_gui.satellites;
+	pattern.planes = std::min(constellation_gui.planes, constellation_gui.satellites);
+	constellation.clear();
+	sim::constellation_add_walker(constellation, pattern);
+}
+
+void display_constellation()
+{
+	if(constellation.size()==0)
+		build_constellation();
+	{
+		PROFILE_SCOPE("constellation_propagate");
+		// steady_clock rather than glfwGetTime: also used by the headless recording, without GLFW
+		auto const start = std::chrono::steady_clock::now();
+		sim::constellation_propagate(constellation, static_cast<double>(timer.t)*constellation_gui.time_warp, sim::body_table_detect_simd(), worker_pool.get());
+		float const ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count();
+		constellation_gui.propagation_ms = 0.9f*constellation_gui.propagation_ms + 0.1f*ms;
+	}
+
+	// km around the center of the earth mesh
+	render::constellation_view view;
+	view.center = {0,0,-earth_radius};
+	view.scale = earth_radius/static_cast<float>(constellation.planet.radius);
+	PROFILE_SCOPE("constellation draw");
+	PROFILE_GPU_SCOPE(gpu_times, "constellation draw");
+	constellation_renderer.draw(constellation, view);
+}
+
+bool parse_record_option(int argc, char* argv[], int& k, record_options& options)
+{
+	if(k+1>=argc)
+		return false;
+	char const* const option = argv[k];
+	char const* const value = argv[k+1];
+	if(std::strcmp(option,"--size")==0){
+		if(std::sscanf(value, "%dx%d", &options.width, &options.height)!=2 || options.width<=0 || options.height<=0)
+			return false;
+	}
+	else if(std::strcmp(option,"--fps")==0){
+		options.fps = static_cast<float>(std::atof(value));
+		if(options.fps<=0)
+			return false;
+	}
+	else if(std::strcmp(option,"--duration")==0){
+		options.duration = static_cast<float>(std::atof(value));
+		if(options.duration<=0)
+			return false;
+	}
+	else if(std::strcmp(option,"--samples")==0){
+		options.samples = std::atoi(value);
+		if(options.samples<1)
+			return false;
+	}
+	else if(std::strcmp(option,"--format")==0){
+		if(std::strcmp(value,"png")==0)
+			options.format = render::frame_format::png;
+		else if(std::strcmp(value,"raw")==0)
+			options.format = render::frame_format::raw;
+		else
+			return false;
+	}
+	else if(std::strcmp(option,"--headless")==0){
+		options.headless = true;
+		if(std::strcmp(value,"egl")==0)
+			options.api = render::headless_api::egl;
+		else if(std::strcmp(value,"osmesa")==0)
+			options.api = render::headless_api::osmesa;
+		else
+			return false;
+	}
+	else
+		return false;
+	k++;
+	return true;
+}
+
+// Time per frame and throughput of a stage of the recording
+static void print_record_stage(char const* name, double seconds, unsigned int frames, unsigned int threads = 1)
+{
+	double const ms_per_frame = frames>0 ? 1000*seconds/frames : 0;
+	std::cout << "  " << name << ": " << ms_per_frame << " ms per frame";
+	if(threads>1)
+		std::cout << " on each of " << threads << " threads";
+	std::cout << ", " << (seconds>0 ? threads*frames/seconds : 0) << " frames/s" << std::endl;
+}
+
+int record_launch(record_options const& options, GLFWwindow* window)
+{
+	typedef std::chrono::steady_clock clock;
+	auto const seconds_between = [](clock::time_point a, clock::time_point b){ return std::chrono::duration<double>(b-a).count(); };
+
+	render::offscreen_target target;
+	if(!target.initialize(options.width, options.height, options.samples)){
+		std::cerr << "Cannot create a framebuffer of " << options.width << "x" << options.height << std::endl;
+		return 1;
+	}
+	render::frame_writer writer;
+	if(!writer.start(options.directory, options.format)){
+		std::cerr << "Cannot write in " << options.directory << std::endl;
+		return 1;
+	}
+	render::frame_readback readback;
+	readback.initialize(options.width, options.height);
+
+	std::cout<<"Initialize data ..."<<std::endl;
+	initialize_data();
+	// no placeholder in a recording: all the assets are uploaded before the first frame
+	while(asset_loader.pending()>0){
+		asset_loader.update(size_t(-1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	lock_camera = true; // same framing as --frames
+	window_size_callback(nullptr, options.width, options.height);
+
+	unsigned int const frame_count = static_cast<unsigned int>(std::ceil(options.duration*options.fps));
+	std::cout << "Record " << frame_count << " frames of " << options.width << "x" << options.height << " at " << options.fps
+		<< " frames/s in " << options.directory << " ..." << std::endl;
+	double simulation_seconds = 0;
+	double scene_seconds = 0;
+	double readback_seconds = 0;
+	clock::time_point const record_start = clock::now();
+	unsigned int frame = 0;
+	for(; frame<frame_count && !(window!=nullptr && glfwWindowShouldClose(window)); ++frame){
+		PROFILE_FRAME_BEGIN();
+		clock::time_point const t0 = clock::now();
+		// fixed step of simulated time, whatever the time taken by the frame
+		timer.t = static_cast<float>(frame)/options.fps;
+		sim::mission_advance_to(mission, mission_parameters, timer.t);
+		sim::attitude_input const input = sim::attitude_input_from(mission, mission_parameters);
+		if(frame==0)
+			sim::attitude_reset(attitude, input, mission_parameters, control_settings.attitude);
+		while(attitude.t + control_settings.max_step <= input.t)
+			sim::attitude_step(attitude, input, mission_parameters, control_settings.attitude, control_settings.max_step);
+		clock::time_point const t1 = clock::now();
+
+		target.bind();
+		scene.light = scene.camera.position();
+		clear_sky();
+		display_scene();
+		target.resolve();
+		clock::time_point const t2 = clock::now();
+
+		readback.read(target.read_framebuffer(), frame, writer);
+		readback.collect(writer, false);
+		clock::time_point const t3 = clock::now();
+		simulation_seconds += seconds_between(t0, t1);
+		scene_seconds += seconds_between(t1, t2);
+		readback_seconds += seconds_between(t2, t3);
+
+		if(window!=nullptr){
+			int width = 0, height = 0;
+			glfwGetFramebufferSize(window, &width, &height);
+			target.blit_to_window(width, height);
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+#ifdef ROCKET_PROFILER
+		gpu_times.frame_end(profiling::frame_index());
+#endif
+		PROFILE_FRAME_END();
+	}
+	clock::time_point const flush_start = clock::now();
+	readback.collect(writer, true);
+	readback_seconds += seconds_between(flush_start, clock::now());
+	writer.finish();
+	double const total_seconds = seconds_between(record_start, clock::now());
+
+	render::readback_statistics const& readback_stats = readback.statistics();
+	render::frame_writer_statistics const writer_stats = writer.statistics();
+	std::cout << writer_stats.frames << " frames written in " << total_seconds << " s: " << writer_stats.frames/total_seconds << " frames/s, "
+		<< (frame/options.fps)/total_seconds << " times real time" << std::endl;
+	print_record_stage("simulation", simulation_seconds, frame);
+	print_record_stage("scene", scene_seconds, frame);
+	print_record_stage("readback", readback_seconds, frame);
+	std::cout << "    waiting for the GPU " << 1000*readback_stats.wait_seconds/std::max(frame,1u) << " ms per frame, for the writers "
+		<< 1000*writer_stats.wait_seconds/std::max(frame,1u) << " ms per frame" << std::endl;
+	print_record_stage("encoding", writer_stats.encode_seconds, writer_stats.frames, writer_stats.threads);
+
+	if(writer.failed()){
+		std::cerr << "Some frames could not be written in " << options.directory << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+void restart_mission()
+{
+	// e.g. another flight model: the timeline is recomputed from t=0, a recording starts a new file
+	simulation.restart(mission_parameters);
+	fleet.reset(fleet_gui.settings, mission_parameters);
+}
+
+void display_gui_flight_model()
+{
+	bool dynamic = mission_parameters.model==sim::flight_model::dynamic;
+	if(ImGui::Checkbox("Dynamic flight model", &dynamic)){
+		// thrust, drag and gravity integrated numerically instead of the scripted trajectory
+		mission_parameters.model = dynamic ? sim::flight_model::dynamic : sim::flight_model::scripted; 
+		restart_mission(); 
+	}
+	if(ImGui::Button("Restart launch"))
+		restart_mission(); 
+
+	// from t=0, every step recorded by the simulation thread
+	sim::simulation_snapshot const& snapshot = simulation.snapshot();
+	bool recording = snapshot.recording;
+	if(ImGui::Checkbox("Record telemetry", &recording))
+		simulation.record(recording);
+	if(snapshot.recording)
+		ImGui::Text("%s: %lu samples, %lu stalls", simulation.settings().telemetry_filename.c_str(),
+			static_cast<unsigned long>(snapshot.telemetry_samples), static_cast<unsigned long>(snapshot.telemetry_stalls));
+	if(snapshot.telemetry_failed)
+		ImGui::Text("%s: write failed, the file is truncated", simulation.settings().telemetry_filename.c_str());
+
+	if(dynamic){
+		sim::integrator_counters const ascent = sim::flight_ascent_counters(mission.flight);
+		sim::integrator_counters const coast = sim::flight_coast_counters(mission.flight);
+		sim::integrator_counters const orbit = sim::flight_orbit_counters(mission.flight);
+		ImGui::Text("ascent rk45: %lu steps, %lu rejected, %lu evaluations", ascent.steps, ascent.rejected, ascent.evaluations);
+		ImGui::Text("coast %s: %lu steps, %lu evaluations", sim::integrator_name(mission_parameters.integration.coast), coast.steps, coast.evaluations);
+		ImGui::Text("orbit %s: %lu steps, %lu evaluations", sim::integrator_name(mission_parameters.integration.orbit), orbit.steps, orbit.evaluations);
+
+		bool us1976 = mission_parameters.vehicle.atmosphere==sim::atmosphere_model::us1976;
+		if(ImGui::Checkbox("US Standard Atmosphere 1976", &us1976)){
+			// otherwise the exponential atmosphere
+			mission_parameters.vehicle.atmosphere = us1976 ? sim::atmosphere_model::us1976 : sim::atmosphere_model::exponential;
+			restart_mission();
+		}
+		if(!mission.radius_set){
+			float q = 0, mach = 0;
+			sim::flight_aerodynamics(mission_parameters, mission.rocket_p, mission.rocket_v, q, mach);
+			ImGui::Text("dynamic pressure %.0f Pa, Mach %.2f", q, mach);
+		}
+		ImGui::Text("max-Q %.0f Pa at %.1f s", mission.flight.max_dynamic_pressure, mission.flight.max_dynamic_pressure_time);
+	}
+}
+
+void display_gui_timeline()
+{
+	if(!ImGui::CollapsingHeader("Timeline"))
+		return;
+	sim::timeline_statistics const stats = timeline.statistics();
+	float const duration = std::max(timeline_duration, stats.computed_until);
+	if(!simulation.snapshot().recording){
+		// seek anywhere, Time Scale at 0 (or the space key) to pause
+		if(ImGui::SliderFloat("Mission time", &timer.t, 0.0f, duration, "%.2f s"))
+			simulation.seek(timer.t);
+	}
+
+	// only the timeline after the earliest edited event is recomputed, in the background
+	bool changed = ImGui::SliderFloat("First separation", &mission_parameters.t_separation_first, 1.0f, 30.0f, "%.1f s");
+	changed = ImGui::SliderFloat("Second separation", &mission_parameters.t_separation_second, 1.0f, 30.0f, "%.1f s") || changed;
+	changed = ImGui::SliderFloat("Orbit start", &mission_parameters.t_satellite_orbit_start, 1.0f, 40.0f, "%.1f s") || changed;
+	if(changed)
+		simulation.set_parameters(mission_parameters);
+
+	// computed range, events and current time on a bar
+	float const width = 400.0f;
+	float const height = 20.0f;
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImVec2 const origin = ImGui::GetCursorScreenPos();
+	auto x = [&](float t){ return origin.x + width*std::min(1.0f, std::max(0.0f, t/duration)); };
+	draw_list->AddRectFilled(origin, ImVec2(origin.x+width, origin.y+height), IM_COL32(60,60,60,255));
+	draw_list->AddRectFilled(origin, ImVec2(x(stats.computed_until), origin.y+height), IM_COL32(70,110,160,255));
+	for(sim::mission_event const& e : timeline.events()){
+		ImU32 const color = e.type==sim::mission_event_type::separation ? IM_COL32(240,160,40,255)
+			: e.type==sim::mission_event_type::landing ? IM_COL32(150,90,40,255) : IM_COL32(120,220,120,255);
+		ImVec2 const p0(x(e.t)-1, origin.y);
+		ImVec2 const p1(x(e.t)+2, origin.y+height);
+		draw_list->AddRectFilled(p0, p1, color);
+		if(ImGui::IsMouseHoveringRect(p0, p1))
+			ImGui::SetTooltip("%.2f s: %s %d", e.t, sim::mission_event_name(e.type), e.body);
+	}
+	draw_list->AddRectFilled(ImVec2(x(timer.t)-1, origin.y-2), ImVec2(x(timer.t)+1, origin.y+height+2), IM_COL32(255,255,255,255));
+	ImGui::Dummy(ImVec2(width, height));
+
+	ImGui::Text("computed until %.1f s: %lu keyframes, %lu checkpoints, %lu events", stats.computed_until,
+		static_cast<unsigned long>(stats.keyframes), static_cast<unsigned long>(stats.checkpoints), static_cast<unsigned long>(stats.events));
+	ImGui::Text("%lu steps simulated, %u recomputations (last kept %.1f s)", static_cast<unsigned long>(stats.steps_computed), stats.recomputations, stats.kept_until);
+}
+
+void display_gui_render_statistics()
+{
+	render::render_statistics const& stats = draw_queue.statistics();
+	ImGui::Text("%.2f ms/frame, %u objects, %u draw calls, %u state changes, %u triangles", frame_time_ms, stats.items, stats.draw_calls, stats.state_changes, stats.triangles);
+	render::planet_lod_statistics const& earth_stats = earth.statistics();
+	ImGui::Text("earth: %u nodes, %u drawn, %u outside the view, %u triangles, %u splits, %u merges", earth_stats.nodes, earth_stats.drawn, earth_stats.culled, earth_stats.triangles, earth_stats.splits, earth_stats.merges);
+	render::cull_statistics const& cull_stats = scene_culling.statistics();
+	ImGui::Text("objects: %u/%u drawn, %u outside the view, %u too small, %u behind the earth (%u nodes tested)", cull_stats.drawn, cull_stats.objects,
+		cull_stats.culled_frustum, cull_stats.culled_small, cull_stats.culled_occluded, cull_stats.nodes_tested);
+	ImGui::SliderFloat("LOD pixel error", &lod_view.pixel_error, 0.25f, 8.0f, "%.2f");
+	ImGui::Checkbox("Frustum culling", &culling_gui.frustum);
+	ImGui::SameLine();
+	ImGui::Checkbox("Earth occlusion", &culling_gui.earth_occlusion);
+	ImGui::SliderFloat("Cull below (pixels)", &culling_gui.min_pixels, 0.0f, 8.0f, "%.1f");
+	if(ImGui::Checkbox("Logarithmic depth", &culling_gui.logarithmic_depth))
+		set_depth_mode();
+}
+
+void display_gui_simulation_thread()
+{
+	if(!ImGui::CollapsingHeader("Simulation thread"))
+		return;
+	sim::simulation_snapshot const& snapshot = simulation.snapshot();
+	sim::jitter_statistics const& sim_jitter = snapshot.jitter;
+	ImGui::Text("%.0f Hz, tick %lu, latest state %.2f ms old", simulation.settings().rate, static_cast<unsigned long>(snapshot.tick), 1000*(simulation.now()-snapshot.wall));
+	ImGui::Text("simulation: period %.3f ms, stddev %.3f ms, max %.3f ms, late by %.3f ms at most, %lu overruns", sim_jitter.period_mean, sim_jitter.period_stddev,
+		sim_jitter.period_max, sim_jitter.lateness_max, static_cast<unsigned long>(sim_jitter.overruns));
+	sim::jitter_statistics const frames = frame_jitter.statistics();
+	ImGui::Text("render: period %.2f ms, stddev %.2f ms, max %.2f ms", frames.period_mean, frames.period_stddev, frames.period_max);
+	if(snapshot.shared)
+		ImGui::Text("shared memory %s: %lu states, %lu events", simulation.settings().shared_memory.c_str(),
+			static_cast<unsigned long>(snapshot.shared_states), static_cast<unsigned long>(snapshot.shared_events));
+}
+
+void display_gui_time_warp()
+{
+	// above 3x the simulation thread steps the mission itself, on rails once in orbit (time_warp.hpp)
+	for(float const warp : {10.0f, 100.0f, 1000.0f, 10000.0f}){
+		char label[16];
+		std::snprintf(label, sizeof(label), "%.0fx", warp);
+		if(ImGui::Button(label)){
+			timer.scale = warp;
+			simulation.set_time_scale(timer.scale);
+		}
+		ImGui::SameLine();
+	}
+	ImGui::Text("time warp");
+	sim::time_warp_statistics const& warp = simulation.snapshot().warp;
+	ImGui::Text("warp %.0fx requested, %.0fx allowed, %.1fx achieved (%s, limited by %s)", warp.requested, warp.allowed, warp.achieved,
+		sim::time_warp_mode_name(warp.mode), sim::time_warp_limit_name(warp.limit));
+	if(warp.mode!=sim::time_warp_mode::timeline)
+		ImGui::Text("%u steps in the last tick, %lu jumps on rails, next event %.2f s", warp.steps, static_cast<unsigned long>(warp.jumps), warp.next_event);
+}
+
+void display_gui_control()
+{
+	if(!ImGui::CollapsingHeader("Guidance and control"))
+		return;
+	// attitudes and timing of the 1 kHz control thread (simulation/control_thread.hpp)
+	ImGui::Text("attitude error %.2f deg, torque (%.0f, %.0f, %.0f) N m%s", attitude.error*180/3.14159265f,
+		attitude.torque.x, attitude.torque.y, attitude.torque.z, attitude.saturated ? ", saturated" : "");
+	ImGui::Text("%lu control steps, %lu resets", static_cast<unsigned long>(attitude.steps), static_cast<unsigned long>(attitude.resets));
+	sim::control_statistics const& control_stats = control.latest().statistics;
+	if(control_stats.cpu>=0)
+		ImGui::Text("%.0f Hz pinned to core %d%s", control.settings().rate, control_stats.cpu, control_stats.realtime ? ", SCHED_FIFO" : "");
+	else
+		ImGui::Text("%.0f Hz, not pinned%s", control.settings().rate, control_stats.realtime ? ", SCHED_FIFO" : "");
+	ImGui::Text("%lu ticks, %lu deadline misses, %lu skipped", static_cast<unsigned long>(control_stats.ticks),
+		static_cast<unsigned long>(control_stats.deadline_misses), static_cast<unsigned long>(control_stats.skipped));
+	ImGui::Text("latency p50 < %.0f us, p99 < %.0f us, max %.0f us", control_stats.latency.percentile(50), control_stats.latency.percentile(99), control_stats.latency.max);
+	float bins[sim::latency_histogram::bins];
+	for(int k=0; k<sim::latency_histogram::bins; ++k)
+		bins[k] = static_cast<float>(control_stats.latency.counts[k]);
+	ImGui::PlotHistogram("latency (log2 us)", bins, sim::latency_histogram::bins, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0,60));
+}
+
+void display_gui_constellation()
+{
+	if(!ImGui::CollapsingHeader("Constellation"))
+		return;
+	ImGui::Checkbox("Show constellation", &constellation_gui.show);
+	bool rebuild = ImGui::SliderInt("Satellites", &constellation_gui.satellites, 100, 50000);
+	rebuild = ImGui::SliderInt("Planes", &constellation_gui.planes, 1, 500) || rebuild;
+	if(rebuild)
+		build_constellation();
+	ImGui::SliderFloat("Orbit time warp", &constellation_gui.time_warp, 1.0f, 1000.0f, "%.0f");
+	bool j2 = constellation.j2();
+	if(ImGui::Checkbox("J2 perturbation", &j2))
+		constellation.set_j2(j2);
+	int const planes = std::min(constellation_gui.planes, constellation_gui.satellites);
+	int const per_plane = constellation_gui.satellites/planes;
+	if(constellation_gui.satellites%planes==0)
+		ImGui::Text("%d planes of %d satellites", planes, per_plane);
+	else
+		ImGui::Text("%d planes: %d of %d satellites and %d of %d", planes, constellation_gui.satellites%planes, per_plane+1,
+			planes - constellation_gui.satellites%planes, per_plane);
+	ImGui::Text("%lu satellites, propagated in %.2f ms (%s, %u threads)", static_cast<unsigned long>(constellation.size()), constellation_gui.propagation_ms,
+		sim::simd_level_name(sim::body_table_detect_simd()), worker_pool ? worker_pool->size() : 1u);
+}
+
+void display_gui_particles()
+{
+	if(!ImGui::CollapsingHeader("Particles"))
+		return;
+	ImGui::Checkbox("Show particles", &particles_gui.show);
+	ImGui::SliderFloat("Exhaust rate", &particles_gui.exhaust_rate, 0.0f, 250000.0f, "%.0f/s");
+	ImGui::SliderInt("Debris per separation", &particles_gui.debris_burst, 0, 20000);
+	ImGui::Text("exhaust %lu/%lu, debris %lu/%lu particles, %lu dropped", static_cast<unsigned long>(exhaust_particles.size()), static_cast<unsigned long>(exhaust_particles.capacity()),
+		static_cast<unsigned long>(debris_particles.size()), static_cast<unsigned long>(debris_particles.capacity()),
+		static_cast<unsigned long>(exhaust_particles.dropped()+debris_particles.dropped()));
+	// the renderer keeps the timings of its last draw: the exhaust
+	render::particle_render_statistics const& stats = particle_renderer.statistics();
+	ImGui::Text("update %.2f ms, sort %.2f ms, upload %.2f ms (%u threads)", particles_gui.update_ms, stats.sort_ms, stats.upload_ms, worker_pool ? worker_pool->size() : 1u);
+}
+
+void update_fleet()
+{
+	PROFILE_SCOPE("fleet update");
+	auto const start = std::chrono::steady_clock::now();
+	fleet.update(timer.t, worker_pool.get(), &mission);
+	float const ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count();
+	fleet_gui.update_ms = 0.9f*fleet_gui.update_ms + 0.1f*ms;
+}
+
+void display_fleet(render::cull_view const& view, vec3 const& eye)
+{
+	if(fleet.vehicles()<=1)
+		return;
+	PROFILE_SCOPE("fleet submit");
+	// same meshes as the rocket of the mission (which is drawn above, with its own transforms)
+	render::lod_chain* const chains[sim::vehicle_part_count] = {&rocket_first_stage, &rocket_second_stage, &rocket_payload_fairing, &satellite_mesh};
+	render::bounding_sphere bounds[sim::vehicle_part_count];
+	for(int kind=0; kind<sim::vehicle_part_count; ++kind){
+		bounds[kind] = chains[kind]->bounds();
+		fleet_instances[kind].resize(chains[kind]->level_count());
+		for(std::vector<vec3>& positions : fleet_instances[kind])
+			positions.clear();
+	}
+
+	fleet_gui.drawn = 0;
+	fleet.entities().each_chunk<sim::part, sim::motion>([&](size_t rows, sim::ecs::entity const*, sim::part const* parts, sim::motion const* motions){
+		for(size_t k=0; k<rows; ++k){
+			int const kind = parts[k].kind;
+			vec3 p = to_vcl(motions[k].p);
+			if(kind==sim::part_satellite)
+				p = p - vec3(0,0,satellite_mesh_offset);
+			float distance = norm(eye - p);
+			if(bounds[kind].radius>=0){
+				// the tests of the scene objects, on the bounding sphere of each part
+				vec3 const center = p + bounds[kind].center;
+				float const radius = bounds[kind].radius;
+				if((view.frustum_culling && render::outside_frustum(view.planes, center, radius)) || render::too_small(view, center, radius) || render::occluded(view, center, radius))
+					continue;
+				distance = std::max(norm(eye - center) - radius, 0.0f);
+			}
+			fleet_instances[kind][chains[kind]->level_at(distance, lod_view)].push_back(p);
+			fleet_gui.drawn++;
+		}
+	});
+
+	// one item per part and level, expanded to its instances by the queue. The chains carry the
+	// attitude of the mission rocket (place_part): the vehicles of the fleet stay upright, as
+	// their culling spheres, only their position goes in the instances
+	for(int kind=0; kind<sim::vehicle_part_count; ++kind){
+		for(size_t level=0; level<fleet_instances[kind].size(); ++level){
+			std::vector<vec3> const& positions = fleet_instances[kind][level];
+			if(positions.empty())
+				continue;
+			mesh_drawable upright = chains[kind]->level_drawable(level);
+			upright.transform.rotate = rotation();
+			upright.transform.translate = vec3(0,0,0);
+			draw_queue.submit_instances(upright, positions.data(), positions.size());
+		}
+	}
+}
+
+void display_gui_fleet()
+{
+	if(!ImGui::CollapsingHeader("Fleet"))
+		return;
+	sim::fleet_settings& settings = fleet_gui.settings;
+	ImGui::SliderInt("Vehicles", &settings.vehicles, 0, 10000);
+	ImGui::SliderInt("Pads", &settings.pads, 1, 400);
+	ImGui::SliderFloat("Cadence", &settings.cadence, 0.0f, 30.0f, "%.1f s per pad");
+	if(ImGui::Button("Launch the fleet"))
+		fleet.reset(settings, mission_parameters); // follows the mission: scrub the time to replay it
+
+	sim::fleet_statistics const stats = fleet.statistics();
+	ImGui::Text("%lu vehicles, %lu entities in %lu archetypes", static_cast<unsigned long>(stats.vehicles), static_cast<unsigned long>(stats.entities), static_cast<unsigned long>(stats.archetypes));
+	ImGui::Text("propelled %lu, ballistic %lu, landed %lu, orbiting %lu", static_cast<unsigned long>(stats.propelled), static_cast<unsigned long>(stats.ballistic),
+		static_cast<unsigned long>(stats.landed), static_cast<unsigned long>(stats.orbiting));
+	ImGui::Text("update %.2f ms, %u parts drawn", fleet_gui.update_ms, fleet_gui.drawn);
+
+	// the camera follows a part of this vehicle (keys 1 to 4, N and P)
+	int vehicle = static_cast<int>(camera_follow.vehicle);
+	if(ImGui::SliderInt("Camera vehicle", &vehicle, 0, std::max(static_cast<int>(stats.vehicles)-1, 0)))
+		camera_follow.vehicle = static_cast<size_t>(vehicle);
+	ImGui::Text(camera_follow.follow ? "following part %d (keys 1 to 4)" : "keys 1 to 4 to follow a part", static_cast<int>(camera_follow.part)+1);
+}
+
+#ifdef ROCKET_PROFILER
+void display_gui_profiler()
+{
+	if(!ImGui::CollapsingHeader("Profiler"))
+		return;
+	bool recording = profiling::enabled();
+	if(ImGui::Checkbox("Record scopes", &recording))
+		profiling::set_enabled(recording); // pause to inspect the history
+	std::deque<profiling::frame_record> const& frames = profiling::history();
+	if(frames.empty())
+		return;
+
+	// rolling frame times
+	static std::vector<float> frame_times;
+	frame_times.clear();
+	for(profiling::frame_record const& f : frames)
+		frame_times.push_back(1e-6f*static_cast<float>(f.end_ns-f.begin_ns));
+	ImGui::PlotLines("frame (ms)", frame_times.data(), static_cast<int>(frame_times.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0,60));
+
+	// flame view of one frame: a row per nesting level and per thread, the width being the duration
+	ImGui::SliderInt("Frames ago", &profiler_frame_offset, 0, static_cast<int>(frames.size())-1);
+	profiler_frame_offset = std::min(profiler_frame_offset, static_cast<int>(frames.size())-1);
+	profiling::frame_record const& f = frames[frames.size()-1-profiler_frame_offset];
+	uint32_t rows_per_thread = 1;
+	uint32_t threads = 1;
+	for(profiling::scope_event const& e : f.events){
+		rows_per_thread = std::max(rows_per_thread, e.depth+1);
+		threads = std::max(threads, e.thread+1);
+	}
+	float const width = 600.0f;
+	float const row_height = 18.0f;
+	double const scale = width / static_cast<double>(std::max<uint64_t>(f.end_ns-f.begin_ns, 1));
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImVec2 const origin = ImGui::GetCursorScreenPos();
+	for(profiling::scope_event const& e : f.events){
+		float const x0 = origin.x + static_cast<float>(scale*static_cast<double>(e.begin_ns>f.begin_ns ? e.begin_ns-f.begin_ns : 0));
+		float const x1 = std::min(origin.x+width, std::max(x0+1.0f, origin.x + static_cast<float>(scale*static_cast<double>(e.end_ns-f.begin_ns))));
+		float const y0 = origin.y + row_height*static_cast<float>(e.thread*rows_per_thread + e.depth);
+		ImVec2 const p0(x0, y0);
+		ImVec2 const p1(x1, y0+row_height-1);
+
+		// same color for the same name from one frame to the next
+		unsigned int hash = 2166136261u;
+		for(char const* c=e.name; *c; ++c)
+			hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+		draw_list->AddRectFilled(p0, p1, IM_COL32(110+hash%130, 110+(hash>>8)%130, 110+(hash>>16)%130, 255));
+		draw_list->PushClipRect(p0, p1, true);
+		draw_list->AddText(ImVec2(x0+2, y0+2), IM_COL32(0,0,0,255), e.name);
+		draw_list->PopClipRect();
+		if(ImGui::IsMouseHoveringRect(p0, p1))
+			ImGui::SetTooltip("%s: %.3f ms", e.name, 1e-6*static_cast<double>(e.end_ns-e.begin_ns));
+	}
+	ImGui::Dummy(ImVec2(width, row_height*static_cast<float>(threads*rows_per_thread)));
+
+	// GPU times are known one frame later
+	for(profiling::gpu_event const& e : f.gpu)
+		ImGui::Text("GPU %s: %.3f ms", e.name, 1e-6*static_cast<double>(e.duration_ns));
+	ImGui::Text("%lu GPU queries dropped", static_cast<unsigned long>(gpu_times.dropped()));
+
+	if(ImGui::Button("Export trace")){
+		if(profiling::export_chrome_trace("profile.json"))
+			std::cout << "Profile written to profile.json (chrome://tracing)" << std::endl;
+	}
+	ImGui::SameLine();
+	if(ImGui::Button("Export CSV")){
+		if(profiling::export_csv("profile.csv"))
+			std::cout << "Profile written to profile.csv" << std::endl;
+	}
+}
+#endif
+
 // Function called every time the screen is resized
 void window_size_callback(GLFWwindow* , int width, int height)
 {
@@ -540,7 +1491,10 @@ void window_size_callback(GLFWwindow* , int width, int height)
 	float const aspect = width / static_cast<float>(height);
 
 	//modifying the far so we can still see the rocket from afar while moving the camera position
-	scene.projection = projection_perspective(50.0f*pi/180.0f, aspect, 0.1f, 10000000000.0f);
+	scene.projection = projection_perspective(field_of_view, aspect, near_plane, far_plane);
+	lod_view.set_projection(field_of_view, static_cast<float>(height));
+	viewport_height = static_cast<float>(height);
+	viewport_aspect = aspect;
 }
 
 
@@ -568,31 +1522,28 @@ void mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 
 // Function called every time a key is entered.
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if(action == GLFW_REPEAT && key == GLFW_KEY_1) {
-		scene.camera.look_at({10,15,firstStage.p.z}, firstStage.p , {0,0,1});
-	} else if(action == GLFW_REPEAT && key == GLFW_KEY_2) {
-		scene.camera.look_at({10,15,secondStage.p.z}, secondStage.p , {0,0,1});
-	} else if(action == GLFW_REPEAT && key == GLFW_KEY_3){
-		scene.camera.look_at({10,15,payloadFairing.p.z}, payloadFairing.p , {0,0,1});
-	} else if(action == GLFW_REPEAT && key == GLFW_KEY_4){
-		if(satellite.p.x >0 ){
-			if(satellite.p.z> -earth_radius){
-				scene.camera.look_at({satellite.p.x+ 60,15,satellite.p.z+60}, satellite.p , {0,0,1});
-			}
-			else{
-				scene.camera.look_at({satellite.p.x+ 60,15,satellite.p.z-60}, satellite.p , {0,0,1});
-			}
-		}
-		else{
-			if(satellite.p.z> -earth_radius){
-				scene.camera.look_at({satellite.p.x- 60,15,satellite.p.z+60}, satellite.p , {0,0,1});
-			}
-			else{
-				scene.camera.look_at({satellite.p.x- 60,15,satellite.p.z-60}, satellite.p , {0,0,1});
-			}
+	vec3 const payload_fairing_p = to_vcl(sim::mission_position(mission, sim::body_payload_fairing));
+
+	if(action == GLFW_PRESS && key >= GLFW_KEY_1 && key <= GLFW_KEY_4) {
+		// follow this part of the chosen vehicle, or stop following it
+		sim::vehicle_part const part = static_cast<sim::vehicle_part>(key - GLFW_KEY_1);
+		camera_follow.follow = !(camera_follow.follow && camera_follow.part == part);
+		camera_follow.part = part;
+	} else if(action == GLFW_PRESS && (key == GLFW_KEY_N || key == GLFW_KEY_P) && fleet.vehicles() > 0){
+		size_t const n = fleet.vehicles();
+		camera_follow.vehicle = key == GLFW_KEY_N ? (camera_follow.vehicle+1)%n : (camera_follow.vehicle+n-1)%n;
+	} else if(action == GLFW_PRESS && key == GLFW_KEY_SPACE){
+		// pause or resume the launch
+		if(timer.scale > 0){
+			resume_scale = timer.scale;
+			timer.scale = 0;
 		}
+		else
+			timer.scale = resume_scale;
+		simulation.set_time_scale(timer.scale);
 	} else if(action == GLFW_PRESS && key == GLFW_KEY_B){
-		scene.camera.look_at({10,15,0}, {0,0,payloadFairing.p.z} , {0,0,1});
+		camera_follow.follow = false;
+		scene.camera.look_at({10,15,0}, {0,0,payload_fairing_p.z} , {0,0,1});
 	} else if(action == GLFW_PRESS && key == GLFW_KEY_L){
 		lock_camera = !lock_camera ; 
 	}else if(action == GLFW_PRESS && (key == GLFW_KEY_ESCAPE)) {
@@ -600,6 +1551,46 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 	}
 }
 
+void follow_camera_target()
+{
+	sim::vec3 target;
+	if(!fleet.position(fleet.part_entity(camera_follow.vehicle, camera_follow.part), target)){
+		camera_follow.follow = false; // the fleet was respawned with fewer vehicles
+		return;
+	}
+	vec3 p = to_vcl(target);
+	if(camera_follow.part != sim::part_satellite){
+		// beside the part, at its height
+		scene.camera.look_at({p.x+10, p.y+15, p.z}, p , {0,0,1});
+		return;
+	}
+	// satellite: from outside its orbit, on the side of the earth where it is
+	p = p - vec3(0,0,satellite_mesh_offset);
+	float const dx = p.x > 0 ? 60.0f : -60.0f;
+	float const dz = p.z > -earth_radius ? 60.0f : -60.0f;
+	scene.camera.look_at({p.x+dx, p.y+15, p.z+dz}, p , {0,0,1});
+}
+
+// Conversion of the positions computed by the simulation engine
+vec3 to_vcl(sim::vec3 const& v)
+{
+	return vec3(v.x, v.y, v.z);
+}
+
+rotation to_vcl(sim::quaternion const& q)
+{
+	sim::vec3 const r = sim::quaternion_rotation_vector(q);
+	float const angle = sim::norm(r);
+	return angle>0 ? rotation(to_vcl(r/angle), angle) : rotation();
+}
+
+void place_part(affine_rts& transform, vec3 const& origin, sim::rigid_body_attitude const& body, sim::vec3 const& pivot)
+{
+	// the pivot of the mesh stays at origin + pivot
+	transform.rotate = to_vcl(body.q);
+	transform.translate = origin + to_vcl(pivot - sim::rotate(body.q, pivot));
+}
+
 // Uniform data used when displaying an object in this scene
 void opengl_uniform(GLuint shader, scene_environment const& current_scene)
 {
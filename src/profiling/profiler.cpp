@@ -0,0 +1,184 @@
+#include "profiling/profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace profiling {
+
+namespace {
+
+std::atomic<bool> recording{true};
+
+// Buffers of all the threads that recorded a scope. The list is only locked when a thread
+// records its first scope and when frame_end() walks it, never when recording.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<thread_buffer>> registry;
+
+std::deque<frame_record> frames;
+frame_record current_frame;
+uint64_t next_frame = 0;
+std::vector<scope_event> drained;
+
+}
+
+uint64_t now_ns()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool enabled() { return recording.load(std::memory_order_relaxed); }
+void set_enabled(bool value) { recording.store(value, std::memory_order_relaxed); }
+
+void thread_buffer::push(scope_event const& e)
+{
+	size_t const h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) >= capacity){
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	events[h % capacity] = e;
+	head.store(h+1, std::memory_order_release);
+}
+
+void thread_buffer::drain(std::vector<scope_event>& out)
+{
+	size_t const h = head.load(std::memory_order_acquire);
+	size_t t = tail.load(std::memory_order_relaxed);
+	for(; t!=h; ++t)
+		out.push_back(events[t % capacity]);
+	tail.store(t, std::memory_order_release);
+}
+
+thread_buffer& current_thread_buffer()
+{
+	// the buffers live until the end of the program, so that frame_end() can read the
+	// scopes of a thread that already exited
+	thread_local thread_buffer* buffer = nullptr;
+	if(buffer==nullptr){
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		registry.push_back(std::unique_ptr<thread_buffer>(new thread_buffer(static_cast<uint32_t>(registry.size()))));
+		buffer = registry.back().get();
+	}
+	return *buffer;
+}
+
+void frame_begin()
+{
+	current_frame = frame_record();
+	current_frame.index = next_frame;
+	current_frame.begin_ns = now_ns();
+}
+
+void frame_end()
+{
+	current_frame.end_ns = now_ns();
+
+	drained.clear();
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for(std::unique_ptr<thread_buffer>& b : registry)
+			b->drain(drained);
+	}
+	// scopes of the worker threads may straddle two frames: they are kept in the frame that drained them
+	std::sort(drained.begin(), drained.end(), [](scope_event const& a, scope_event const& b){
+		return a.begin_ns!=b.begin_ns ? a.begin_ns<b.begin_ns : a.depth<b.depth;
+	});
+	current_frame.events = drained;
+
+	frames.push_back(current_frame);
+	while(frames.size()>history_size)
+		frames.pop_front();
+	next_frame++;
+}
+
+uint64_t frame_index()
+{
+	return next_frame;
+}
+
+void add_gpu_event(uint64_t frame, char const* name, uint64_t duration_ns)
+{
+	if(frames.empty() || frame<frames.front().index || frame>frames.back().index)
+		return;
+	gpu_event e;
+	e.name = name;
+	e.duration_ns = duration_ns;
+	frames[size_t(frame - frames.front().index)].gpu.push_back(e);
+}
+
+std::deque<frame_record> const& history()
+{
+	return frames;
+}
+
+// Signed: a worker scope drained in a frame may have started before it
+static double microseconds(uint64_t from, uint64_t to)
+{
+	return 1e-3*static_cast<double>(static_cast<int64_t>(to-from));
+}
+
+// Names are string literals of the code: only the quotes and backslashes need escaping
+static std::string json_string(char const* s)
+{
+	std::string out = "\"";
+	for(; *s; ++s){
+		if(*s=='"' || *s=='\\')
+			out += '\\';
+		out += *s;
+	}
+	return out + "\"";
+}
+
+bool export_chrome_trace(std::string const& filename)
+{
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+	if(frames.empty()){
+		out << "{\"traceEvents\":[]}\n";
+		return true;
+	}
+
+	// complete events ("ph":"X") in microseconds from the first frame. GPU durations have no
+	// timestamp (GL_TIME_ELAPSED): they are laid out one after the other from the frame start.
+	uint64_t const origin = frames.front().begin_ns;
+	uint32_t const gpu_track = 1000;
+	out << "{\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << gpu_track << ",\"args\":{\"name\":\"GPU\"}}";
+	for(frame_record const& f : frames){
+		out << ",\n{\"name\":\"frame " << f.index << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << microseconds(origin, f.begin_ns)
+			<< ",\"dur\":" << microseconds(f.begin_ns, f.end_ns) << "}";
+		for(scope_event const& e : f.events)
+			out << ",\n{\"name\":" << json_string(e.name) << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+				<< ",\"ts\":" << microseconds(origin, e.begin_ns) << ",\"dur\":" << microseconds(e.begin_ns, e.end_ns) << "}";
+		uint64_t t = f.begin_ns;
+		for(gpu_event const& e : f.gpu){
+			out << ",\n{\"name\":" << json_string(e.name) << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << gpu_track
+				<< ",\"ts\":" << microseconds(origin, t) << ",\"dur\":" << 1e-3*static_cast<double>(e.duration_ns) << "}";
+			t += e.duration_ns;
+		}
+	}
+	out << "\n]}\n";
+	return bool(out);
+}
+
+bool export_csv(std::string const& filename)
+{
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+	out << "frame,source,thread,depth,name,start_us,duration_us\n";
+	for(frame_record const& f : frames){
+		for(scope_event const& e : f.events)
+			out << f.index << ",cpu," << e.thread << ',' << e.depth << ',' << e.name << ','
+				<< microseconds(f.begin_ns, e.begin_ns) << ',' << microseconds(e.begin_ns, e.end_ns) << '\n';
+		for(gpu_event const& e : f.gpu)
+			out << f.index << ",gpu,,0," << e.name << ",," << 1e-3*static_cast<double>(e.duration_ns) << '\n';
+	}
+	return bool(out);
+}
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+/**
+Lightweight hierarchical frame profiler.
+PROFILE_SCOPE("name") measures the enclosing block. Each thread writes its scopes in its own
+single-producer/single-consumer ring (no lock when recording); frame_end() drains the rings of
+all the threads into a rolling history of frames, displayed in the GUI and exported as a
+Chrome trace (chrome://tracing, Perfetto) or as CSV.
+GPU durations measured by gpu_timer (render/gpu_timer.hpp) are attached to the frame they
+belong to once the queries are resolved.
+
+Built only with the ROCKET_PROFILER definition (CMake option of the same name): without it
+the macros expand to nothing.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace profiling {
+
+struct scope_event
+{
+	char const* name;   // string literal
+	uint64_t begin_ns;
+	uint64_t end_ns;
+	uint32_t depth;     // nesting level in its thread
+	uint32_t thread;
+};
+
+struct gpu_event
+{
+	char const* name;
+	uint64_t duration_ns;
+};
+
+struct frame_record
+{
+	uint64_t index = 0;
+	uint64_t begin_ns = 0;
+	uint64_t end_ns = 0;
+	std::vector<scope_event> events; // all the threads, sorted by begin time
+	std::vector<gpu_event> gpu;      // in submission order
+};
+
+// Monotonic clock in nanoseconds
+uint64_t now_ns();
+
+// Recording can be paused at runtime (the scopes then only test this flag)
+bool enabled();
+void set_enabled(bool value);
+
+// Scopes of the calling thread, in a ring that frame_end() drains
+class thread_buffer
+{
+public:
+	static size_t const capacity = 8192;
+
+	explicit thread_buffer(uint32_t thread_arg) : thread(thread_arg) {}
+
+	void push(scope_event const& e);      // producer: the owning thread
+	void drain(std::vector<scope_event>& out); // consumer: frame_end()
+
+	uint32_t const thread;
+	uint32_t depth = 0;                   // only used by the owning thread
+	std::atomic<uint64_t> dropped{0};     // events lost because the ring was full
+
+private:
+	scope_event events[capacity];
+	std::atomic<size_t> head{0}; // next write
+	std::atomic<size_t> tail{0}; // next read
+};
+
+// Buffer of the calling thread, registered on first use
+thread_buffer& current_thread_buffer();
+
+class scope
+{
+public:
+	explicit scope(char const* name_arg)
+		: name(name_arg)
+	{
+		if(enabled()){
+			buffer = &current_thread_buffer();
+			depth = buffer->depth++;
+			begin = now_ns();
+		}
+	}
+	~scope()
+	{
+		if(buffer==nullptr)
+			return;
+		buffer->depth--;
+		scope_event e;
+		e.name = name;
+		e.begin_ns = begin;
+		e.end_ns = now_ns();
+		e.depth = depth;
+		e.thread = buffer->thread;
+		buffer->push(e);
+	}
+
+	scope(scope const&) = delete;
+	scope& operator=(scope const&) = delete;
+
+private:
+	char const* name;
+	thread_buffer* buffer = nullptr; // null when the profiler is paused
+	uint32_t depth = 0;
+	uint64_t begin = 0;
+};
+
+// Frame boundaries, called by the main thread
+void frame_begin();
+void frame_end();
+uint64_t frame_index(); // of the current frame
+
+// Attach a GPU duration to a frame of the history (ignored if the frame is too old)
+void add_gpu_event(uint64_t frame, char const* name, uint64_t duration_ns);
+
+// Last frames, oldest first
+std::deque<frame_record> const& history();
+size_t const history_size = 240;
+
+// Export of the history
+bool export_chrome_trace(std::string const& filename);
+bool export_csv(std::string const& filename);
+
+}
+
+#define PROFILE_CONCATENATE_IMPL(a,b) a##b
+#define PROFILE_CONCATENATE(a,b) PROFILE_CONCATENATE_IMPL(a,b)
+
+#ifdef ROCKET_PROFILER
+#define PROFILE_SCOPE(name) profiling::scope PROFILE_CONCATENATE(profile_scope_, __LINE__)(name)
+#define PROFILE_FRAME_BEGIN() profiling::frame_begin()
+#define PROFILE_FRAME_END() profiling::frame_end()
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_FRAME_END()
+#endif
@@ -0,0 +1,172 @@
+#include "render/constellation_renderer.hpp"
+
+using namespace vcl;
+
+namespace render {
+
+static char const* const vertex_shader = R"(
+#version 330 core
+layout (location = 0) in vec3 position;     // vertex of the octahedron, also its normal
+layout (location = 1) in float satellite_x; // km, inertial frame of the planet
+layout (location = 2) in float satellite_y;
+layout (location = 3) in float satellite_z;
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters;
+};
+
+uniform vec3 center;
+uniform float scale;
+uniform float satellite_size;
+
+out vec3 fragment_position;
+out vec3 fragment_normal;
+#ifdef LOGARITHMIC_DEPTH
+out float depth_w;
+#endif
+
+void main()
+{
+	vec3 p = center + scale*vec3(satellite_x, satellite_y, satellite_z) + satellite_size*position;
+	fragment_position = p;
+	fragment_normal = position;
+	gl_Position = projection * view * vec4(p, 1.0);
+#ifdef LOGARITHMIC_DEPTH
+	depth_w = 1.0 + gl_Position.w;
+#endif
+}
+)";
+
+static char const* const fragment_shader = R"(
+#version 330 core
+in vec3 fragment_position;
+in vec3 fragment_normal;
+#ifdef LOGARITHMIC_DEPTH
+in float depth_w;
+#endif
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters;
+};
+
+uniform vec3 color;
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	vec3 L = normalize(light.xyz - fragment_position);
+	float diffuse = abs(dot(normalize(fragment_normal), L));
+	FragColor = vec4((0.4 + 0.6*diffuse)*color, 1.0);
+#ifdef LOGARITHMIC_DEPTH
+	gl_FragDepth = log2(depth_w) * depth_parameters.x;
+#endif
+}
+)";
+
+// Octahedron of unit radius: 6 vertices, 8 triangles. The normal of a vertex is its position.
+static float const satellite_vertices[] = {1,0,0, -1,0,0, 0,1,0, 0,-1,0, 0,0,1, 0,0,-1};
+static GLuint const satellite_indices[] = {0,2,4, 2,1,4, 1,3,4, 3,0,4, 2,0,5, 1,2,5, 3,1,5, 0,3,5};
+static GLsizei const satellite_index_count = 24;
+
+void constellation_renderer::compile(depth_mode mode)
+{
+	if(shader!=0)
+		glDeleteProgram(shader);
+	shader = opengl_create_shader_program(shader_source(vertex_shader, mode), shader_source(fragment_shader, mode));
+	GLuint const block = glGetUniformBlockIndex(shader, "frame_uniforms");
+	glUniformBlockBinding(shader, block, 0);
+	location_center = glGetUniformLocation(shader, "center");
+	location_scale = glGetUniformLocation(shader, "scale");
+	location_size = glGetUniformLocation(shader, "satellite_size");
+	location_color = glGetUniformLocation(shader, "color");
+}
+
+void constellation_renderer::initialize(depth_mode mode)
+{
+	compile(mode);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(1, &mesh_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(satellite_vertices), satellite_vertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glGenBuffers(1, &index_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_vbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(satellite_indices), satellite_indices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &position_vbo);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void constellation_renderer::set_depth_mode(depth_mode mode)
+{
+	if(vao!=0)
+		compile(mode);
+}
+
+void constellation_renderer::clear()
+{
+	if(vao!=0)
+		glDeleteVertexArrays(1, &vao);
+	if(mesh_vbo!=0)
+		glDeleteBuffers(1, &mesh_vbo);
+	if(index_vbo!=0)
+		glDeleteBuffers(1, &index_vbo);
+	if(position_vbo!=0)
+		glDeleteBuffers(1, &position_vbo);
+	if(shader!=0)
+		glDeleteProgram(shader);
+	vao = mesh_vbo = index_vbo = position_vbo = shader = 0;
+	capacity = 0;
+	instances = 0;
+}
+
+void constellation_renderer::draw(sim::constellation const& c, constellation_view const& view)
+{
+	instances = static_cast<unsigned int>(c.size());
+	if(instances==0 || shader==0)
+		return;
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
+	size_t const column_bytes = c.size()*sizeof(float);
+	if(c.size()>capacity){
+		// the columns start at multiples of the capacity: the attribute offsets only change when the buffer grows
+		capacity = c.size() + c.size()/2;
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(3*capacity*sizeof(float)), nullptr, GL_STREAM_DRAW);
+		for(GLuint k=0; k<3; ++k){
+			glEnableVertexAttribArray(1+k);
+			glVertexAttribPointer(1+k, 1, GL_FLOAT, GL_FALSE, sizeof(float), reinterpret_cast<void*>(k*capacity*sizeof(float)));
+			glVertexAttribDivisor(1+k, 1);
+		}
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(3*capacity*sizeof(float)), nullptr, GL_STREAM_DRAW); // orphaned: no wait for the previous frame
+	glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(column_bytes), c.px.data());
+	glBufferSubData(GL_ARRAY_BUFFER, GLintptr(capacity*sizeof(float)), GLsizeiptr(column_bytes), c.py.data());
+	glBufferSubData(GL_ARRAY_BUFFER, GLintptr(2*capacity*sizeof(float)), GLsizeiptr(column_bytes), c.pz.data());
+
+	glUseProgram(shader);
+	glUniform3f(location_center, view.center.x, view.center.y, view.center.z);
+	glUniform1f(location_scale, view.scale);
+	glUniform1f(location_size, view.satellite_size);
+	glUniform3f(location_color, view.color.x, view.color.y, view.color.z);
+	glDrawElementsInstanced(GL_TRIANGLES, satellite_index_count, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(instances));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+}
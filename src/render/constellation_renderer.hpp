@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+Instanced drawing of a satellite constellation (simulation/constellation.hpp).
+Every satellite is the same small octahedron: one draw call for the whole constellation. The
+positions computed by the propagator are uploaded as they are, the three columns px, py, pz one
+after the other in a single buffer, and read as per-instance attributes; the vertex shader maps
+them from km around the planet center to the coordinates of the scene. The camera and the light
+come from the frame_uniforms block of the render queue (binding 0), which must be initialized.
+*/
+
+#include "render/render_queue.hpp"
+#include "simulation/constellation.hpp"
+#include "vcl/vcl.hpp"
+
+namespace render {
+
+struct constellation_view
+{
+	vcl::vec3 center;          // planet center in the scene
+	float scale = 1.0f;        // scene units per km
+	float satellite_size = 4.0f; // scene units
+	vcl::vec3 color = {1.0f, 0.85f, 0.3f};
+};
+
+class constellation_renderer
+{
+public:
+	// Compile the shader and create the satellite mesh (needs an OpenGL context)
+	void initialize(depth_mode mode = depth_mode::logarithmic);
+	void clear();
+	// Recompile the shader for the depth mode of the render queue
+	void set_depth_mode(depth_mode mode);
+
+	// Upload the last propagated positions and draw them
+	void draw(sim::constellation const& c, constellation_view const& view);
+
+	unsigned int drawn() const { return instances; }
+
+private:
+	void compile(depth_mode mode);
+
+	GLuint shader = 0;
+	GLuint vao = 0;
+	GLuint mesh_vbo = 0;
+	GLuint index_vbo = 0;
+	GLuint position_vbo = 0;
+	size_t capacity = 0;       // satellites of the position buffer
+	unsigned int instances = 0;
+
+	GLint location_center = -1, location_scale = -1, location_size = -1, location_color = -1;
+};
+
+}
@@ -0,0 +1,230 @@
+#include "render/culling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vcl;
+
+namespace render {
+
+void frustum::set(vec3 const& eye, mat4 const& view, float fov, float aspect, float near_plane, float far_plane)
+{
+	// axes of the camera: rows of the view matrix, the camera looking along -z
+	vec3 const right = {view(0,0), view(0,1), view(0,2)};
+	vec3 const up = {view(1,0), view(1,1), view(1,2)};
+	vec3 const forward = {-view(2,0), -view(2,1), -view(2,2)};
+	float const tan_y = std::tan(fov/2);
+	float const tan_x = aspect*tan_y;
+
+	normal[0] = normalize(right + tan_x*forward);   // left
+	normal[1] = normalize(-right + tan_x*forward);  // right
+	normal[2] = normalize(up + tan_y*forward);      // bottom
+	normal[3] = normalize(-up + tan_y*forward);     // top
+	for(int k=0; k<4; ++k)
+		offset[k] = -dot(normal[k], eye);
+	normal[4] = forward;                            // near
+	offset[4] = -dot(forward, eye) - near_plane;
+	normal[5] = -forward;                           // far
+	offset[5] = dot(forward, eye) + far_plane;
+}
+
+bool outside_frustum(frustum const& planes, vec3 const& center, float radius)
+{
+	for(int k=0; k<6; ++k)
+		if(dot(planes.normal[k], center) + planes.offset[k] < -radius)
+			return true;
+	return false;
+}
+
+bool too_small(cull_view const& view, vec3 const& center, float radius)
+{
+	float const distance = norm(center - view.eye) - radius;
+	return view.min_pixels>0 && distance>0 && 2*radius*view.projection_scale < view.min_pixels*distance;
+}
+
+bool occluded(cull_view const& view, vec3 const& center, float radius)
+{
+	float const R = view.occluder.radius;
+	vec3 const to_occluder = view.occluder.center - view.eye;
+	float const D = norm(to_occluder);
+	vec3 const v = center - view.eye;
+	float const d = norm(v);
+	if(R<0 || D<=R || d<=radius)
+		return false;
+	// beyond the plane of the horizon circle, seen from the eye...
+	vec3 const axis = to_occluder/D;
+	float const along = dot(v, axis);
+	if(along - radius < (D*D - R*R)/D)
+		return false;
+	// ...and inside the cone tangent to the occluder
+	float const angle = std::acos(std::max(-1.0f, std::min(1.0f, along/d)));
+	return angle + std::asin(radius/d) <= std::asin(R/D);
+}
+
+// ****************************************** //
+// Objects of the scene
+// ****************************************** //
+
+size_t scene_culling::add(affine_rts const& transform, bool moving)
+{
+	object o;
+	o.transform = &transform;
+	o.moving = moving;
+	objects.push_back(o);
+	dirty = dirty || !moving;
+	return objects.size()-1;
+}
+
+void scene_culling::set_bounds(size_t index, bounding_sphere const& bounds)
+{
+	objects[index].local = bounds;
+	dirty = dirty || !objects[index].moving;
+}
+
+bounding_sphere scene_culling::place(bounding_sphere const& local, affine_rts const& transform)
+{
+	if(local.radius<0)
+		return local;
+	mat4 const m = transform.matrix();
+	bounding_sphere world;
+	for(int i=0; i<3; ++i)
+		world.center[i] = m(i,0)*local.center.x + m(i,1)*local.center.y + m(i,2)*local.center.z + m(i,3);
+	world.radius = local.radius*transform.scale;
+	return world;
+}
+
+void scene_culling::build()
+{
+	leaf_objects.clear();
+	for(size_t k=0; k<objects.size(); ++k){
+		object& o = objects[k];
+		if(o.moving)
+			continue;
+		o.world = place(o.local, *o.transform);
+		if(o.world.radius>=0)
+			leaf_objects.push_back(k);
+	}
+	nodes.clear();
+	if(!leaf_objects.empty())
+		build_node(0, leaf_objects.size());
+	dirty = false;
+}
+
+// Top-down: split at the median of the centers along the longest side of their box
+int scene_culling::build_node(size_t first, size_t count)
+{
+	node n;
+	n.first = first;
+	n.count = count;
+	vec3 center_low, center_high;
+	for(size_t k=first; k<first+count; ++k){
+		bounding_sphere const& s = objects[leaf_objects[k]].world;
+		for(int i=0; i<3; ++i){
+			float const low = s.center[i]-s.radius, high = s.center[i]+s.radius;
+			n.low[i] = k==first ? low : std::min(n.low[i], low);
+			n.high[i] = k==first ? high : std::max(n.high[i], high);
+			center_low[i] = k==first ? s.center[i] : std::min(center_low[i], s.center[i]);
+			center_high[i] = k==first ? s.center[i] : std::max(center_high[i], s.center[i]);
+		}
+	}
+	int const index = int(nodes.size());
+	nodes.push_back(n);
+	if(count<=2)
+		return index;
+
+	int axis = 0;
+	for(int i=1; i<3; ++i)
+		if(center_high[i]-center_low[i] > center_high[axis]-center_low[axis])
+			axis = i;
+	size_t const half = count/2;
+	std::nth_element(leaf_objects.begin()+first, leaf_objects.begin()+first+half, leaf_objects.begin()+first+count,
+		[&](size_t a, size_t b){ return objects[a].world.center[axis] < objects[b].world.center[axis]; });
+	int const left = build_node(first, half);
+	int const right = build_node(first+half, count-half);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+void scene_culling::cull_object(object& o, cull_view const& view, bool test_frustum)
+{
+	bounding_sphere const s = o.moving ? place(o.local, *o.transform) : o.world;
+	o.visible = false;
+	if(s.radius<0)
+		o.visible = true;
+	else if(test_frustum && outside_frustum(view.planes, s.center, s.radius))
+		stats.culled_frustum++;
+	else if(too_small(view, s.center, s.radius))
+		stats.culled_small++;
+	else if(occluded(view, s.center, s.radius))
+		stats.culled_occluded++;
+	else
+		o.visible = true;
+	stats.drawn += o.visible ? 1 : 0;
+}
+
+// inside: the box of the parent is inside the frustum, so is this one
+void scene_culling::cull_node(int index, cull_view const& view, bool inside)
+{
+	node const& n = nodes[index];
+	stats.nodes_tested++;
+	vec3 const center = 0.5f*(n.low + n.high);
+	vec3 const half = 0.5f*(n.high - n.low);
+	float const radius = norm(half);
+
+	unsigned int* culled = nullptr;
+	if(!inside){
+		inside = true;
+		for(int k=0; k<6 && culled==nullptr; ++k){
+			vec3 const& p = view.planes.normal[k];
+			float const extent = std::abs(p.x)*half.x + std::abs(p.y)*half.y + std::abs(p.z)*half.z;
+			float const s = dot(p, center) + view.planes.offset[k];
+			if(s < -extent)
+				culled = &stats.culled_frustum;
+			inside = inside && s >= extent;
+		}
+	}
+	if(culled==nullptr && too_small(view, center, radius))
+		culled = &stats.culled_small;
+	if(culled==nullptr && occluded(view, center, radius))
+		culled = &stats.culled_occluded;
+	if(culled!=nullptr){
+		// the whole subtree, without looking at its nodes
+		for(size_t k=n.first; k<n.first+n.count; ++k)
+			objects[leaf_objects[k]].visible = false;
+		*culled += unsigned(n.count);
+		return;
+	}
+
+	if(n.left<0){
+		for(size_t k=n.first; k<n.first+n.count; ++k)
+			cull_object(objects[leaf_objects[k]], view, !inside);
+		return;
+	}
+	cull_node(n.left, view, inside);
+	cull_node(n.right, view, inside);
+}
+
+void scene_culling::cull(cull_view const& view_arg)
+{
+	if(dirty)
+		build();
+	cull_view view = view_arg;
+	if(!view.frustum_culling){
+		// planes that never reject
+		for(int k=0; k<6; ++k){
+			view.planes.normal[k] = {0,0,0};
+			view.planes.offset[k] = 1;
+		}
+	}
+
+	stats = cull_statistics();
+	stats.objects = unsigned(objects.size());
+	for(object& o : objects)
+		if(o.moving || o.local.radius<0)
+			cull_object(o, view, true);
+	if(!nodes.empty())
+		cull_node(0, view, false);
+}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/**
+Visibility of the objects of the scene, before they are submitted to the render queue.
+Every object has a bounding sphere in the coordinates of its mesh, placed by its transform. An
+object is culled when its sphere is
+ - outside the view frustum,
+ - smaller on screen than cull_view::min_pixels (diameter), with the same projection_scale as the
+   levels of detail (render/lod.hpp),
+ - hidden behind the planet: inside the cone of the planet seen from the eye and beyond its horizon.
+The static objects (the pad) are kept in a bounding volume hierarchy, rebuilt when their bounds
+change (e.g. once their mesh is loaded): a subtree outside the frustum, too small or hidden is
+rejected with one test, and a subtree inside the frustum is not tested against the frustum again.
+The moving objects (rocket stages, billboard) are tested one by one.
+*/
+
+#include "vcl/vcl.hpp"
+
+#include <vector>
+
+namespace render {
+
+struct bounding_sphere
+{
+	vcl::vec3 center;
+	float radius = -1; // < 0: unknown (mesh not loaded), never culled
+};
+
+// Planes of the view frustum, normals towards the inside
+struct frustum
+{
+	vcl::vec3 normal[6];
+	float offset[6];    // dot(normal,p) + offset >= 0 inside
+
+	// From the camera (view matrix, eye) and the perspective projection
+	void set(vcl::vec3 const& eye, vcl::mat4 const& view, float fov, float aspect, float near_plane, float far_plane);
+};
+
+struct cull_view
+{
+	vcl::vec3 eye;
+	frustum planes;
+	bool frustum_culling = true;
+	float projection_scale = 1000.0f; // viewport_height / (2*tan(fov/2)), as lod_view
+	float min_pixels = 1.0f;          // smaller projected diameters are culled (0: none)
+	bounding_sphere occluder;         // planet hiding what is behind its horizon (radius < 0: none)
+};
+
+struct cull_statistics
+{
+	unsigned int objects = 0;
+	unsigned int drawn = 0;
+	unsigned int culled_frustum = 0;
+	unsigned int culled_small = 0;
+	unsigned int culled_occluded = 0;
+	unsigned int nodes_tested = 0;  // of the hierarchy
+};
+
+// Tests of one sphere, in the scene coordinates
+bool outside_frustum(frustum const& planes, vcl::vec3 const& center, float radius);
+bool too_small(cull_view const& view, vcl::vec3 const& center, float radius);
+bool occluded(cull_view const& view, vcl::vec3 const& center, float radius);
+
+class scene_culling
+{
+public:
+	// Object placed by transform (kept by address: it must outlive the culling), static or moving.
+	// Returns its index for set_bounds and visible
+	size_t add(vcl::affine_rts const& transform, bool moving);
+	// Bounding sphere in the coordinates of the mesh
+	void set_bounds(size_t object, bounding_sphere const& bounds);
+
+	// Visibility of all the objects for this view, with their transforms of this frame
+	void cull(cull_view const& view);
+	bool visible(size_t object) const { return objects[object].visible; }
+
+	cull_statistics const& statistics() const { return stats; }
+
+private:
+	struct object
+	{
+		vcl::affine_rts const* transform;
+		bool moving;
+		bounding_sphere local;
+		bounding_sphere world;   // static objects: computed when the hierarchy is built
+		bool visible = true;
+	};
+
+	struct node
+	{
+		vcl::vec3 low, high;     // box of the spheres of the subtree
+		int left = -1, right = -1;
+		size_t first = 0, count = 0; // leaves: range of leaf_objects
+	};
+
+	static bounding_sphere place(bounding_sphere const& local, vcl::affine_rts const& transform);
+	void build();
+	int build_node(size_t first, size_t count);
+	void cull_node(int index, cull_view const& view, bool inside);
+	void cull_object(object& o, cull_view const& view, bool test_frustum);
+
+	std::vector<object> objects;
+	std::vector<node> nodes;
+	std::vector<size_t> leaf_objects;  // static objects with bounds, in the order of the leaves
+	bool dirty = true;
+	cull_statistics stats;
+};
+
+}
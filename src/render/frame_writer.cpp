@@ -0,0 +1,292 @@
+#include "render/frame_writer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace render {
+
+// ****************************************** //
+// PNG encoding
+// ****************************************** //
+
+// Slicing-by-8: tables[k] advances the CRC of a byte followed by k zero bytes
+static uint32_t const (&crc_tables())[8][256]
+{
+	static uint32_t tables[8][256];
+	static bool const initialized = []{
+		for(uint32_t n=0; n<256; ++n){
+			uint32_t c = n;
+			for(int k=0; k<8; ++k)
+				c = (c&1) ? 0xEDB88320u^(c>>1) : c>>1;
+			tables[0][n] = c;
+		}
+		for(uint32_t n=0; n<256; ++n)
+			for(int k=1; k<8; ++k)
+				tables[k][n] = tables[0][tables[k-1][n]&0xFF]^(tables[k-1][n]>>8);
+		return true;
+	}();
+	(void)initialized;
+	return tables;
+}
+
+static uint32_t crc_update(uint32_t crc, uint8_t const* data, size_t size)
+{
+	uint32_t const (&t)[8][256] = crc_tables();
+	size_t k = 0;
+	for(; k+8<=size; k+=8){
+		uint32_t const low = crc ^ (uint32_t(data[k]) | uint32_t(data[k+1])<<8 | uint32_t(data[k+2])<<16 | uint32_t(data[k+3])<<24);
+		uint32_t const high = uint32_t(data[k+4]) | uint32_t(data[k+5])<<8 | uint32_t(data[k+6])<<16 | uint32_t(data[k+7])<<24;
+		crc = t[7][low&0xFF]^t[6][(low>>8)&0xFF]^t[5][(low>>16)&0xFF]^t[4][low>>24]
+			^ t[3][high&0xFF]^t[2][(high>>8)&0xFF]^t[1][(high>>16)&0xFF]^t[0][high>>24];
+	}
+	for(; k<size; ++k)
+		crc = t[0][(crc^data[k])&0xFF]^(crc>>8);
+	return crc;
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t v)
+{
+	out.push_back(uint8_t(v>>24));
+	out.push_back(uint8_t(v>>16));
+	out.push_back(uint8_t(v>>8));
+	out.push_back(uint8_t(v));
+}
+
+static void write_chunk(std::ostream& out, char const* type, std::vector<uint8_t> const& data)
+{
+	std::vector<uint8_t> header;
+	put_u32(header, uint32_t(data.size()));
+	header.insert(header.end(), type, type+4);
+	uint32_t const crc = crc_update(crc_update(0xFFFFFFFFu, header.data()+4, 4), data.data(), data.size())^0xFFFFFFFFu;
+	std::vector<uint8_t> footer;
+	put_u32(footer, crc);
+	out.write(reinterpret_cast<char const*>(header.data()), std::streamsize(header.size()));
+	out.write(reinterpret_cast<char const*>(data.data()), std::streamsize(data.size()));
+	out.write(reinterpret_cast<char const*>(footer.data()), std::streamsize(footer.size()));
+}
+
+bool write_png(std::string const& filename, uint32_t width, uint32_t height, uint8_t const* pixels_bottom_up)
+{
+	size_t const row_bytes = size_t(width)*4;
+
+	// scanlines (filter 0) in zlib stored blocks of at most 65535 bytes
+	size_t const raw_size = (row_bytes+1)*height;
+	std::vector<uint8_t> idat;
+	idat.reserve(raw_size + raw_size/65535*5 + 16);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	uint32_t adler_a = 1, adler_b = 0;
+	size_t block_left = 0;
+	size_t remaining = raw_size;
+	auto put = [&](uint8_t const* data, size_t size){
+		while(size>0){
+			if(block_left==0){
+				block_left = std::min<size_t>(remaining, 65535);
+				remaining -= block_left;
+				idat.push_back(remaining==0 ? 1 : 0);
+				idat.push_back(uint8_t(block_left));
+				idat.push_back(uint8_t(block_left>>8));
+				idat.push_back(uint8_t(~block_left));
+				idat.push_back(uint8_t(~block_left>>8));
+			}
+			size_t const n = std::min(size, block_left);
+			idat.insert(idat.end(), data, data+n);
+			// modulo every 5552 bytes, the largest run that cannot overflow 32 bits. The bytes are
+			// summed 16 at a time (b gains 16*a plus the bytes weighted by their distance to the end),
+			// which the compiler vectorizes, instead of the serial a += byte, b += a
+			for(size_t k=0; k<n; ){
+				size_t const end = std::min(n, k+5552);
+				for(; k+16<=end; k+=16){
+					uint32_t sum = 0, weighted = 0;
+					for(uint32_t i=0; i<16; ++i){
+						sum += data[k+i];
+						weighted += (16-i)*data[k+i];
+					}
+					adler_b += 16*adler_a + weighted;
+					adler_a += sum;
+				}
+				for(; k<end; ++k){
+					adler_a += data[k];
+					adler_b += adler_a;
+				}
+				adler_a %= 65521;
+				adler_b %= 65521;
+			}
+			data += n;
+			size -= n;
+			block_left -= n;
+		}
+	};
+	uint8_t const filter = 0;
+	for(uint32_t y=0; y<height; ++y){
+		put(&filter, 1);
+		put(pixels_bottom_up + (height-1-y)*row_bytes, row_bytes);
+	}
+	put_u32(idat, (adler_b<<16)|adler_a);
+
+	std::vector<uint8_t> header;
+	put_u32(header, width);
+	put_u32(header, height);
+	uint8_t const format[] = {8, 6, 0, 0, 0}; // 8 bits, RGBA, deflate, no filter choice, no interlacing
+	header.insert(header.end(), format, format+5);
+
+	std::ofstream out(filename, std::ios::binary);
+	char const signature[] = {char(0x89), 'P', 'N', 'G', '\r', '\n', char(0x1A), '\n'};
+	out.write(signature, sizeof(signature));
+	write_chunk(out, "IHDR", header);
+	write_chunk(out, "IDAT", idat);
+	write_chunk(out, "IEND", std::vector<uint8_t>());
+	return bool(out);
+}
+
+// ****************************************** //
+// Writer threads
+// ****************************************** //
+
+frame_writer::~frame_writer()
+{
+	finish();
+}
+
+bool frame_writer::start(std::string const& directory_arg, frame_format format_arg, unsigned int thread_count)
+{
+	directory = directory_arg;
+	format = format_arg;
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	if(format==frame_format::raw){
+		// created once, then each thread writes at the offset of its frames
+		std::ofstream out(filename(0), std::ios::binary | std::ios::trunc);
+		if(!out)
+			return false;
+	}
+
+	if(thread_count==0){
+		unsigned int const hardware = std::thread::hardware_concurrency();
+		thread_count = std::max(1u, hardware>1 ? hardware-1 : 1u);
+	}
+	queue_limit = 2*thread_count;
+	stopping = false;
+	error = false;
+	stats = frame_writer_statistics();
+	stats.threads = thread_count;
+	for(unsigned int k=0; k<thread_count; ++k)
+		workers.emplace_back(&frame_writer::worker_loop, this);
+	return true;
+}
+
+void frame_writer::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake_up.notify_all();
+	for(std::thread& t : workers)
+		t.join();
+	workers.clear();
+}
+
+std::vector<uint8_t> frame_writer::acquire_buffer(size_t size)
+{
+	std::vector<uint8_t> buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!free_buffers.empty()){
+			buffer = std::move(free_buffers.back());
+			free_buffers.pop_back();
+		}
+	}
+	buffer.resize(size);
+	return buffer;
+}
+
+void frame_writer::submit(frame_image image)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if(queue.size()>=queue_limit){
+		auto const start = std::chrono::steady_clock::now();
+		space.wait(lock, [this]{ return queue.size()<queue_limit; });
+		stats.wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	}
+	queue.push_back(std::move(image));
+	lock.unlock();
+	wake_up.notify_one();
+}
+
+void frame_writer::worker_loop()
+{
+	std::vector<uint8_t> flipped;
+	while(true){
+		frame_image image;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_up.wait(lock, [this]{ return stopping || !queue.empty(); });
+			if(queue.empty())
+				return; // stopping, and everything is written
+			image = std::move(queue.front());
+			queue.pop_front();
+		}
+		space.notify_one();
+
+		auto const start = std::chrono::steady_clock::now();
+		bool const ok = write(image, flipped);
+		double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		error = error || !ok;
+		stats.frames++;
+		stats.bytes += image.pixels.size();
+		stats.encode_seconds += seconds;
+		free_buffers.push_back(std::move(image.pixels));
+	}
+}
+
+bool frame_writer::write(frame_image const& image, std::vector<uint8_t>& flipped)
+{
+	if(format==frame_format::png)
+		return write_png(filename(image.index), image.width, image.height, image.pixels.data());
+
+	size_t const row_bytes = size_t(image.width)*4;
+	flipped.resize(image.pixels.size());
+	for(uint32_t y=0; y<image.height; ++y)
+		std::copy_n(image.pixels.data() + (image.height-1-y)*row_bytes, row_bytes, flipped.data() + y*row_bytes);
+	std::fstream out(filename(image.index), std::ios::binary | std::ios::in | std::ios::out);
+	out.seekp(std::streamoff(image.index*flipped.size()));
+	out.write(reinterpret_cast<char const*>(flipped.data()), std::streamsize(flipped.size()));
+	return bool(out);
+}
+
+bool frame_writer::failed() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return error;
+}
+
+frame_writer_statistics frame_writer::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+std::string frame_writer::filename(uint64_t index) const
+{
+	if(format==frame_format::raw)
+		return directory + "/frames.rgba";
+	char name[32];
+	std::snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(index));
+	return directory + name;
+}
+
+}
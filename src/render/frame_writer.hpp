@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+Pool of threads writing the frames of an offscreen rendering (see render/offscreen.hpp).
+The frames arrive as read by glReadPixels: RGBA, rows from the bottom of the image. The threads
+flip them and write either
+ - one PNG file per frame (frame_000000.png, ...), with stored (uncompressed) deflate blocks:
+   the frames are meant to be encoded to a video afterwards, file size is traded for speed,
+ - or all the frames one after the other in frames.rgba, each thread writing at the offset of
+   its frame, e.g. for ffmpeg -f rawvideo -pix_fmt rgba -s WxH -r FPS -i frames.rgba.
+submit() blocks while too many frames wait, so that a slow disk bounds the memory used.
+*/
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace render {
+
+enum class frame_format { png, raw };
+
+struct frame_image
+{
+	uint64_t index = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels; // RGBA, bottom-up rows
+};
+
+struct frame_writer_statistics
+{
+	unsigned int frames = 0;
+	uint64_t bytes = 0;
+	double encode_seconds = 0; // summed over the threads
+	double wait_seconds = 0;   // submit() blocked on a full queue
+	unsigned int threads = 0;
+};
+
+// Write an RGBA image, given with bottom-up rows, as a PNG file
+bool write_png(std::string const& filename, uint32_t width, uint32_t height, uint8_t const* pixels_bottom_up);
+
+class frame_writer
+{
+public:
+	~frame_writer();
+
+	// Create the directory if needed and start the threads (0: hardware threads - 1)
+	bool start(std::string const& directory, frame_format format, unsigned int thread_count = 0);
+	// Write the remaining frames and stop the threads
+	void finish();
+
+	// Buffer for the next frame, recycled from the frames already written
+	std::vector<uint8_t> acquire_buffer(size_t size);
+	void submit(frame_image image);
+
+	bool failed() const;
+	frame_writer_statistics statistics() const;
+	std::string filename(uint64_t index) const;
+
+private:
+	void worker_loop();
+	bool write(frame_image const& image, std::vector<uint8_t>& flipped);
+
+	std::string directory;
+	frame_format format = frame_format::png;
+	size_t queue_limit = 0;
+
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable wake_up;   // workers: a frame arrived, or finish()
+	std::condition_variable space;     // submit(): a frame was taken
+	std::deque<frame_image> queue;
+	std::vector<std::vector<uint8_t>> free_buffers;
+	bool stopping = false;
+	bool error = false;
+	frame_writer_statistics stats;
+};
+
+}
@@ -0,0 +1,72 @@
+#include "render/gpu_timer.hpp"
+
+namespace render {
+
+void gpu_timer::initialize()
+{
+	for(query_set& s : sets){
+		glGenQueries(static_cast<GLsizei>(max_queries), s.queries);
+		s.count = 0;
+	}
+	current = 0;
+	open = false;
+	initialized = true;
+}
+
+void gpu_timer::clear()
+{
+	if(!initialized)
+		return;
+	for(query_set& s : sets)
+		glDeleteQueries(static_cast<GLsizei>(max_queries), s.queries);
+	initialized = false;
+}
+
+bool gpu_timer::begin(char const* name)
+{
+	query_set& s = sets[current];
+	if(!initialized)
+		return false;
+	if(open || s.count==max_queries){ // nested scope or too many scopes this frame
+		dropped_count++;
+		return false;
+	}
+	s.names[s.count] = name;
+	glBeginQuery(GL_TIME_ELAPSED, s.queries[s.count]);
+	open = true;
+	return true;
+}
+
+void gpu_timer::end()
+{
+	if(!open)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	sets[current].count++;
+	open = false;
+}
+
+void gpu_timer::frame_end(uint64_t frame)
+{
+	if(!initialized)
+		return;
+	sets[current].frame = frame;
+
+	// queries of the previous frame: they had a whole frame to complete
+	query_set& previous = sets[1-current];
+	for(size_t k=0; k<previous.count; ++k){
+		GLint available = 0;
+		glGetQueryObjectiv(previous.queries[k], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available){
+			dropped_count++;
+			continue;
+		}
+		GLuint64 duration = 0;
+		glGetQueryObjectui64v(previous.queries[k], GL_QUERY_RESULT, &duration);
+		profiling::add_gpu_event(previous.frame, previous.names[k], duration);
+	}
+	previous.count = 0;
+	current = 1-current;
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/**
+GPU durations of the profiled draw groups (GL_TIME_ELAPSED queries).
+Reading a query result right after the frame would stall the CPU until the GPU catches up: the
+queries are double buffered instead. The queries issued during frame N are read at the end of
+frame N+1, only if the driver reports them as available; otherwise they are dropped (and counted)
+rather than waited for. Resolved durations are attached to their frame in the profiler history.
+Time elapsed queries cannot be nested: a gpu scope opened inside another one is ignored.
+*/
+
+#include "profiling/profiler.hpp"
+#include "vcl/vcl.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace render {
+
+class gpu_timer
+{
+public:
+	static size_t const max_queries = 32; // per frame
+
+	// Create the query objects (needs an OpenGL context)
+	void initialize();
+	void clear();
+
+	// Start measuring the following GL commands; false (and nothing to end) if a measure is already open
+	bool begin(char const* name);
+	void end();
+
+	// Resolve the queries of the previous frame and swap the sets. frame is the profiler index of the ending frame.
+	void frame_end(uint64_t frame);
+
+	uint64_t dropped() const { return dropped_count; } // results not available in time, or above max_queries
+
+private:
+	struct query_set
+	{
+		GLuint queries[max_queries] = {};
+		char const* names[max_queries] = {};
+		size_t count = 0;
+		uint64_t frame = 0;
+	};
+
+	query_set sets[2];
+	int current = 0;
+	bool open = false;
+	bool initialized = false;
+	uint64_t dropped_count = 0;
+};
+
+class gpu_scope
+{
+public:
+	gpu_scope(gpu_timer& timer_arg, char const* name) : timer(timer_arg), active(profiling::enabled() && timer.begin(name)) {}
+	~gpu_scope() { if(active) timer.end(); }
+
+	gpu_scope(gpu_scope const&) = delete;
+	gpu_scope& operator=(gpu_scope const&) = delete;
+
+private:
+	gpu_timer& timer;
+	bool active;
+};
+
+}
+
+#ifdef ROCKET_PROFILER
+#define PROFILE_GPU_SCOPE(timer, name) render::gpu_scope PROFILE_CONCATENATE(profile_gpu_scope_, __LINE__)(timer, name)
+#else
+#define PROFILE_GPU_SCOPE(timer, name)
+#endif
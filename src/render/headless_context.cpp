@@ -0,0 +1,146 @@
+#include "render/headless_context.hpp"
+
+// glad first: it replaces the OpenGL header included by osmesa.h
+#include "vcl/vcl.hpp"
+
+#ifdef ROCKET_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef ROCKET_HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+namespace render {
+
+bool headless_supported(headless_api api)
+{
+	switch(api){
+#ifdef ROCKET_HEADLESS_EGL
+	case headless_api::egl: return true;
+#endif
+#ifdef ROCKET_HEADLESS_OSMESA
+	case headless_api::osmesa: return true;
+#endif
+	default: return false;
+	}
+}
+
+char const* headless_api_name(headless_api api)
+{
+	return api==headless_api::egl ? "EGL" : "OSMesa";
+}
+
+headless_context::~headless_context()
+{
+	destroy();
+}
+
+#ifdef ROCKET_HEADLESS_EGL
+static bool has_extension(char const* extensions, char const* name)
+{
+	return extensions!=nullptr && std::strstr(extensions, name)!=nullptr;
+}
+#endif
+
+bool headless_context::create(headless_api api_arg)
+{
+	destroy();
+	api = api_arg;
+	if(!headless_supported(api)){
+		std::cerr << "Built without " << headless_api_name(api) << " support" << std::endl;
+		return false;
+	}
+
+#ifdef ROCKET_HEADLESS_EGL
+	if(api==headless_api::egl){
+		EGLDisplay d = EGL_NO_DISPLAY;
+		// surfaceless platform: no X11 or Wayland server is needed
+		char const* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC const get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if(get_platform_display!=nullptr && has_extension(client_extensions, "EGL_MESA_platform_surfaceless"))
+			d = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if(d==EGL_NO_DISPLAY)
+			d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if(d==EGL_NO_DISPLAY || !eglInitialize(d, nullptr, nullptr)){
+			std::cerr << "No EGL display" << std::endl;
+			return false;
+		}
+		display = d;
+
+		EGLint const config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_NONE};
+		EGLConfig config;
+		EGLint config_count = 0;
+		EGLint const context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+		if(!eglChooseConfig(d, config_attributes, &config, 1, &config_count) || config_count==0
+			|| !eglBindAPI(EGL_OPENGL_API)
+			|| (context = eglCreateContext(d, config, EGL_NO_CONTEXT, context_attributes))==EGL_NO_CONTEXT){
+			std::cerr << "Cannot create an OpenGL 3.3 core context with EGL" << std::endl;
+			destroy();
+			return false;
+		}
+
+		// the scene is drawn in a framebuffer object: a surface is only created when the driver requires one
+		EGLSurface s = EGL_NO_SURFACE;
+		if(!has_extension(eglQueryString(d, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")){
+			EGLint const surface_attributes[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+			s = eglCreatePbufferSurface(d, config, surface_attributes);
+			surface = s;
+		}
+		if(!eglMakeCurrent(d, s, s, context) || !gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))){
+			std::cerr << "Cannot use the EGL context" << std::endl;
+			destroy();
+			return false;
+		}
+		return true;
+	}
+#endif
+
+#ifdef ROCKET_HEADLESS_OSMESA
+	if(api==headless_api::osmesa){
+		int const attributes[] = {OSMESA_FORMAT, OSMESA_RGBA, OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE, OSMESA_CONTEXT_MAJOR_VERSION, 3, OSMESA_CONTEXT_MINOR_VERSION, 3, 0};
+		OSMesaContext const c = OSMesaCreateContextAttribs(attributes, nullptr);
+		if(c==nullptr){
+			std::cerr << "Cannot create an OpenGL 3.3 core context with OSMesa" << std::endl;
+			return false;
+		}
+		context = c;
+		buffer.resize(16*16*4);
+		if(!OSMesaMakeCurrent(c, buffer.data(), GL_UNSIGNED_BYTE, 16, 16) || !gladLoadGLLoader(reinterpret_cast<GLADloadproc>(OSMesaGetProcAddress))){
+			std::cerr << "Cannot use the OSMesa context" << std::endl;
+			destroy();
+			return false;
+		}
+		return true;
+	}
+#endif
+	return false;
+}
+
+void headless_context::destroy()
+{
+#ifdef ROCKET_HEADLESS_EGL
+	if(api==headless_api::egl && display!=nullptr){
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if(surface!=nullptr)
+			eglDestroySurface(display, surface);
+		if(context!=nullptr)
+			eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+#endif
+#ifdef ROCKET_HEADLESS_OSMESA
+	if(api==headless_api::osmesa && context!=nullptr)
+		OSMesaDestroyContext(static_cast<OSMesaContext>(context));
+#endif
+	display = context = surface = nullptr;
+	buffer.clear();
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+OpenGL context without window nor display server, for the offscreen rendering (--record ... --headless):
+ - EGL (built with ROCKET_HEADLESS_EGL): surfaceless platform of Mesa when available, e.g.
+   llvmpipe on a machine without GPU, otherwise the default display of the EGL driver,
+ - OSMesa (built with ROCKET_HEADLESS_OSMESA): software rendering of Mesa in memory.
+The context is OpenGL 3.3 core, the scene being drawn in a framebuffer object. The OpenGL
+functions are loaded by glad from the library of the context instead of GLFW.
+*/
+
+#include <string>
+#include <vector>
+
+namespace render {
+
+enum class headless_api { egl, osmesa };
+
+// Whether the support of the API was built (see CMakeLists.txt)
+bool headless_supported(headless_api api);
+char const* headless_api_name(headless_api api);
+
+class headless_context
+{
+public:
+	~headless_context();
+
+	// Create the context, make it current and load the OpenGL functions
+	bool create(headless_api api);
+	void destroy();
+
+private:
+	headless_api api = headless_api::egl;
+	void* display = nullptr;  // EGLDisplay
+	void* context = nullptr;  // EGLContext or OSMesaContext
+	void* surface = nullptr;  // EGLSurface, when the driver has no surfaceless context
+	std::vector<unsigned char> buffer; // OSMesa: color buffer of the (unused) default framebuffer
+};
+
+}
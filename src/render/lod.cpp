@@ -0,0 +1,467 @@
+#include "render/lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vcl;
+
+namespace render {
+
+void lod_view::set_projection(float fov, float viewport_height)
+{
+	projection_scale = viewport_height/(2*std::tan(fov/2));
+}
+
+float screen_space_error(float geometric_error, float distance, lod_view const& view)
+{
+	return geometric_error*view.projection_scale/std::max(distance, 1e-3f);
+}
+
+float tessellation_error(float radius, int segments)
+{
+	return radius*(1-std::cos(pi/segments));
+}
+
+// ****************************************** //
+// Mesh chain of a primitive
+// ****************************************** //
+
+void lod_chain::add_level(mesh const& shape, float geometric_error)
+{
+	assets::cached_mesh level;
+	assets::mesh_bounding_sphere(shape, level.bound_center, level.bound_radius);
+	level.drawable = mesh_drawable(shape);
+	add_level(level, geometric_error);
+}
+
+void lod_chain::add_level(assets::cached_mesh const& shape, float geometric_error)
+{
+	reserve_level(geometric_error);
+	set_level(levels.size()-1, shape);
+}
+
+void lod_chain::reserve_level(float geometric_error)
+{
+	level_data level;
+	level.geometric_error = geometric_error;
+	levels.push_back(level);
+}
+
+void lod_chain::set_level(size_t k, assets::cached_mesh const& shape)
+{
+	if(k<bounds_level){
+		// bounding sphere of the finest level
+		center = shape.bound_center;
+		radius = shape.bound_radius;
+		bounds_level = k;
+	}
+	levels[k].drawable = shape.drawable;
+}
+
+bounding_sphere lod_chain::bounds() const
+{
+	bounding_sphere sphere;
+	sphere.center = center;
+	sphere.radius = bounds_level==size_t(-1) ? -1.0f : radius;
+	return sphere;
+}
+
+mesh_drawable const& lod_chain::select(vec3 const& eye, lod_view const& view)
+{
+	float const distance = std::max(norm(eye - (center + transform.translate)) - radius, 0.0f);
+
+	if(current>0 && screen_space_error(levels[current].geometric_error, distance, view) > view.pixel_error)
+		current--; // refine
+	else if(current+1<levels.size() && screen_space_error(levels[current+1].geometric_error, distance, view) < 0.5f*view.pixel_error)
+		current++; // coarsen
+
+	return level_drawable(current);
+}
+
+size_t lod_chain::nearest_loaded(size_t level) const
+{
+	// preferably the finer one
+	size_t drawn = level;
+	for(size_t d=1; levels[drawn].drawable.vao==0 && d<levels.size(); ++d){
+		if(level>=d && levels[level-d].drawable.vao!=0)
+			drawn = level-d;
+		else if(level+d<levels.size() && levels[level+d].drawable.vao!=0)
+			drawn = level+d;
+	}
+	return drawn;
+}
+
+size_t lod_chain::level_at(float distance, lod_view const& view) const
+{
+	// coarsest level whose error is not visible
+	size_t level = 0;
+	while(level+1<levels.size() && screen_space_error(levels[level+1].geometric_error, distance, view) <= view.pixel_error)
+		++level;
+	return level;
+}
+
+mesh_drawable const& lod_chain::level_drawable(size_t level)
+{
+	mesh_drawable& drawable = levels[nearest_loaded(level)].drawable;
+	drawable.transform = transform;
+	drawable.shading = shading;
+	return drawable;
+}
+
+// Resolutions of the chains, divided by 2.5 from one level to the next
+static std::vector<int> chain_resolutions(int finest)
+{
+	std::vector<int> resolutions;
+	for(int n=finest; n>=6; n=std::max(6, int(n/2.5f))){
+		resolutions.push_back(n);
+		if(n==6)
+			break;
+	}
+	return resolutions;
+}
+
+lod_chain lod_chain_cylinder(float radius, vec3 const& p1, vec3 const& p2, int finest_resolution, bool closed, assets::asset_cache* cache)
+{
+	lod_chain chain;
+	std::vector<int> const resolutions = chain_resolutions(finest_resolution);
+	for(size_t k=0; k<resolutions.size(); ++k){
+		int const n = resolutions[k];
+		// the finest level keeps the original subdivision along the axis, the others only need the silhouette
+		int const n_axis = k==0 ? n : 2;
+		if(cache!=nullptr)
+			chain.add_level(cache->mesh("mesh_primitive_cylinder", mesh_primitive_cylinder, radius, p1, p2, n, n_axis, closed), tessellation_error(radius, n));
+		else
+			chain.add_level(mesh_primitive_cylinder(radius, p1, p2, n, n_axis, closed), tessellation_error(radius, n));
+	}
+	return chain;
+}
+
+lod_chain lod_chain_cone(float radius, float height, vec3 const& p0, vec3 const& n, bool closed, int finest_resolution, assets::asset_cache* cache)
+{
+	lod_chain chain;
+	std::vector<int> const resolutions = chain_resolutions(finest_resolution);
+	for(size_t k=0; k<resolutions.size(); ++k){
+		int const r = resolutions[k];
+		int const n_axis = k==0 ? r : 2;
+		if(cache!=nullptr)
+			chain.add_level(cache->mesh("mesh_primitive_cone", mesh_primitive_cone, radius, height, p0, n, closed, r, n_axis), tessellation_error(radius, r));
+		else
+			chain.add_level(mesh_primitive_cone(radius, height, p0, n, closed, r, n_axis), tessellation_error(radius, r));
+	}
+	return chain;
+}
+
+void load_lod_chain_cylinder(lod_chain& chain, assets::async_loader& loader, float radius, vec3 const& p1, vec3 const& p2, int finest_resolution, bool closed)
+{
+	std::vector<int> const resolutions = chain_resolutions(finest_resolution);
+	for(size_t k=0; k<resolutions.size(); ++k){
+		int const n = resolutions[k];
+		int const n_axis = k==0 ? n : 2;
+		size_t const level = chain.level_count();
+		chain.reserve_level(tessellation_error(radius, n));
+		loader.load_mesh([&chain, level](assets::cached_mesh const& m){ chain.set_level(level, m); },
+			"mesh_primitive_cylinder", mesh_primitive_cylinder, radius, p1, p2, n, n_axis, closed);
+	}
+}
+
+void load_lod_chain_cone(lod_chain& chain, assets::async_loader& loader, float radius, float height, vec3 const& p0, vec3 const& n, bool closed, int finest_resolution)
+{
+	std::vector<int> const resolutions = chain_resolutions(finest_resolution);
+	for(size_t k=0; k<resolutions.size(); ++k){
+		int const r = resolutions[k];
+		int const n_axis = k==0 ? r : 2;
+		size_t const level = chain.level_count();
+		chain.reserve_level(tessellation_error(radius, r));
+		loader.load_mesh([&chain, level](assets::cached_mesh const& m){ chain.set_level(level, m); },
+			"mesh_primitive_cone", mesh_primitive_cone, radius, height, p0, n, closed, r, n_axis);
+	}
+}
+
+// ****************************************** //
+// Cube-sphere quadtree of the planet
+// ****************************************** //
+
+// Frame (normal, u axis, v axis) of the cube faces, u x v = normal so that the triangles face outwards
+static vec3 const face_frames[6][3] = {
+	{{ 1,0,0}, { 0, 1,0}, {0,0,1}},
+	{{-1,0,0}, { 0,-1,0}, {0,0,1}},
+	{{0, 1,0}, {-1, 0,0}, {0,0,1}},
+	{{0,-1,0}, { 1, 0,0}, {0,0,1}},
+	{{0,0, 1}, { 1, 0,0}, {0,1,0}},
+	{{0,0,-1}, {-1, 0,0}, {0,1,0}}
+};
+
+static float angle_between(vec3 const& a, vec3 const& b)
+{
+	return std::acos(std::max(-1.0f, std::min(1.0f, dot(a,b))));
+}
+
+vec3 planet_lod::sphere_point(int face, float u, float v) const
+{
+	vec3 const* frame = face_frames[face];
+	return normalize(frame[0] + u*frame[1] + v*frame[2]);
+}
+
+void planet_lod::initialize(float radius_arg, vec3 const& center_arg, planet_lod_settings const& settings_arg)
+{
+	clear();
+	radius = radius_arg;
+	center = center_arg;
+	settings = settings_arg;
+	for(int face=0; face<6; ++face){
+		roots[face] = create_node(face, 0, -1, -1, 2);
+		build_mesh(nodes[roots[face]]);
+	}
+}
+
+void planet_lod::clear()
+{
+	for(node& n : nodes)
+		if(n.has_mesh)
+			n.drawable.clear();
+	nodes.clear();
+	free_nodes.clear();
+	for(int& root : roots)
+		root = -1;
+	stats = planet_lod_statistics();
+}
+
+int planet_lod::create_node(int face, int depth, float u0, float v0, float size)
+{
+	int index;
+	if(!free_nodes.empty()){
+		index = free_nodes.back();
+		free_nodes.pop_back();
+		nodes[index] = node();
+	}
+	else{
+		index = int(nodes.size());
+		nodes.push_back(node());
+	}
+
+	node& n = nodes[index];
+	n.face = face;
+	n.depth = depth;
+	n.u0 = u0;
+	n.v0 = v0;
+	n.size = size;
+
+	vec3 const corners[4] = {sphere_point(face,u0,v0), sphere_point(face,u0+size,v0), sphere_point(face,u0+size,v0+size), sphere_point(face,u0,v0+size)};
+	n.direction = sphere_point(face, u0+size/2, v0+size/2);
+	n.angular_radius = 0;
+	n.bound_center = center + radius*n.direction;
+	n.bound_radius = 0;
+	for(vec3 const& c : corners){
+		n.angular_radius = std::max(n.angular_radius, angle_between(n.direction, c));
+		n.bound_radius = std::max(n.bound_radius, norm(center + radius*c - n.bound_center));
+	}
+
+	// sagitta of one cell of the grid
+	float const side_angle = angle_between(sphere_point(face, u0, v0+size/2), sphere_point(face, u0+size, v0+size/2));
+	n.geometric_error = radius*(1-std::cos(side_angle/(2*settings.grid)));
+	return index;
+}
+
+void planet_lod::build_mesh(node& n)
+{
+	int const N = settings.grid;
+	mesh shape;
+
+	// longitude of the node center, to keep the texture coordinates continuous across the seam
+	float const u_center = std::atan2(n.direction.y, n.direction.x)/(2*pi);
+	auto texture_coordinates = [&](vec3 const& d){
+		// same parametrization as mesh_primitive_sphere: u = longitude/(2pi), v = colatitude/pi
+		float u = u_center;
+		if(std::abs(d.x)>1e-6f || std::abs(d.y)>1e-6f)
+			u = std::atan2(d.y, d.x)/(2*pi);
+		u -= std::round(u - u_center);
+		float const v = std::acos(std::max(-1.0f, std::min(1.0f, d.z)))/pi;
+		return vec2(u, v);
+	};
+
+	for(int j=0; j<=N; ++j){
+		for(int i=0; i<=N; ++i){
+			vec3 const d = sphere_point(n.face, n.u0 + n.size*i/N, n.v0 + n.size*j/N);
+			shape.position.push_back(center + radius*d);
+			shape.normal.push_back(d);
+			shape.uv.push_back(texture_coordinates(d));
+		}
+	}
+	for(int j=0; j<N; ++j){
+		for(int i=0; i<N; ++i){
+			unsigned int const k00 = j*(N+1)+i, k10 = k00+1, k01 = k00+N+1, k11 = k01+1;
+			shape.connectivity.push_back(uint3{k00, k10, k11});
+			shape.connectivity.push_back(uint3{k00, k11, k01});
+		}
+	}
+
+	// skirts hanging below the border hide the cracks with coarser neighbours
+	float const skirt = 0.1f*n.bound_radius;
+	auto add_skirt = [&](unsigned int a, unsigned int b){
+		unsigned int const base = static_cast<unsigned int>(shape.position.size());
+		for(unsigned int k : {a, b}){
+			vec3 const d = shape.normal[k];
+			shape.position.push_back(shape.position[k] - skirt*d);
+			shape.normal.push_back(d);
+			shape.uv.push_back(shape.uv[k]);
+		}
+		shape.connectivity.push_back(uint3{a, base+1, b});
+		shape.connectivity.push_back(uint3{a, base, base+1});
+	};
+	for(int i=0; i<N; ++i){
+		add_skirt(i, i+1);                                  // v = v0
+		add_skirt(N*(N+1)+i+1, N*(N+1)+i);                  // v = v0+size
+		add_skirt((i+1)*(N+1), i*(N+1));                    // u = u0
+		add_skirt(i*(N+1)+N, (i+1)*(N+1)+N);                // u = u0+size
+	}
+
+	shape.fill_empty_field();
+	n.drawable = mesh_drawable(shape);
+	n.has_mesh = true;
+}
+
+void planet_lod::release(int index)
+{
+	node& n = nodes[index];
+	for(int& child : n.children){
+		if(child>=0)
+			release(child);
+		child = -1;
+	}
+	if(n.has_mesh)
+		n.drawable.clear();
+	n.has_mesh = false;
+	free_nodes.push_back(index);
+}
+
+void planet_lod::evaluate(int index, vec3 const& eye, lod_view const& view)
+{
+	node& n = nodes[index];
+	vec3 const eye_direction = normalize(eye-center);
+	n.visible = angle_between(n.direction, eye_direction) <= horizon_angle + n.angular_radius;
+	float const distance = std::max(norm(eye - n.bound_center) - n.bound_radius, 0.0f);
+	n.screen_error = screen_space_error(n.geometric_error, distance, view);
+
+	if(!n.is_leaf())
+		for(int child : n.children)
+			evaluate(child, eye, view);
+}
+
+void planet_lod::update(vec3 const& eye, lod_view const& view)
+{
+	if(roots[0]<0)
+		return;
+
+	stats.splits = stats.merges = 0;
+	float const d = norm(eye-center);
+	horizon_angle = d>radius ? std::acos(radius/d) : pi;
+	for(int root : roots)
+		evaluate(root, eye, view);
+
+	// merge the nodes whose children are leaves that are no longer needed (one level per frame)
+	std::vector<int> stack(roots, roots+6);
+	std::vector<int> leaves;
+	while(!stack.empty()){
+		int const index = stack.back();
+		stack.pop_back();
+		node& n = nodes[index];
+		if(n.is_leaf()){
+			leaves.push_back(index);
+			continue;
+		}
+		bool children_leaves = true;
+		for(int child : n.children)
+			children_leaves = children_leaves && nodes[child].is_leaf();
+		if(children_leaves && (!n.visible || n.screen_error < 0.5f*view.pixel_error)){
+			for(int& child : n.children){
+				release(child);
+				child = -1;
+			}
+			stats.merges++;
+			leaves.push_back(index);
+			continue;
+		}
+		for(int child : n.children)
+			stack.push_back(child);
+	}
+
+	// split the visible leaves with the largest errors, within the triangle budget
+	unsigned int const node_triangles = 2*settings.grid*settings.grid + 8*settings.grid;
+	unsigned int triangles = 0;
+	std::vector<int> candidates;
+	for(int index : leaves){
+		node const& n = nodes[index];
+		if(!n.visible)
+			continue;
+		triangles += node_triangles;
+		if(n.screen_error > view.pixel_error && n.depth < settings.max_depth)
+			candidates.push_back(index);
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](int a, int b){ return nodes[a].screen_error > nodes[b].screen_error; });
+
+	for(int index : candidates){
+		if(int(stats.splits) >= settings.max_splits_per_frame || triangles + 3*node_triangles > settings.max_triangles)
+			break;
+		for(int k=0; k<4; ++k){
+			node const& parent = nodes[index];
+			float const half = parent.size/2;
+			int const child = create_node(parent.face, parent.depth+1, parent.u0 + half*(k%2), parent.v0 + half*(k/2), half);
+			build_mesh(nodes[child]);
+			evaluate(child, eye, view);
+			nodes[index].children[k] = child;
+		}
+		triangles += 3*node_triangles;
+		stats.splits++;
+	}
+
+	// statistics of the resulting tree
+	stats.nodes = static_cast<unsigned int>(nodes.size() - free_nodes.size());
+	stats.leaves = stats.drawn = stats.triangles = 0;
+	stack.assign(roots, roots+6);
+	while(!stack.empty()){
+		node const& n = nodes[stack.back()];
+		stack.pop_back();
+		if(!n.is_leaf()){
+			for(int child : n.children)
+				stack.push_back(child);
+			continue;
+		}
+		stats.leaves++;
+		if(n.visible){
+			stats.drawn++;
+			stats.triangles += node_triangles;
+		}
+	}
+}
+
+void planet_lod::submit(render_queue& queue, cull_view const* view)
+{
+	unsigned int const node_triangles = 2*settings.grid*settings.grid + 8*settings.grid;
+	stats.drawn = stats.culled = stats.triangles = 0;
+	std::vector<int> stack(roots, roots+6);
+	while(!stack.empty()){
+		int const index = stack.back();
+		stack.pop_back();
+		if(index<0)
+			continue;
+		node& n = nodes[index];
+		if(!n.is_leaf()){
+			for(int child : n.children)
+				stack.push_back(child);
+			continue;
+		}
+		if(!n.visible)
+			continue;
+		if(view!=nullptr && view->frustum_culling && outside_frustum(view->planes, n.bound_center, n.bound_radius)){
+			stats.culled++;
+			continue;
+		}
+		stats.drawn++;
+		stats.triangles += node_triangles;
+		n.drawable.shading = shading;
+		n.drawable.texture = texture;
+		queue.submit(n.drawable);
+	}
+}
+
+}
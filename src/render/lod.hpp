@@ -0,0 +1,172 @@
+#pragma once
+
+/**
+Level of detail driven by the projected screen-space error.
+A geometric error e (in scene units) seen at distance d covers e*K/d pixels, with
+K = viewport_height / (2*tan(fov/2)); a mesh is detailed enough when this stays under
+lod_view::pixel_error.
+ - lod_chain: precomputed tessellations of a primitive (cylinder, cone, ...), from the finest to
+   the coarsest, one of them being drawn according to the distance to the camera.
+ - planet_lod: quadtree over the 6 faces of a cube projected on the sphere. Leaves are split
+   when their error is visible and merged back when it is not, a few nodes per frame, within a
+   triangle budget. Nodes behind the horizon are neither refined nor drawn, nor are the leaves
+   outside the view frustum.
+*/
+
+#include "assets/asset_cache.hpp"
+#include "assets/async_loader.hpp"
+#include "render/culling.hpp"
+#include "render/render_queue.hpp"
+#include "vcl/vcl.hpp"
+
+#include <vector>
+
+namespace render {
+
+struct lod_view
+{
+	float projection_scale = 1000.0f; // viewport_height / (2*tan(fov/2))
+	float pixel_error = 1.0f;         // tolerated error on screen, in pixels
+
+	// Set from the vertical field of view (radians) and the viewport height (pixels)
+	void set_projection(float fov, float viewport_height);
+};
+
+// Error on screen in pixels of a geometric error seen at the given distance
+float screen_space_error(float geometric_error, float distance, lod_view const& view);
+
+// Sagitta of a circle of the given radius approximated with n segments
+float tessellation_error(float radius, int segments);
+
+// ****************************************** //
+// Mesh chain of a primitive
+// ****************************************** //
+
+class lod_chain
+{
+public:
+	// applied to all the levels
+	vcl::affine_rts transform;
+	vcl::shading_parameters shading;
+
+	// Add a level, from the finest to the coarsest
+	void add_level(vcl::mesh const& shape, float geometric_error);
+	void add_level(assets::cached_mesh const& shape, float geometric_error);
+	// Add a level whose mesh is given later by set_level (asynchronous loading)
+	void reserve_level(float geometric_error);
+	void set_level(size_t k, assets::cached_mesh const& shape);
+
+	// Level to draw for this viewpoint, changing of at most one level per frame. The coarser
+	// level is only taken once its error is well under the threshold, to avoid popping back and forth.
+	// While the selected level is not loaded, the nearest loaded one is drawn (vao 0 if none is).
+	vcl::mesh_drawable const& select(vcl::vec3 const& eye, lod_view const& view);
+
+	size_t level() const { return current; }
+
+	// For the instances of submit_instances: level for an object at this distance (without the
+	// hysteresis of select), and the drawable of a level or of the nearest loaded one
+	size_t level_at(float distance, lod_view const& view) const;
+	vcl::mesh_drawable const& level_drawable(size_t level);
+	size_t level_count() const { return levels.size(); }
+	// Bounding sphere of the finest loaded level, in local coordinates (radius < 0 if none is loaded)
+	bounding_sphere bounds() const;
+
+private:
+	struct level_data
+	{
+		vcl::mesh_drawable drawable;
+		float geometric_error;
+	};
+	size_t nearest_loaded(size_t level) const;
+	std::vector<level_data> levels;
+	vcl::vec3 center;  // bounding sphere of the finest loaded level, in local coordinates
+	float radius = 0;
+	size_t bounds_level = size_t(-1); // level giving the bounding sphere
+	size_t current = 0;
+};
+
+// Cylinder and cone chains with the same parameters as mesh_primitive_cylinder/cone,
+// the finest level having the given resolution. The levels are taken from the cache when one is given.
+lod_chain lod_chain_cylinder(float radius, vcl::vec3 const& p1, vcl::vec3 const& p2, int finest_resolution, bool closed, assets::asset_cache* cache = nullptr);
+lod_chain lod_chain_cone(float radius, float height, vcl::vec3 const& p0, vcl::vec3 const& n, bool closed, int finest_resolution, assets::asset_cache* cache = nullptr);
+// Same chains, the levels being filled by the asynchronous loader: the chain must outlive the loading
+void load_lod_chain_cylinder(lod_chain& chain, assets::async_loader& loader, float radius, vcl::vec3 const& p1, vcl::vec3 const& p2, int finest_resolution, bool closed);
+void load_lod_chain_cone(lod_chain& chain, assets::async_loader& loader, float radius, float height, vcl::vec3 const& p0, vcl::vec3 const& n, bool closed, int finest_resolution);
+
+// ****************************************** //
+// Cube-sphere quadtree of the planet
+// ****************************************** //
+
+struct planet_lod_settings
+{
+	int grid = 16;                    // quads per side of a node
+	int max_depth = 12;
+	unsigned int max_triangles = 60000; // of the drawn leaves
+	int max_splits_per_frame = 8;     // mesh generations per frame
+};
+
+struct planet_lod_statistics
+{
+	unsigned int nodes = 0;
+	unsigned int leaves = 0;
+	unsigned int drawn = 0;     // visible leaves (submitted by the last submit)
+	unsigned int culled = 0;    // leaves above the horizon but outside the view frustum
+	unsigned int triangles = 0; // of the visible leaves
+	unsigned int splits = 0;    // during the last update
+	unsigned int merges = 0;
+};
+
+class planet_lod
+{
+public:
+	vcl::shading_parameters shading;
+	GLuint texture = 0; // equirectangular, same parametrization as mesh_primitive_sphere
+
+	void initialize(float radius, vcl::vec3 const& center, planet_lod_settings const& settings = planet_lod_settings());
+	void clear();
+
+	// Refine and coarsen the quadtree for this viewpoint
+	void update(vcl::vec3 const& eye, lod_view const& view);
+	// Submit the visible leaves, those outside the frustum of the view being skipped when one is given
+	void submit(render_queue& queue, cull_view const* view = nullptr);
+
+	planet_lod_statistics const& statistics() const { return stats; }
+
+private:
+	struct node
+	{
+		int face;
+		int depth;
+		float u0, v0, size;        // square [u0,u0+size]x[v0,v0+size] of the face in [-1,1]^2
+		int children[4] = {-1,-1,-1,-1};
+		vcl::vec3 direction;       // center of the node on the unit sphere
+		float angular_radius;      // cone containing the node seen from the planet center
+		vcl::vec3 bound_center;
+		float bound_radius;
+		float geometric_error;
+		// per frame
+		bool visible = false;
+		float screen_error = 0;
+		bool has_mesh = false;
+		vcl::mesh_drawable drawable;
+
+		bool is_leaf() const { return children[0]<0; }
+	};
+
+	int create_node(int face, int depth, float u0, float v0, float size);
+	void build_mesh(node& n);
+	void release(int index);  // frees the node and its subtree
+	void evaluate(int index, vcl::vec3 const& eye, lod_view const& view);
+	vcl::vec3 sphere_point(int face, float u, float v) const;
+
+	float radius = 1;
+	vcl::vec3 center;
+	planet_lod_settings settings;
+	std::vector<node> nodes;
+	std::vector<int> free_nodes;
+	int roots[6] = {-1,-1,-1,-1,-1,-1};
+	float horizon_angle = 0; // angle between the eye direction and the horizon, seen from the center
+	planet_lod_statistics stats;
+};
+
+}
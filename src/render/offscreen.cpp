@@ -0,0 +1,218 @@
+#include "render/offscreen.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace render {
+
+static double seconds_since(std::chrono::steady_clock::time_point const& start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+// ****************************************** //
+// Framebuffer
+// ****************************************** //
+
+offscreen_target::~offscreen_target()
+{
+	// no OpenGL call: the context may be destroyed before the global targets
+}
+
+bool offscreen_target::initialize(int width, int height, int samples)
+{
+	clear();
+	w = width;
+	h = height;
+	if(samples>1){
+		GLint max_samples = 1;
+		glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+		samples = std::min(samples, int(max_samples));
+	}
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	if(samples>1)
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, w, h);
+	else
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	if(samples>1)
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, w, h);
+	else
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE;
+
+	if(complete && samples>1){
+		glGenFramebuffers(1, &resolve_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, resolve_framebuffer);
+		glGenRenderbuffers(1, &resolve_color);
+		glBindRenderbuffer(GL_RENDERBUFFER, resolve_color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_color);
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE;
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if(!complete)
+		clear();
+	return complete;
+}
+
+void offscreen_target::clear()
+{
+	if(framebuffer!=0){
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color);
+		glDeleteRenderbuffers(1, &depth);
+	}
+	if(resolve_framebuffer!=0){
+		glDeleteFramebuffers(1, &resolve_framebuffer);
+		glDeleteRenderbuffers(1, &resolve_color);
+	}
+	framebuffer = color = depth = 0;
+	resolve_framebuffer = resolve_color = 0;
+}
+
+void offscreen_target::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, w, h);
+}
+
+void offscreen_target::resolve()
+{
+	if(resolve_framebuffer==0)
+		return;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_framebuffer);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void offscreen_target::blit_to_window(int window_width, int window_height)
+{
+	// keep the aspect ratio of the recording
+	float const scale = std::min(window_width/float(w), window_height/float(h));
+	int const x = int(window_width - scale*w)/2;
+	int const y = int(window_height - scale*h)/2;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer());
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBlitFramebuffer(0, 0, w, h, x, y, x+int(scale*w), y+int(scale*h), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// ****************************************** //
+// Readback
+// ****************************************** //
+
+frame_readback::~frame_readback()
+{
+	// no OpenGL call, as for offscreen_target
+}
+
+void frame_readback::initialize(int width, int height, size_t buffer_count)
+{
+	clear();
+	w = width;
+	h = height;
+	slots.resize(std::max<size_t>(buffer_count, 1));
+	for(slot& s : slots){
+		glGenBuffers(1, &s.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(w)*h*4, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	next = 0;
+	pending_count = 0;
+	stats = readback_statistics();
+}
+
+void frame_readback::clear()
+{
+	for(slot& s : slots){
+		if(s.fence!=nullptr)
+			glDeleteSync(s.fence);
+		glDeleteBuffers(1, &s.buffer);
+	}
+	slots.clear();
+	pending_count = 0;
+}
+
+void frame_readback::read(GLuint framebuffer, uint64_t index, frame_writer& writer)
+{
+	if(pending_count==slots.size())
+		collect_oldest(writer, true);
+
+	auto const start = std::chrono::steady_clock::now();
+	slot& s = slots[next];
+	s.index = index;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); // returns at once: the copy goes in the buffer
+	s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glFlush(); // the fence must reach the GPU to be signaled without a blocking wait
+	stats.read_seconds += seconds_since(start);
+
+	next = (next+1)%slots.size();
+	pending_count++;
+}
+
+void frame_readback::collect(frame_writer& writer, bool wait)
+{
+	while(pending_count>0 && collect_oldest(writer, wait)) {}
+}
+
+bool frame_readback::collect_oldest(frame_writer& writer, bool wait)
+{
+	slot& s = slots[(next + slots.size() - pending_count)%slots.size()];
+
+	GLenum status = glClientWaitSync(s.fence, 0, 0);
+	if(status==GL_TIMEOUT_EXPIRED){
+		if(!wait)
+			return false;
+		auto const start = std::chrono::steady_clock::now();
+		while(status==GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); // 100 ms
+		stats.wait_seconds += seconds_since(start);
+	}
+	glDeleteSync(s.fence);
+	s.fence = nullptr;
+
+	auto const start = std::chrono::steady_clock::now();
+	size_t const size = size_t(w)*h*4;
+	frame_image image;
+	image.index = s.index;
+	image.width = uint32_t(w);
+	image.height = uint32_t(h);
+	image.pixels = writer.acquire_buffer(size);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+	void const* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT);
+	if(mapped!=nullptr){
+		std::memcpy(image.pixels.data(), mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	stats.copy_seconds += seconds_since(start);
+	pending_count--;
+
+	if(mapped!=nullptr){
+		stats.frames++;
+		writer.submit(std::move(image));
+	}
+	return true;
+}
+
+}
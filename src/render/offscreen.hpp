@@ -0,0 +1,92 @@
+#pragma once
+
+/**
+Offscreen rendering of the scene into image files (--record, see main.cpp).
+ - offscreen_target: framebuffer object of any size, multisampled, the scene being drawn in it
+   instead of the window.
+ - frame_readback: ring of pixel buffer objects. read() starts the copy of the frame into the
+   next buffer and puts a fence after it; collect() maps only the buffers whose fence is signaled,
+   so that the transfer of a frame overlaps with the rendering of the following ones. The ring
+   being full, read() waits for the oldest frame.
+The frames are then flipped and written by the threads of a frame_writer (render/frame_writer.hpp).
+*/
+
+#include "render/frame_writer.hpp"
+#include "vcl/vcl.hpp"
+
+#include <vector>
+
+namespace render {
+
+class offscreen_target
+{
+public:
+	~offscreen_target();
+
+	// samples>1: multisampled color and depth, resolved by resolve()
+	bool initialize(int width, int height, int samples = 4);
+	void clear();
+
+	// Draw in the target, on its whole size
+	void bind();
+	// Resolve the samples in the framebuffer read back (nothing to do without multisampling)
+	void resolve();
+	GLuint read_framebuffer() const { return resolve_framebuffer!=0 ? resolve_framebuffer : framebuffer; }
+	// Copy the last frame to the window, scaled, e.g. as a preview of the recording
+	void blit_to_window(int window_width, int window_height);
+
+	int width() const { return w; }
+	int height() const { return h; }
+
+private:
+	int w = 0;
+	int h = 0;
+	GLuint framebuffer = 0;
+	GLuint color = 0;
+	GLuint depth = 0;
+	GLuint resolve_framebuffer = 0; // multisampling only
+	GLuint resolve_color = 0;
+};
+
+struct readback_statistics
+{
+	unsigned int frames = 0;
+	double read_seconds = 0; // glReadPixels into the pixel buffers
+	double wait_seconds = 0; // fences not signaled yet
+	double copy_seconds = 0; // mapping and copy to the writer buffers
+};
+
+class frame_readback
+{
+public:
+	~frame_readback();
+
+	void initialize(int width, int height, size_t buffer_count = 3);
+	void clear();
+
+	// Start the copy of the frame drawn in framebuffer
+	void read(GLuint framebuffer, uint64_t index, frame_writer& writer);
+	// Give the frames whose copy is complete to the writer; all of them, waiting, if wait is true
+	void collect(frame_writer& writer, bool wait);
+
+	size_t pending() const { return pending_count; }
+	readback_statistics const& statistics() const { return stats; }
+
+private:
+	struct slot
+	{
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		uint64_t index = 0;
+	};
+	bool collect_oldest(frame_writer& writer, bool wait);
+
+	int w = 0;
+	int h = 0;
+	std::vector<slot> slots;
+	size_t next = 0;          // slot of the next read
+	size_t pending_count = 0; // slots read and not collected, before next
+	readback_statistics stats;
+};
+
+}
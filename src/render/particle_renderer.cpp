@@ -0,0 +1,169 @@
+#include "render/particle_renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace vcl;
+
+namespace render {
+
+static char const* const vertex_shader = R"(
+#version 330 core
+layout (location = 0) in vec4 particle; // position, age relative to the lifetime
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters;
+};
+
+uniform vec2 size;           // diameter at birth and at death
+uniform float viewport_height;
+
+out float life;
+#ifdef LOGARITHMIC_DEPTH
+out float depth_w;
+#endif
+
+void main()
+{
+	life = particle.w;
+	gl_Position = projection * view * vec4(particle.xyz, 1.0);
+	// projected diameter in pixels
+	gl_PointSize = mix(size.x, size.y, life) * projection[1][1] * 0.5 * viewport_height / max(gl_Position.w, 1e-3);
+#ifdef LOGARITHMIC_DEPTH
+	depth_w = 1.0 + gl_Position.w;
+#endif
+}
+)";
+
+static char const* const fragment_shader = R"(
+#version 330 core
+in float life;
+#ifdef LOGARITHMIC_DEPTH
+in float depth_w;
+#endif
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters;
+};
+
+uniform vec3 color_start;
+uniform vec3 color_end;
+uniform vec2 alpha;
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	// soft disc
+	vec2 d = 2.0*gl_PointCoord - 1.0;
+	float r2 = dot(d, d);
+	if(r2 > 1.0)
+		discard;
+	float a = mix(alpha.x, alpha.y, life) * (1.0 - r2);
+	FragColor = vec4(mix(color_start, color_end, life), a);
+#ifdef LOGARITHMIC_DEPTH
+	gl_FragDepth = log2(depth_w) * depth_parameters.x;
+#endif
+}
+)";
+
+void particle_renderer::compile(depth_mode mode)
+{
+	if(shader!=0)
+		glDeleteProgram(shader);
+	shader = opengl_create_shader_program(shader_source(vertex_shader, mode), shader_source(fragment_shader, mode));
+	GLuint const block = glGetUniformBlockIndex(shader, "frame_uniforms");
+	glUniformBlockBinding(shader, block, 0);
+	location_color_start = glGetUniformLocation(shader, "color_start");
+	location_color_end = glGetUniformLocation(shader, "color_end");
+	location_alpha = glGetUniformLocation(shader, "alpha");
+	location_size = glGetUniformLocation(shader, "size");
+	location_viewport_height = glGetUniformLocation(shader, "viewport_height");
+}
+
+void particle_renderer::initialize(depth_mode mode)
+{
+	compile(mode);
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void particle_renderer::set_depth_mode(depth_mode mode)
+{
+	if(vao!=0)
+		compile(mode);
+}
+
+void particle_renderer::clear()
+{
+	if(vao!=0)
+		glDeleteVertexArrays(1, &vao);
+	if(vbo!=0)
+		glDeleteBuffers(1, &vbo);
+	if(shader!=0)
+		glDeleteProgram(shader);
+	vao = vbo = shader = 0;
+	capacity = 0;
+}
+
+void particle_renderer::draw(sim::particle_pool const& particles, particle_style const& style, vec3 const& eye, vec3 const& forward,
+	float viewport_height, sim::thread_pool* workers)
+{
+	typedef std::chrono::steady_clock clock;
+	stats.particles = static_cast<unsigned int>(particles.size());
+	if(particles.size()==0 || shader==0){
+		stats.sort_ms = stats.upload_ms = 0;
+		return;
+	}
+
+	clock::time_point const t0 = clock::now();
+	draw_list.build(particles, {eye.x, eye.y, eye.z}, {forward.x, forward.y, forward.z}, workers);
+	clock::time_point const t1 = clock::now();
+
+	// orphaned at each frame: no wait for the draw of the previous frame
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	capacity = std::max(capacity, particles.capacity());
+	glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(4*capacity*sizeof(float)), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(4*draw_list.size()*sizeof(float)), draw_list.vertices());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	clock::time_point const t2 = clock::now();
+	stats.sort_ms = std::chrono::duration<float, std::milli>(t1-t0).count();
+	stats.upload_ms = std::chrono::duration<float, std::milli>(t2-t1).count();
+
+	glUseProgram(shader);
+	glUniform3f(location_color_start, style.color_start.x, style.color_start.y, style.color_start.z);
+	glUniform3f(location_color_end, style.color_end.x, style.color_end.y, style.color_end.z);
+	glUniform2f(location_alpha, style.alpha_start, style.alpha_end);
+	glUniform2f(location_size, style.size_start, style.size_end);
+	glUniform1f(location_viewport_height, viewport_height);
+
+	// tested against the scene but not written: the particles do not hide each other
+	glDepthMask(GL_FALSE);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	if(style.additive)
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(draw_list.size()));
+	glBindVertexArray(0);
+	if(style.additive)
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_PROGRAM_POINT_SIZE);
+	glDepthMask(GL_TRUE);
+}
+
+}
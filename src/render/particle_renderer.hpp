@@ -0,0 +1,65 @@
+#pragma once
+
+/**
+Drawing of the particles (simulation/particles.hpp) as point sprites, one draw call per pool.
+The vertices are built on the CPU from back to front (particle_draw_list, split over the threads
+of a pool) and uploaded in an orphaned buffer; the color, opacity and size of a particle follow
+its age through the particle_style. The particles are blended without writing the depth, after
+the opaque objects. The camera comes from the frame_uniforms block of the render queue (binding 0).
+*/
+
+#include "render/render_queue.hpp"
+#include "simulation/particles.hpp"
+#include "vcl/vcl.hpp"
+
+namespace render {
+
+// Appearance over the life of a particle, interpolated from birth to death
+struct particle_style
+{
+	vcl::vec3 color_start = {1.0f, 0.9f, 0.6f};
+	vcl::vec3 color_end = {0.5f, 0.5f, 0.5f};
+	float alpha_start = 0.8f;
+	float alpha_end = 0.0f;
+	float size_start = 0.2f;  // diameter in scene units
+	float size_end = 1.0f;
+	bool additive = false;    // glowing particles (order independent)
+};
+
+struct particle_render_statistics
+{
+	unsigned int particles = 0;
+	float sort_ms = 0;    // back to front vertices
+	float upload_ms = 0;
+};
+
+class particle_renderer
+{
+public:
+	// Compile the shader and create the vertex buffer (needs an OpenGL context)
+	void initialize(depth_mode mode = depth_mode::logarithmic);
+	void clear();
+	// Recompile the shader for the depth mode of the render queue
+	void set_depth_mode(depth_mode mode);
+
+	// viewport_height: in pixels, for the size of the sprites
+	void draw(sim::particle_pool const& particles, particle_style const& style, vcl::vec3 const& eye, vcl::vec3 const& forward,
+		float viewport_height, sim::thread_pool* workers = nullptr);
+
+	particle_render_statistics const& statistics() const { return stats; }
+
+private:
+	void compile(depth_mode mode);
+
+	GLuint shader = 0;
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	size_t capacity = 0; // particles
+
+	GLint location_color_start = -1, location_color_end = -1, location_alpha = -1, location_size = -1, location_viewport_height = -1;
+
+	sim::particle_draw_list draw_list;
+	particle_render_statistics stats;
+};
+
+}
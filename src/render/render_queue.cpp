@@ -0,0 +1,372 @@
+#include "render/render_queue.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace vcl;
+
+namespace render {
+
+// Same Phong model as the mesh shader of VCL, with the camera and light in a uniform block
+// and the model matrix and color given per instance
+static char const* const vertex_shader = R"(
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec3 color;
+layout (location = 3) in vec2 uv;
+layout (location = 4) in vec4 model_row_0; // row-major model matrix of the instance
+layout (location = 5) in vec4 model_row_1;
+layout (location = 6) in vec4 model_row_2;
+layout (location = 7) in vec4 model_row_3;
+layout (location = 8) in vec4 instance_color;
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters; // x: 1/log2(1+far)
+};
+
+out struct fragment_data
+{
+	vec3 position;
+	vec3 normal;
+	vec3 color;
+	vec2 uv;
+	vec3 eye;
+	vec4 tint;
+} fragment;
+
+#ifdef LOGARITHMIC_DEPTH
+out float depth_w;
+#endif
+
+void main()
+{
+	mat4 model = transpose(mat4(model_row_0, model_row_1, model_row_2, model_row_3));
+	vec4 p = model * vec4(position, 1.0);
+	fragment.position = p.xyz;
+	fragment.normal = mat3(transpose(inverse(model))) * normal;
+	fragment.color = color;
+	fragment.uv = uv;
+	fragment.eye = -transpose(mat3(view)) * vec3(view * vec4(0.0, 0.0, 0.0, 1.0));
+	fragment.tint = instance_color;
+	gl_Position = projection * view * p;
+#ifdef LOGARITHMIC_DEPTH
+	depth_w = 1.0 + gl_Position.w;
+#endif
+}
+)";
+
+static char const* const fragment_shader = R"(
+#version 330 core
+in struct fragment_data
+{
+	vec3 position;
+	vec3 normal;
+	vec3 color;
+	vec2 uv;
+	vec3 eye;
+	vec4 tint;
+} fragment;
+
+#ifdef LOGARITHMIC_DEPTH
+in float depth_w;
+#endif
+
+layout (std140, row_major) uniform frame_uniforms
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	vec4 depth_parameters; // x: 1/log2(1+far)
+};
+
+layout (location = 0) out vec4 FragColor;
+
+uniform sampler2D image_texture;
+uniform float ambient = 0.3;
+uniform float diffuse = 0.7;
+uniform float specular = 0.3;
+uniform float specular_exponent = 64.0;
+
+void main()
+{
+	vec3 N = normalize(fragment.normal);
+	if(gl_FrontFacing == false)
+		N = -N;
+	vec3 L = normalize(light.xyz - fragment.position);
+	float diffuse_value = max(dot(N,L), 0.0);
+	float specular_value = 0.0;
+	if(diffuse_value > 0.0){
+		vec3 R = reflect(-L, N);
+		vec3 V = normalize(fragment.eye - fragment.position);
+		specular_value = pow(max(dot(R,V), 0.0), specular_exponent);
+	}
+
+	vec4 color_image_texture = texture(image_texture, vec2(fragment.uv.x, 1.0-fragment.uv.y));
+	vec3 color_object = fragment.color * fragment.tint.rgb * color_image_texture.rgb;
+	vec3 color_shading = (ambient + diffuse*diffuse_value) * color_object + specular*specular_value*vec3(1.0, 1.0, 1.0);
+	FragColor = vec4(color_shading, fragment.tint.a * color_image_texture.a);
+#ifdef LOGARITHMIC_DEPTH
+	gl_FragDepth = log2(depth_w) * depth_parameters.x;
+#endif
+}
+)";
+
+// std140 layout of frame_uniforms
+struct frame_uniforms
+{
+	float projection[16];
+	float view[16];
+	float light[4];
+	float depth_parameters[4];
+};
+
+std::string shader_source(char const* source, depth_mode mode)
+{
+	std::string s = source;
+	if(mode==depth_mode::logarithmic){
+		size_t const line_end = s.find('\n', s.find("#version"));
+		s.insert(line_end+1, "#define LOGARITHMIC_DEPTH\n");
+	}
+	return s;
+}
+
+static void copy_matrix(mat4 const& m, float* out)
+{
+	for(int i=0; i<4; ++i)
+		for(int j=0; j<4; ++j)
+			out[4*i+j] = m(i,j);
+}
+
+// Number of floats per instance: model matrix and color
+static size_t const instance_stride = 20;
+
+void render_queue::compile()
+{
+	if(shader!=0)
+		glDeleteProgram(shader);
+	shader = opengl_create_shader_program(shader_source(vertex_shader, mode), shader_source(fragment_shader, mode));
+	GLuint const block = glGetUniformBlockIndex(shader, "frame_uniforms");
+	glUniformBlockBinding(shader, block, 0);
+
+	location_ambient = glGetUniformLocation(shader, "ambient");
+	location_diffuse = glGetUniformLocation(shader, "diffuse");
+	location_specular = glGetUniformLocation(shader, "specular");
+	location_specular_exponent = glGetUniformLocation(shader, "specular_exponent");
+	location_texture = glGetUniformLocation(shader, "image_texture");
+}
+
+void render_queue::initialize(depth_mode mode_arg)
+{
+	mode = mode_arg;
+	compile();
+
+	glGenBuffers(1, &frame_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_uniforms), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, frame_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenBuffers(1, &instance_vbo);
+}
+
+void render_queue::set_depth(depth_mode mode_arg, float far_plane_arg)
+{
+	far_plane = far_plane_arg;
+	if(mode_arg!=mode){
+		mode = mode_arg;
+		if(shader!=0)
+			compile();
+	}
+}
+
+void render_queue::begin_frame(mat4 const& projection, mat4 const& view, vec3 const& light)
+{
+	frame_uniforms uniforms;
+	copy_matrix(projection, uniforms.projection);
+	copy_matrix(view, uniforms.view);
+	uniforms.light[0] = light.x;
+	uniforms.light[1] = light.y;
+	uniforms.light[2] = light.z;
+	uniforms.light[3] = 1.0f;
+	uniforms.depth_parameters[0] = 1.0f/std::log2(1.0f + far_plane);
+	uniforms.depth_parameters[1] = uniforms.depth_parameters[2] = uniforms.depth_parameters[3] = 0.0f;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	items.clear();
+	positions.clear();
+	current = render_statistics();
+	current.uniform_uploads = 1;
+}
+
+void render_queue::submit(mesh_drawable const& drawable, render_state const& state)
+{
+	if(drawable.vao==0)
+		return; // buffers not loaded yet (see assets/async_loader.hpp)
+	item it;
+	it.pass = state.depth_write ? 0 : 1;
+	it.texture = drawable.texture;
+	it.vao = drawable.vao;
+	it.index_buffer = drawable.vbo.at("index");
+	it.triangle_count = drawable.number_triangles;
+	it.phong = drawable.shading.phong;
+	copy_matrix(drawable.transform.matrix(), it.model);
+	it.color[0] = drawable.shading.color.x;
+	it.color[1] = drawable.shading.color.y;
+	it.color[2] = drawable.shading.color.z;
+	it.color[3] = drawable.shading.alpha;
+	items.push_back(it);
+	current.items++;
+}
+
+void render_queue::submit_instances(mesh_drawable const& drawable, vec3 const* instance_positions, size_t count, render_state const& state)
+{
+	if(drawable.vao==0 || count==0)
+		return;
+	submit(drawable, state);
+	item& it = items.back();
+	it.instanced = true;
+	it.first_position = positions.size()/3;
+	it.instance_count = count;
+	for(size_t k=0; k<count; ++k){
+		positions.push_back(instance_positions[k].x);
+		positions.push_back(instance_positions[k].y);
+		positions.push_back(instance_positions[k].z);
+	}
+	current.items += unsigned(count-1);
+}
+
+static bool phong_less(shading_parameters_phong const& a, shading_parameters_phong const& b)
+{
+	if(a.ambient!=b.ambient) return a.ambient<b.ambient;
+	if(a.diffuse!=b.diffuse) return a.diffuse<b.diffuse;
+	if(a.specular!=b.specular) return a.specular<b.specular;
+	return a.specular_exponent<b.specular_exponent;
+}
+
+bool render_queue::same_batch(item const& a, item const& b)
+{
+	return a.pass==b.pass && a.texture==b.texture && a.vao==b.vao && a.index_buffer==b.index_buffer && a.triangle_count==b.triangle_count
+		&& !phong_less(a.phong, b.phong) && !phong_less(b.phong, a.phong);
+}
+
+void render_queue::flush()
+{
+	// sort key: pass, texture, mesh, material. Stable so that instances keep their submission order
+	sorted.clear();
+	for(item const& it : items)
+		sorted.push_back(&it);
+	std::stable_sort(sorted.begin(), sorted.end(), [](item const* a, item const* b){
+		if(a->pass!=b->pass) return a->pass<b->pass;
+		if(a->texture!=b->texture) return a->texture<b->texture;
+		if(a->vao!=b->vao) return a->vao<b->vao;
+		return phong_less(a->phong, b->phong);
+	});
+
+	// per-instance data of the whole frame, uploaded in one buffer
+	size_t instance_count = 0;
+	for(item const* it : sorted)
+		instance_count += it->instance_count;
+	instance_data.resize(instance_count*instance_stride);
+	size_t instance = 0;
+	for(item const* it : sorted){
+		for(size_t k=0; k<it->instance_count; ++k, ++instance){
+			float* const data = &instance_data[instance*instance_stride];
+			std::memcpy(data, it->model, 16*sizeof(float));
+			std::memcpy(data+16, it->color, 4*sizeof(float));
+			if(it->instanced){
+				// translation column of the row-major matrix
+				float const* p = &positions[3*(it->first_position+k)];
+				data[3] = p[0];
+				data[7] = p[1];
+				data[11] = p[2];
+			}
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	if(instance_count>instance_capacity){
+		instance_capacity = std::max(instance_count, 2*instance_capacity);
+		glBufferData(GL_ARRAY_BUFFER, instance_capacity*instance_stride*sizeof(float), nullptr, GL_STREAM_DRAW);
+	}
+	if(!instance_data.empty())
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instance_data.size()*sizeof(float), instance_data.data());
+
+	glUseProgram(shader);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(location_texture, 0);
+	current.state_changes++;
+
+	GLuint bound_texture = 0, bound_vao = 0;
+	bool depth_write = true;
+	glDepthMask(GL_TRUE);
+	item const* material = nullptr;
+
+	size_t begin = 0;
+	size_t first_instance = 0;
+	while(begin<sorted.size()){
+		item const& first = *sorted[begin];
+		size_t end = begin+1;
+		size_t batch_instances = first.instance_count;
+		while(end<sorted.size() && same_batch(first, *sorted[end]))
+			batch_instances += sorted[end++]->instance_count;
+
+		if(first.texture!=bound_texture){
+			glBindTexture(GL_TEXTURE_2D, first.texture);
+			bound_texture = first.texture;
+			current.state_changes++;
+		}
+		bool const batch_depth_write = first.pass==0;
+		if(batch_depth_write!=depth_write){
+			glDepthMask(batch_depth_write ? GL_TRUE : GL_FALSE);
+			depth_write = batch_depth_write;
+			current.state_changes++;
+		}
+		if(material==nullptr || phong_less(material->phong, first.phong) || phong_less(first.phong, material->phong)){
+			glUniform1f(location_ambient, first.phong.ambient);
+			glUniform1f(location_diffuse, first.phong.diffuse);
+			glUniform1f(location_specular, first.phong.specular);
+			glUniform1f(location_specular_exponent, first.phong.specular_exponent);
+			material = &first;
+			current.uniform_uploads++;
+		}
+		if(first.vao!=bound_vao){
+			glBindVertexArray(first.vao);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, first.index_buffer);
+			bound_vao = first.vao;
+			current.state_changes++;
+		}
+
+		// instance attributes of this batch, read from its range of the instance buffer
+		for(GLuint k=0; k<5; ++k){
+			GLuint const location = 4+k;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, GLsizei(instance_stride*sizeof(float)),
+				reinterpret_cast<void*>((first_instance*instance_stride + 4*k)*sizeof(float)));
+			glVertexAttribDivisor(location, 1);
+		}
+		glDrawElementsInstanced(GL_TRIANGLES, GLsizei(first.triangle_count*3), GL_UNSIGNED_INT, nullptr, GLsizei(batch_instances));
+		current.draw_calls++;
+		current.triangles += first.triangle_count*unsigned(batch_instances);
+
+		begin = end;
+		first_instance += batch_instances;
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDepthMask(GL_TRUE);
+	glUseProgram(0);
+
+	last_frame = current;
+	items.clear();
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/**
+Render queue of the scene.
+Instead of drawing each mesh_drawable immediately (one glUseProgram, one name lookup per uniform and
+one draw call per object), the drawables of a frame are submitted to the queue, which
+ - sorts them by pass (opaque first, then billboards without depth write), shader, texture and mesh,
+ - shares the camera and the light of the frame through a std140 uniform buffer, uploaded once,
+ - merges the consecutive items using the same mesh and the same state into one instanced draw call
+   (e.g. the four towers, or a fleet of vehicles), the model matrix and the color being per instance.
+submit_instances adds many copies of a drawable at once, e.g. all the vehicles of a fleet drawn with
+the same mesh: they are one item of the sort, whose instances are expanded when the frame is flushed.
+The number of draw calls and GL state changes of the last frame are kept for display.
+
+With the far plane at 1e10, a standard depth buffer of 24 bits keeps about 0.2*d^2/2^24 of
+precision at distance d (several units at the pad seen from 3000 units): the ground, road and
+marker fight. The logarithmic depth writes log2(1+w)/log2(1+far) instead, a relative precision of
+about log(far)/2^24 = 1e-6 at every distance. The shaders of the other renderers sharing
+frame_uniforms are compiled with the same depth mode (shader_source).
+*/
+
+#include "vcl/vcl.hpp"
+
+#include <string>
+#include <vector>
+
+namespace render {
+
+enum class depth_mode { standard, logarithmic };
+
+// Source of a shader of the scene for this depth mode: defines LOGARITHMIC_DEPTH after the #version line.
+// The vertex shader then outputs depth_w = 1 + gl_Position.w, and the fragment shader writes
+// gl_FragDepth = log2(depth_w) * depth_parameters.x (depth_parameters of frame_uniforms)
+std::string shader_source(char const* source, depth_mode mode);
+
+// Render state of an item, part of the sort key
+struct render_state
+{
+	bool depth_write = true;  // false for the billboards (drawn after the opaque objects)
+};
+
+struct render_statistics
+{
+	unsigned int items = 0;          // submitted drawables (= draw calls without the queue)
+	unsigned int draw_calls = 0;
+	unsigned int triangles = 0;
+	unsigned int state_changes = 0;  // program, texture, vertex array and depth mask changes
+	unsigned int uniform_uploads = 0;
+};
+
+class render_queue
+{
+public:
+	// Compile the instanced shader and create the buffers (needs an OpenGL context)
+	void initialize(depth_mode mode = depth_mode::logarithmic);
+
+	// Depth mode and far plane of the projection (recompiles the shader when the mode changes)
+	void set_depth(depth_mode mode, float far_plane);
+	depth_mode depth() const { return mode; }
+
+	// Camera and light of the frame, uploaded once in the uniform buffer
+	void begin_frame(vcl::mat4 const& projection, vcl::mat4 const& view, vcl::vec3 const& light);
+
+	// Add a drawable with its current transform and shading
+	void submit(vcl::mesh_drawable const& drawable, render_state const& state = render_state());
+	// Add copies of a drawable, its translation replaced by each of the positions
+	void submit_instances(vcl::mesh_drawable const& drawable, vcl::vec3 const* positions, size_t count, render_state const& state = render_state());
+
+	// Sort, batch and draw all the items of the frame, then empty the queue
+	void flush();
+
+	render_statistics const& statistics() const { return last_frame; }
+
+private:
+	struct item
+	{
+		unsigned int pass;            // 0: opaque, 1: no depth write
+		GLuint texture;
+		GLuint vao;
+		GLuint index_buffer;
+		GLuint triangle_count;
+		vcl::shading_parameters_phong phong;
+		float model[16];              // row-major model matrix
+		float color[4];               // color and alpha
+		size_t first_position = 0;    // submit_instances: range in positions
+		size_t instance_count = 1;
+		bool instanced = false;
+	};
+
+	static bool same_batch(item const& a, item const& b);
+	void compile();
+
+	depth_mode mode = depth_mode::logarithmic;
+	float far_plane = 1e10f;
+	GLuint shader = 0;
+	GLuint frame_ubo = 0;        // std140 block frame_uniforms
+	GLuint instance_vbo = 0;     // model matrix and color of each instance
+	size_t instance_capacity = 0;
+
+	// uniform locations, looked up once
+	GLint location_ambient = -1, location_diffuse = -1, location_specular = -1, location_specular_exponent = -1, location_texture = -1;
+
+	std::vector<item> items;
+	std::vector<float> positions;  // of the items of submit_instances, 3 floats per instance
+	std::vector<item const*> sorted;
+	std::vector<float> instance_data;
+	render_statistics current;
+	render_statistics last_frame;
+};
+
+}
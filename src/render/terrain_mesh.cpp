@@ -0,0 +1,80 @@
+#include "render/terrain_mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vcl;
+
+namespace render {
+
+static vec3 mix(vec3 const& a, vec3 const& b, float s)
+{
+	s = std::min(std::max(s, 0.0f), 1.0f);
+	return (1-s)*a + s*b;
+}
+
+mesh terrain_mesh(sim::terrain_settings const& settings, float skirt)
+{
+	sim::heightfield const terrain(settings);
+	int const N = terrain.resolution();
+	float const cell = terrain.cell_size();
+	vec3 const grass = {0.0f, 1.0f, 0.5f};  // color of the former ground quad
+	vec3 const water = {0.0f, 0.467f, 0.745f};
+	vec3 const earth = {0.45f, 0.55f, 0.25f};
+	vec3 const rock = {0.5f, 0.45f, 0.4f};
+	float const top = std::max(terrain.max_height(), 1e-3f);
+
+	mesh shape;
+	for(int j=0; j<=N; ++j){
+		for(int i=0; i<=N; ++i){
+			sim::vec3 const p = terrain.vertex_position(i, j);
+			shape.position.push_back(vec3(p.x, p.y, p.z));
+			// central differences of the vertex heights
+			float const dx = terrain.vertex_height(std::min(i+1,N), j) - terrain.vertex_height(std::max(i-1,0), j);
+			float const dy = terrain.vertex_height(i, std::min(j+1,N)) - terrain.vertex_height(i, std::max(j-1,0));
+			vec3 const n = {-dx/(2*cell), -dy/(2*cell), 1.0f};
+			shape.normal.push_back(n/norm(n));
+			shape.uv.push_back(vec2(static_cast<float>(i)/N, static_cast<float>(j)/N));
+
+			float const r = std::sqrt(p.x*p.x + p.y*p.y);
+			if(r <= settings.flat_radius)
+				shape.color.push_back(grass);
+			else if(p.z <= 0.0f)
+				shape.color.push_back(water);
+			else
+				shape.color.push_back(p.z < 0.5f*top ? mix(grass, earth, 2*p.z/top) : mix(earth, rock, 2*p.z/top - 1));
+		}
+	}
+	for(int j=0; j<N; ++j){
+		for(int i=0; i<N; ++i){
+			// split along the diagonal of the collision triangles (terrain.hpp)
+			unsigned int const k00 = j*(N+1)+i, k10 = k00+1, k01 = k00+N+1, k11 = k01+1;
+			shape.connectivity.push_back(uint3{k00, k10, k11});
+			shape.connectivity.push_back(uint3{k00, k11, k01});
+		}
+	}
+
+	// skirt: the sea goes down along the border of the grid
+	auto add_skirt = [&](unsigned int a, unsigned int b){
+		unsigned int const base = static_cast<unsigned int>(shape.position.size());
+		for(unsigned int k : {a, b}){
+			shape.position.push_back(shape.position[k] - vec3(0,0,skirt));
+			shape.normal.push_back(shape.normal[k]);
+			shape.uv.push_back(shape.uv[k]);
+			shape.color.push_back(shape.color[k]);
+		}
+		shape.connectivity.push_back(uint3{a, base+1, b});
+		shape.connectivity.push_back(uint3{a, base, base+1});
+	};
+	for(int i=0; i<N; ++i){
+		add_skirt(i, i+1);                                  // y = -half_extent
+		add_skirt(N*(N+1)+i+1, N*(N+1)+i);                  // y = +half_extent
+		add_skirt((i+1)*(N+1), i*(N+1));                    // x = -half_extent
+		add_skirt(i*(N+1)+N, (i+1)*(N+1)+N);                // x = +half_extent
+	}
+
+	shape.fill_empty_field();
+	return shape;
+}
+
+}
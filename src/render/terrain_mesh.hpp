@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+Mesh of the terrain of the launch site (simulation/terrain.hpp), drawn instead of the flat quads
+of the ground and of the water: the same triangles as the collision surface, colored per vertex
+(sea at z=0 around the hills, grass on the launch area, then earth and rock with the height).
+A skirt hangs from the border of the grid, down to the earth sphere which falls away under it.
+Made to be a generator of the asset cache: it only depends on the settings of the terrain.
+*/
+
+#include "simulation/terrain.hpp"
+#include "vcl/vcl.hpp"
+
+namespace render {
+
+vcl::mesh terrain_mesh(sim::terrain_settings const& settings, float skirt);
+
+}
@@ -0,0 +1,218 @@
+#include "simulation/atmosphere.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+namespace {
+
+// ****************************************** //
+// Math usable at compile time
+// ****************************************** //
+
+constexpr double ln2 = 0.69314718055994530942;
+
+constexpr double cx_exp(double x)
+{
+	// x = k ln2 + r with |r| <= ln2/2, then the series of exp(r)
+	int const k = static_cast<int>(x/ln2 + (x<0 ? -0.5 : 0.5));
+	double const r = x - k*ln2;
+	double term = 1, sum = 1;
+	for(int n=1; n<30; ++n){
+		term *= r/n;
+		sum += term;
+	}
+	for(int n=0; n<k; ++n)
+		sum *= 2;
+	for(int n=0; n>k; --n)
+		sum *= 0.5;
+	return sum;
+}
+
+constexpr double cx_log(double x)
+{
+	// x = m 2^e with m in [1,2), then log(m) = 2 atanh((m-1)/(m+1))
+	int e = 0;
+	while(x>=2){ x *= 0.5; ++e; }
+	while(x<1){ x *= 2; --e; }
+	double const s = (x-1)/(x+1);
+	double term = s, sum = 0;
+	for(int n=1; n<80; n+=2){
+		sum += term/n;
+		term *= s*s;
+	}
+	return 2*sum + e*ln2;
+}
+
+constexpr double cx_sqrt(double x)
+{
+	double r = x>1 ? x : 1;
+	for(int n=0; n<60; ++n)
+		r = 0.5*(r + x/r);
+	return r;
+}
+
+struct constexpr_math
+{
+	static constexpr double exp(double x) { return cx_exp(x); }
+	static constexpr double pow(double a, double b) { return cx_exp(b*cx_log(a)); }
+	static constexpr double sqrt(double x) { return cx_sqrt(x); }
+};
+
+struct runtime_math
+{
+	static double exp(double x) { return std::exp(x); }
+	static double pow(double a, double b) { return std::pow(a, b); }
+	static double sqrt(double x) { return std::sqrt(x); }
+};
+
+// ****************************************** //
+// US Standard Atmosphere 1976
+// ****************************************** //
+
+constexpr double g0 = 9.80665;               // m/s^2
+constexpr double gas_constant = 8.31432;     // J/(mol K), value of the standard
+constexpr double molar_mass = 0.0289644;     // kg/mol
+constexpr double air_gas_constant = gas_constant/molar_mass;
+constexpr double heat_capacity_ratio = 1.4;
+constexpr double earth_radius = 6356766.0;   // m, for the geopotential altitude and gravity
+
+// Layers of constant lapse rate: base geopotential altitude (m) and lapse rate (K/m)
+constexpr int layer_count = 7;
+constexpr double layer_base[layer_count+1] = {0.0, 11000.0, 20000.0, 32000.0, 47000.0, 51000.0, 71000.0, 84852.0};
+constexpr double layer_lapse[layer_count] = {-0.0065, 0.0, 0.001, 0.0028, 0.0, -0.0028, -0.002};
+
+struct standard_state
+{
+	double density, pressure, temperature, speed_of_sound, gravity;
+};
+
+// Pressure dh above the base of a layer (hydrostatic equilibrium of a perfect gas)
+template <typename M>
+constexpr double layer_pressure(double t_base, double p_base, double lapse, double dh)
+{
+	if(lapse==0)
+		return p_base*M::exp(-g0*dh/(air_gas_constant*t_base));
+	return p_base*M::pow(t_base/(t_base+lapse*dh), g0/(air_gas_constant*lapse));
+}
+
+// State at the geometric altitude z (m); the last layer is extended above 86 km
+template <typename M>
+constexpr standard_state standard_atmosphere(double z)
+{
+	double const h = earth_radius*z/(earth_radius+z);
+	double t = 288.15, p = 101325.0;
+	int layer = 0;
+	while(layer+1<layer_count && h>layer_base[layer+1]){
+		double const thickness = layer_base[layer+1]-layer_base[layer];
+		p = layer_pressure<M>(t, p, layer_lapse[layer], thickness);
+		t += layer_lapse[layer]*thickness;
+		++layer;
+	}
+	double const dh = h-layer_base[layer];
+	p = layer_pressure<M>(t, p, layer_lapse[layer], dh);
+	t += layer_lapse[layer]*dh;
+
+	double const r = earth_radius/(earth_radius+z);
+	standard_state s = {};
+	s.density = p/(air_gas_constant*t);
+	s.pressure = p;
+	s.temperature = t;
+	s.speed_of_sound = M::sqrt(heat_capacity_ratio*air_gas_constant*t);
+	s.gravity = g0*r*r;
+	return s;
+}
+
+// ****************************************** //
+// Tables
+// ****************************************** //
+
+constexpr float table_step = 250.0f; // m
+constexpr int table_size = static_cast<int>(us1976_top/table_step) + 1;
+
+struct atmosphere_table
+{
+	float log_density[table_size];
+	float log_pressure[table_size];
+	float temperature[table_size];
+	float speed_of_sound[table_size];
+};
+
+constexpr atmosphere_table make_atmosphere_table()
+{
+	atmosphere_table table = {};
+	for(int i=0; i<table_size; ++i){
+		standard_state const s = standard_atmosphere<constexpr_math>(i*static_cast<double>(table_step));
+		table.log_density[i] = static_cast<float>(cx_log(s.density));
+		table.log_pressure[i] = static_cast<float>(cx_log(s.pressure));
+		table.temperature[i] = static_cast<float>(s.temperature);
+		table.speed_of_sound[i] = static_cast<float>(s.speed_of_sound);
+	}
+	return table;
+}
+
+constexpr atmosphere_table table = make_atmosphere_table();
+static_assert(table.temperature[0]==288.15f, "sea level temperature of the standard");
+
+// Interval of the altitude: u is the unclamped fraction (extrapolation of the logarithms), held the clamped one
+struct table_position
+{
+	int index;
+	float u;
+	float held;
+};
+
+inline table_position locate(float altitude)
+{
+	float const x = altitude*(1.0f/table_step);
+	float const clamped = std::min(static_cast<float>(table_size-1), std::max(0.0f, x)); // also maps NaN to 0
+	int const i = std::min(static_cast<int>(clamped), table_size-2);
+	return {i, x-static_cast<float>(i), clamped-static_cast<float>(i)};
+}
+
+inline float lerp(float const* values, int i, float u)
+{
+	return values[i] + u*(values[i+1]-values[i]);
+}
+
+// One division: cheaper than a table, and valid far above it
+inline float gravity(float altitude)
+{
+	float const r = static_cast<float>(earth_radius)/(static_cast<float>(earth_radius)+altitude);
+	return static_cast<float>(g0)*r*r;
+}
+
+}
+
+atmosphere_sample us1976(float altitude)
+{
+	table_position const at = locate(altitude);
+	atmosphere_sample s;
+	s.density = std::exp(lerp(table.log_density, at.index, at.u));
+	s.pressure = std::exp(lerp(table.log_pressure, at.index, at.u));
+	s.temperature = lerp(table.temperature, at.index, at.held);
+	s.speed_of_sound = lerp(table.speed_of_sound, at.index, at.held);
+	s.gravity = gravity(altitude);
+	return s;
+}
+
+float us1976_density(float altitude)
+{
+	table_position const at = locate(altitude);
+	return std::exp(lerp(table.log_density, at.index, at.u));
+}
+
+atmosphere_sample us1976_analytic(double altitude)
+{
+	standard_state const s = standard_atmosphere<runtime_math>(altitude);
+	atmosphere_sample r;
+	r.density = static_cast<float>(s.density);
+	r.pressure = static_cast<float>(s.pressure);
+	r.temperature = static_cast<float>(s.temperature);
+	r.speed_of_sound = static_cast<float>(s.speed_of_sound);
+	r.gravity = static_cast<float>(s.gravity);
+	return r;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+US Standard Atmosphere 1976 (0 to 86 km) and altitude-dependent gravity, for the drag and the
+dynamic pressure of the dynamic flight model.
+The seven layers of constant lapse rate are defined on the geopotential altitude; the tables are
+sampled every 250 m of geometric altitude and generated at compile time (constexpr, in
+atmosphere.cpp). A lookup clamps the index and interpolates without branches:
+ - the logarithms of density and pressure linearly (exact in the isothermal layers), so that above
+   86 km they keep decreasing exponentially with the slope of the last interval,
+ - temperature and speed of sound linearly, held at the ends of the table.
+Gravity decreases with the square of the distance to the center of the earth of the standard, and
+is computed directly (one division is cheaper than a lookup).
+us1976_analytic evaluates the formulas of the standard in double precision, as the reference of the
+tables (see the atmosphere benchmarks of rocket_bench).
+*/
+
+namespace sim {
+
+struct atmosphere_sample
+{
+	float density;        // kg/m^3
+	float pressure;       // Pa
+	float temperature;    // K
+	float speed_of_sound; // m/s
+	float gravity;        // m/s^2, g0 (r0/(r0+z))^2 with the radius of the standard
+};
+
+// Geometric altitude (m) covered by the tables
+constexpr float us1976_top = 86000.0f;
+
+// Interpolated in the tables
+atmosphere_sample us1976(float altitude);
+float us1976_density(float altitude);
+
+// Formulas of the standard (reference, between 0 and 86 km)
+atmosphere_sample us1976_analytic(double altitude);
+
+// q = rho v^2 / 2 (Pa)
+inline float dynamic_pressure(float density, float speed) { return 0.5f*density*speed*speed; }
+
+}
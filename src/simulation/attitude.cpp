@@ -0,0 +1,238 @@
+#include "simulation/attitude.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+// ****************************************** //
+// Quaternions
+// ****************************************** //
+
+quaternion normalize(quaternion const& q)
+{
+	float const n = std::sqrt(q.w*q.w + q.x*q.x + q.y*q.y + q.z*q.z);
+	return n>0 ? quaternion(q.w/n, q.x/n, q.y/n, q.z/n) : quaternion();
+}
+
+vec3 rotate(quaternion const& q, vec3 const& v)
+{
+	// v + 2 u x (u x v + w v), u the vector part
+	vec3 const u(q.x, q.y, q.z);
+	vec3 const t = 2.0f*cross(u, v);
+	return v + q.w*t + cross(u, t);
+}
+
+quaternion quaternion_from_rotation_vector(vec3 const& r)
+{
+	float const angle = norm(r);
+	if(angle < 1e-8f)
+		return normalize(quaternion(1.0f, 0.5f*r.x, 0.5f*r.y, 0.5f*r.z));
+	float const s = std::sin(0.5f*angle)/angle;
+	return {std::cos(0.5f*angle), s*r.x, s*r.y, s*r.z};
+}
+
+vec3 quaternion_rotation_vector(quaternion const& q_arg)
+{
+	// q and -q are the same rotation: the one with w>=0 has the angle in [0,pi]
+	quaternion const q = q_arg.w<0 ? quaternion(-q_arg.w, -q_arg.x, -q_arg.y, -q_arg.z) : q_arg;
+	vec3 const u(q.x, q.y, q.z);
+	float const s = norm(u);
+	if(s < 1e-8f)
+		return 2.0f*u;
+	float const angle = 2.0f*std::atan2(s, q.w);
+	return (angle/s)*u;
+}
+
+quaternion quaternion_between(vec3 const& a_arg, vec3 const& b_arg)
+{
+	vec3 const a = a_arg/norm(a_arg);
+	vec3 const b = b_arg/norm(b_arg);
+	float const c = dot(a, b);
+	if(c < -0.999999f){
+		// half turn around any axis orthogonal to a
+		vec3 axis = cross(vec3(1,0,0), a);
+		if(norm(axis) < 1e-3f)
+			axis = cross(vec3(0,1,0), a);
+		axis = axis/norm(axis);
+		return {0.0f, axis.x, axis.y, axis.z};
+	}
+	vec3 const u = cross(a, b);
+	return normalize(quaternion(1.0f + c, u.x, u.y, u.z));
+}
+
+// ****************************************** //
+// Rigid bodies and autopilot
+// ****************************************** //
+
+static engine_parameters const& engine(mission_parameters const& parameters, int index)
+{
+	vehicle_parameters const& vehicle = parameters.vehicle;
+	return index==0 ? vehicle.first_stage : index==1 ? vehicle.second_stage : vehicle.upper_stage;
+}
+
+// Principal moments of a solid cylinder along its axis z
+static vec3 cylinder_inertia(float mass, float length, float radius)
+{
+	float const transverse = mass*(3*radius*radius + length*length)/12;
+	return {transverse, transverse, 0.5f*mass*radius*radius};
+}
+
+// Lowest part still attached: 0 first stage, 1 second stage, 2 upper part
+static int lowest_attached(int32_t const* phase)
+{
+	if(phase[body_first_stage]==body_attached)
+		return 0;
+	return phase[body_second_stage]==body_attached ? 1 : 2;
+}
+
+static void rotate_body(rigid_body_attitude& body, vec3 const& inertia, vec3 const& torque, float dt)
+{
+	vec3 const w = body.w;
+	vec3 const momentum(inertia.x*w.x, inertia.y*w.y, inertia.z*w.z);
+	vec3 const gyroscopic = torque - cross(w, momentum);
+	body.w += dt*vec3(gyroscopic.x/inertia.x, gyroscopic.y/inertia.y, gyroscopic.z/inertia.z);
+	body.q = normalize(body.q*quaternion_from_rotation_vector(dt*body.w));
+}
+
+attitude_input attitude_input_from(mission_state const& state, mission_parameters const& parameters)
+{
+	attitude_input input;
+	input.t = state.t;
+	input.rocket_v = state.rocket_v;
+	for(int k=0; k<mission_body_count; ++k){
+		input.velocity[k] = state.bodies.velocity(k);
+		input.phase[k] = state.bodies.phase[k];
+	}
+	input.in_orbit = state.radius_set;
+
+	int active = lowest_attached(input.phase);
+	if(parameters.model==flight_model::dynamic){
+		active = state.flight.active_engine;
+		input.engine_on = state.flight.engine_on;
+		input.mass = static_cast<float>(state.flight.ascent.y[6]);
+	}
+	else{
+		// the scripted rocket climbs at constant speed until the orbit start, on full tanks
+		input.engine_on = !state.radius_set;
+		for(int k=active; k<3; ++k)
+			input.mass += engine(parameters, k).dry_mass + engine(parameters, k).propellant_mass;
+	}
+	input.thrust = input.engine_on ? engine(parameters, active).thrust : 0.0f;
+	return input;
+}
+
+vec3 attitude_guidance(attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings)
+{
+	vec3 v = input.rocket_v;
+	if(input.in_orbit)
+		v = input.velocity[body_satellite];
+	else if(input.engine_on && parameters.model==flight_model::dynamic)
+		return flight_thrust_direction(parameters, input.t);
+	float const speed = norm(v);
+	if(speed >= settings.min_speed)
+		return v/speed;
+	return flight_thrust_direction(parameters, input.t); // on the pad
+}
+
+void attitude_reset(attitude_state& state, attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings)
+{
+	state.t = input.t;
+	state.target = attitude_guidance(input, parameters, settings);
+	state.target_rate = vec3(0,0,0);
+	state.target_time = input.t;
+	state.stack.q = quaternion_between(vec3(0,0,1), state.target);
+	state.stack.w = vec3(0,0,0);
+	state.integral = vec3(0,0,0);
+	state.torque = vec3(0,0,0);
+	state.error = 0;
+	state.saturated = false;
+	for(int k=0; k<mission_body_count; ++k){
+		state.phase[k] = input.phase[k];
+		state.bodies[k] = state.stack;
+		if(input.phase[k]==body_ballistic)
+			state.bodies[k].w = vec3(settings.separation_tumble, 0, 0);
+	}
+	state.resets++;
+}
+
+void attitude_step(attitude_state& state, attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings, float dt)
+{
+	// separations: the stage leaves with the attitude and the rates of the stack, and a tumble
+	for(int k : {int(body_first_stage), int(body_second_stage)}){
+		if(state.phase[k]==body_attached && input.phase[k]==body_ballistic){
+			state.bodies[k] = state.stack;
+			state.bodies[k].w += vec3(settings.separation_tumble, 0, 0);
+		}
+	}
+	for(int k=0; k<mission_body_count; ++k)
+		state.phase[k] = input.phase[k];
+
+	// stack (the satellite alone in orbit)
+	int const lowest = input.in_orbit ? 2 : lowest_attached(input.phase);
+	float length = 0;
+	for(int k=lowest; k<3; ++k)
+		length += settings.length[k];
+	vec3 const inertia = cylinder_inertia(std::max(input.mass, 1.0f), length, settings.radius);
+
+	// attitude error: rotation of the body frame onto the guidance direction, without roll, and
+	// rate of the guidance direction (e.g. prograde in orbit) as the rate to follow
+	// (over the mission time between two inputs, as several steps may share one)
+	vec3 const target = attitude_guidance(input, parameters, settings);
+	if(input.t > state.target_time){
+		state.target_rate = cross(state.target, target)/static_cast<float>(input.t - state.target_time);
+		if(norm(state.target_rate) > settings.max_guidance_rate)
+			state.target_rate = vec3(0,0,0); // a step (e.g. the orbit insertion), not a rate to follow
+		state.target_time = input.t;
+	}
+	state.target = target;
+	rigid_body_attitude& stack = state.stack;
+	vec3 const target_rate = rotate(conjugate(stack.q), state.target_rate);
+	vec3 const axis = rotate(stack.q, vec3(0,0,1));
+	state.error = std::acos(std::min(1.0f, std::max(-1.0f, dot(axis, state.target))));
+	quaternion const goal = quaternion_between(axis, state.target)*stack.q;
+	vec3 const error = quaternion_rotation_vector(conjugate(stack.q)*goal);
+
+	// PID as angular accelerations, times the inertia
+	float const kp = settings.bandwidth*settings.bandwidth;
+	float const kd = 2*settings.damping*settings.bandwidth;
+	float const ki = kp/settings.integral_time;
+	vec3 const alpha = kp*error + ki*state.integral + kd*(target_rate - stack.w);
+	vec3 torque(inertia.x*alpha.x, inertia.y*alpha.y, inertia.z*alpha.z);
+
+	// gimbal of the engine (arm: half the stack) and reaction control
+	float const pitch_yaw = settings.rcs_torque + (input.engine_on ? input.thrust*0.5f*length*std::sin(settings.max_gimbal) : 0.0f);
+	float const limit[3] = {pitch_yaw, pitch_yaw, settings.rcs_torque};
+	float* const component[3] = {&torque.x, &torque.y, &torque.z};
+	state.saturated = false;
+	for(int a=0; a<3; ++a){
+		if(std::abs(*component[a]) > limit[a]){
+			*component[a] = std::copysign(limit[a], *component[a]);
+			state.saturated = true;
+		}
+	}
+	if(!state.saturated){
+		state.integral += dt*error;
+		float const n = norm(state.integral);
+		if(n > settings.integral_limit)
+			state.integral *= settings.integral_limit/n;
+	}
+	state.torque = torque;
+	rotate_body(stack, inertia, torque, dt);
+
+	// the separated stages turn freely until they land (or stop with them at the orbit start),
+	// the attached parts with the stack
+	for(int k=0; k<mission_body_count; ++k){
+		rigid_body_attitude& body = state.bodies[k];
+		if(k>=2 || state.phase[k]==body_attached)
+			body = stack;
+		else if(state.phase[k]==body_ballistic && !input.in_orbit)
+			rotate_body(body, cylinder_inertia(engine(parameters, k).dry_mass, settings.length[k], settings.radius), vec3(0,0,0), dt);
+		else if(state.phase[k]==body_landed)
+			body.w = vec3(0,0,0);
+	}
+	state.t += dt;
+	state.steps++;
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+/**
+Attitude of the rocket and of its stages: rigid bodies with a quaternion attitude, and the
+autopilot steering the stack along the guidance direction.
+ - body frame: z along the axis of the rocket (the engine pushes along +z), the quaternion of a
+   body rotates its frame into the world frame
+ - rotation: Euler's equations I dw/dt = torque - w x (I w) in the body frame (principal axes of a
+   solid cylinder), the attitude turned by the exact rotation of w*dt over each step
+ - guidance: thrust direction of the pitch program while an engine of the dynamic model burns
+   (flight_thrust_direction), direction of the velocity otherwise (no angle of attack: the gravity
+   turn of the ascent follows it), prograde for the satellite in orbit
+ - autopilot: PID on the attitude error (rotation vector of the body frame), with the gains of a
+   second order loop of natural frequency bandwidth. The torque is limited by the gimbal of the
+   active engine (pitch and yaw) and by the reaction control (roll, and every axis when no engine
+   burns); the integral is bounded, and frozen while saturated
+ - stages: the attached ones share the attitude of the stack. At separation a stage keeps the
+   attitude and the rates of the stack plus a tumble, then rotates freely until it lands
+The translation of the mission does not depend on the attitude: the timeline, the batch tools and
+the time warp need a mission independent of the wall clock. The dynamic model pushes along the
+guidance direction, which the autopilot tracks, and the attitude error tells how closely.
+*/
+
+#include "simulation/mission.hpp"
+
+#include <cstdint>
+
+namespace sim {
+
+// ****************************************** //
+// Quaternions
+// ****************************************** //
+
+struct quaternion
+{
+	float w = 1.0f;
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+
+	quaternion() = default;
+	constexpr quaternion(float w_arg, float x_arg, float y_arg, float z_arg) : w(w_arg), x(x_arg), y(y_arg), z(z_arg) {}
+};
+
+inline quaternion operator*(quaternion const& a, quaternion const& b)
+{
+	return {a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z,
+	        a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+	        a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+	        a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w};
+}
+inline quaternion conjugate(quaternion const& q) { return {q.w, -q.x, -q.y, -q.z}; }
+quaternion normalize(quaternion const& q);
+
+// Rotation of v by the unit quaternion q
+vec3 rotate(quaternion const& q, vec3 const& v);
+// Rotation of axis*angle (r = angle*axis), and back (angle in [0,pi])
+quaternion quaternion_from_rotation_vector(vec3 const& r);
+vec3 quaternion_rotation_vector(quaternion const& q);
+// Shortest rotation taking the direction a to the direction b
+quaternion quaternion_between(vec3 const& a, vec3 const& b);
+
+// ****************************************** //
+// Rigid bodies and autopilot
+// ****************************************** //
+
+struct attitude_settings
+{
+	// solid cylinders for the inertia, at the scale of the scene
+	float radius = 0.5f;
+	float length[3] = {5.0f, 2.0f, 3.0f};  // first stage, second stage, upper part (fairing)
+
+	float max_gimbal = 0.1f;     // rad
+	float rcs_torque = 5000.0f;  // N m per axis, reaction control
+	float bandwidth = 1.5f;      // rad/s, of the closed loop
+	float damping = 0.9f;
+	float integral_time = 3.0f;  // s
+	float integral_limit = 0.02f; // rad s, a large maneuver does not wind it up
+	float separation_tumble = 0.3f; // rad/s, given to a stage by its separation
+	float min_speed = 1.0f;      // m/s, slower the velocity gives no direction
+	float max_guidance_rate = 2.0f; // rad/s, faster changes of the guidance direction are steps
+};
+
+struct rigid_body_attitude
+{
+	quaternion q;   // body to world
+	vec3 w;         // angular velocity in the body frame (rad/s)
+};
+
+// The mission at one time, as the attitude needs it
+struct attitude_input
+{
+	double t = 0;
+	vec3 rocket_v;
+	vec3 velocity[mission_body_count];
+	int32_t phase[mission_body_count] = {};
+	bool in_orbit = false;
+	bool engine_on = false;
+	float thrust = 0;  // N, of the active engine
+	float mass = 0;    // kg, of the stack
+};
+
+attitude_input attitude_input_from(mission_state const& state, mission_parameters const& parameters);
+
+struct attitude_state
+{
+	double t = 0;
+	rigid_body_attitude stack;           // attached parts, then the satellite in orbit
+	rigid_body_attitude bodies[mission_body_count];
+	int32_t phase[mission_body_count] = {};
+
+	vec3 target;          // guidance direction (world)
+	vec3 target_rate;     // its angular velocity (world, rad/s)
+	double target_time = 0; // mission time of the input it was computed from
+	float error = 0;      // angle between the axis of the stack and the target (rad)
+	vec3 integral;        // of the attitude error (rad s)
+	vec3 torque;          // applied to the stack (body frame, N m)
+	bool saturated = false;
+	uint64_t steps = 0;
+	uint64_t resets = 0;
+};
+
+// Guidance direction of the stack for this input (unit, world frame)
+vec3 attitude_guidance(attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings);
+
+// Every body on the guidance direction at rest, e.g. at the launch or after a jump in time
+void attitude_reset(attitude_state& state, attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings);
+
+// One control step of dt: separations, guidance, autopilot and rotation of every body
+void attitude_step(attitude_state& state, attitude_input const& input, mission_parameters const& parameters, attitude_settings const& settings, float dt);
+
+}
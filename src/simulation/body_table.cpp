@@ -0,0 +1,294 @@
+#include "simulation/body_table.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ROCKET_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+Note on reproducibility: the scalar, SSE and AVX2 paths evaluate the same expressions in the same
+order, and the file is compiled with -ffp-contract=off (see CMakeLists.txt) so that no path gets
+fused multiply-adds the others do not have.
+*/
+
+namespace sim {
+
+void body_table::resize(size_t n)
+{
+	for(std::vector<float>* column : {&px,&py,&pz,&vx,&vy,&vz,&p0x,&p0y,&p0z,&v0x,&v0y,&v0z,&t_separation})
+		column->resize(n, 0.0f);
+	phase.resize(n, body_inactive);
+}
+
+size_t body_table::add(vec3 const& p0, vec3 const& v, float t_separation_arg)
+{
+	size_t const k = size();
+	resize(k+1);
+	p0x[k] = p0.x; p0y[k] = p0.y; p0z[k] = p0.z;
+	set_position(k, p0);
+	set_velocity(k, v);
+	t_separation[k] = t_separation_arg;
+	phase[k] = body_attached;
+	return k;
+}
+
+// Constants shared by all the code paths
+struct kernel_constants
+{
+	float t;
+	float ngx, ngy, ngz;  // -g
+	float hgx, hgy, hgz;  // -0.5*g
+};
+
+// Scalar version of the kernel for bodies [begin,end), also used for the tail of the SIMD loops
+static void advance_scalar(body_table& b, kernel_constants const& c, size_t begin, size_t end)
+{
+	for(size_t k=begin; k<end; ++k){
+		int32_t const phase = b.phase[k];
+		bool const attached = phase==body_attached;
+		bool const separating = attached && (c.t >= b.t_separation[k]);
+		bool const stay_attached = attached && !separating;
+		bool const ballistic = phase==body_ballistic;
+		bool const flying = ballistic && (b.pz[k] > 0.0f);
+		bool const landing = ballistic && !(b.pz[k] > 0.0f);
+
+		float const tau = c.t - b.t_separation[k];
+
+		// initial conditions at separation
+		float const p0x = separating ? b.px[k] : b.p0x[k];
+		float const p0y = separating ? b.py[k] : b.p0y[k];
+		float const p0z = separating ? b.pz[k] : b.p0z[k];
+		float const v0x = separating ? b.vx[k] : b.v0x[k];
+		float const v0y = separating ? b.vy[k] : b.v0y[k];
+		float const v0z = separating ? b.vz[k] : b.v0z[k];
+
+		// candidate states
+		float const ax = b.p0x[k] + b.vx[k]*c.t;
+		float const ay = b.p0y[k] + b.vy[k]*c.t;
+		float const az = b.p0z[k] + b.vz[k]*c.t;
+
+		float const fvx = c.ngx*tau + b.v0x[k];
+		float const fvy = c.ngy*tau + b.v0y[k];
+		float const fvz = c.ngz*tau + b.v0z[k];
+		float const fpx = (c.hgx*tau*tau + b.v0x[k]*tau) + b.p0x[k];
+		float const fpy = (c.hgy*tau*tau + b.v0y[k]*tau) + b.p0y[k];
+		float const fpz = (c.hgz*tau*tau + b.v0z[k]*tau) + b.p0z[k];
+
+		b.px[k] = stay_attached ? ax : flying ? fpx : landing ? 0.0f : b.px[k];
+		b.py[k] = stay_attached ? ay : flying ? fpy : landing ? 0.0f : b.py[k];
+		b.pz[k] = stay_attached ? az : flying ? fpz : landing ? 0.0f : b.pz[k];
+		b.vx[k] = flying ? fvx : landing ? 0.0f : b.vx[k];
+		b.vy[k] = flying ? fvy : landing ? 0.0f : b.vy[k];
+		b.vz[k] = flying ? fvz : landing ? 0.0f : b.vz[k];
+
+		b.p0x[k] = p0x; b.p0y[k] = p0y; b.p0z[k] = p0z;
+		b.v0x[k] = v0x; b.v0y[k] = v0y; b.v0z[k] = v0z;
+		b.phase[k] = separating ? int32_t(body_ballistic) : landing ? int32_t(body_landed) : phase;
+	}
+}
+
+#ifdef ROCKET_SIMD_X86
+
+// SSE2 version: 4 bodies per iteration, masks combined with and/andnot/or
+static inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask,a), _mm_andnot_ps(mask,b));
+}
+
+static void advance_sse(body_table& b, kernel_constants const& c, size_t begin, size_t n)
+{
+	__m128 const t = _mm_set1_ps(c.t);
+	__m128 const ngx = _mm_set1_ps(c.ngx), ngy = _mm_set1_ps(c.ngy), ngz = _mm_set1_ps(c.ngz);
+	__m128 const hgx = _mm_set1_ps(c.hgx), hgy = _mm_set1_ps(c.hgy), hgz = _mm_set1_ps(c.hgz);
+	__m128 const zero = _mm_setzero_ps();
+	__m128i const attached_id = _mm_set1_epi32(body_attached);
+	__m128i const ballistic_id = _mm_set1_epi32(body_ballistic);
+	__m128i const landed_id = _mm_set1_epi32(body_landed);
+
+	size_t const n4 = n - (n-begin)%4;
+	for(size_t k=begin; k<n4; k+=4){
+		__m128i const phase = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&b.phase[k]));
+		__m128 const ts = _mm_loadu_ps(&b.t_separation[k]);
+		__m128 const px = _mm_loadu_ps(&b.px[k]), py = _mm_loadu_ps(&b.py[k]), pz = _mm_loadu_ps(&b.pz[k]);
+		__m128 const vx = _mm_loadu_ps(&b.vx[k]), vy = _mm_loadu_ps(&b.vy[k]), vz = _mm_loadu_ps(&b.vz[k]);
+		__m128 const p0x = _mm_loadu_ps(&b.p0x[k]), p0y = _mm_loadu_ps(&b.p0y[k]), p0z = _mm_loadu_ps(&b.p0z[k]);
+		__m128 const v0x = _mm_loadu_ps(&b.v0x[k]), v0y = _mm_loadu_ps(&b.v0y[k]), v0z = _mm_loadu_ps(&b.v0z[k]);
+
+		__m128 const attached = _mm_castsi128_ps(_mm_cmpeq_epi32(phase, attached_id));
+		__m128 const separating = _mm_and_ps(attached, _mm_cmpge_ps(t, ts));
+		__m128 const stay_attached = _mm_andnot_ps(separating, attached);
+		__m128 const ballistic = _mm_castsi128_ps(_mm_cmpeq_epi32(phase, ballistic_id));
+		__m128 const above = _mm_cmpgt_ps(pz, zero);
+		__m128 const flying = _mm_and_ps(ballistic, above);
+		__m128 const landing = _mm_andnot_ps(above, ballistic);
+
+		__m128 const tau = _mm_sub_ps(t, ts);
+
+		__m128 const ax = _mm_add_ps(p0x, _mm_mul_ps(vx, t));
+		__m128 const ay = _mm_add_ps(p0y, _mm_mul_ps(vy, t));
+		__m128 const az = _mm_add_ps(p0z, _mm_mul_ps(vz, t));
+
+		__m128 const fvx = _mm_add_ps(_mm_mul_ps(ngx, tau), v0x);
+		__m128 const fvy = _mm_add_ps(_mm_mul_ps(ngy, tau), v0y);
+		__m128 const fvz = _mm_add_ps(_mm_mul_ps(ngz, tau), v0z);
+		__m128 const fpx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(hgx, tau), tau), _mm_mul_ps(v0x, tau)), p0x);
+		__m128 const fpy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(hgy, tau), tau), _mm_mul_ps(v0y, tau)), p0y);
+		__m128 const fpz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(hgz, tau), tau), _mm_mul_ps(v0z, tau)), p0z);
+
+		// landing bodies go to zero: clear the lanes instead of selecting a zero register
+		_mm_storeu_ps(&b.px[k], _mm_andnot_ps(landing, select_sse(stay_attached, ax, select_sse(flying, fpx, px))));
+		_mm_storeu_ps(&b.py[k], _mm_andnot_ps(landing, select_sse(stay_attached, ay, select_sse(flying, fpy, py))));
+		_mm_storeu_ps(&b.pz[k], _mm_andnot_ps(landing, select_sse(stay_attached, az, select_sse(flying, fpz, pz))));
+		_mm_storeu_ps(&b.vx[k], _mm_andnot_ps(landing, select_sse(flying, fvx, vx)));
+		_mm_storeu_ps(&b.vy[k], _mm_andnot_ps(landing, select_sse(flying, fvy, vy)));
+		_mm_storeu_ps(&b.vz[k], _mm_andnot_ps(landing, select_sse(flying, fvz, vz)));
+
+		_mm_storeu_ps(&b.p0x[k], select_sse(separating, px, p0x));
+		_mm_storeu_ps(&b.p0y[k], select_sse(separating, py, p0y));
+		_mm_storeu_ps(&b.p0z[k], select_sse(separating, pz, p0z));
+		_mm_storeu_ps(&b.v0x[k], select_sse(separating, vx, v0x));
+		_mm_storeu_ps(&b.v0y[k], select_sse(separating, vy, v0y));
+		_mm_storeu_ps(&b.v0z[k], select_sse(separating, vz, v0z));
+
+		__m128i const new_phase = _mm_castps_si128(select_sse(separating, _mm_castsi128_ps(ballistic_id),
+			select_sse(landing, _mm_castsi128_ps(landed_id), _mm_castsi128_ps(phase))));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&b.phase[k]), new_phase);
+	}
+	advance_scalar(b, c, n4, n);
+}
+
+// AVX2 version: 8 bodies per iteration. Only avx2 is enabled (not fma) to keep the same rounding as the other paths.
+__attribute__((target("avx2")))
+static inline __m256 select_avx(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_blendv_ps(b, a, mask);
+}
+
+__attribute__((target("avx2")))
+static void advance_avx2(body_table& b, kernel_constants const& c, size_t n)
+{
+	__m256 const t = _mm256_set1_ps(c.t);
+	__m256 const ngx = _mm256_set1_ps(c.ngx), ngy = _mm256_set1_ps(c.ngy), ngz = _mm256_set1_ps(c.ngz);
+	__m256 const hgx = _mm256_set1_ps(c.hgx), hgy = _mm256_set1_ps(c.hgy), hgz = _mm256_set1_ps(c.hgz);
+	__m256 const zero = _mm256_setzero_ps();
+	__m256i const attached_id = _mm256_set1_epi32(body_attached);
+	__m256i const ballistic_id = _mm256_set1_epi32(body_ballistic);
+	__m256i const landed_id = _mm256_set1_epi32(body_landed);
+
+	size_t const n8 = n - n%8;
+	for(size_t k=0; k<n8; k+=8){
+		__m256i const phase = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(&b.phase[k]));
+		__m256 const ts = _mm256_loadu_ps(&b.t_separation[k]);
+		__m256 const px = _mm256_loadu_ps(&b.px[k]), py = _mm256_loadu_ps(&b.py[k]), pz = _mm256_loadu_ps(&b.pz[k]);
+		__m256 const vx = _mm256_loadu_ps(&b.vx[k]), vy = _mm256_loadu_ps(&b.vy[k]), vz = _mm256_loadu_ps(&b.vz[k]);
+		__m256 const p0x = _mm256_loadu_ps(&b.p0x[k]), p0y = _mm256_loadu_ps(&b.p0y[k]), p0z = _mm256_loadu_ps(&b.p0z[k]);
+		__m256 const v0x = _mm256_loadu_ps(&b.v0x[k]), v0y = _mm256_loadu_ps(&b.v0y[k]), v0z = _mm256_loadu_ps(&b.v0z[k]);
+
+		__m256 const attached = _mm256_castsi256_ps(_mm256_cmpeq_epi32(phase, attached_id));
+		__m256 const separating = _mm256_and_ps(attached, _mm256_cmp_ps(t, ts, _CMP_GE_OQ));
+		__m256 const stay_attached = _mm256_andnot_ps(separating, attached);
+		__m256 const ballistic = _mm256_castsi256_ps(_mm256_cmpeq_epi32(phase, ballistic_id));
+		__m256 const above = _mm256_cmp_ps(pz, zero, _CMP_GT_OQ);
+		__m256 const flying = _mm256_and_ps(ballistic, above);
+		__m256 const landing = _mm256_andnot_ps(above, ballistic);
+
+		__m256 const tau = _mm256_sub_ps(t, ts);
+
+		__m256 const ax = _mm256_add_ps(p0x, _mm256_mul_ps(vx, t));
+		__m256 const ay = _mm256_add_ps(p0y, _mm256_mul_ps(vy, t));
+		__m256 const az = _mm256_add_ps(p0z, _mm256_mul_ps(vz, t));
+
+		__m256 const fvx = _mm256_add_ps(_mm256_mul_ps(ngx, tau), v0x);
+		__m256 const fvy = _mm256_add_ps(_mm256_mul_ps(ngy, tau), v0y);
+		__m256 const fvz = _mm256_add_ps(_mm256_mul_ps(ngz, tau), v0z);
+		__m256 const fpx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(hgx, tau), tau), _mm256_mul_ps(v0x, tau)), p0x);
+		__m256 const fpy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(hgy, tau), tau), _mm256_mul_ps(v0y, tau)), p0y);
+		__m256 const fpz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(hgz, tau), tau), _mm256_mul_ps(v0z, tau)), p0z);
+
+		_mm256_storeu_ps(&b.px[k], _mm256_andnot_ps(landing, select_avx(stay_attached, ax, select_avx(flying, fpx, px))));
+		_mm256_storeu_ps(&b.py[k], _mm256_andnot_ps(landing, select_avx(stay_attached, ay, select_avx(flying, fpy, py))));
+		_mm256_storeu_ps(&b.pz[k], _mm256_andnot_ps(landing, select_avx(stay_attached, az, select_avx(flying, fpz, pz))));
+		_mm256_storeu_ps(&b.vx[k], _mm256_andnot_ps(landing, select_avx(flying, fvx, vx)));
+		_mm256_storeu_ps(&b.vy[k], _mm256_andnot_ps(landing, select_avx(flying, fvy, vy)));
+		_mm256_storeu_ps(&b.vz[k], _mm256_andnot_ps(landing, select_avx(flying, fvz, vz)));
+
+		_mm256_storeu_ps(&b.p0x[k], select_avx(separating, px, p0x));
+		_mm256_storeu_ps(&b.p0y[k], select_avx(separating, py, p0y));
+		_mm256_storeu_ps(&b.p0z[k], select_avx(separating, pz, p0z));
+		_mm256_storeu_ps(&b.v0x[k], select_avx(separating, vx, v0x));
+		_mm256_storeu_ps(&b.v0y[k], select_avx(separating, vy, v0y));
+		_mm256_storeu_ps(&b.v0z[k], select_avx(separating, vz, v0z));
+
+		__m256i const new_phase = _mm256_castps_si256(select_avx(separating, _mm256_castsi256_ps(ballistic_id),
+			select_avx(landing, _mm256_castsi256_ps(landed_id), _mm256_castsi256_ps(phase))));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(&b.phase[k]), new_phase);
+	}
+	advance_sse(b, c, n8, n); // remaining bodies, e.g. the 4 bodies of a single mission
+}
+
+#endif
+
+simd_level body_table_detect_simd()
+{
+	static simd_level const level = [](){
+		simd_level best = simd_level::scalar;
+#ifdef ROCKET_SIMD_X86
+		best = simd_level::sse;
+		if(__builtin_cpu_supports("avx2"))
+			best = simd_level::avx2;
+#endif
+		// allow to force a lower level, e.g. to compare the code paths
+		char const* forced = std::getenv("ROCKET_SIMD");
+		if(forced!=nullptr){
+			if(std::strcmp(forced,"scalar")==0)
+				best = simd_level::scalar;
+			else if(std::strcmp(forced,"sse")==0 && best!=simd_level::scalar)
+				best = simd_level::sse;
+		}
+		return best;
+	}();
+	return level;
+}
+
+char const* simd_level_name(simd_level level)
+{
+	switch(level){
+	case simd_level::avx2: return "avx2";
+	case simd_level::sse: return "sse";
+	default: return "scalar";
+	}
+}
+
+void body_table_advance(body_table& bodies, float t, vec3 const& g, simd_level level)
+{
+	kernel_constants c;
+	c.t = t;
+	c.ngx = -g.x; c.ngy = -g.y; c.ngz = -g.z;
+	vec3 const hg = -0.5f*g;
+	c.hgx = hg.x; c.hgy = hg.y; c.hgz = hg.z;
+
+	size_t const n = bodies.size();
+#ifdef ROCKET_SIMD_X86
+	if(level==simd_level::avx2){
+		advance_avx2(bodies, c, n);
+		return;
+	}
+	if(level==simd_level::sse){
+		advance_sse(bodies, c, 0, n);
+		return;
+	}
+#else
+	(void)level;
+#endif
+	advance_scalar(bodies, c, 0, n);
+}
+
+void body_table_advance(body_table& bodies, float t, vec3 const& g)
+{
+	body_table_advance(bodies, t, g, body_table_detect_simd());
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+Structure-of-arrays table of rocket bodies (stages, payload fairing, satellite, ...).
+Each column is contiguous so that the integration kernel processes 4 (SSE) or 8 (AVX2) bodies
+per instruction. The kernel is branch-free: separation, ballistic fall and floor clamping are
+expressed as masks, and the scalar fallback performs exactly the same float operations so that
+every code path gives bit-identical results.
+*/
+
+#include "simulation/sim_math.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace sim {
+
+// Phase of a body, stored as int32 to be compared directly in SIMD registers
+enum body_phase : int32_t
+{
+	body_attached = 0,   // moves with the rocket: p = p0 + v*t
+	body_ballistic = 1,  // separated, falls under gravity from (p0,v0) since t_separation
+	body_landed = 2,     // reached the ground, stays there (at the origin when clamped by the kernel)
+	body_inactive = 3    // not handled by the kernel (e.g. satellite in orbit)
+};
+
+// Instruction set used by body_table_advance
+enum class simd_level { scalar, sse, avx2 };
+
+struct body_table
+{
+	// position and velocity at time t
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+
+	// initial conditions, reset at separation
+	std::vector<float> p0x, p0y, p0z;
+	std::vector<float> v0x, v0y, v0z;
+
+	std::vector<float> t_separation; // +infinity for bodies that never separate
+	std::vector<int32_t> phase;      // body_phase
+
+	size_t size() const { return phase.size(); }
+	void resize(size_t n);
+	void clear() { resize(0); }
+
+	// Add an attached body at position p0 moving with velocity v, separating at t_separation. Returns its index.
+	size_t add(vec3 const& p0, vec3 const& v, float t_separation_arg = std::numeric_limits<float>::infinity());
+
+	vec3 position(size_t k) const { return {px[k], py[k], pz[k]}; }
+	vec3 velocity(size_t k) const { return {vx[k], vy[k], vz[k]}; }
+	void set_position(size_t k, vec3 const& p) { px[k]=p.x; py[k]=p.y; pz[k]=p.z; }
+	void set_velocity(size_t k, vec3 const& v) { vx[k]=v.x; vy[k]=v.y; vz[k]=v.z; }
+	bool separated(size_t k) const { return phase[k]==body_ballistic || phase[k]==body_landed; }
+};
+
+// Best instruction set supported by the CPU (can be forced with the environment variable ROCKET_SIMD=scalar|sse|avx2)
+simd_level body_table_detect_simd();
+char const* simd_level_name(simd_level level);
+
+// Evaluate all the bodies at time t
+//  - attached bodies reaching t_separation store their current p/v as p0/v0 and become ballistic
+//  - ballistic bodies above the floor follow p = -0.5*g*tau^2 + v0*tau + p0 (tau = t - t_separation)
+//  - ballistic bodies below the floor are clamped to the origin and become landed (the missions land
+//    their stages on the terrain before, at the impact point: see mission.cpp)
+void body_table_advance(body_table& bodies, float t, vec3 const& g, simd_level level);
+void body_table_advance(body_table& bodies, float t, vec3 const& g); // uses body_table_detect_simd()
+
+}
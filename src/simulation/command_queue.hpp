@@ -0,0 +1,52 @@
+#pragma once
+
+/**
+Bounded lock-free queue between one producer thread and one consumer thread (ring of Capacity
+slots, a power of two). push() fails instead of waiting when the ring is full, pop() when it is
+empty: neither thread is ever blocked by the other.
+*/
+
+#include <atomic>
+#include <cstddef>
+
+namespace sim {
+
+template <typename T, size_t Capacity>
+class command_queue
+{
+	static_assert(Capacity>0 && (Capacity & (Capacity-1))==0, "the capacity of a command_queue must be a power of two");
+
+public:
+	command_queue() = default;
+	command_queue(command_queue const&) = delete;
+	command_queue& operator=(command_queue const&) = delete;
+
+	// Producer
+	bool push(T const& value)
+	{
+		size_t const tail = write.load(std::memory_order_relaxed);
+		if(tail - read.load(std::memory_order_acquire) == Capacity)
+			return false;
+		slots[tail & (Capacity-1)] = value;
+		write.store(tail+1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer
+	bool pop(T& value)
+	{
+		size_t const head = read.load(std::memory_order_relaxed);
+		if(head == write.load(std::memory_order_acquire))
+			return false;
+		value = slots[head & (Capacity-1)];
+		read.store(head+1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T slots[Capacity];
+	alignas(64) std::atomic<size_t> write{0}; // next slot of the producer
+	alignas(64) std::atomic<size_t> read{0};  // next slot of the consumer
+};
+
+}
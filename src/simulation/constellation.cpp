@@ -0,0 +1,345 @@
+#include "simulation/constellation.hpp"
+#include "simulation/thread_pool.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ROCKET_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+As in body_table.cpp, the three paths evaluate the same expressions in the same order (the file is
+compiled with -ffp-contract=off), and the roundings to the nearest integer of the scalar path
+are the ones of the SIMD conversions (cvtps2dq, default rounding mode).
+*/
+
+namespace sim {
+
+static double const two_pi = 6.283185307179586;
+
+void constellation::clear()
+{
+	elements.clear();
+	for(std::vector<float>* column : {&a,&e,&b,&cos_i,&sin_i,&mean_anomaly,&raan,&argument_of_perigee,
+		&mean_anomaly_rate,&raan_rate,&argument_of_perigee_rate,&px,&py,&pz})
+		column->clear();
+	columns_valid = false;
+}
+
+size_t constellation::add(orbit_elements const& orbit)
+{
+	size_t const k = size();
+	elements.push_back(orbit);
+	a.push_back(static_cast<float>(orbit.semi_major_axis));
+	e.push_back(static_cast<float>(orbit.eccentricity));
+	b.push_back(static_cast<float>(orbit.semi_major_axis*std::sqrt(1-orbit.eccentricity*orbit.eccentricity)));
+	cos_i.push_back(static_cast<float>(std::cos(orbit.inclination)));
+	sin_i.push_back(static_cast<float>(std::sin(orbit.inclination)));
+	for(std::vector<float>* column : {&mean_anomaly,&raan,&argument_of_perigee,&mean_anomaly_rate,&raan_rate,&argument_of_perigee_rate,&px,&py,&pz})
+		column->push_back(0.0f);
+	columns_valid = false;
+	return k;
+}
+
+void constellation::set_j2(bool value)
+{
+	with_j2 = value;
+	columns_valid = false;
+}
+
+static size_t const propagation_grain = 4096;
+
+static double epoch_of(double t)
+{
+	return constellation_rebase_interval*std::round(t/constellation_rebase_interval);
+}
+
+void constellation::rebase(double t, thread_pool* pool)
+{
+	t = epoch_of(t);
+	if(pool!=nullptr && size()>propagation_grain)
+		pool->parallel_for(size(), propagation_grain, [&](size_t begin, size_t end){ rebase_range(t, begin, end); });
+	else
+		rebase_range(t, 0, size());
+	epoch_time = t;
+	columns_valid = true;
+}
+
+void constellation::rebase_range(double t, size_t begin, size_t end)
+{
+	for(size_t k=begin; k<end; ++k){
+		orbit_elements const& o = elements[k];
+		orbit_rates const rates = orbit_secular_rates(o, planet, with_j2);
+		mean_anomaly[k] = static_cast<float>(wrap_angle(o.mean_anomaly + rates.mean_anomaly*t));
+		raan[k] = static_cast<float>(wrap_angle(o.raan + rates.raan*t));
+		argument_of_perigee[k] = static_cast<float>(wrap_angle(o.argument_of_perigee + rates.argument_of_perigee*t));
+		mean_anomaly_rate[k] = static_cast<float>(rates.mean_anomaly);
+		raan_rate[k] = static_cast<float>(rates.raan);
+		argument_of_perigee_rate[k] = static_cast<float>(rates.argument_of_perigee);
+	}
+}
+
+bool constellation::needs_rebase(double t) const
+{
+	return !columns_valid || epoch_of(t)!=epoch_time;
+}
+
+void constellation_add_walker(constellation& c, walker_pattern const& pattern)
+{
+	int const per_plane = pattern.satellites/pattern.planes;
+	int const remainder = pattern.satellites%pattern.planes;
+	for(int plane=0; plane<pattern.planes; ++plane){
+		int const count = per_plane + (plane<remainder ? 1 : 0);
+		for(int k=0; k<count; ++k){
+			orbit_elements o;
+			o.semi_major_axis = c.planet.radius + pattern.altitude;
+			o.inclination = pattern.inclination;
+			o.raan = two_pi*plane/pattern.planes;
+			o.mean_anomaly = wrap_angle(two_pi*k/count + two_pi*pattern.phasing*plane/pattern.satellites);
+			c.add(o);
+		}
+	}
+}
+
+// ****************************************** //
+// Kernels
+// ****************************************** //
+
+// sin/cos: reduction to [-pi/4,pi/4] around the nearest multiple q of pi/2 (pi/2 split in two
+// floats), Taylor polynomials, then exchange and signs given by the quadrant q
+static float const two_over_pi = 0.636619772f;
+static float const half_pi_high = 1.57079637f;
+static float const half_pi_low = -4.37113883e-8f;
+static float const sin_1 = -1.0f/6, sin_2 = 1.0f/120, sin_3 = -1.0f/5040, sin_4 = 1.0f/362880;
+static float const cos_1 = -1.0f/2, cos_2 = 1.0f/24, cos_3 = -1.0f/720, cos_4 = 1.0f/40320, cos_5 = -1.0f/3628800;
+
+static inline void sincos_scalar(float x, float& s, float& c)
+{
+	// round to nearest even by adding 1.5*2^23 (|x| is far below 2^22), as cvtps2dq does
+	float const qf = (x*two_over_pi + 12582912.0f) - 12582912.0f;
+	int32_t const q = static_cast<int32_t>(qf);
+	float const r = (x - qf*half_pi_high) - qf*half_pi_low;
+	float const r2 = r*r;
+	float const sr = r + (r*r2)*(sin_1 + r2*(sin_2 + r2*(sin_3 + r2*sin_4)));
+	float const cr = 1.0f + r2*(cos_1 + r2*(cos_2 + r2*(cos_3 + r2*(cos_4 + r2*cos_5))));
+	bool const swap = (q & 1)!=0;
+	float const sv = swap ? cr : sr;
+	float const cv = swap ? sr : cr;
+	s = (q & 2)!=0 ? -sv : sv;
+	c = ((q+1) & 2)!=0 ? -cv : cv;
+}
+
+static void propagate_scalar(constellation& c, float tau, size_t begin, size_t end)
+{
+	for(size_t k=begin; k<end; ++k){
+		float const e = c.e[k];
+		float const M = c.mean_anomaly[k] + c.mean_anomaly_rate[k]*tau;
+		float const W = c.raan[k] + c.raan_rate[k]*tau;
+		float const w = c.argument_of_perigee[k] + c.argument_of_perigee_rate[k]*tau;
+
+		// Kepler's equation E - e*sin(E) = M
+		float sE, cE;
+		sincos_scalar(M, sE, cE);
+		float E = M + e*sE;
+		for(int it=0; it<constellation_kepler_iterations; ++it){
+			sincos_scalar(E, sE, cE);
+			E = E - ((E - e*sE) - M)/(1.0f - e*cE);
+		}
+		sincos_scalar(E, sE, cE);
+		float const x = c.a[k]*(cE - e);
+		float const y = c.b[k]*sE;
+
+		// orbital plane to inertial frame
+		float sW, cW, sw, cw;
+		sincos_scalar(W, sW, cW);
+		sincos_scalar(w, sw, cw);
+		float const ci = c.cos_i[k], si = c.sin_i[k];
+		float const Px = cW*cw - (sW*sw)*ci;
+		float const Py = sW*cw + (cW*sw)*ci;
+		float const Pz = sw*si;
+		float const Qx = -(cW*sw + (sW*cw)*ci);
+		float const Qy = (cW*cw)*ci - sW*sw;
+		float const Qz = cw*si;
+		c.px[k] = x*Px + y*Qx;
+		c.py[k] = x*Py + y*Qy;
+		c.pz[k] = x*Pz + y*Qz;
+	}
+}
+
+#ifdef ROCKET_SIMD_X86
+
+// SSE2 version: 4 satellites per iteration
+static inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask,a), _mm_andnot_ps(mask,b));
+}
+
+static inline void sincos_sse(__m128 x, __m128& s, __m128& c)
+{
+	__m128i const one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+	__m128i const q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(two_over_pi)));
+	__m128 const qf = _mm_cvtepi32_ps(q);
+	__m128 const r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(half_pi_high))), _mm_mul_ps(qf, _mm_set1_ps(half_pi_low)));
+	__m128 const r2 = _mm_mul_ps(r, r);
+	__m128 const sr = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), _mm_add_ps(_mm_set1_ps(sin_1), _mm_mul_ps(r2,
+		_mm_add_ps(_mm_set1_ps(sin_2), _mm_mul_ps(r2, _mm_add_ps(_mm_set1_ps(sin_3), _mm_mul_ps(r2, _mm_set1_ps(sin_4)))))))));
+	__m128 const cr = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, _mm_add_ps(_mm_set1_ps(cos_1), _mm_mul_ps(r2,
+		_mm_add_ps(_mm_set1_ps(cos_2), _mm_mul_ps(r2, _mm_add_ps(_mm_set1_ps(cos_3), _mm_mul_ps(r2,
+		_mm_add_ps(_mm_set1_ps(cos_4), _mm_mul_ps(r2, _mm_set1_ps(cos_5)))))))))));
+	__m128 const swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	// bit 1 of the quadrant moved to the sign bit
+	__m128 const negate_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+	__m128 const negate_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+	s = _mm_xor_ps(select_sse(swap, cr, sr), negate_s);
+	c = _mm_xor_ps(select_sse(swap, sr, cr), negate_c);
+}
+
+static void propagate_sse(constellation& c, float tau_arg, size_t begin, size_t end)
+{
+	__m128 const tau = _mm_set1_ps(tau_arg);
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const sign = _mm_set1_ps(-0.0f);
+
+	size_t const end4 = end - (end-begin)%4;
+	for(size_t k=begin; k<end4; k+=4){
+		__m128 const e = _mm_loadu_ps(&c.e[k]);
+		__m128 const M = _mm_add_ps(_mm_loadu_ps(&c.mean_anomaly[k]), _mm_mul_ps(_mm_loadu_ps(&c.mean_anomaly_rate[k]), tau));
+		__m128 const W = _mm_add_ps(_mm_loadu_ps(&c.raan[k]), _mm_mul_ps(_mm_loadu_ps(&c.raan_rate[k]), tau));
+		__m128 const w = _mm_add_ps(_mm_loadu_ps(&c.argument_of_perigee[k]), _mm_mul_ps(_mm_loadu_ps(&c.argument_of_perigee_rate[k]), tau));
+
+		__m128 sE, cE;
+		sincos_sse(M, sE, cE);
+		__m128 E = _mm_add_ps(M, _mm_mul_ps(e, sE));
+		for(int it=0; it<constellation_kepler_iterations; ++it){
+			sincos_sse(E, sE, cE);
+			E = _mm_sub_ps(E, _mm_div_ps(_mm_sub_ps(_mm_sub_ps(E, _mm_mul_ps(e, sE)), M), _mm_sub_ps(one, _mm_mul_ps(e, cE))));
+		}
+		sincos_sse(E, sE, cE);
+		__m128 const x = _mm_mul_ps(_mm_loadu_ps(&c.a[k]), _mm_sub_ps(cE, e));
+		__m128 const y = _mm_mul_ps(_mm_loadu_ps(&c.b[k]), sE);
+
+		__m128 sW, cW, sw, cw;
+		sincos_sse(W, sW, cW);
+		sincos_sse(w, sw, cw);
+		__m128 const ci = _mm_loadu_ps(&c.cos_i[k]), si = _mm_loadu_ps(&c.sin_i[k]);
+		__m128 const Px = _mm_sub_ps(_mm_mul_ps(cW, cw), _mm_mul_ps(_mm_mul_ps(sW, sw), ci));
+		__m128 const Py = _mm_add_ps(_mm_mul_ps(sW, cw), _mm_mul_ps(_mm_mul_ps(cW, sw), ci));
+		__m128 const Pz = _mm_mul_ps(sw, si);
+		__m128 const Qx = _mm_xor_ps(_mm_add_ps(_mm_mul_ps(cW, sw), _mm_mul_ps(_mm_mul_ps(sW, cw), ci)), sign);
+		__m128 const Qy = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cW, cw), ci), _mm_mul_ps(sW, sw));
+		__m128 const Qz = _mm_mul_ps(cw, si);
+		_mm_storeu_ps(&c.px[k], _mm_add_ps(_mm_mul_ps(x, Px), _mm_mul_ps(y, Qx)));
+		_mm_storeu_ps(&c.py[k], _mm_add_ps(_mm_mul_ps(x, Py), _mm_mul_ps(y, Qy)));
+		_mm_storeu_ps(&c.pz[k], _mm_add_ps(_mm_mul_ps(x, Pz), _mm_mul_ps(y, Qz)));
+	}
+	propagate_scalar(c, tau_arg, end4, end);
+}
+
+// AVX2 version: 8 satellites per iteration, without fma (same rounding as the other paths)
+__attribute__((target("avx2")))
+static inline __m256 select_avx(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_blendv_ps(b, a, mask);
+}
+
+__attribute__((target("avx2")))
+static inline void sincos_avx(__m256 x, __m256& s, __m256& c)
+{
+	__m256i const one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+	__m256i const q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(two_over_pi)));
+	__m256 const qf = _mm256_cvtepi32_ps(q);
+	__m256 const r = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(half_pi_high))), _mm256_mul_ps(qf, _mm256_set1_ps(half_pi_low)));
+	__m256 const r2 = _mm256_mul_ps(r, r);
+	__m256 const sr = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), _mm256_add_ps(_mm256_set1_ps(sin_1), _mm256_mul_ps(r2,
+		_mm256_add_ps(_mm256_set1_ps(sin_2), _mm256_mul_ps(r2, _mm256_add_ps(_mm256_set1_ps(sin_3), _mm256_mul_ps(r2, _mm256_set1_ps(sin_4)))))))));
+	__m256 const cr = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(r2, _mm256_add_ps(_mm256_set1_ps(cos_1), _mm256_mul_ps(r2,
+		_mm256_add_ps(_mm256_set1_ps(cos_2), _mm256_mul_ps(r2, _mm256_add_ps(_mm256_set1_ps(cos_3), _mm256_mul_ps(r2,
+		_mm256_add_ps(_mm256_set1_ps(cos_4), _mm256_mul_ps(r2, _mm256_set1_ps(cos_5)))))))))));
+	__m256 const swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+	__m256 const negate_s = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+	__m256 const negate_c = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+	s = _mm256_xor_ps(select_avx(swap, cr, sr), negate_s);
+	c = _mm256_xor_ps(select_avx(swap, sr, cr), negate_c);
+}
+
+__attribute__((target("avx2")))
+static void propagate_avx2(constellation& c, float tau_arg, size_t begin, size_t end)
+{
+	__m256 const tau = _mm256_set1_ps(tau_arg);
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const sign = _mm256_set1_ps(-0.0f);
+
+	size_t const end8 = end - (end-begin)%8;
+	for(size_t k=begin; k<end8; k+=8){
+		__m256 const e = _mm256_loadu_ps(&c.e[k]);
+		__m256 const M = _mm256_add_ps(_mm256_loadu_ps(&c.mean_anomaly[k]), _mm256_mul_ps(_mm256_loadu_ps(&c.mean_anomaly_rate[k]), tau));
+		__m256 const W = _mm256_add_ps(_mm256_loadu_ps(&c.raan[k]), _mm256_mul_ps(_mm256_loadu_ps(&c.raan_rate[k]), tau));
+		__m256 const w = _mm256_add_ps(_mm256_loadu_ps(&c.argument_of_perigee[k]), _mm256_mul_ps(_mm256_loadu_ps(&c.argument_of_perigee_rate[k]), tau));
+
+		__m256 sE, cE;
+		sincos_avx(M, sE, cE);
+		__m256 E = _mm256_add_ps(M, _mm256_mul_ps(e, sE));
+		for(int it=0; it<constellation_kepler_iterations; ++it){
+			sincos_avx(E, sE, cE);
+			E = _mm256_sub_ps(E, _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(E, _mm256_mul_ps(e, sE)), M), _mm256_sub_ps(one, _mm256_mul_ps(e, cE))));
+		}
+		sincos_avx(E, sE, cE);
+		__m256 const x = _mm256_mul_ps(_mm256_loadu_ps(&c.a[k]), _mm256_sub_ps(cE, e));
+		__m256 const y = _mm256_mul_ps(_mm256_loadu_ps(&c.b[k]), sE);
+
+		__m256 sW, cW, sw, cw;
+		sincos_avx(W, sW, cW);
+		sincos_avx(w, sw, cw);
+		__m256 const ci = _mm256_loadu_ps(&c.cos_i[k]), si = _mm256_loadu_ps(&c.sin_i[k]);
+		__m256 const Px = _mm256_sub_ps(_mm256_mul_ps(cW, cw), _mm256_mul_ps(_mm256_mul_ps(sW, sw), ci));
+		__m256 const Py = _mm256_add_ps(_mm256_mul_ps(sW, cw), _mm256_mul_ps(_mm256_mul_ps(cW, sw), ci));
+		__m256 const Pz = _mm256_mul_ps(sw, si);
+		__m256 const Qx = _mm256_xor_ps(_mm256_add_ps(_mm256_mul_ps(cW, sw), _mm256_mul_ps(_mm256_mul_ps(sW, cw), ci)), sign);
+		__m256 const Qy = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cW, cw), ci), _mm256_mul_ps(sW, sw));
+		__m256 const Qz = _mm256_mul_ps(cw, si);
+		_mm256_storeu_ps(&c.px[k], _mm256_add_ps(_mm256_mul_ps(x, Px), _mm256_mul_ps(y, Qx)));
+		_mm256_storeu_ps(&c.py[k], _mm256_add_ps(_mm256_mul_ps(x, Py), _mm256_mul_ps(y, Qy)));
+		_mm256_storeu_ps(&c.pz[k], _mm256_add_ps(_mm256_mul_ps(x, Pz), _mm256_mul_ps(y, Qz)));
+	}
+	propagate_sse(c, tau_arg, end8, end);
+}
+
+#endif
+
+static void propagate_range(constellation& c, float tau, simd_level level, size_t begin, size_t end)
+{
+#ifdef ROCKET_SIMD_X86
+	if(level==simd_level::avx2){
+		propagate_avx2(c, tau, begin, end);
+		return;
+	}
+	if(level==simd_level::sse){
+		propagate_sse(c, tau, begin, end);
+		return;
+	}
+#else
+	(void)level;
+#endif
+	propagate_scalar(c, tau, begin, end);
+}
+
+void constellation_propagate(constellation& c, double t, simd_level level, thread_pool* pool)
+{
+	if(c.needs_rebase(t))
+		c.rebase(t, pool);
+	float const tau = static_cast<float>(t - c.epoch());
+
+	if(pool!=nullptr && c.size()>propagation_grain)
+		pool->parallel_for(c.size(), propagation_grain, [&](size_t begin, size_t end){ propagate_range(c, tau, level, begin, end); });
+	else
+		propagate_range(c, tau, level, 0, c.size());
+}
+
+void constellation_propagate(constellation& c, double t)
+{
+	constellation_propagate(c, t, body_table_detect_simd());
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/**
+Constellation of satellites on Keplerian orbits (see orbit.hpp), propagated in batch.
+The elements are stored as structure of arrays, and the kernel processes 4 (SSE) or 8 (AVX2)
+satellites per instruction: Kepler's equation is solved with a fixed number of Newton iterations
+and sin/cos are polynomials, so that the kernel is branch-free. As for body_table, the scalar
+path performs exactly the same float operations and every path gives bit-identical positions.
+
+The float columns hold the angles at an epoch close to the propagation time: the multiple of
+constellation_rebase_interval nearest to it. They are advanced in double precision from the
+elements of t=0 whenever the propagation time crosses to another epoch, so that float precision is
+enough at any time, and the positions only depend on t (not on the previous propagations).
+*/
+
+#include "simulation/body_table.hpp"
+#include "simulation/orbit.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace sim {
+
+class thread_pool;
+
+double const constellation_rebase_interval = 600; // s
+
+struct constellation
+{
+	planet_model planet;
+	std::vector<orbit_elements> elements; // at t=0
+
+	// float columns at the epoch
+	std::vector<float> a, e, b;              // semi-axes (km) and eccentricity
+	std::vector<float> cos_i, sin_i;
+	std::vector<float> mean_anomaly, raan, argument_of_perigee;
+	std::vector<float> mean_anomaly_rate, raan_rate, argument_of_perigee_rate;
+
+	// positions at the last propagation (km, inertial frame)
+	std::vector<float> px, py, pz;
+
+	size_t size() const { return elements.size(); }
+	void clear();
+	size_t add(orbit_elements const& orbit);
+
+	bool j2() const { return with_j2; }
+	void set_j2(bool value);
+
+	// Advance the float columns to the epoch of time t
+	void rebase(double t, thread_pool* pool = nullptr);
+	double epoch() const { return epoch_time; }
+	bool needs_rebase(double t) const;
+
+private:
+	void rebase_range(double t, size_t begin, size_t end);
+
+	bool with_j2 = true;
+	double epoch_time = 0;
+	bool columns_valid = false;
+};
+
+// Walker delta pattern i:t/p/f: t satellites on p planes evenly spread in ascending node,
+// the satellites of neighbouring planes being shifted by f*360/t degrees. When p does not divide
+// t, the first t%p planes hold one more satellite: the constellation always has t satellites
+struct walker_pattern
+{
+	double altitude = 550;      // km above the equatorial radius
+	double inclination = 0.93;  // rad
+	int satellites = 1584;
+	int planes = 72;
+	int phasing = 1;
+};
+void constellation_add_walker(constellation& c, walker_pattern const& pattern);
+
+// Positions at time t (s), optionally split over the threads of a pool
+void constellation_propagate(constellation& c, double t, simd_level level, thread_pool* pool = nullptr);
+void constellation_propagate(constellation& c, double t); // uses body_table_detect_simd()
+
+// Number of Newton iterations of the kernel: enough for float precision up to e = 0.9
+int const constellation_kepler_iterations = 6;
+
+}
@@ -0,0 +1,191 @@
+#include "simulation/control_thread.hpp"
+
+#include "simulation/simulation_thread.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace sim {
+
+// ****************************************** //
+// Latency histogram
+// ****************************************** //
+
+void latency_histogram::add(double seconds)
+{
+	float const us = static_cast<float>(1e6*std::max(seconds, 0.0));
+	int k = 0;
+	if(us >= 1.0f)
+		k = std::min(bins-1, 1 + static_cast<int>(std::floor(std::log2(us))));
+	counts[k]++;
+	total++;
+	max = std::max(max, us);
+}
+
+float latency_histogram::percentile(double p) const
+{
+	if(total==0)
+		return 0;
+	double const rank = std::max(1.0, std::ceil(p/100*static_cast<double>(total)));
+	uint64_t sum = 0;
+	for(int k=0; k<bins; ++k){
+		sum += counts[k];
+		if(static_cast<double>(sum) >= rank)
+			return k+1<bins ? bin_begin(k+1) : std::numeric_limits<float>::infinity();
+	}
+	return std::numeric_limits<float>::infinity();
+}
+
+// ****************************************** //
+// Control thread
+// ****************************************** //
+
+control_thread::~control_thread()
+{
+	stop();
+}
+
+void control_thread::start(control_thread_settings const& settings)
+{
+	stop();
+	current_settings = settings;
+	origin = std::chrono::steady_clock::now();
+	initialized = false;
+	attitude = attitude_state();
+	statistics = control_statistics();
+	ticks = 0;
+
+	// first attitudes before the thread starts: the render thread always has one to draw
+	tick();
+	snapshots.update();
+	snapshot = snapshots.read_buffer();
+
+	quit = false;
+	thread = std::thread(&control_thread::loop, this);
+}
+
+void control_thread::stop()
+{
+	if(!thread.joinable())
+		return;
+	quit = true;
+	thread.join();
+}
+
+double control_thread::now() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void control_thread::pin()
+{
+#ifdef __linux__
+	int cpu = current_settings.cpu;
+	if(cpu==-1){
+		// last core of those the process may run on
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if(sched_getaffinity(0, sizeof(allowed), &allowed)==0){
+			for(int k=CPU_SETSIZE; k-- > 0;){
+				if(CPU_ISSET(k, &allowed)){
+					cpu = k;
+					break;
+				}
+			}
+		}
+	}
+	if(cpu>=0){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set)==0)
+			statistics.cpu = cpu;
+	}
+	if(current_settings.realtime){
+		sched_param priority;
+		priority.sched_priority = sched_get_priority_min(SCHED_FIFO);
+		statistics.realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &priority)==0;
+	}
+#endif
+}
+
+void control_thread::loop()
+{
+	pin();
+	typedef std::chrono::steady_clock clock;
+	double const dt = period();
+	clock::duration const step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(dt));
+	clock::time_point deadline = clock::now();
+	double deadline_s = now();
+	while(!quit){
+		// far behind (e.g. the process was suspended): skip the missed ticks
+		double const late = now() - deadline_s;
+		if(late > current_settings.max_catch_up*dt){
+			double const skipped = std::floor(late/dt);
+			statistics.skipped += static_cast<uint64_t>(skipped);
+			deadline += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(skipped*dt));
+			deadline_s += skipped*dt;
+		}
+
+		tick();
+
+		// latency of this tick, published with the next one
+		double const done = now();
+		statistics.latency.add(done - deadline_s);
+		if(done > deadline_s + dt)
+			statistics.deadline_misses++;
+		statistics.ticks++;
+
+		deadline += step;
+		deadline_s += dt;
+		std::this_thread::sleep_until(deadline);
+	}
+}
+
+void control_thread::tick()
+{
+	control_feed feed;
+	if(source.read_control(feed)){
+		mission_tick = feed.tick;
+		input = feed.input;
+		parameters = feed.parameters;
+	}
+
+	// control steps up to the mission time of the latest state, or a reset after a jump
+	attitude_settings const& settings = current_settings.attitude;
+	float const h = current_settings.max_step;
+	double const lag = input.t - attitude.t;
+	if(!initialized || lag < 0 || lag > current_settings.max_steps*h){
+		attitude_reset(attitude, input, parameters, settings);
+		initialized = true;
+	}
+	else if(lag > 0){
+		int const n = std::max(1, static_cast<int>(std::ceil(lag/h - 1e-6)));
+		float const dt = static_cast<float>(lag/n);
+		for(int k=0; k<n; ++k)
+			attitude_step(attitude, input, parameters, settings, dt);
+		attitude.t = input.t;
+	}
+
+	control_snapshot& s = snapshots.write_buffer();
+	s.tick = ticks++;
+	s.mission_tick = mission_tick;
+	s.attitude = attitude;
+	s.statistics = statistics;
+	snapshots.publish();
+}
+
+control_snapshot const& control_thread::latest()
+{
+	if(snapshots.update())
+		snapshot = snapshots.read_buffer();
+	return snapshot;
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/**
+Guidance and autopilot on a thread of their own at a fixed 1 kHz, pinned to one core.
+Every tick, the thread takes the latest state of the mission published by the simulation thread
+(simulation_thread::read_control), runs the control steps of attitude.hpp up to its mission time,
+max_step of mission time at most each, and publishes the attitudes in a triple buffer for the
+render thread. After a jump in time (seek, restart, time warp faster than max_steps per tick) the
+attitudes are reset on the guidance direction, at rest.
+The timing of the loop is measured against its deadlines, to see whether the controller holds its
+rate while the other cores render: latency from the deadline of a tick to the publication of its
+attitudes (histogram of powers of two microseconds), and deadline misses (published after the
+deadline of the next tick). The core is the last one the process may run on by default; the
+real-time priority (SCHED_FIFO) is only asked for when enabled, and needs the privilege.
+Pinning and priority are Linux only: elsewhere the thread runs unpinned.
+*/
+
+#include "simulation/attitude.hpp"
+#include "simulation/triple_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace sim {
+
+class simulation_thread;
+
+// ****************************************** //
+// Latency histogram
+// ****************************************** //
+
+struct latency_histogram
+{
+	static int const bins = 16; // [0,1) us, [1,2), [2,4), ..., [2^14 us, infinity)
+
+	uint64_t counts[bins] = {};
+	uint64_t total = 0;
+	float max = 0; // us
+
+	void add(double seconds);
+	// Upper bound (us) of the bin of the percentile p in [0,100], infinity in the last bin
+	float percentile(double p) const;
+	// Lower bound of bin k (us)
+	static float bin_begin(int k) { return k==0 ? 0.0f : static_cast<float>(1u << (k-1)); }
+};
+
+// ****************************************** //
+// Control thread
+// ****************************************** //
+
+struct control_thread_settings
+{
+	double rate = 1000.0;      // ticks per second
+	int max_catch_up = 50;     // late ticks run back to back, beyond them the loop skips ahead
+	int cpu = -1;              // core the thread is pinned to, -1: the last one allowed, -2: not pinned
+	bool realtime = false;     // SCHED_FIFO priority, if the process is allowed to
+	float max_step = 0.001f;   // s of mission time per control step
+	int max_steps = 16;        // per tick, beyond the attitudes are reset
+	attitude_settings attitude;
+};
+
+struct control_statistics
+{
+	uint64_t ticks = 0;
+	uint64_t deadline_misses = 0; // published after the deadline of the next tick
+	uint64_t skipped = 0;         // ticks skipped by a loop far behind
+	latency_histogram latency;    // from the deadline to the publication
+	int cpu = -1;                 // pinned to, -1: not pinned
+	bool realtime = false;
+};
+
+// State published by the control thread
+struct control_snapshot
+{
+	uint64_t tick = 0;
+	uint64_t mission_tick = 0; // of the simulation thread state it follows
+	attitude_state attitude;
+	control_statistics statistics;
+};
+
+class control_thread
+{
+public:
+	explicit control_thread(simulation_thread& source_arg) : source(source_arg) {}
+	~control_thread();
+
+	control_thread(control_thread const&) = delete;
+	control_thread& operator=(control_thread const&) = delete;
+
+	// After simulation_thread::start, which publishes the first state of the mission
+	void start(control_thread_settings const& settings = control_thread_settings());
+	void stop();
+	bool running() const { return thread.joinable(); }
+
+	// Render thread: latest attitudes
+	control_snapshot const& latest();
+
+	control_thread_settings const& settings() const { return current_settings; }
+	double period() const { return 1.0/current_settings.rate; }
+
+private:
+	void loop();
+	void pin();
+	void tick();
+	double now() const;
+
+	simulation_thread& source;
+	control_thread_settings current_settings;
+	std::chrono::steady_clock::time_point origin;
+	std::thread thread;
+	std::atomic<bool> quit{false};
+
+	// control thread
+	bool initialized = false;
+	uint64_t mission_tick = 0;
+	attitude_input input;
+	mission_parameters parameters;
+	attitude_state attitude;
+	control_statistics statistics;
+	uint64_t ticks = 0;
+	triple_buffer<control_snapshot> snapshots;
+
+	// render thread
+	control_snapshot snapshot;
+};
+
+}
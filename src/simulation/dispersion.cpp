@@ -0,0 +1,60 @@
+#include "simulation/dispersion.hpp"
+
+#include "simulation/random.hpp"
+#include "simulation/thread_pool.hpp"
+
+namespace sim {
+
+mission_parameters dispersion_draw(dispersion_parameters const& campaign, uint64_t index)
+{
+	random_stream rng(campaign.seed, index);
+	mission_parameters p = campaign.nominal;
+
+	p.t_separation_first = static_cast<float>(rng.normal(p.t_separation_first, campaign.sigma_t_separation_first));
+	p.t_separation_second = static_cast<float>(rng.normal(p.t_separation_second, campaign.sigma_t_separation_second));
+	p.t_satellite_orbit_start = static_cast<float>(rng.normal(p.t_satellite_orbit_start, campaign.sigma_t_satellite_orbit_start));
+	p.rocket_v0.x = static_cast<float>(rng.normal(p.rocket_v0.x, campaign.sigma_rocket_v0.x));
+	p.rocket_v0.y = static_cast<float>(rng.normal(p.rocket_v0.y, campaign.sigma_rocket_v0.y));
+	p.rocket_v0.z = static_cast<float>(rng.normal(p.rocket_v0.z, campaign.sigma_rocket_v0.z));
+	return p;
+}
+
+dispersion_sample dispersion_run(mission_parameters const& parameters, mission_state& state)
+{
+	dispersion_sample sample;
+	sample.parameters = parameters;
+
+	mission_initialize(state, parameters);
+
+	// stages are only updated before the orbit phase, so the run stops at the orbit insertion
+	while(!state.radius_set)
+		mission_step(state, parameters);
+
+	// impacts on the terrain, at their exact time and point (see mission_state::impacts)
+	terrain_impact const& first = state.impacts[body_first_stage];
+	terrain_impact const& second = state.impacts[body_second_stage];
+	sample.first_stage_landed = state.bodies.phase[body_first_stage]==body_landed;
+	sample.first_stage_impact = sample.first_stage_landed ? first.p : vec3();
+	sample.first_stage_impact_time = sample.first_stage_landed ? first.t : 0.0f;
+	sample.second_stage_landed = state.bodies.phase[body_second_stage]==body_landed;
+	sample.second_stage_impact = sample.second_stage_landed ? second.p : vec3();
+	sample.second_stage_impact_time = sample.second_stage_landed ? second.t : 0.0f;
+	sample.orbit_insertion_radius = state.radius;
+	return sample;
+}
+
+std::vector<dispersion_sample> dispersion_campaign(dispersion_parameters const& campaign, thread_pool& pool)
+{
+	std::vector<dispersion_sample> samples(campaign.sample_count);
+
+	// chunks small enough to balance the load, large enough to amortize the scheduling
+	size_t const grain = 256;
+	pool.parallel_for(campaign.sample_count, grain, [&](size_t begin, size_t end){
+		mission_state state; // reused by all the runs of the chunk
+		for(size_t k=begin; k<end; ++k)
+			samples[k] = dispersion_run(dispersion_draw(campaign, k), state);
+	});
+	return samples;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/**
+Monte Carlo launch dispersion analysis.
+Each run perturbs the separation times, the orbit start time and the ascent velocity of the
+nominal mission, simulates it until the orbit insertion, and records the impact points of the
+stages and the orbit insertion radius (payload fairing altitude + earth radius).
+*/
+
+#include "simulation/mission.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace sim {
+
+class thread_pool;
+
+// Standard deviations of the perturbations (normal distributions centered on the nominal mission)
+struct dispersion_parameters
+{
+	mission_parameters nominal;
+
+	float sigma_t_separation_first = 0.2f;      // s
+	float sigma_t_separation_second = 0.2f;     // s
+	float sigma_t_satellite_orbit_start = 0.2f; // s
+	vec3 sigma_rocket_v0 = {0.05f, 0.05f, 0.1f}; // m/s per component
+
+	uint64_t seed = 1;
+	size_t sample_count = 100000;
+};
+
+// Result of one run
+struct dispersion_sample
+{
+	mission_parameters parameters;  // perturbed parameters of the run
+
+	bool first_stage_landed = false;
+	bool second_stage_landed = false;
+	vec3 first_stage_impact;   // point where the stage hits the terrain
+	vec3 second_stage_impact;
+	float first_stage_impact_time = 0;
+	float second_stage_impact_time = 0;
+
+	float orbit_insertion_radius = 0;
+};
+
+// Perturbed parameters of run `index` (only depends on the seed and the index)
+mission_parameters dispersion_draw(dispersion_parameters const& campaign, uint64_t index);
+
+// Simulate one mission until the orbit insertion and record its impacts
+dispersion_sample dispersion_run(mission_parameters const& parameters, mission_state& state);
+
+// Run the whole campaign on the pool. samples[k] is the result of run k, whatever the number of threads.
+std::vector<dispersion_sample> dispersion_campaign(dispersion_parameters const& campaign, thread_pool& pool);
+
+}
@@ -0,0 +1,122 @@
+#include "simulation/ecs.hpp"
+
+namespace sim {
+namespace ecs {
+
+world::world()
+{
+	// archetype 0: entities without components
+	archetype_of(0, nullptr, nullptr, nullptr, 0);
+}
+
+uint32_t world::archetype_of(component_mask mask, archetype const* from, int const* ids, column_factory const* factories, size_t count)
+{
+	auto const found = archetype_index.find(mask);
+	if(found!=archetype_index.end())
+		return found->second;
+
+	std::unique_ptr<archetype> a(new archetype());
+	a->mask = mask;
+	for(int id=0; id<max_component_types; ++id){
+		if((mask & (component_mask(1) << id))!=0 && from!=nullptr && from->columns[id])
+			a->columns[id] = from->columns[id]->empty_copy();
+	}
+	for(size_t k=0; k<count; ++k){
+		if(!a->columns[ids[k]])
+			a->columns[ids[k]] = factories[k]();
+	}
+	uint32_t const index = static_cast<uint32_t>(archetypes.size());
+	archetypes.push_back(std::move(a));
+	archetype_index[mask] = index;
+	return index;
+}
+
+entity world::allocate(uint32_t archetype_index_arg)
+{
+	uint32_t index;
+	if(!free_list.empty()){
+		index = free_list.back();
+		free_list.pop_back();
+	}
+	else{
+		index = static_cast<uint32_t>(locations.size());
+		locations.push_back({free_slot, 0});
+		generations.push_back(0);
+	}
+	archetype& a = *archetypes[archetype_index_arg];
+	entity const e = {index, generations[index]};
+	locations[index] = {archetype_index_arg, static_cast<uint32_t>(a.size())};
+	a.entities.push_back(e);
+	living++;
+	return e;
+}
+
+entity world::create()
+{
+	return allocate(0);
+}
+
+bool world::alive(entity e) const
+{
+	return e.index<locations.size() && locations[e.index].archetype!=free_slot && generations[e.index]==e.generation;
+}
+
+void world::remove_row(archetype& a, uint32_t row)
+{
+	for(int id=0; id<max_component_types; ++id){
+		if(a.columns[id])
+			a.columns[id]->remove(row);
+	}
+	if(row+1<a.entities.size()){
+		a.entities[row] = a.entities.back();
+		locations[a.entities[row].index].row = row;
+	}
+	a.entities.pop_back();
+}
+
+void world::move(entity e, uint32_t target)
+{
+	location const at = locations[e.index];
+	if(at.archetype==target)
+		return;
+	archetype& source = *archetypes[at.archetype];
+	archetype& destination = *archetypes[target];
+	for(int id=0; id<max_component_types; ++id){
+		if(source.columns[id] && destination.columns[id])
+			destination.columns[id]->append_from(*source.columns[id], at.row);
+	}
+	destination.entities.push_back(e);
+	remove_row(source, at.row);
+	locations[e.index] = {target, static_cast<uint32_t>(destination.size()-1)};
+}
+
+void world::destroy(entity e)
+{
+	if(!alive(e))
+		return;
+	remove_row(*archetypes[locations[e.index].archetype], locations[e.index].row);
+	locations[e.index].archetype = free_slot;
+	generations[e.index]++;
+	free_list.push_back(e.index);
+	living--;
+}
+
+void world::clear()
+{
+	for(std::unique_ptr<archetype>& a : archetypes){
+		for(int id=0; id<max_component_types; ++id){
+			if(a->columns[id])
+				a->columns[id]->clear();
+		}
+		for(entity const& e : a->entities){
+			locations[e.index].archetype = free_slot;
+			generations[e.index]++;
+			free_list.push_back(e.index);
+		}
+		a->entities.clear();
+	}
+	living = 0;
+}
+
+}
+}
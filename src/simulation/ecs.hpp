@@ -0,0 +1,259 @@
+#pragma once
+
+/**
+Entity-component storage by archetypes.
+An entity is an index checked by a generation; its components are plain structs. The entities
+having exactly the same set of component types share an archetype, which stores each type in its
+own contiguous array (a column), so that a system reads the components it needs as arrays, without
+holes or indirections, whatever the other components of the entities are.
+Adding or removing a component moves the entity (its row) to the archetype of its new set, the last
+row of the old archetype taking its place: rows are not stable, entities are kept by handle. The
+structural changes (create, destroy, add, remove) must stay out of the loops over the rows of
+each/each_chunk; systems collect the entities to change first (see fleet.cpp).
+Component types get an id at their first use, from any thread, max_component_types at most in the
+program.
+*/
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sim {
+namespace ecs {
+
+using component_mask = uint64_t;
+int const max_component_types = 64;
+
+struct entity
+{
+	uint32_t index = ~0u;
+	uint32_t generation = 0;
+};
+inline bool operator==(entity a, entity b) { return a.index==b.index && a.generation==b.generation; }
+inline bool operator!=(entity a, entity b) { return !(a==b); }
+
+namespace detail {
+// Atomic: the first use of two component types may happen on two threads (e.g. tasks of a pool)
+inline int next_component_id()
+{
+	static std::atomic<int> count{0};
+	return count.fetch_add(1, std::memory_order_relaxed);
+}
+}
+
+// Id of a component type, the same in all the worlds
+template <typename T>
+int component_id()
+{
+	static int const id = detail::next_component_id();
+	assert(id < max_component_types);
+	return id;
+}
+
+template <typename T>
+component_mask component_bit() { return component_mask(1) << component_id<T>(); }
+
+template <typename... C>
+component_mask mask_of()
+{
+	component_mask mask = 0;
+	int const expand[] = {0, (mask |= component_bit<C>(), 0)...};
+	(void)expand;
+	return mask;
+}
+
+// Type-erased column of an archetype
+class column_base
+{
+public:
+	virtual ~column_base() = default;
+	virtual std::unique_ptr<column_base> empty_copy() const = 0;
+	virtual void append_from(column_base& source, size_t row) = 0; // moves source[row] to the end
+	virtual void remove(size_t row) = 0;                           // the last row takes its place
+	virtual void clear() = 0;
+};
+
+template <typename T>
+class column final : public column_base
+{
+public:
+	std::vector<T> data;
+
+	std::unique_ptr<column_base> empty_copy() const override { return std::unique_ptr<column_base>(new column<T>()); }
+	void append_from(column_base& source, size_t row) override { data.push_back(std::move(static_cast<column<T>&>(source).data[row])); }
+	void remove(size_t row) override
+	{
+		if(row+1<data.size())
+			data[row] = std::move(data.back());
+		data.pop_back();
+	}
+	void clear() override { data.clear(); }
+};
+
+struct archetype
+{
+	component_mask mask = 0;
+	std::vector<entity> entities;
+	std::unique_ptr<column_base> columns[max_component_types]; // null for the types not in the mask
+
+	size_t size() const { return entities.size(); }
+
+	template <typename T>
+	std::vector<T>& column_data() { return static_cast<column<T>&>(*columns[component_id<T>()]).data; }
+};
+
+class world
+{
+public:
+	world();
+
+	// Entity without components, or with these ones
+	entity create();
+	template <typename... C> entity create(C... components);
+	void destroy(entity e);
+	bool alive(entity e) const;
+
+	// Component of a living entity, nullptr if it has none (invalidated by the structural changes)
+	template <typename T> T* get(entity e);
+	template <typename T> bool has(entity e) const;
+
+	// Move the entity to the archetype with (without) T. add replaces the component if it has one
+	template <typename T> void add(entity e, T component);
+	template <typename T> void remove(entity e);
+
+	// f(rows, entities, C* columns...) for each archetype having all the C, f(entity, C&...) for each entity
+	template <typename... C, typename F> void each_chunk(F&& f);
+	template <typename... C, typename F> void each(F&& f);
+
+	// Entities having all the C
+	template <typename... C> size_t count() const;
+	size_t size() const { return living; }
+	size_t archetype_count() const { return archetypes.size(); }
+
+	// Destroy all the entities (the handles given before are no longer alive)
+	void clear();
+
+private:
+	using column_factory = std::unique_ptr<column_base>(*)();
+	template <typename T> static std::unique_ptr<column_base> make_column() { return std::unique_ptr<column_base>(new column<T>()); }
+
+	struct location
+	{
+		uint32_t archetype;
+		uint32_t row;
+	};
+	static uint32_t const free_slot = ~0u;
+
+	// Archetype of mask, its columns taken from `from` and from the factories of the new types
+	uint32_t archetype_of(component_mask mask, archetype const* from, int const* ids, column_factory const* factories, size_t count);
+	entity allocate(uint32_t archetype_index);
+	void remove_row(archetype& a, uint32_t row);
+	void move(entity e, uint32_t target); // rows of the columns kept, the new ones are pushed by the caller
+
+	std::vector<std::unique_ptr<archetype>> archetypes;
+	std::unordered_map<component_mask, uint32_t> archetype_index;
+	std::vector<location> locations;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> free_list;
+	size_t living = 0;
+};
+
+// ****************************************** //
+// Templates
+// ****************************************** //
+
+template <typename... C>
+entity world::create(C... components)
+{
+	int const ids[] = {-1, component_id<C>()...};
+	column_factory const factories[] = {nullptr, &make_column<C>...};
+	uint32_t const index = archetype_of(mask_of<C...>(), nullptr, ids+1, factories+1, sizeof...(C));
+	archetype& a = *archetypes[index];
+	entity const e = allocate(index);
+	int const expand[] = {0, (a.column_data<C>().push_back(std::move(components)), 0)...};
+	(void)expand;
+	return e;
+}
+
+template <typename T>
+T* world::get(entity e)
+{
+	if(!alive(e))
+		return nullptr;
+	location const& at = locations[e.index];
+	archetype& a = *archetypes[at.archetype];
+	if((a.mask & component_bit<T>())==0)
+		return nullptr;
+	return &a.column_data<T>()[at.row];
+}
+
+template <typename T>
+bool world::has(entity e) const
+{
+	return alive(e) && (archetypes[locations[e.index].archetype]->mask & component_bit<T>())!=0;
+}
+
+template <typename T>
+void world::add(entity e, T component)
+{
+	if(!alive(e))
+		return;
+	if(T* current = get<T>(e)){
+		*current = std::move(component);
+		return;
+	}
+	archetype const& from = *archetypes[locations[e.index].archetype];
+	int const id = component_id<T>();
+	column_factory const factory = &make_column<T>;
+	uint32_t const target = archetype_of(from.mask | component_bit<T>(), &from, &id, &factory, 1);
+	move(e, target);
+	archetypes[target]->column_data<T>().push_back(std::move(component));
+}
+
+template <typename T>
+void world::remove(entity e)
+{
+	if(!has<T>(e))
+		return;
+	archetype const& from = *archetypes[locations[e.index].archetype];
+	move(e, archetype_of(from.mask & ~component_bit<T>(), &from, nullptr, nullptr, 0));
+}
+
+template <typename... C, typename F>
+void world::each_chunk(F&& f)
+{
+	component_mask const required = mask_of<C...>();
+	for(std::unique_ptr<archetype>& a : archetypes){
+		if((a->mask & required)==required && a->size()>0)
+			f(a->size(), static_cast<entity const*>(a->entities.data()), a->template column_data<C>().data()...);
+	}
+}
+
+template <typename... C, typename F>
+void world::each(F&& f)
+{
+	each_chunk<C...>([&f](size_t rows, entity const* entities, C*... columns){
+		for(size_t k=0; k<rows; ++k)
+			f(entities[k], columns[k]...);
+	});
+}
+
+template <typename... C>
+size_t world::count() const
+{
+	component_mask const required = mask_of<C...>();
+	size_t n = 0;
+	for(std::unique_ptr<archetype> const& a : archetypes){
+		if((a->mask & required)==required)
+			n += a->size();
+	}
+	return n;
+}
+
+}
+}
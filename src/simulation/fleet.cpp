@@ -0,0 +1,247 @@
+#include "simulation/fleet.hpp"
+
+#include "simulation/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace sim {
+
+// Rows of an archetype per task of the pool
+static size_t const fleet_grain = 16384;
+
+// body(begin,end) over the rows, on the pool when there are enough of them
+template <typename F>
+static void for_rows(size_t rows, thread_pool* pool, F const& body)
+{
+	if(pool!=nullptr && rows>fleet_grain)
+		pool->parallel_for(rows, fleet_grain, body);
+	else
+		body(0, rows);
+}
+
+static vec3 normalize(vec3 const& a)
+{
+	float const n = norm(a);
+	return n>0 ? a/n : vec3(0,0,1);
+}
+
+// ****************************************** //
+// Systems
+// ****************************************** //
+
+void fleet_staging(ecs::world& world, mission_parameters const& parameters, float t, thread_pool* pool)
+{
+	// released parts, changed once the rows are no longer read (the changes move the rows)
+	struct release
+	{
+		ecs::entity e;
+		vehicle_part kind;
+		propelled stack;
+	};
+	std::vector<release> released;
+	world.each_chunk<part, propelled>([&](size_t rows, ecs::entity const* entities, part const* parts, propelled const* stacks){
+		for(size_t k=0; k<rows; ++k){
+			if(t >= stacks[k].t_release)
+				released.push_back({entities[k], parts[k].kind, stacks[k]});
+		}
+	});
+
+	// impacts of the released stages, in one batch
+	std::vector<terrain_query> queries;
+	for(release const& r : released){
+		if(r.kind!=part_payload_fairing)
+			queries.push_back(terrain_parabola(r.stack.pad + (r.stack.t_release-r.stack.t_launch)*r.stack.v, r.stack.v, parameters.g));
+	}
+	std::vector<terrain_impact> impacts(queries.size());
+	terrain_intersect(mission_terrain(parameters), queries.data(), impacts.data(), queries.size(), pool);
+
+	vec3 const center = {0,0,-parameters.earth_radius};
+	size_t stage = 0;
+	for(release const& r : released){
+		vec3 const p = r.stack.pad + (r.stack.t_release-r.stack.t_launch)*r.stack.v;
+		world.remove<propelled>(r.e);
+		if(r.kind==part_payload_fairing){
+			// circular orbit through the insertion point, downrange towards +x (as the mission)
+			orbiting o;
+			o.center = center;
+			o.radius = norm(p-center);
+			o.u = normalize(p-center);
+			o.w = normalize(vec3(1,0,0) - dot(vec3(1,0,0), o.u)*o.u);
+			o.angular_velocity = parameters.orbit_angular_velocity;
+			o.t0 = r.stack.t_release;
+			world.add(r.e, o);
+			world.get<part>(r.e)->kind = part_satellite;
+		}
+		else{
+			terrain_impact const& impact = impacts[stage++];
+			world.add(r.e, ballistic{p, r.stack.v, r.stack.t_release, r.stack.t_release + impact.t, impact.p});
+		}
+	}
+}
+
+void fleet_propulsion(ecs::world& world, float t, thread_pool* pool)
+{
+	world.each_chunk<motion, propelled>([&](size_t rows, ecs::entity const*, motion* motions, propelled const* stacks){
+		for_rows(rows, pool, [=](size_t begin, size_t end){
+			for(size_t k=begin; k<end; ++k){
+				float const tau = std::max(t - stacks[k].t_launch, 0.0f);
+				motions[k].p = stacks[k].pad + tau*stacks[k].v;
+				motions[k].v = tau>0 ? stacks[k].v : vec3(0,0,0);
+			}
+		});
+	});
+}
+
+void fleet_ballistic(ecs::world& world, vec3 const& g, float t, thread_pool* pool)
+{
+	world.each_chunk<motion, ballistic>([&](size_t rows, ecs::entity const*, motion* motions, ballistic const* falls){
+		for_rows(rows, pool, [=](size_t begin, size_t end){
+			for(size_t k=begin; k<end; ++k){
+				float const tau = t - falls[k].t0;
+				motions[k].p = falls[k].p0 + tau*falls[k].v0 - (0.5f*tau*tau)*g;
+				motions[k].v = falls[k].v0 - tau*g;
+			}
+		});
+	});
+
+	// past the impact: landed at the impact point
+	std::vector<ecs::entity> landing;
+	world.each_chunk<ballistic>([&](size_t rows, ecs::entity const* entities, ballistic const* falls){
+		for(size_t k=0; k<rows; ++k){
+			if(t >= falls[k].t_impact)
+				landing.push_back(entities[k]);
+		}
+	});
+	for(ecs::entity const e : landing){
+		motion& m = *world.get<motion>(e);
+		m.p = world.get<ballistic>(e)->impact;
+		m.v = {0,0,0};
+		world.remove<ballistic>(e);
+		world.add(e, landed());
+	}
+}
+
+void fleet_orbit(ecs::world& world, float t, thread_pool* pool)
+{
+	world.each_chunk<motion, orbiting>([&](size_t rows, ecs::entity const*, motion* motions, orbiting const* orbits){
+		for_rows(rows, pool, [=](size_t begin, size_t end){
+			for(size_t k=begin; k<end; ++k){
+				orbiting const& o = orbits[k];
+				float const angle = o.angular_velocity*(t - o.t0);
+				float const s = std::sin(angle);
+				float const c = std::cos(angle);
+				motions[k].p = o.center + o.radius*(c*o.u + s*o.w);
+				motions[k].v = (o.radius*o.angular_velocity)*(c*o.w - s*o.u);
+			}
+		});
+	});
+}
+
+void fleet_mission_link(ecs::world& world, mission_state const& mission, mission_parameters const& parameters)
+{
+	bool const in_orbit = mission_in_orbit(mission, parameters);
+	world.each<motion, mission_link>([&](ecs::entity, motion& m, mission_link const& link){
+		mission_body const body = in_orbit && link.body==body_payload_fairing ? body_satellite : link.body;
+		m.p = mission_position(mission, body);
+		m.v = mission_velocity(mission, body);
+	});
+}
+
+// ****************************************** //
+// Fleet
+// ****************************************** //
+
+void fleet::reset(fleet_settings const& settings_arg, mission_parameters const& parameters_arg)
+{
+	current_settings = settings_arg;
+	parameters = parameters_arg;
+	respawns = 0;
+	spawn();
+}
+
+void fleet::spawn()
+{
+	world.clear();
+	parts.clear();
+	last_t = 0;
+
+	if(current_settings.include_mission){
+		std::array<ecs::entity, 3> const mission_parts = {{
+			world.create(motion{parameters.rocket_p0, {0,0,0}}, mission_link{body_first_stage}),
+			world.create(motion{parameters.rocket_p0, {0,0,0}}, mission_link{body_second_stage}),
+			world.create(motion{parameters.rocket_p0, {0,0,0}}, mission_link{body_payload_fairing})
+		}};
+		parts.push_back(mission_parts);
+	}
+
+	int const pads = std::max(current_settings.pads, 1);
+	int const columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(pads))));
+	float const spacing = current_settings.pad_spacing;
+	for(int k=0; k<current_settings.vehicles; ++k){
+		int const pad = k%pads;
+		// grid beside the launch complex, along +y
+		vec3 p0 = parameters.rocket_p0 + vec3((static_cast<float>(pad%columns) - 0.5f*static_cast<float>(columns-1))*spacing,
+			static_cast<float>(pad/columns + 2)*spacing, 0);
+		p0.z += mission_terrain(parameters).height(p0.x, p0.y); // pads beyond the launch area stand on the hills
+		float const t_launch = static_cast<float>(k/pads)*current_settings.cadence;
+		uint32_t const vehicle = static_cast<uint32_t>(parts.size());
+		float const releases[3] = {parameters.t_separation_first, parameters.t_separation_second, parameters.t_satellite_orbit_start};
+		std::array<ecs::entity, 3> vehicle_parts;
+		for(int s=0; s<3; ++s){
+			vehicle_parts[s] = world.create(part{static_cast<vehicle_part>(s), vehicle}, motion{p0, {0,0,0}},
+				propelled{p0, parameters.rocket_v0, t_launch, t_launch + releases[s]});
+		}
+		parts.push_back(vehicle_parts);
+	}
+}
+
+void fleet::update(float t, thread_pool* pool, mission_state const* mission)
+{
+	if(t < last_t){
+		// the systems only go forward: back to the pads, then straight to t
+		spawn();
+		respawns++;
+	}
+	last_t = t;
+
+	fleet_staging(world, parameters, t, pool);
+	fleet_propulsion(world, t, pool);
+	fleet_ballistic(world, parameters.g, t, pool);
+	fleet_orbit(world, t, pool);
+	if(mission!=nullptr)
+		fleet_mission_link(world, *mission, parameters);
+}
+
+ecs::entity fleet::part_entity(size_t vehicle, vehicle_part kind) const
+{
+	if(vehicle>=parts.size())
+		return ecs::entity();
+	return parts[vehicle][kind==part_satellite ? part_payload_fairing : kind];
+}
+
+bool fleet::position(ecs::entity e, vec3& p)
+{
+	motion const* m = world.get<motion>(e);
+	if(m==nullptr)
+		return false;
+	p = m->p;
+	return true;
+}
+
+fleet_statistics fleet::statistics() const
+{
+	fleet_statistics s;
+	s.vehicles = parts.size();
+	s.entities = world.size();
+	s.archetypes = world.archetype_count();
+	s.propelled = world.count<propelled>();
+	s.ballistic = world.count<ballistic>();
+	s.landed = world.count<landed>();
+	s.orbiting = world.count<orbiting>();
+	s.respawns = respawns;
+	return s;
+}
+
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+/**
+Fleet of launch vehicles on an entity-component world (ecs.hpp), for launch-cadence studies:
+many vehicles launched from several pads, each flying the scripted mission from its launch time.
+A vehicle is three entities, its first stage, second stage and payload; the phase of a part is
+its archetype:
+ - propelled: attached to the ascending stack, p = pad + v (t - t_launch), until its release
+ - ballistic: stage dropped at its separation, falling under g until it hits the terrain
+ - landed: on the terrain at its impact point
+ - orbiting: payload after the orbit start, on a circular orbit around the earth center
+The systems are closed-form in t. fleet_staging moves the parts released before t to their next
+archetype, then fleet_propulsion, fleet_ballistic and fleet_orbit evaluate the rows of their
+archetypes, in parallel on a thread_pool; going back in time respawns the fleet and evaluates it
+again at t. The stages separate exactly at their separation time; the impacts of the stages
+released together are found in one batch of terrain queries (terrain.hpp), and each stage lands
+at its impact time and point whatever the step between two updates (the body table of the
+mission separates at the first step after the separation time).
+The rocket of the mission can be vehicle 0: its parts have no motion of their own but follow the
+mission state (mission_link), so that the cameras target any vehicle the same way.
+*/
+
+#include "simulation/ecs.hpp"
+#include "simulation/mission.hpp"
+#include "simulation/sim_math.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace sim {
+
+class thread_pool;
+
+// Kind of a part, which gives the mesh drawing it
+enum vehicle_part : uint8_t
+{
+	part_first_stage = 0,
+	part_second_stage = 1,
+	part_payload_fairing = 2,
+	part_satellite = 3,       // the payload once in orbit
+	vehicle_part_count = 4
+};
+
+// ****************************************** //
+// Components
+// ****************************************** //
+
+struct part
+{
+	vehicle_part kind;
+	uint32_t vehicle;
+};
+
+struct motion
+{
+	vec3 p;
+	vec3 v;
+};
+
+struct propelled
+{
+	vec3 pad;
+	vec3 v;           // ascent velocity
+	float t_launch;
+	float t_release;  // separation of a stage, orbit start of the payload
+};
+
+struct ballistic
+{
+	vec3 p0;
+	vec3 v0;
+	float t0;
+	float t_impact;   // on the terrain
+	vec3 impact;
+};
+
+struct landed
+{
+};
+
+struct orbiting
+{
+	vec3 center;      // of the earth
+	vec3 u, w;        // orthonormal: radial direction at the insertion, direction of motion
+	float radius;
+	float angular_velocity;
+	float t0;
+};
+
+// Part of the rocket of the mission, moved by the mission engine
+struct mission_link
+{
+	mission_body body;
+};
+
+// ****************************************** //
+// Systems
+// ****************************************** //
+
+// Parts released at t: stages become ballistic, payloads orbiting (and satellites)
+void fleet_staging(ecs::world& world, mission_parameters const& parameters, float t, thread_pool* pool = nullptr);
+void fleet_propulsion(ecs::world& world, float t, thread_pool* pool = nullptr);
+// Falling stages, landed at their impact time
+void fleet_ballistic(ecs::world& world, vec3 const& g, float t, thread_pool* pool = nullptr);
+void fleet_orbit(ecs::world& world, float t, thread_pool* pool = nullptr);
+// Positions of the parts of the mission rocket
+void fleet_mission_link(ecs::world& world, mission_state const& mission, mission_parameters const& parameters);
+
+// ****************************************** //
+// Fleet
+// ****************************************** //
+
+struct fleet_settings
+{
+	int vehicles = 0;          // besides the rocket of the mission
+	int pads = 25;             // square grid beside the launch complex
+	float pad_spacing = 12.0f;
+	float cadence = 2.0f;      // s between two launches from the same pad
+	bool include_mission = true; // rocket of the mission as vehicle 0
+};
+
+struct fleet_statistics
+{
+	size_t vehicles = 0;
+	size_t entities = 0;
+	size_t archetypes = 0;
+	size_t propelled = 0;
+	size_t ballistic = 0;
+	size_t landed = 0;
+	size_t orbiting = 0;
+	size_t respawns = 0;
+};
+
+class fleet
+{
+public:
+	// Spawn the vehicles on their pads, with the times and velocities of the mission parameters
+	void reset(fleet_settings const& settings, mission_parameters const& parameters);
+
+	// Run the systems at time t (mission: state of vehicle 0 when it is included)
+	void update(float t, thread_pool* pool = nullptr, mission_state const* mission = nullptr);
+
+	ecs::world& entities() { return world; }
+	size_t vehicles() const { return parts.size(); }
+	fleet_settings const& settings() const { return current_settings; }
+
+	// Entity of a part of a vehicle (the satellite is the payload in orbit)
+	ecs::entity part_entity(size_t vehicle, vehicle_part kind) const;
+	// Position of an entity with a motion
+	bool position(ecs::entity e, vec3& p);
+
+	fleet_statistics statistics() const;
+
+private:
+	void spawn();
+
+	fleet_settings current_settings;
+	mission_parameters parameters;
+	ecs::world world;
+	std::vector<std::array<ecs::entity, 3>> parts;
+	float last_t = 0;
+	size_t respawns = 0;
+};
+
+}
@@ -0,0 +1,448 @@
+#include "simulation/flight_dynamics.hpp"
+
+#include "simulation/atmosphere.hpp"
+#include "simulation/mission.hpp"
+#include "simulation/orbit.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sim {
+
+static vec3 to_vec3(double x, double y, double z)
+{
+	return vec3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+}
+
+vec3 gravity_acceleration(vec3 const& p, float g0, float earth_radius)
+{
+	vec3 const r = p - vec3(0,0,-earth_radius);
+	float const d = norm(r);
+	float const mu = g0*earth_radius*earth_radius;
+	return -(mu/(d*d*d))*r;
+}
+
+double air_density(vehicle_parameters const& vehicle, double altitude)
+{
+	if(vehicle.atmosphere==atmosphere_model::us1976)
+		return us1976_density(static_cast<float>(altitude));
+	return vehicle.air_density_sea_level*std::exp(-altitude/vehicle.atmosphere_scale_height);
+}
+
+// Same in double precision, used inside the integrators
+static void gravity(double const* p, double g0, double earth_radius, double* a)
+{
+	double const rx = p[0], ry = p[1], rz = p[2] + earth_radius;
+	double const d2 = rx*rx + ry*ry + rz*rz;
+	double const k = -g0*earth_radius*earth_radius/(d2*std::sqrt(d2));
+	a[0] = k*rx;
+	a[1] = k*ry;
+	a[2] = k*rz;
+}
+
+vec3 coast_body::position() const
+{
+	if(method==integrator_type::rk45){
+		state_vector<6> const y = rk45.interpolate(sample_time);
+		return to_vec3(y[0], y[1], y[2]);
+	}
+	symplectic_integrator::vec x, v;
+	symplectic.interpolate(sample_time, x, v);
+	return to_vec3(x[0], x[1], x[2]);
+}
+
+vec3 coast_body::velocity() const
+{
+	if(method==integrator_type::rk45){
+		state_vector<6> const y = rk45.interpolate(sample_time);
+		return to_vec3(y[3], y[4], y[5]);
+	}
+	symplectic_integrator::vec x, v;
+	symplectic.interpolate(sample_time, x, v);
+	return to_vec3(v[0], v[1], v[2]);
+}
+
+integrator_counters coast_body::counters() const
+{
+	integrator_counters c = symplectic.counters;
+	c += rk45.counters;
+	return c;
+}
+
+static engine_parameters const& engine(mission_parameters const& parameters, int index)
+{
+	vehicle_parameters const& vehicle = parameters.vehicle;
+	return index==0 ? vehicle.first_stage : index==1 ? vehicle.second_stage : vehicle.upper_stage;
+}
+
+// Derivative of the ascent state (p, v, mass)
+struct ascent_derivative
+{
+	mission_parameters const& parameters;
+	flight_state const& flight;
+	double g0;
+	vec3 thrust_direction;   // initial direction, followed by the pitch program from its start
+
+	void operator()(double t, state_vector<7> const& y, state_vector<7>& dydt) const
+	{
+		vehicle_parameters const& vehicle = parameters.vehicle;
+		double const mass = y[6];
+		double a[3];
+		gravity(&y[0], g0, parameters.earth_radius, a);
+
+		// thrust and mass flow of the active engine
+		double mass_flow = 0;
+		if(flight.engine_on){
+			engine_parameters const& e = engine(parameters, flight.active_engine);
+			vec3 const d = parameters.pitch.rate!=0 && t>parameters.pitch.start_time ? flight_thrust_direction(parameters, t) : thrust_direction;
+			a[0] += e.thrust*d.x/mass;
+			a[1] += e.thrust*d.y/mass;
+			a[2] += e.thrust*d.z/mass;
+			mass_flow = e.mass_flow;
+		}
+
+		// drag
+		double const rz = y[2] + parameters.earth_radius;
+		double const altitude = std::sqrt(y[0]*y[0] + y[1]*y[1] + rz*rz) - parameters.earth_radius;
+		double const rho = air_density(vehicle, altitude);
+		double const speed = std::sqrt(y[3]*y[3] + y[4]*y[4] + y[5]*y[5]);
+		double const k = -0.5*rho*speed*vehicle.drag_area/mass;
+		a[0] += k*y[3];
+		a[1] += k*y[4];
+		a[2] += k*y[5];
+
+		// the pad holds the rocket until the thrust exceeds its weight
+		if(y[2] <= parameters.rocket_p0.z && y[5] <= 0 && a[2] < 0){
+			a[0] = a[1] = a[2] = 0;
+		}
+
+		dydt[0] = y[3]; dydt[1] = y[4]; dydt[2] = y[5];
+		dydt[3] = a[0]; dydt[4] = a[1]; dydt[5] = a[2];
+		dydt[6] = -mass_flow;
+	}
+};
+
+static vec3 thrust_direction(mission_parameters const& parameters)
+{
+	// the rocket keeps the attitude given by the direction of rocket_v0 (vertical by default)
+	float const n = norm(parameters.rocket_v0);
+	return n>0 ? parameters.rocket_v0/n : vec3(0,0,1);
+}
+
+vec3 flight_thrust_direction(mission_parameters const& parameters, double t)
+{
+	vec3 const d = thrust_direction(parameters);
+	pitch_program const& pitch = parameters.pitch;
+	if(pitch.rate==0 || t<=pitch.start_time)
+		return d;
+
+	// in the vertical plane of the initial direction, leaning towards its horizontal part
+	float const horizontal = std::sqrt(d.x*d.x + d.y*d.y);
+	vec3 const h = horizontal>0 ? vec3(d.x/horizontal, d.y/horizontal, 0) : vec3(1,0,0);
+	float const elevation = std::atan2(horizontal, d.z); // from the vertical
+	float const angle = elevation + std::min(pitch.max_angle, static_cast<float>(pitch.rate*(t-pitch.start_time)));
+	return std::sin(angle)*h + vec3(0,0,std::cos(angle));
+}
+
+static void start_engine(flight_state& flight, mission_parameters const& parameters, int index, double t)
+{
+	engine_parameters const& e = engine(parameters, index);
+	flight.active_engine = index;
+	flight.engine_on = e.mass_flow>0;
+	flight.ignition_time = t;
+	flight.burnout_time = flight.engine_on ? t + e.propellant_mass/e.mass_flow : t;
+}
+
+static void start_coast(coast_body& body, integrator_type method, rk45_options const& options, double t, double const* p, double const* v)
+{
+	body.method = method;
+	body.active = true;
+	body.landed = false;
+	body.sample_time = t;
+	if(method==integrator_type::rk45){
+		body.rk45.options = options;
+		body.rk45.reset(t, {p[0],p[1],p[2],v[0],v[1],v[2]});
+	}
+	else{
+		body.symplectic.method = method;
+		body.symplectic.reset(t, {p[0],p[1],p[2]}, {v[0],v[1],v[2]});
+	}
+}
+
+// Time of the next separation of the stack (infinity once both stages are dropped)
+static double next_separation(flight_state const& flight, mission_parameters const& parameters)
+{
+	if(flight.separations==0)
+		return parameters.t_separation_first;
+	if(flight.separations==1)
+		return std::max(parameters.t_separation_second, parameters.t_separation_first);
+	return std::numeric_limits<double>::infinity();
+}
+
+// Drop the lowest stage of the stack at the end of the current ascent step
+static void separate(flight_state& flight, mission_state& state, mission_parameters const& parameters)
+{
+	int const stage = flight.separations;
+	double const t = flight.ascent.t;
+	state_vector<7> y = flight.ascent.y;
+
+	// mass dropped: dry mass + unburnt propellant of the stage
+	engine_parameters const& e = engine(parameters, stage);
+	double burnt = 0;
+	if(flight.active_engine==stage)
+		burnt = std::min<double>(e.propellant_mass, e.mass_flow*(std::min(t, flight.burnout_time) - flight.ignition_time));
+	else if(flight.active_engine>stage)
+		burnt = e.propellant_mass;
+	y[6] -= e.dry_mass + (e.propellant_mass - burnt);
+	flight.propellant_dropped_burnt += burnt;
+
+	start_coast(flight.stages[stage], parameters.integration.coast, parameters.integration.ascent, t, &y[0], &y[3]);
+	state.bodies.phase[stage==0 ? body_first_stage : body_second_stage] = body_ballistic;
+	flight.separations++;
+
+	// the next engine takes over, the integration restarts after the discontinuity
+	start_engine(flight, parameters, stage+1, t);
+	flight.ascent.reset(t, y);
+}
+
+// Integrate the stack until time t (or the orbit start), handling the events on the way
+static void advance_ascent(flight_state& flight, mission_state& state, mission_parameters const& parameters, double t)
+{
+	ascent_derivative const f = {parameters, flight, norm(parameters.g), thrust_direction(parameters)};
+	double const t_orbit = parameters.t_satellite_orbit_start;
+
+	for(;;){
+		double const t_separation = next_separation(flight, parameters);
+		double const t_burnout = flight.engine_on ? flight.burnout_time : std::numeric_limits<double>::infinity();
+		double const t_event = std::min(std::min(t_separation, t_burnout), t_orbit);
+
+		flight.ascent.advance(f, t, t_event);
+		if(flight.ascent.t < t_event || t_event > t || t_event == t_orbit)
+			return;
+
+		// event reached before t
+		if(t_event == t_burnout){
+			flight.engine_on = false;
+			flight.ascent.reset(flight.ascent.t, flight.ascent.y);
+		}
+		else
+			separate(flight, state, parameters);
+	}
+}
+
+// Integrate a body under gravity until time t
+static void advance_coast(coast_body& body, mission_parameters const& parameters, double t, double h)
+{
+	double const g0 = norm(parameters.g);
+	double const earth_radius = parameters.earth_radius;
+	if(body.method==integrator_type::rk45){
+		auto const f = [g0,earth_radius](double, state_vector<6> const& y, state_vector<6>& dydt){
+			dydt[0] = y[3]; dydt[1] = y[4]; dydt[2] = y[5];
+			gravity(&y[0], g0, earth_radius, &dydt[3]);
+		};
+		// free steps, the sample at t comes from the dense output
+		body.rk45.advance(f, t, std::numeric_limits<double>::infinity());
+	}
+	else{
+		auto const a = [g0,earth_radius](double, state_vector<3> const& x, state_vector<3>& acceleration){
+			gravity(&x[0], g0, earth_radius, &acceleration[0]);
+		};
+		// fixed steps of h on the grid of the body, the sample at t interpolated in the last one
+		body.symplectic.advance_past(a, t, h);
+	}
+	body.sample_time = t;
+}
+
+void flight_aerodynamics(mission_parameters const& parameters, vec3 const& p, vec3 const& v, float& q, float& mach)
+{
+	float const altitude = norm(p - vec3(0,0,-parameters.earth_radius)) - parameters.earth_radius;
+	float const speed = norm(v);
+	q = dynamic_pressure(static_cast<float>(air_density(parameters.vehicle, altitude)), speed);
+	mach = speed/us1976(altitude).speed_of_sound;
+}
+
+// max-Q is tracked at the samples of the stack, not at the steps of the integrator
+static void update_aerodynamics(flight_state& flight, mission_parameters const& parameters, vec3 const& p, vec3 const& v, float t)
+{
+	flight_aerodynamics(parameters, p, v, flight.dynamic_pressure, flight.mach);
+	if(flight.dynamic_pressure > flight.max_dynamic_pressure){
+		flight.max_dynamic_pressure = flight.dynamic_pressure;
+		flight.max_dynamic_pressure_time = t;
+	}
+}
+
+void flight_initialize(mission_state& state, mission_parameters const& parameters)
+{
+	flight_state& flight = state.flight;
+	flight = flight_state();
+
+	vehicle_parameters const& v = parameters.vehicle;
+	double const mass = v.first_stage.dry_mass + v.first_stage.propellant_mass
+		+ v.second_stage.dry_mass + v.second_stage.propellant_mass
+		+ v.upper_stage.dry_mass + v.upper_stage.propellant_mass;
+	vec3 const p0 = parameters.rocket_p0;
+
+	flight.ascent.options = parameters.integration.ascent;
+	flight.ascent.reset(0.0, {p0.x, p0.y, p0.z, 0, 0, 0, mass});
+	start_engine(flight, parameters, 0, 0.0);
+}
+
+void flight_evaluate(mission_state& state, mission_parameters const& parameters, float current_time)
+{
+	flight_state& flight = state.flight;
+	body_table& b = state.bodies;
+	double const t = current_time;
+
+	if(current_time < parameters.t_satellite_orbit_start){
+		advance_ascent(flight, state, parameters, t);
+
+		// stack still attached, sampled at t with the dense output of the last step
+		state_vector<7> const y = flight.ascent.interpolate(t);
+		state.rocket_p = to_vec3(y[0], y[1], y[2]);
+		state.rocket_v = to_vec3(y[3], y[4], y[5]);
+		update_aerodynamics(flight, parameters, state.rocket_p, state.rocket_v, current_time);
+		for(size_t k : {size_t(body_first_stage), size_t(body_second_stage), size_t(body_payload_fairing)}){
+			if(b.phase[k]==body_attached){
+				b.set_position(k, state.rocket_p);
+				b.set_velocity(k, state.rocket_v);
+			}
+		}
+
+		// separated stages fall until they hit the terrain
+		for(int s=0; s<2; ++s){
+			coast_body& body = flight.stages[s];
+			size_t const k = s==0 ? body_first_stage : body_second_stage;
+			if(!body.active || body.landed)
+				continue;
+			vec3 const previous = body.position();
+			vec3 const previous_v = body.velocity();
+			double const previous_t = body.sample_time;
+			advance_coast(body, parameters, t, parameters.integration.coast_step);
+			vec3 const p = body.position();
+			// path of the step: the parabola leaving the last sample with its velocity and
+			// reaching the new one, searched for the impact with the terrain
+			float const h = static_cast<float>(t - previous_t);
+			terrain_impact impact;
+			if(h>0){
+				terrain_query step = terrain_segment(previous, p, h);
+				step.v = previous_v;
+				step.a = (2/(h*h))*(p - previous - h*previous_v);
+				impact = mission_terrain(parameters).intersect(step);
+			}
+			if(impact.hit()){
+				impact.t = static_cast<float>(previous_t + impact.t);
+				state.impacts[k] = impact;
+				body.landed = true;
+				b.phase[k] = body_landed;
+				b.set_position(k, impact.p);
+				b.set_velocity(k, vec3(0,0,0));
+			}
+			else{
+				b.set_position(k, p);
+				b.set_velocity(k, body.velocity());
+			}
+		}
+	}
+	else{
+		if(!state.radius_set){
+			// orbit insertion: the payload gets the circular velocity around the earth center
+			advance_ascent(flight, state, parameters, parameters.t_satellite_orbit_start);
+			state_vector<7> const y = flight.ascent.y;
+			double const r[3] = {y[0], y[1], y[2] + parameters.earth_radius};
+			double const d = std::sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+			double const speed = std::sqrt(norm(parameters.g)*parameters.earth_radius*parameters.earth_radius/d);
+			// tangent in the (x,z) plane, towards +x at the top (same direction as the scripted orbit)
+			double tx = r[2], tz = -r[0];
+			double const tn = std::sqrt(tx*tx + tz*tz);
+			if(tn>0){ tx /= tn; tz /= tn; } else { tx = 1; tz = 0; }
+			double const v[3] = {speed*tx, 0, speed*tz};
+			start_coast(flight.satellite, parameters.integration.orbit, parameters.integration.ascent, parameters.t_satellite_orbit_start, &y[0], v);
+			state.radius = static_cast<float>(d);
+			state.radius_set = true;
+		}
+
+		advance_coast(flight.satellite, parameters, t, parameters.integration.orbit_step);
+		vec3 const p = flight.satellite.position();
+		b.set_position(body_satellite, p);
+		b.set_velocity(body_satellite, flight.satellite.velocity());
+		state.angle_of_rotation = std::atan2(p.x, p.z + parameters.earth_radius);
+	}
+}
+
+void flight_on_rails(mission_state& state, mission_parameters const& parameters, float current_time)
+{
+	coast_body& satellite = state.flight.satellite;
+	if(!state.radius_set || !satellite.active){
+		flight_evaluate(state, parameters, current_time);
+		return;
+	}
+
+	// satellite at its last sample, from the earth center
+	double const earth_radius = parameters.earth_radius;
+	orbit_state s;
+	if(satellite.method==integrator_type::rk45){
+		state_vector<6> const y = satellite.rk45.interpolate(satellite.sample_time);
+		for(int k=0; k<3; ++k){
+			s.position[k] = y[k];
+			s.velocity[k] = y[3+k];
+		}
+	}
+	else{
+		symplectic_integrator::vec x, v;
+		satellite.symplectic.interpolate(satellite.sample_time, x, v);
+		for(int k=0; k<3; ++k){
+			s.position[k] = x[k];
+			s.velocity[k] = v[k];
+		}
+	}
+	s.position[2] += earth_radius;
+
+	planet_model planet;
+	planet.mu = norm(parameters.g)*earth_radius*earth_radius;
+	planet.radius = earth_radius;
+	planet.j2 = 0;
+	orbit_elements const elements = orbit_from_state(s, planet.mu);
+	if(!(elements.eccentricity<1)){
+		// escaping: no closed orbit to follow
+		flight_evaluate(state, parameters, current_time);
+		return;
+	}
+	orbit_state const next = orbit_propagate(elements, planet, current_time - satellite.sample_time, false);
+
+	double const p[3] = {next.position[0], next.position[1], next.position[2] - earth_radius};
+	start_coast(satellite, satellite.method, parameters.integration.ascent, current_time, p, next.velocity);
+	vec3 const position = satellite.position();
+	state.bodies.set_position(body_satellite, position);
+	state.bodies.set_velocity(body_satellite, satellite.velocity());
+	state.angle_of_rotation = std::atan2(position.x, position.z + parameters.earth_radius);
+}
+
+double flight_propellant_burnt(flight_state const& flight, mission_parameters const& parameters, double t)
+{
+	// the engines burn at constant mass flow, the active one being the engine of the lowest stage
+	engine_parameters const& e = engine(parameters, flight.active_engine);
+	double burnt = 0;
+	if(e.mass_flow>0)
+		burnt = std::min<double>(e.propellant_mass, e.mass_flow*std::max(0.0, std::min(t, flight.burnout_time) - flight.ignition_time));
+	return flight.propellant_dropped_burnt + burnt;
+}
+
+integrator_counters flight_ascent_counters(flight_state const& flight)
+{
+	return flight.ascent.counters;
+}
+
+integrator_counters flight_coast_counters(flight_state const& flight)
+{
+	integrator_counters c = flight.stages[0].counters();
+	c += flight.stages[1].counters();
+	return c;
+}
+
+integrator_counters flight_orbit_counters(flight_state const& flight)
+{
+	return flight.satellite.counters();
+}
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+/**
+Dynamic flight model: thrust, mass flow, aerodynamic drag and inverse-square gravity,
+integrated numerically instead of the closed-form kinematics of the scripted mission.
+ - powered ascent of the stack still attached: Dormand-Prince RK45 (state p, v, mass)
+ - falling stages and satellite orbit: symplectic integrator (or RK45), gravity only. Each body
+   steps on its own grid (coast_step, orbit_step, or the free steps of RK45) ahead of the mission
+   time, and is sampled by interpolation inside its last step
+Separations and burnouts are integration events: no step straddles a discontinuity.
+*/
+
+#include "simulation/integrators.hpp"
+#include "simulation/sim_math.hpp"
+
+namespace sim {
+
+struct mission_parameters;
+struct mission_state;
+
+// Scripted: constant ascent velocity and closed-form parabolas (the original showcase)
+// Dynamic: numerical integration of the forces described here
+enum class flight_model { scripted, dynamic };
+
+// Propulsion of one stage
+struct engine_parameters
+{
+	float dry_mass;         // kg
+	float propellant_mass;  // kg
+	float thrust;           // N
+	float mass_flow;        // kg/s
+};
+
+// Density of the air for the drag: US Standard Atmosphere 1976 (tables of atmosphere.hpp), or
+// the exponential atmosphere of air_density_sea_level and atmosphere_scale_height
+enum class atmosphere_model { exponential, us1976 };
+
+// Vehicle and atmosphere, with magnitudes chosen for the scale of the scene (earth radius 1000)
+struct vehicle_parameters
+{
+	engine_parameters first_stage = {1500.0f, 4000.0f, 88000.0f, 100.0f};
+	engine_parameters second_stage = {500.0f, 1500.0f, 33000.0f, 60.0f};
+	engine_parameters upper_stage = {300.0f, 500.0f, 9000.0f, 20.0f}; // payload fairing engine, after the second separation
+
+	float drag_area = 0.25f;               // drag coefficient x reference area (m^2)
+	float air_density_sea_level = 1.225f;  // kg/m^3
+	float atmosphere_scale_height = 8500.0f; // m
+	atmosphere_model atmosphere = atmosphere_model::us1976;
+};
+
+// Gravity turn of the powered ascent: from start_time, the thrust leans from its initial direction
+// (rocket_v0) towards the horizontal downrange (+x for a vertical launch), at rate until max_angle
+struct pitch_program
+{
+	float start_time = 0.0f;  // s
+	float rate = 0.0f;        // rad/s (0: the attitude is kept)
+	float max_angle = 1.2f;   // rad, from the initial direction
+};
+
+// Integrator used in each phase, to trade accuracy for throughput
+struct integration_settings
+{
+	rk45_options ascent;                             // powered flight, adaptive
+	integrator_type coast = integrator_type::yoshida4; // separated stages
+	double coast_step = 0.01;                          // s, symplectic methods only
+	integrator_type orbit = integrator_type::yoshida4; // satellite
+	double orbit_step = 0.05;
+};
+
+// A body moving under gravity only
+struct coast_body
+{
+	integrator_type method = integrator_type::yoshida4;
+	symplectic_integrator symplectic;
+	rk45_integrator<6> rk45;
+	bool active = false;
+	bool landed = false;
+	double sample_time = 0; // time of the last sample (the integrator steps past it and interpolates)
+
+	vec3 position() const;
+	vec3 velocity() const;
+	integrator_counters counters() const;
+};
+
+struct flight_state
+{
+	rk45_integrator<7> ascent;  // p, v, mass of the stack still attached
+	int active_engine = 0;      // 0: first stage, 1: second stage, 2: upper stage
+	bool engine_on = true;
+	double ignition_time = 0;   // of the active engine
+	double burnout_time = 0;    // of the active engine
+	int separations = 0;        // number of stages dropped
+	double propellant_dropped_burnt = 0; // propellant burnt by the stages dropped (kg)
+
+	// aerodynamics of the stack at the last sample, and max-Q of the ascent so far
+	float dynamic_pressure = 0; // Pa
+	float mach = 0;
+	float max_dynamic_pressure = 0;
+	float max_dynamic_pressure_time = 0;
+
+	coast_body stages[2];       // first and second stage after separation
+	coast_body satellite;       // after the orbit insertion
+};
+
+// Density of the air at the altitude, for the atmosphere model of the vehicle
+double air_density(vehicle_parameters const& vehicle, double altitude);
+
+// Acceleration of gravity at p for a planet of radius R centered at (0,0,-R), surface gravity g0
+vec3 gravity_acceleration(vec3 const& p, float g0, float earth_radius);
+
+// Reset the dynamic model to the launch configuration
+void flight_initialize(mission_state& state, mission_parameters const& parameters);
+
+// Integrate the dynamic model up to current_time and update the bodies of the mission
+void flight_evaluate(mission_state& state, mission_parameters const& parameters, float current_time);
+
+// Propagate the satellite in orbit up to current_time on its Kepler orbit (O(1), no J2), and restart
+//  its integrator there. Before the orbit start, flight_evaluate
+void flight_on_rails(mission_state& state, mission_parameters const& parameters, float current_time);
+
+// Dynamic pressure (Pa) and Mach number of a body at p moving at v, in the atmosphere of the vehicle
+void flight_aerodynamics(mission_parameters const& parameters, vec3 const& p, vec3 const& v, float& q, float& mach);
+
+// Thrust direction at time t, following the pitch program of the mission
+vec3 flight_thrust_direction(mission_parameters const& parameters, double t);
+
+// Propellant burnt since the launch up to time t (<= the time of the state), in kg
+double flight_propellant_burnt(flight_state const& flight, mission_parameters const& parameters, double t);
+
+// Counters of the integrators of each phase
+integrator_counters flight_ascent_counters(flight_state const& flight);
+integrator_counters flight_coast_counters(flight_state const& flight);
+integrator_counters flight_orbit_counters(flight_state const& flight);
+
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+/**
+Numerical integrators for the flight dynamics.
+ - rk45_integrator: Dormand-Prince 5(4) with error control, FSAL and dense output, for the
+   powered ascent (thrust, mass flow, drag, gravity).
+ - symplectic_integrator: velocity Verlet (2nd order) or Yoshida (4th order) for x'' = a(t,x),
+   used for the coast and orbit phases where energy must not drift.
+Every integrator counts its steps, rejected steps and function evaluations, so that the cost
+of each phase can be compared with the accuracy it gives.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace sim {
+
+template <size_t N> using state_vector = std::array<double,N>;
+
+struct integrator_counters
+{
+	unsigned long steps = 0;        // accepted steps
+	unsigned long rejected = 0;     // rejected steps (error too large)
+	unsigned long evaluations = 0;  // calls to the derivative / acceleration function
+
+	integrator_counters& operator+=(integrator_counters const& c)
+	{
+		steps += c.steps; rejected += c.rejected; evaluations += c.evaluations;
+		return *this;
+	}
+};
+
+// Integration method selectable for the coast and orbit phases
+enum class integrator_type { rk45, velocity_verlet, yoshida4 };
+
+inline char const* integrator_name(integrator_type type)
+{
+	switch(type){
+	case integrator_type::rk45: return "rk45";
+	case integrator_type::velocity_verlet: return "velocity_verlet";
+	default: return "yoshida4";
+	}
+}
+
+// ****************************************** //
+// Dormand-Prince RK45
+// ****************************************** //
+
+struct rk45_options
+{
+	double rtol = 1e-6;      // relative tolerance
+	double atol = 1e-6;      // absolute tolerance
+	double h_initial = 0.01; // first step size
+	double h_min = 1e-8;
+	double h_max = 1.0;
+};
+
+// Integrates y' = f(t,y) where f is a callable void(double t, state const& y, state& dydt)
+template <size_t N>
+class rk45_integrator
+{
+public:
+	using state = state_vector<N>;
+
+	double t = 0;           // time of the last accepted step
+	double t_previous = 0;  // beginning of the last accepted step
+	state y{};              // solution at t
+	double h = 0.01;        // next step size
+	rk45_options options;
+	integrator_counters counters;
+
+	// Start a new integration (e.g. after a discontinuity such as a stage separation)
+	void reset(double t0, state const& y0)
+	{
+		t = t_previous = t0;
+		y = y0;
+		h = options.h_initial;
+		has_k1 = false;
+		has_dense = false;
+	}
+
+	// One accepted step, not going past t_limit. Returns false if t already reached t_limit.
+	template <typename F>
+	bool step(F const& f, double t_limit)
+	{
+		if(t >= t_limit)
+			return false;
+
+		if(!has_k1){
+			f(t, y, k[0]);
+			counters.evaluations++;
+			has_k1 = true;
+		}
+
+		for(;;){
+			double const step_size = std::min(h, t_limit - t);
+			state y_new, err;
+			stages(f, step_size, y_new, err);
+
+			// scaled RMS norm of the error estimate
+			double e = 0;
+			for(size_t i=0; i<N; ++i){
+				double const scale = options.atol + options.rtol*std::max(std::abs(y[i]), std::abs(y_new[i]));
+				double const r = err[i]/scale;
+				e += r*r;
+			}
+			e = std::sqrt(e/N);
+
+			double const factor = e==0 ? 5.0 : std::min(5.0, std::max(0.2, 0.9*std::pow(e, -0.2)));
+			if(e <= 1.0 || step_size <= options.h_min){
+				// accept: store what the dense output needs, FSAL k7 becomes k1
+				prepare_dense(step_size, y_new);
+				t_previous = t;
+				t = (step_size == t_limit - t) ? t_limit : t + step_size;
+				y = y_new;
+				k[0] = k[6];
+				counters.steps++;
+				// keep the proposed size if the step was only shortened to hit t_limit
+				if(step_size >= h)
+					h = std::min(options.h_max, std::max(options.h_min, step_size*factor));
+				return true;
+			}
+			counters.rejected++;
+			h = std::max(options.h_min, step_size*factor);
+		}
+	}
+
+	// Accepted steps until t >= t_target, never going past t_limit
+	template <typename F>
+	void advance(F const& f, double t_target, double t_limit)
+	{
+		while(t < t_target && step(f, t_limit)) {}
+	}
+
+	// Dense output: 4th order interpolation inside the last accepted step [t_previous, t]
+	state interpolate(double time) const
+	{
+		if(!has_dense || t <= t_previous)
+			return y;
+		double const theta = (time - t_previous)/(t - t_previous);
+		double const theta1 = 1.0 - theta;
+		state out;
+		for(size_t i=0; i<N; ++i)
+			out[i] = r[0][i] + theta*(r[1][i] + theta1*(r[2][i] + theta*(r[3][i] + theta1*r[4][i])));
+		return out;
+	}
+
+private:
+	state k[7];     // stages of the current step (k[0] = f(t,y))
+	state r[5];     // dense output coefficients of the last accepted step
+	bool has_k1 = false;
+	bool has_dense = false;
+
+	template <typename F>
+	void stages(F const& f, double hs, state& y_new, state& err)
+	{
+		static double const a21 = 1.0/5;
+		static double const a31 = 3.0/40, a32 = 9.0/40;
+		static double const a41 = 44.0/45, a42 = -56.0/15, a43 = 32.0/9;
+		static double const a51 = 19372.0/6561, a52 = -25360.0/2187, a53 = 64448.0/6561, a54 = -212.0/729;
+		static double const a61 = 9017.0/3168, a62 = -355.0/33, a63 = 46732.0/5247, a64 = 49.0/176, a65 = -5103.0/18656;
+		static double const a71 = 35.0/384, a73 = 500.0/1113, a74 = 125.0/192, a75 = -2187.0/6784, a76 = 11.0/84;
+		static double const e1 = 71.0/57600, e3 = -71.0/16695, e4 = 71.0/1920, e5 = -17253.0/339200, e6 = 22.0/525, e7 = -1.0/40;
+
+		state tmp;
+		for(size_t i=0; i<N; ++i) tmp[i] = y[i] + hs*a21*k[0][i];
+		f(t + hs/5, tmp, k[1]);
+		for(size_t i=0; i<N; ++i) tmp[i] = y[i] + hs*(a31*k[0][i] + a32*k[1][i]);
+		f(t + 3*hs/10, tmp, k[2]);
+		for(size_t i=0; i<N; ++i) tmp[i] = y[i] + hs*(a41*k[0][i] + a42*k[1][i] + a43*k[2][i]);
+		f(t + 4*hs/5, tmp, k[3]);
+		for(size_t i=0; i<N; ++i) tmp[i] = y[i] + hs*(a51*k[0][i] + a52*k[1][i] + a53*k[2][i] + a54*k[3][i]);
+		f(t + 8*hs/9, tmp, k[4]);
+		for(size_t i=0; i<N; ++i) tmp[i] = y[i] + hs*(a61*k[0][i] + a62*k[1][i] + a63*k[2][i] + a64*k[3][i] + a65*k[4][i]);
+		f(t + hs, tmp, k[5]);
+		for(size_t i=0; i<N; ++i) y_new[i] = y[i] + hs*(a71*k[0][i] + a73*k[2][i] + a74*k[3][i] + a75*k[4][i] + a76*k[5][i]);
+		f(t + hs, y_new, k[6]);
+		counters.evaluations += 6;
+
+		for(size_t i=0; i<N; ++i)
+			err[i] = hs*(e1*k[0][i] + e3*k[2][i] + e4*k[3][i] + e5*k[4][i] + e6*k[5][i] + e7*k[6][i]);
+	}
+
+	// Coefficients of the continuous extension (Hairer & Wanner, DOPRI5 contd5)
+	void prepare_dense(double hs, state const& y_new)
+	{
+		static double const d1 = -12715105075.0/11282082432, d3 = 87487479700.0/32700410799, d4 = -10690763975.0/1880347072;
+		static double const d5 = 701980252875.0/199316789632, d6 = -1453857185.0/822651844, d7 = 69997945.0/29380423;
+		for(size_t i=0; i<N; ++i){
+			double const ydiff = y_new[i] - y[i];
+			double const bspl = hs*k[0][i] - ydiff;
+			r[0][i] = y[i];
+			r[1][i] = ydiff;
+			r[2][i] = bspl;
+			r[3][i] = ydiff - hs*k[6][i] - bspl;
+			r[4][i] = hs*(d1*k[0][i] + d3*k[2][i] + d4*k[3][i] + d5*k[4][i] + d6*k[5][i] + d7*k[6][i]);
+		}
+		has_dense = true;
+	}
+};
+
+// ****************************************** //
+// Symplectic integrators for x'' = a(t,x)
+// ****************************************** //
+
+// Position/velocity integrated with velocity Verlet or Yoshida 4th order.
+//  a is a callable void(double t, state_vector<3> const& x, state_vector<3>& acceleration)
+class symplectic_integrator
+{
+public:
+	using vec = state_vector<3>;
+
+	integrator_type method = integrator_type::yoshida4;
+	double t = 0;
+	vec x{};
+	vec v{};
+	double t_previous = 0;  // beginning of the last step
+	vec x_previous{};
+	vec v_previous{};
+	integrator_counters counters;
+
+	void reset(double t0, vec const& x0, vec const& v0)
+	{
+		t = t_previous = t0;
+		x = x_previous = x0;
+		v = v_previous = v0;
+		has_acceleration = false;
+	}
+
+	// One step of size h
+	template <typename A>
+	void step(A const& a, double h)
+	{
+		t_previous = t;
+		x_previous = x;
+		v_previous = v;
+		if(method == integrator_type::velocity_verlet)
+			step_verlet(a, h);
+		else
+			step_yoshida(a, h);
+		t += h;
+		counters.steps++;
+	}
+
+	// Fixed steps of size h_max (the last one shortened) until time t_target
+	template <typename A>
+	void advance(A const& a, double t_target, double h_max)
+	{
+		while(t < t_target){
+			double const h = std::min(h_max, t_target - t);
+			step(a, h);
+			if(t_target - t < 1e-12)
+				t = t_target;
+		}
+	}
+
+	// Steps of size h until t >= t_target: the body keeps its own time grid, sampled in between
+	// with interpolate
+	template <typename A>
+	void advance_past(A const& a, double t_target, double h)
+	{
+		while(t < t_target)
+			step(a, h);
+	}
+
+	// Cubic Hermite interpolation inside the last step [t_previous, t] from the positions and
+	// velocities at both ends (4th order for the position, 3rd order for the velocity)
+	void interpolate(double time, vec& x_out, vec& v_out) const
+	{
+		double const h = t - t_previous;
+		if(h <= 0){
+			x_out = x;
+			v_out = v;
+			return;
+		}
+		double const s = (time - t_previous)/h;
+		double const s2 = s*s, s3 = s2*s;
+		double const h00 = 2*s3 - 3*s2 + 1, h10 = s3 - 2*s2 + s, h01 = 3*s2 - 2*s3, h11 = s3 - s2;
+		double const d00 = 6*s2 - 6*s, d10 = 3*s2 - 4*s + 1, d01 = 6*s - 6*s2, d11 = 3*s2 - 2*s;
+		for(int i=0; i<3; ++i){
+			x_out[i] = h00*x_previous[i] + h10*h*v_previous[i] + h01*x[i] + h11*h*v[i];
+			v_out[i] = (d00*x_previous[i] + d01*x[i])/h + d10*v_previous[i] + d11*v[i];
+		}
+	}
+
+private:
+	vec acceleration{};         // a(t,x), kept between Verlet steps
+	bool has_acceleration = false;
+
+	template <typename A>
+	void step_verlet(A const& a, double h)
+	{
+		if(!has_acceleration){
+			a(t, x, acceleration);
+			counters.evaluations++;
+			has_acceleration = true;
+		}
+		for(int i=0; i<3; ++i){
+			v[i] += 0.5*h*acceleration[i];
+			x[i] += h*v[i];
+		}
+		a(t+h, x, acceleration);
+		counters.evaluations++;
+		for(int i=0; i<3; ++i)
+			v[i] += 0.5*h*acceleration[i];
+	}
+
+	template <typename A>
+	void step_yoshida(A const& a, double h)
+	{
+		// Yoshida (1990) coefficients of the 4th order composition of leapfrog steps
+		static double const cbrt2 = std::cbrt(2.0);
+		static double const w1 = 1.0/(2.0 - cbrt2);
+		static double const w0 = -cbrt2/(2.0 - cbrt2);
+		double const c[4] = {w1/2, (w0+w1)/2, (w0+w1)/2, w1/2};
+		double const d[3] = {w1, w0, w1};
+
+		double time = t;
+		vec acc;
+		for(int s=0; s<3; ++s){
+			for(int i=0; i<3; ++i) x[i] += c[s]*h*v[i];
+			time += c[s]*h;
+			a(time, x, acc);
+			for(int i=0; i<3; ++i) v[i] += d[s]*h*acc[i];
+		}
+		for(int i=0; i<3; ++i) x[i] += c[3]*h*v[i];
+		counters.evaluations += 3;
+		has_acceleration = false; // the Verlet cache is no longer valid
+	}
+};
+
+}
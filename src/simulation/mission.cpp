@@ -0,0 +1,154 @@
+#include "simulation/mission.hpp"
+
+#include <cmath>
+#include <utility>
+
+namespace sim {
+
+// The fall of a separated stage is a parabola from its separation: its impact on the terrain is
+// known from there (at the exact time and point, whatever dt), and the stage lands at the first
+// step after it, before the body table would find it below the floor
+static void land_on_terrain(mission_state& state, mission_parameters const& parameters, float current_time)
+{
+	body_table& b = state.bodies;
+	for(size_t k : {size_t(body_first_stage), size_t(body_second_stage)}){
+		if(b.phase[k]!=body_ballistic)
+			continue;
+		terrain_impact& impact = state.impacts[k];
+		if(!impact.hit()){
+			impact = mission_terrain(parameters).intersect(terrain_parabola(vec3(b.p0x[k], b.p0y[k], b.p0z[k]), vec3(b.v0x[k], b.v0y[k], b.v0z[k]), parameters.g));
+			impact.t += b.t_separation[k];
+		}
+		if(current_time >= impact.t){
+			b.set_position(k, impact.p);
+			b.set_velocity(k, vec3(0,0,0));
+			b.phase[k] = body_landed;
+		}
+	}
+}
+
+// Evaluate the mission at the given time
+static void mission_evaluate(mission_state& state, mission_parameters const& parameters, float current_time)
+{
+	state.t = current_time;
+
+	if(parameters.model == flight_model::dynamic){
+		flight_evaluate(state, parameters, current_time);
+		return;
+	}
+
+	/* simple trajectory and velocity (scripted model). The dynamic model of flight_dynamics.cpp
+	replaces them with the integration of thrust, mass flow, drag and gravity */
+	vec3 const v = parameters.rocket_v0;
+	state.rocket_v = v;
+	state.rocket_p = parameters.rocket_p0 + vec3(0,0,v.z*current_time);
+
+	if(current_time < parameters.t_satellite_orbit_start){   // pre satellite orbit stage, i.e. rocket launch
+		/* stages follow the rocket until their separation time, then fall under gravity until they
+		reach the floor. The payload fairing never separates (t_separation = infinity); for the sake
+		of simplification it is taken here as the payload itself. The satellite row is inactive. */
+		body_table_advance(state.bodies, current_time, parameters.g);
+		land_on_terrain(state, parameters, current_time);
+	}
+	else{   //satellite orbit phase
+		if(!state.radius_set){
+			//set radius once only
+			state.radius = state.bodies.pz[body_payload_fairing] + parameters.earth_radius;
+			state.radius_set = true;
+		}
+
+		/*
+		rotation around the y axis centered on the earth center c_earth = (0,0,-earth_radius):
+		translate c_earth to the origin, rotate (Rsin(theta), y, Rcos(theta)), and translate back
+		*/
+		float const w = parameters.orbit_angular_velocity;
+		state.angle_of_rotation = w*(current_time - parameters.t_satellite_orbit_start);
+		float const s = std::sin(state.angle_of_rotation);
+		float const c = std::cos(state.angle_of_rotation);
+		body_table& b = state.bodies;
+		b.set_position(body_satellite, vec3(state.radius*s, b.py[body_satellite], state.radius*c - parameters.earth_radius));
+		b.set_velocity(body_satellite, vec3(state.radius*w*c, 0, -state.radius*w*s));
+	}
+}
+
+void mission_initialize(mission_state& state, mission_parameters const& parameters)
+{
+	// reset the scalar fields but keep the allocated columns of the body table
+	body_table bodies = std::move(state.bodies);
+	state = mission_state();
+	state.bodies = std::move(bodies);
+
+	//initialize body parts data
+	body_table& b = state.bodies;
+	b.clear();
+	b.add(parameters.rocket_p0, parameters.rocket_v0, parameters.t_separation_first);
+	b.add(parameters.rocket_p0, parameters.rocket_v0, parameters.t_separation_second);
+	b.add(parameters.rocket_p0, parameters.rocket_v0);
+	b.add(parameters.rocket_p0, vec3(0,0,0));
+	b.phase[body_satellite] = body_inactive;
+
+	if(parameters.model == flight_model::dynamic)
+		flight_initialize(state, parameters);
+
+	mission_evaluate(state, parameters, 0.0f);
+}
+
+void mission_step(mission_state& state, mission_parameters const& parameters)
+{
+	state.step_count++;
+	// t is recomputed from the step counter so that no rounding error accumulates
+	float const t = static_cast<float>(static_cast<double>(state.step_count)*parameters.dt);
+	mission_evaluate(state, parameters, t);
+}
+
+unsigned int mission_advance_to(mission_state& state, mission_parameters const& parameters, float t_target)
+{
+	unsigned int steps = 0;
+	while(static_cast<double>(state.step_count+1)*parameters.dt <= t_target){
+		mission_step(state, parameters);
+		steps++;
+	}
+	return steps;
+}
+
+bool mission_on_rails(mission_state const& state)
+{
+	// after the orbit start, the stages are left where they were
+	return state.radius_set;
+}
+
+unsigned int mission_jump(mission_state& state, mission_parameters const& parameters, unsigned int step)
+{
+	if(step<=state.step_count)
+		return 0;
+	if(!mission_on_rails(state)){
+		unsigned int steps = 0;
+		while(state.step_count<step){
+			mission_step(state, parameters);
+			steps++;
+		}
+		return steps;
+	}
+
+	state.step_count = step;
+	float const t = static_cast<float>(static_cast<double>(state.step_count)*parameters.dt);
+	if(parameters.model == flight_model::dynamic){
+		state.t = t;
+		flight_on_rails(state, parameters, t);
+	}
+	else
+		mission_evaluate(state, parameters, t); // closed form in t once the radius is set
+	return 0;
+}
+
+heightfield const& mission_terrain(mission_parameters const& parameters)
+{
+	return parameters.terrain ? launch_site_terrain() : flat_terrain();
+}
+
+bool mission_in_orbit(mission_state const& state, mission_parameters const& parameters)
+{
+	return state.t >= parameters.t_satellite_orbit_start;
+}
+
+}
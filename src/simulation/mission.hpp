@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+Headless mission engine.
+All the trajectory computations that used to live in display_scene() are here, with no
+OpenGL/VCL dependency, so the same code drives the interactive scene and the batch tools.
+
+The mission is advanced with a fixed time step: the state at step n is always evaluated at
+t = n*dt, which is what makes the rendered and the batch trajectories identical bit-for-bit.
+*/
+
+#include "simulation/body_table.hpp"
+#include "simulation/flight_dynamics.hpp"
+#include "simulation/sim_math.hpp"
+#include "simulation/terrain.hpp"
+
+namespace sim {
+
+// Parameters of one mission (separation times, ascent velocity, planet)
+struct mission_parameters
+{
+	float t_separation_first = 10.0f;      // first stage separation time
+	float t_separation_second = 15.0f;     // second stage separation time
+	float t_satellite_orbit_start = 20.0f; // start of the satellite orbit phase
+
+	vec3 rocket_p0 = {0,0,0};    // initial position of the rocket
+	vec3 rocket_v0 = {0,0,5.0f}; // ascent velocity of the rocket (was hard-coded in display_scene)
+
+	vec3 g = {0,0,9.81f};           // gravity constant
+	float earth_radius = 1000.0f;   // earth is centered at (0,0,-earth_radius)
+	float orbit_angular_velocity = 0.5f; // rotation speed of the satellite around the earth (rad/s)
+
+	float dt = 0.01f; // fixed simulation time step
+	bool terrain = true; // stages land on the terrain of the launch site (terrain.hpp), on the plane z=0 otherwise
+
+	flight_model model = flight_model::scripted; // closed-form kinematics or numerical integration of the forces
+	vehicle_parameters vehicle;       // masses, engines and drag (dynamic model only)
+	pitch_program pitch;              // attitude of the powered ascent (dynamic model only)
+	integration_settings integration; // integrator of each phase (dynamic model only)
+};
+
+// Rows of the body table of a mission
+enum mission_body
+{
+	body_first_stage = 0,
+	body_second_stage = 1,
+	body_payload_fairing = 2, // taken here as the payload itself, never separates
+	body_satellite = 3,       // moved by the orbit phase only
+	mission_body_count = 4
+};
+
+// Complete state of a mission at time t
+struct mission_state
+{
+	float t = 0.0f;          // current simulation time (= step_count*dt)
+	unsigned int step_count = 0;
+
+	// rocket as a whole
+	vec3 rocket_p;
+	vec3 rocket_v;
+
+	// three parts of the rocket and the payload (rows given by mission_body)
+	body_table bodies;
+
+	// satellite rotation radius - rotation phase around the earth
+	bool radius_set = false;
+	float radius = 0.0f;
+	float angle_of_rotation = 0.0f;
+
+	// integrators of the dynamic flight model
+	flight_state flight;
+
+	// ground contact of the separated stages (mission time in t, infinity until it is known):
+	// predicted at the separation by the scripted model, found by the step of the dynamic one
+	terrain_impact impacts[mission_body_count];
+};
+
+// Reset the state to the launch configuration (t=0)
+void mission_initialize(mission_state& state, mission_parameters const& parameters);
+
+// Advance the mission of exactly one fixed step parameters.dt
+void mission_step(mission_state& state, mission_parameters const& parameters);
+
+// Advance with fixed steps while the next step does not go past t_target.
+//  Returns the number of steps taken.
+unsigned int mission_advance_to(mission_state& state, mission_parameters const& parameters, float t_target);
+
+// True once only the satellite moves, on its orbit: the state of any later step follows from this one
+//  in O(1) with mission_jump (scripted: closed form, dynamic: Kepler orbit)
+bool mission_on_rails(mission_state const& state);
+
+// Go to the given step: in O(1) when the mission is on rails (the same state as the fixed steps with
+//  the scripted model, the analytic orbit instead of the integrator with the dynamic one), with the
+//  fixed steps otherwise. Returns the number of steps taken
+unsigned int mission_jump(mission_state& state, mission_parameters const& parameters, unsigned int step);
+
+// Terrain the stages of the mission land on
+heightfield const& mission_terrain(mission_parameters const& parameters);
+
+// Position/velocity of one of the bodies
+inline vec3 mission_position(mission_state const& state, mission_body body) { return state.bodies.position(body); }
+inline vec3 mission_velocity(mission_state const& state, mission_body body) { return state.bodies.velocity(body); }
+inline bool mission_separated(mission_state const& state, mission_body body) { return state.bodies.separated(body); }
+
+// True once the satellite orbit phase has started
+bool mission_in_orbit(mission_state const& state, mission_parameters const& parameters);
+
+}
@@ -0,0 +1,442 @@
+#include "simulation/optimizer.hpp"
+
+#include "simulation/random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <string>
+
+namespace sim {
+
+// ****************************************** //
+// Text serialization
+// ****************************************** //
+
+static void write_values(std::ostream& out, char const* name, std::vector<double> const& values)
+{
+	out << name << ' ' << values.size();
+	for(double v : values)
+		out << ' ' << v;
+	out << '\n';
+}
+
+static bool read_values(std::istream& in, char const* name, std::vector<double>& values)
+{
+	std::string key;
+	size_t count = 0;
+	if(!(in >> key >> count) || key!=name)
+		return false;
+	values.resize(count);
+	for(double& v : values)
+		in >> v;
+	return static_cast<bool>(in);
+}
+
+template <typename T>
+static bool read_value(std::istream& in, char const* name, T& value)
+{
+	std::string key;
+	return (in >> key >> value) && key==name;
+}
+
+// ****************************************** //
+// CMA-ES
+// ****************************************** //
+
+void cma_es::initialize(point const& mean, double sigma, cma_es_options const& options_arg)
+{
+	options = options_arg;
+	n = mean.size();
+	lambda = options.population>0 ? options.population : 4 + static_cast<size_t>(3*std::log(static_cast<double>(n)));
+	lambda = std::max<size_t>(lambda, 2);
+	set_strategy();
+
+	m = mean;
+	step = sigma;
+	C.assign(n*n, 0.0);
+	B.assign(n*n, 0.0);
+	for(size_t i=0; i<n; ++i)
+		C[i*n+i] = B[i*n+i] = 1.0;
+	D.assign(n, 1.0);
+	pc.assign(n, 0.0);
+	ps.assign(n, 0.0);
+	generation_count = 0;
+	broken = false;
+	sampled = false;
+	history.clear();
+	has_best = false;
+	best_f = std::numeric_limits<double>::infinity();
+}
+
+// Default strategy parameters (Hansen, The CMA Evolution Strategy: A Tutorial)
+void cma_es::set_strategy()
+{
+	double const N = static_cast<double>(n);
+	mu = lambda/2;
+	weights.resize(mu);
+	for(size_t i=0; i<mu; ++i)
+		weights[i] = std::log(static_cast<double>(mu)+0.5) - std::log(static_cast<double>(i)+1.0);
+	double const sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+	double sum2 = 0;
+	for(double& w : weights){
+		w /= sum;
+		sum2 += w*w;
+	}
+	mueff = 1.0/sum2;
+
+	cc = (4 + mueff/N)/(N + 4 + 2*mueff/N);
+	cs = (mueff + 2)/(N + mueff + 5);
+	c1 = 2/((N+1.3)*(N+1.3) + mueff);
+	cmu = std::min(1 - c1, 2*(mueff - 2 + 1/mueff)/((N+2)*(N+2) + mueff));
+	damps = 1 + 2*std::max(0.0, std::sqrt((mueff-1)/(N+1)) - 1) + cs;
+	chi_n = std::sqrt(N)*(1 - 1/(4*N) + 1/(21*N*N));
+}
+
+// Cyclic Jacobi rotations: the dimension is small (a few parameters of a mission)
+void cma_es::decompose()
+{
+	std::vector<double> A = C;
+	std::fill(B.begin(), B.end(), 0.0);
+	for(size_t i=0; i<n; ++i)
+		B[i*n+i] = 1.0;
+	for(int sweep=0; sweep<100; ++sweep){
+		double off = 0;
+		for(size_t p=0; p<n; ++p)
+			for(size_t q=p+1; q<n; ++q)
+				off += A[p*n+q]*A[p*n+q];
+		if(off < 1e-30)
+			break;
+		for(size_t p=0; p<n; ++p){
+			for(size_t q=p+1; q<n; ++q){
+				double const apq = A[p*n+q];
+				if(apq==0)
+					continue;
+				double const theta = (A[q*n+q] - A[p*n+p])/(2*apq);
+				double const t = (theta>=0 ? 1.0 : -1.0)/(std::abs(theta) + std::sqrt(theta*theta + 1));
+				double const c = 1/std::sqrt(t*t + 1);
+				double const s = t*c;
+				for(size_t k=0; k<n; ++k){
+					double const akp = A[k*n+p], akq = A[k*n+q];
+					A[k*n+p] = c*akp - s*akq;
+					A[k*n+q] = s*akp + c*akq;
+				}
+				for(size_t k=0; k<n; ++k){
+					double const apk = A[p*n+k], aqk = A[q*n+k];
+					A[p*n+k] = c*apk - s*aqk;
+					A[q*n+k] = s*apk + c*aqk;
+				}
+				for(size_t k=0; k<n; ++k){
+					double const bkp = B[k*n+p], bkq = B[k*n+q];
+					B[k*n+p] = c*bkp - s*bkq;
+					B[k*n+q] = s*bkp + c*bkq;
+				}
+			}
+		}
+	}
+	for(size_t i=0; i<n; ++i){
+		double const eigenvalue = A[i*n+i];
+		if(!(eigenvalue>0) || !std::isfinite(eigenvalue)){
+			broken = true;
+			return;
+		}
+		D[i] = std::sqrt(eigenvalue);
+	}
+}
+
+std::vector<point> const& cma_es::ask()
+{
+	if(sampled)
+		return samples;
+	random_stream rng(options.seed, generation_count);
+	samples.assign(lambda, point(n));
+	steps.assign(lambda, point(n));
+	point z(n);
+	for(size_t k=0; k<lambda; ++k){
+		for(double& v : z)
+			v = rng.normal(0.0, 1.0);
+		// y = B D z
+		for(size_t i=0; i<n; ++i){
+			double y = 0;
+			for(size_t j=0; j<n; ++j)
+				y += B[i*n+j]*D[j]*z[j];
+			steps[k][i] = y;
+			samples[k][i] = m[i] + step*y;
+		}
+	}
+	sampled = true;
+	return samples;
+}
+
+void cma_es::tell(std::vector<double> const& values)
+{
+	if(!sampled || values.size()!=lambda)
+		return;
+	std::vector<size_t> rank(lambda);
+	std::iota(rank.begin(), rank.end(), 0);
+	std::stable_sort(rank.begin(), rank.end(), [&](size_t a, size_t b){ return values[a] < values[b]; });
+
+	if(!has_best || values[rank[0]] < best_f){
+		best_f = values[rank[0]];
+		best_x = samples[rank[0]];
+		has_best = true;
+	}
+	size_t const history_length = 10 + static_cast<size_t>(std::ceil(30.0*static_cast<double>(n)/static_cast<double>(lambda)));
+	history.push_back(values[rank[0]]);
+	if(history.size()>history_length)
+		history.erase(history.begin());
+
+	// mean: weighted recombination of the mu best steps
+	point yw(n, 0.0);
+	for(size_t i=0; i<mu; ++i)
+		for(size_t j=0; j<n; ++j)
+			yw[j] += weights[i]*steps[rank[i]][j];
+	for(size_t j=0; j<n; ++j)
+		m[j] += step*yw[j];
+
+	// step size path, with C^-1/2 yw = B D^-1 B^T yw
+	point t(n, 0.0);
+	for(size_t i=0; i<n; ++i){
+		double s = 0;
+		for(size_t j=0; j<n; ++j)
+			s += B[j*n+i]*yw[j];
+		t[i] = s/D[i];
+	}
+	double const ps_scale = std::sqrt(cs*(2-cs)*mueff);
+	double ps_norm = 0;
+	for(size_t i=0; i<n; ++i){
+		double s = 0;
+		for(size_t j=0; j<n; ++j)
+			s += B[i*n+j]*t[j];
+		ps[i] = (1-cs)*ps[i] + ps_scale*s;
+		ps_norm += ps[i]*ps[i];
+	}
+	ps_norm = std::sqrt(ps_norm);
+
+	// covariance path, stalled when the step size path is too long
+	double const g = static_cast<double>(generation_count+1);
+	bool const hsig = ps_norm/std::sqrt(1 - std::pow(1-cs, 2*g)) < (1.4 + 2/(static_cast<double>(n)+1))*chi_n;
+	double const pc_scale = std::sqrt(cc*(2-cc)*mueff);
+	for(size_t i=0; i<n; ++i)
+		pc[i] = (1-cc)*pc[i] + (hsig ? pc_scale*yw[i] : 0.0);
+
+	// rank one and rank mu updates
+	double const old_weight = 1 - c1 - cmu + (hsig ? 0.0 : c1*cc*(2-cc));
+	for(size_t i=0; i<n; ++i){
+		for(size_t j=0; j<=i; ++j){
+			double rank_mu = 0;
+			for(size_t k=0; k<mu; ++k)
+				rank_mu += weights[k]*steps[rank[k]][i]*steps[rank[k]][j];
+			double const c = old_weight*C[i*n+j] + c1*pc[i]*pc[j] + cmu*rank_mu;
+			C[i*n+j] = C[j*n+i] = c;
+		}
+	}
+
+	step *= std::exp((cs/damps)*(ps_norm/chi_n - 1));
+	generation_count++;
+	sampled = false;
+	decompose();
+}
+
+bool cma_es::converged() const
+{
+	if(broken)
+		return true;
+	double const longest = *std::max_element(D.begin(), D.end());
+	if(step*longest < options.tolerance_x)
+		return true;
+	size_t const history_length = 10 + static_cast<size_t>(std::ceil(30.0*static_cast<double>(n)/static_cast<double>(lambda)));
+	if(history.size()<history_length)
+		return false;
+	auto const range = std::minmax_element(history.begin(), history.end());
+	return *range.second - *range.first < options.tolerance_f;
+}
+
+void cma_es::save(std::ostream& out) const
+{
+	out.precision(17);
+	out << "cma_es " << n << ' ' << lambda << ' ' << options.seed << ' ' << options.tolerance_x << ' ' << options.tolerance_f << '\n';
+	out << "generation " << generation_count << '\n';
+	out << "sigma " << step << '\n';
+	write_values(out, "mean", m);
+	write_values(out, "covariance", C);
+	write_values(out, "pc", pc);
+	write_values(out, "ps", ps);
+	write_values(out, "history", history);
+	out << "best " << (has_best ? 1 : 0) << ' ' << (has_best ? best_f : 0.0) << '\n';
+	write_values(out, "best_point", best_x);
+}
+
+bool cma_es::load(std::istream& in)
+{
+	std::string key;
+	if(!(in >> key >> n >> lambda >> options.seed >> options.tolerance_x >> options.tolerance_f) || key!="cma_es")
+		return false;
+	options.population = lambda;
+	set_strategy();
+	int best_flag = 0;
+	if(!read_value(in, "generation", generation_count) || !read_value(in, "sigma", step)
+		|| !read_values(in, "mean", m) || !read_values(in, "covariance", C) || !read_values(in, "pc", pc) || !read_values(in, "ps", ps)
+		|| !read_values(in, "history", history) || !(in >> key >> best_flag >> best_f) || key!="best" || !read_values(in, "best_point", best_x))
+		return false;
+	if(m.size()!=n || C.size()!=n*n || pc.size()!=n || ps.size()!=n)
+		return false;
+	has_best = best_flag!=0;
+	B.assign(n*n, 0.0);
+	D.assign(n, 1.0);
+	broken = false;
+	sampled = false;
+	decompose();
+	return true;
+}
+
+// ****************************************** //
+// Nelder-Mead
+// ****************************************** //
+
+void nelder_mead::initialize(point const& x0, double step, double tolerance_x_arg, double tolerance_f_arg)
+{
+	tolerance_x = tolerance_x_arg;
+	tolerance_f = tolerance_f_arg;
+	size_t const n = x0.size();
+	vertices.assign(n+1, x0);
+	for(size_t i=0; i<n; ++i)
+		vertices[i+1][i] += step;
+	values_f.assign(n+1, std::numeric_limits<double>::max()); // finite: written in the checkpoints
+	state = phase::simplex;
+	batch.clear();
+	iteration_count = 0;
+}
+
+void nelder_mead::order()
+{
+	std::vector<size_t> rank(vertices.size());
+	std::iota(rank.begin(), rank.end(), 0);
+	std::stable_sort(rank.begin(), rank.end(), [&](size_t a, size_t b){ return values_f[a] < values_f[b]; });
+	std::vector<point> v(vertices.size());
+	std::vector<double> f(vertices.size());
+	for(size_t k=0; k<rank.size(); ++k){
+		v[k] = vertices[rank[k]];
+		f[k] = values_f[rank[k]];
+	}
+	vertices.swap(v);
+	values_f.swap(f);
+}
+
+std::vector<point> const& nelder_mead::ask()
+{
+	size_t const n = vertices.size()-1;
+	batch.clear();
+	if(state==phase::simplex){
+		batch = vertices;
+	}
+	else if(state==phase::shrink){
+		// towards the best vertex
+		for(size_t k=1; k<=n; ++k){
+			point x = vertices[0];
+			for(size_t i=0; i<n; ++i)
+				x[i] += 0.5*(vertices[k][i] - vertices[0][i]);
+			batch.push_back(x);
+		}
+	}
+	else{
+		// centroid of all but the worst, then reflection, expansion, outside and inside contractions
+		point c(n, 0.0);
+		for(size_t k=0; k<n; ++k)
+			for(size_t i=0; i<n; ++i)
+				c[i] += vertices[k][i]/static_cast<double>(n);
+		point const& w = vertices[n];
+		double const coefficients[4] = {1.0, 2.0, 0.5, -0.5};
+		for(double a : coefficients){
+			point x(n);
+			for(size_t i=0; i<n; ++i)
+				x[i] = c[i] + a*(c[i] - w[i]);
+			batch.push_back(x);
+		}
+	}
+	return batch;
+}
+
+void nelder_mead::tell(std::vector<double> const& values)
+{
+	if(values.size()!=batch.size())
+		return;
+	size_t const n = vertices.size()-1;
+	if(state==phase::simplex){
+		values_f = values;
+		order();
+		state = phase::candidates;
+		return;
+	}
+	if(state==phase::shrink){
+		for(size_t k=1; k<=n; ++k){
+			vertices[k] = batch[k-1];
+			values_f[k] = values[k-1];
+		}
+		order();
+		state = phase::candidates;
+		iteration_count++;
+		return;
+	}
+
+	double const fr = values[0], fe = values[1], foc = values[2], fic = values[3];
+	int accepted = -1;
+	if(fr < values_f[0])
+		accepted = fe < fr ? 1 : 0;
+	else if(fr < values_f[n-1])
+		accepted = 0;
+	else if(fr < values_f[n])
+		accepted = foc <= fr ? 2 : -1;
+	else
+		accepted = fic < values_f[n] ? 3 : -1;
+
+	if(accepted<0){
+		state = phase::shrink;
+		return;
+	}
+	vertices[n] = batch[accepted];
+	values_f[n] = values[accepted];
+	order();
+	iteration_count++;
+}
+
+bool nelder_mead::converged() const
+{
+	if(state==phase::simplex)
+		return false;
+	double size = 0;
+	for(size_t k=1; k<vertices.size(); ++k)
+		for(size_t i=0; i<vertices[k].size(); ++i)
+			size = std::max(size, std::abs(vertices[k][i] - vertices[0][i]));
+	return size < tolerance_x || values_f.back() - values_f.front() < tolerance_f;
+}
+
+void nelder_mead::save(std::ostream& out) const
+{
+	out.precision(17);
+	out << "nelder_mead " << vertices.size() << ' ' << tolerance_x << ' ' << tolerance_f << ' ' << static_cast<int>(state) << ' ' << iteration_count << '\n';
+	for(point const& v : vertices)
+		write_values(out, "vertex", v);
+	write_values(out, "values", values_f);
+}
+
+bool nelder_mead::load(std::istream& in)
+{
+	std::string key;
+	size_t count = 0;
+	int phase_index = 0;
+	if(!(in >> key >> count >> tolerance_x >> tolerance_f >> phase_index >> iteration_count) || key!="nelder_mead")
+		return false;
+	vertices.resize(count);
+	for(point& v : vertices)
+		if(!read_values(in, "vertex", v))
+			return false;
+	state = static_cast<phase>(phase_index);
+	batch.clear();
+	return read_values(in, "values", values_f) && values_f.size()==count;
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+Derivative-free minimization of f over R^n, by batches of points.
+ask() gives the points to evaluate and tell() their values (in the same order); the points of a batch
+are independent, so the caller evaluates them concurrently (e.g. on a thread_pool).
+ - cma_es: covariance matrix adaptation evolution strategy. Every generation samples a population from
+   a normal distribution, whose mean, step size and covariance follow the best samples. The samples of
+   generation g come from random_stream(seed, g): the search does not depend on the number of threads,
+   and resuming from a saved state gives the same generations as an uninterrupted run.
+ - nelder_mead: simplex method, used as a fallback when the covariance of CMA-ES breaks down and to
+   polish its result. Each iteration evaluates the reflection, the expansion and both contractions at
+   once, instead of one after the other.
+Both can be saved to and loaded from a text stream, for checkpoints of long searches.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace sim {
+
+using point = std::vector<double>;
+
+struct cma_es_options
+{
+	size_t population = 0;     // samples per generation (0: 4 + 3 ln n, more to use more threads)
+	uint64_t seed = 1;
+	double tolerance_x = 1e-6; // converged when the longest axis of the distribution is shorter
+	double tolerance_f = 1e-9; // ... or when the best values of the last generations are this close
+};
+
+class cma_es
+{
+public:
+	void initialize(point const& mean, double sigma, cma_es_options const& options = cma_es_options());
+
+	// Samples of the current generation
+	std::vector<point> const& ask();
+	// Values of the samples given by ask(): the distribution moves towards the lowest ones
+	void tell(std::vector<double> const& values);
+
+	bool converged() const;
+	bool degenerate() const { return broken; } // covariance no longer positive definite
+	size_t generation() const { return generation_count; }
+	size_t population() const { return lambda; }
+	point const& mean() const { return m; }
+	double sigma() const { return step; }
+
+	point const& best_point() const { return best_x; }
+	double best_value() const { return best_f; }
+
+	void save(std::ostream& out) const;
+	bool load(std::istream& in);
+
+private:
+	void set_strategy();   // constants of the strategy for n and lambda
+	void decompose();      // C = B diag(D^2) B^T
+
+	cma_es_options options;
+	size_t n = 0;
+	size_t lambda = 0;
+	size_t mu = 0;
+	std::vector<double> weights;
+	double mueff = 0, cc = 0, cs = 0, c1 = 0, cmu = 0, damps = 0, chi_n = 0;
+
+	point m;
+	double step = 0;
+	std::vector<double> C;     // n x n, row major
+	std::vector<double> B;     // eigenvectors in columns
+	std::vector<double> D;     // square roots of the eigenvalues
+	point pc, ps;              // evolution paths
+	size_t generation_count = 0;
+	bool broken = false;
+
+	std::vector<point> samples;
+	std::vector<point> steps;  // (sample - mean)/sigma
+	bool sampled = false;
+
+	std::vector<double> history; // best value of the last generations
+	point best_x;
+	double best_f = 0;
+	bool has_best = false;
+};
+
+class nelder_mead
+{
+public:
+	// Initial simplex: x0 and x0 + step along each axis
+	void initialize(point const& x0, double step, double tolerance_x = 1e-7, double tolerance_f = 1e-10);
+
+	std::vector<point> const& ask();
+	void tell(std::vector<double> const& values);
+
+	bool converged() const;
+	size_t iteration() const { return iteration_count; }
+
+	point const& best_point() const { return vertices[0]; }
+	double best_value() const { return values_f[0]; }
+
+	void save(std::ostream& out) const;
+	bool load(std::istream& in);
+
+private:
+	enum class phase { simplex, candidates, shrink };
+
+	void order();  // vertices sorted by value
+
+	double tolerance_x = 0, tolerance_f = 0;
+	std::vector<point> vertices;   // n+1
+	std::vector<double> values_f;
+	phase state = phase::simplex;
+	std::vector<point> batch;
+	size_t iteration_count = 0;
+};
+
+}
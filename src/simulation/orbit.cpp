@@ -0,0 +1,124 @@
+#include "simulation/orbit.hpp"
+
+#include <cmath>
+
+namespace sim {
+
+static double const two_pi = 6.283185307179586;
+
+double wrap_angle(double angle)
+{
+	double const wrapped = std::fmod(angle, two_pi);
+	return wrapped<0 ? wrapped+two_pi : wrapped;
+}
+
+orbit_rates orbit_secular_rates(orbit_elements const& elements, planet_model const& planet, bool j2)
+{
+	double const a = elements.semi_major_axis;
+	double const e = elements.eccentricity;
+	double const n = std::sqrt(planet.mu/(a*a*a));
+
+	orbit_rates rates;
+	rates.mean_anomaly = n;
+	if(j2){
+		double const p = a*(1-e*e);
+		double const k = planet.j2*(planet.radius/p)*(planet.radius/p);
+		double const c = std::cos(elements.inclination);
+		rates.raan = -1.5*n*k*c;
+		rates.argument_of_perigee = 0.75*n*k*(5*c*c-1);
+		rates.mean_anomaly = n*(1 + 0.75*k*std::sqrt(1-e*e)*(3*c*c-1));
+	}
+	return rates;
+}
+
+double solve_kepler(double mean_anomaly, double eccentricity)
+{
+	// M in [-pi,pi]: E has the same sign and |E| <= pi
+	double const M = wrap_angle(mean_anomaly + 3.141592653589793) - 3.141592653589793;
+	double E = eccentricity<0.8 ? M : (M<0 ? -3.141592653589793 : 3.141592653589793);
+	for(int k=0; k<50; ++k){
+		double const delta = (E - eccentricity*std::sin(E) - M)/(1 - eccentricity*std::cos(E));
+		E -= delta;
+		if(std::abs(delta)<1e-14)
+			break;
+	}
+	return E;
+}
+
+orbit_state orbit_propagate(orbit_elements const& elements, planet_model const& planet, double t, bool j2)
+{
+	orbit_rates const rates = orbit_secular_rates(elements, planet, j2);
+	double const a = elements.semi_major_axis;
+	double const e = elements.eccentricity;
+	double const M = elements.mean_anomaly + rates.mean_anomaly*t;
+	double const raan = elements.raan + rates.raan*t;
+	double const w = elements.argument_of_perigee + rates.argument_of_perigee*t;
+
+	// position and velocity in the orbital plane (x towards the perigee)
+	double const E = solve_kepler(M, e);
+	double const cE = std::cos(E), sE = std::sin(E);
+	double const b = a*std::sqrt(1-e*e);
+	double const E_rate = rates.mean_anomaly/(1 - e*cE);
+	double const x = a*(cE - e), y = b*sE;
+	double const vx = -a*sE*E_rate, vy = b*cE*E_rate;
+
+	// rotation to the inertial frame: P towards the perigee, Q 90 degrees ahead in the plane
+	double const cW = std::cos(raan), sW = std::sin(raan);
+	double const cw = std::cos(w), sw = std::sin(w);
+	double const ci = std::cos(elements.inclination), si = std::sin(elements.inclination);
+	double const P[3] = {cW*cw - sW*sw*ci, sW*cw + cW*sw*ci, sw*si};
+	double const Q[3] = {-cW*sw - sW*cw*ci, -sW*sw + cW*cw*ci, cw*si};
+
+	orbit_state state;
+	for(int k=0; k<3; ++k){
+		state.position[k] = x*P[k] + y*Q[k];
+		state.velocity[k] = vx*P[k] + vy*Q[k];
+	}
+	return state;
+}
+
+orbit_elements orbit_from_state(orbit_state const& state, double mu)
+{
+	double const* r = state.position;
+	double const* v = state.velocity;
+	double const r_norm = std::sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+	double const v2 = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+	double const rv = r[0]*v[0] + r[1]*v[1] + r[2]*v[2];
+
+	double const h[3] = {r[1]*v[2]-r[2]*v[1], r[2]*v[0]-r[0]*v[2], r[0]*v[1]-r[1]*v[0]};
+	double const h_norm = std::sqrt(h[0]*h[0] + h[1]*h[1] + h[2]*h[2]);
+	double const node[3] = {-h[1], h[0], 0}; // z x h
+	double const node_norm = std::sqrt(node[0]*node[0] + node[1]*node[1]);
+	double ev[3];
+	for(int k=0; k<3; ++k)
+		ev[k] = ((v2 - mu/r_norm)*r[k] - rv*v[k])/mu;
+	double const e = std::sqrt(ev[0]*ev[0] + ev[1]*ev[1] + ev[2]*ev[2]);
+
+	orbit_elements elements;
+	elements.semi_major_axis = 1/(2/r_norm - v2/mu);
+	elements.eccentricity = e;
+	elements.inclination = std::acos(h[2]/h_norm);
+
+	// equatorial orbits have no node and circular orbits no perigee: the angle is then
+	// measured from the x axis, or from the node, and carried by the mean anomaly
+	bool const equatorial = node_norm < 1e-12*h_norm;
+	bool const circular = e < 1e-12;
+	double const node_dir[3] = {equatorial ? 1 : node[0]/node_norm, equatorial ? 0 : node[1]/node_norm, 0};
+	elements.raan = equatorial ? 0 : wrap_angle(std::atan2(node[1], node[0]));
+
+	// angles in the orbital plane from node_dir, positive around h
+	auto const plane_angle = [&](double const* u){
+		double const cross[3] = {node_dir[1]*u[2]-node_dir[2]*u[1], node_dir[2]*u[0]-node_dir[0]*u[2], node_dir[0]*u[1]-node_dir[1]*u[0]};
+		double const sine = (cross[0]*h[0] + cross[1]*h[1] + cross[2]*h[2])/h_norm;
+		double const cosine = node_dir[0]*u[0] + node_dir[1]*u[1] + node_dir[2]*u[2];
+		return std::atan2(sine, cosine);
+	};
+	double const latitude_argument = plane_angle(r);
+	elements.argument_of_perigee = circular ? 0 : wrap_angle(plane_angle(ev));
+	double const true_anomaly = latitude_argument - elements.argument_of_perigee;
+	double const E = std::atan2(std::sqrt(1-e*e)*std::sin(true_anomaly), e + std::cos(true_anomaly));
+	elements.mean_anomaly = wrap_angle(E - e*std::sin(E));
+	return elements;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/**
+Keplerian orbits with the secular effect of the oblateness of the planet (J2).
+The elements are propagated analytically: the mean anomaly grows linearly and the position
+follows from Kepler's equation E - e*sin(E) = M. With J2, the ascending node, the argument of
+perigee and the mean anomaly drift at constant (secular) rates; the periodic terms are ignored,
+which is the usual model for the visualization and the coverage of constellations.
+
+Units: km, s, radians. Inertial frame centered on the planet, z along the polar axis.
+This is the double precision reference; constellation.hpp propagates many orbits in float.
+*/
+
+namespace sim {
+
+struct planet_model
+{
+	double mu = 398600.4418;    // gravitational parameter (km^3/s^2)
+	double radius = 6378.137;   // equatorial radius (km)
+	double j2 = 1.08262668e-3;
+};
+
+struct orbit_elements
+{
+	double semi_major_axis = 7000;  // km
+	double eccentricity = 0;        // elliptic orbits only: [0,1)
+	double inclination = 0;
+	double raan = 0;                // right ascension of the ascending node
+	double argument_of_perigee = 0;
+	double mean_anomaly = 0;        // at t=0
+};
+
+// Drift of the angles (rad/s): mean motion, with the J2 correction when enabled
+struct orbit_rates
+{
+	double mean_anomaly = 0;
+	double raan = 0;
+	double argument_of_perigee = 0;
+};
+
+struct orbit_state
+{
+	double position[3];
+	double velocity[3];
+};
+
+orbit_rates orbit_secular_rates(orbit_elements const& elements, planet_model const& planet, bool j2);
+
+// Eccentric anomaly E of a mean anomaly M (Newton iterations to full precision)
+double solve_kepler(double mean_anomaly, double eccentricity);
+
+// Position and velocity at time t
+orbit_state orbit_propagate(orbit_elements const& elements, planet_model const& planet, double t, bool j2 = true);
+
+// Elements (at t=0) of the orbit going through a state, e.g. at the orbit insertion
+orbit_elements orbit_from_state(orbit_state const& state, double mu);
+
+// Angle in [0, 2pi)
+double wrap_angle(double angle);
+
+}
@@ -0,0 +1,203 @@
+#include "simulation/particles.hpp"
+#include "simulation/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace sim {
+
+// particles per task of the thread pool
+static size_t const particle_grain = 16384;
+
+void particle_pool::reserve(size_t capacity_arg)
+{
+	max_count = capacity_arg;
+	count = 0;
+	for(std::vector<float>* column : {&px,&py,&pz,&vx,&vy,&vz,&age,&lifetime})
+		column->assign(max_count, 0.0f);
+}
+
+// Uniform in [-1,1)
+static float signed_uniform(random_stream& random)
+{
+	return static_cast<float>(2*random.uniform() - 1);
+}
+
+size_t particle_pool::emit(particle_emitter const& emitter, size_t n, random_stream& random)
+{
+	size_t const added = std::min(n, max_count-count);
+	dropped_count += n-added;
+
+	// basis around the jet direction
+	vec3 const d = emitter.direction/norm(emitter.direction);
+	vec3 const helper = std::abs(d.z)<0.9f ? vec3{0,0,1} : vec3{1,0,0};
+	vec3 u = cross(d, helper);
+	u = u/norm(u);
+	vec3 const w = cross(d, u);
+
+	for(size_t k=count; k<count+added; ++k){
+		float const theta = emitter.cone*std::sqrt(static_cast<float>(random.uniform()));
+		float const phi = static_cast<float>(6.283185307179586*random.uniform());
+		vec3 const direction = std::cos(theta)*d + std::sin(theta)*(std::cos(phi)*u + std::sin(phi)*w);
+		float const speed = emitter.speed*(1 + emitter.speed_spread*signed_uniform(random));
+		vec3 const v = emitter.velocity + speed*direction;
+		px[k] = emitter.position.x + emitter.position_spread*signed_uniform(random);
+		py[k] = emitter.position.y + emitter.position_spread*signed_uniform(random);
+		pz[k] = emitter.position.z + emitter.position_spread*signed_uniform(random);
+		vx[k] = v.x;
+		vy[k] = v.y;
+		vz[k] = v.z;
+		age[k] = 0;
+		lifetime[k] = emitter.lifetime*(1 + emitter.lifetime_spread*signed_uniform(random));
+	}
+	count += added;
+	return added;
+}
+
+size_t particle_pool::emit_continuous(particle_emitter& emitter, float dt, random_stream& random)
+{
+	float const wanted = emitter.rate*dt + emitter.carry;
+	size_t const n = static_cast<size_t>(std::max(wanted, 0.0f));
+	emitter.carry = wanted - static_cast<float>(n);
+	return emit(emitter, n, random);
+}
+
+// Semi-implicit Euler step and bounce on the ground. The survivors are compacted at the start
+// of the range in the same pass, their number being kept for update()
+void particle_pool::update_range(float dt, particle_parameters const& parameters, size_t begin, size_t end)
+{
+	float const damping = std::max(0.0f, 1 - parameters.drag*dt);
+	float const gx = parameters.gravity_scale*parameters.g.x*dt;
+	float const gy = parameters.gravity_scale*parameters.g.y*dt;
+	float const gz = parameters.gravity_scale*parameters.g.z*dt;
+	float const ground = parameters.ground_z;
+
+	size_t alive = begin;
+	for(size_t k=begin; k<end; ++k){
+		float const a = age[k] + dt;
+		float const life = lifetime[k];
+		float const x = (vx[k]-gx)*damping;
+		float const y = (vy[k]-gy)*damping;
+		float const z = (vz[k]-gz)*damping;
+		float const p = pz[k] + z*dt;
+		bool const bounce = p<ground && z<0;
+		// written unconditionally: a dead particle is overwritten by the next survivor
+		px[alive] = px[k] + x*dt;
+		py[alive] = py[k] + y*dt;
+		pz[alive] = bounce ? ground : p;
+		vx[alive] = bounce ? x*parameters.friction : x;
+		vy[alive] = bounce ? y*parameters.friction : y;
+		vz[alive] = bounce ? -z*parameters.restitution : z;
+		age[alive] = a;
+		lifetime[alive] = life;
+		alive += a<life ? 1 : 0;
+	}
+	survivors[begin/particle_grain] = alive-begin;
+}
+
+void particle_pool::move(size_t from, size_t to, size_t n)
+{
+	for(std::vector<float>* column : {&px,&py,&pz,&vx,&vy,&vz,&age,&lifetime})
+		std::memmove(column->data()+to, column->data()+from, n*sizeof(float));
+}
+
+void particle_pool::update(float dt, particle_parameters const& parameters, thread_pool* workers)
+{
+	if(count==0)
+		return;
+	size_t const chunks = (count+particle_grain-1)/particle_grain;
+	survivors.assign(chunks, 0);
+	if(workers!=nullptr && chunks>1)
+		workers->parallel_for(count, particle_grain, [&](size_t begin, size_t end){ update_range(dt, parameters, begin, end); });
+	else{
+		for(size_t c=0; c<chunks; ++c)
+			update_range(dt, parameters, c*particle_grain, std::min(count, (c+1)*particle_grain));
+	}
+
+	// close the gaps between the compacted chunks
+	size_t alive = survivors[0];
+	for(size_t c=1; c<chunks; ++c){
+		if(survivors[c]>0 && alive!=c*particle_grain)
+			move(c*particle_grain, alive, survivors[c]);
+		alive += survivors[c];
+	}
+	count = alive;
+}
+
+// ****************************************** //
+// Drawing order
+// ****************************************** //
+
+void particle_draw_list::build(particle_pool const& particles, vec3 const& eye, vec3 const& forward, thread_pool* workers)
+{
+	count = particles.size();
+	size_t const chunks = (count+particle_grain-1)/particle_grain;
+	size_t const buckets = size_t(1) << particle_depth_bits;
+	depth.resize(count);
+	bucket.resize(count);
+	chunk_min.assign(chunks, 0.0f);
+	chunk_max.assign(chunks, 0.0f);
+	histograms.assign(chunks*buckets, 0);
+	vertex_data.resize(4*count);
+	if(count==0)
+		return;
+	auto const run = [&](std::function<void(size_t,size_t)> const& body){
+		if(workers!=nullptr && chunks>1)
+			workers->parallel_for(count, particle_grain, body);
+		else{
+			for(size_t c=0; c<chunks; ++c)
+				body(c*particle_grain, std::min(count, (c+1)*particle_grain));
+		}
+	};
+
+	// depths and their range
+	run([&](size_t begin, size_t end){
+		float low = 0, high = 0;
+		for(size_t k=begin; k<end; ++k){
+			float const d = (particles.px[k]-eye.x)*forward.x + (particles.py[k]-eye.y)*forward.y + (particles.pz[k]-eye.z)*forward.z;
+			depth[k] = d;
+			low = k==begin ? d : std::min(low, d);
+			high = k==begin ? d : std::max(high, d);
+		}
+		chunk_min[begin/particle_grain] = low;
+		chunk_max[begin/particle_grain] = high;
+	});
+	float const low = *std::min_element(chunk_min.begin(), chunk_min.end());
+	float const high = *std::max_element(chunk_max.begin(), chunk_max.end());
+	float const scale = high>low ? (static_cast<float>(buckets)-0.5f)/(high-low) : 0.0f;
+
+	// bucket 0 for the farthest particles
+	run([&](size_t begin, size_t end){
+		uint32_t* h = histograms.data() + (begin/particle_grain)*buckets;
+		for(size_t k=begin; k<end; ++k){
+			uint16_t const b = static_cast<uint16_t>(std::min(static_cast<size_t>((high-depth[k])*scale), buckets-1));
+			bucket[k] = b;
+			h[b]++;
+		}
+	});
+
+	// first place of each (chunk, bucket): by bucket, then by chunk, so the order is stable
+	uint32_t sum = 0;
+	for(size_t b=0; b<buckets; ++b){
+		for(size_t c=0; c<chunks; ++c){
+			uint32_t const n = histograms[c*buckets+b];
+			histograms[c*buckets+b] = sum;
+			sum += n;
+		}
+	}
+
+	run([&](size_t begin, size_t end){
+		uint32_t* offsets = histograms.data() + (begin/particle_grain)*buckets;
+		for(size_t k=begin; k<end; ++k){
+			float* v = vertex_data.data() + 4*size_t(offsets[bucket[k]]++);
+			v[0] = particles.px[k];
+			v[1] = particles.py[k];
+			v[2] = particles.pz[k];
+			v[3] = std::min(particles.age[k]/particles.lifetime[k], 1.0f);
+		}
+	});
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+/**
+Particles of the engine exhaust and of the separation debris.
+A particle_pool stores the particles as structure of arrays in columns allocated once for a fixed
+capacity: emitting never allocates, and particles beyond the capacity are dropped (and counted).
+update() advances all the particles and removes the dead ones; the work is split in chunks over
+the threads of a thread_pool, each chunk compacting its survivors in place, then the chunks are
+moved together.
+For the drawing, a particle_draw_list lists the vertices of the particles from back to front.
+*/
+
+#include "simulation/random.hpp"
+#include "simulation/sim_math.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sim {
+
+class thread_pool;
+
+// Emission of new particles, e.g. at the nozzle of the active stage
+struct particle_emitter
+{
+	vec3 position;
+	vec3 velocity;                 // of the emitter, given to the particles
+	vec3 direction = {0,0,-1};     // of the jet
+	float speed = 20.0f;           // along the direction, relative to the emitter
+	float speed_spread = 0.3f;     // relative
+	float cone = 0.2f;             // half angle (rad)
+	float position_spread = 0.2f;  // around the position
+	float lifetime = 2.0f;         // s
+	float lifetime_spread = 0.3f;  // relative
+	float rate = 0;                // particles per second, for emit_continuous()
+	float carry = 0;               // fraction of particle not emitted yet by emit_continuous()
+};
+
+struct particle_parameters
+{
+	vec3 g = {0,0,9.81f};      // subtracted from the velocities, as in mission_parameters
+	float gravity_scale = 1;   // e.g. light for the exhaust gases
+	float drag = 0.5f;         // damping of the velocity (1/s)
+	float ground_z = 0;        // bounce on the ground plane
+	float restitution = 0.3f;
+	float friction = 0.6f;     // tangent velocity kept at a bounce
+};
+
+class particle_pool
+{
+public:
+	explicit particle_pool(size_t capacity_arg = 0) { reserve(capacity_arg); }
+
+	// Allocate the columns (removes the particles)
+	void reserve(size_t capacity_arg);
+	size_t capacity() const { return max_count; }
+	size_t size() const { return count; }
+	void clear() { count = 0; }
+
+	// Add up to n particles: returns the number added, the others are dropped
+	size_t emit(particle_emitter const& emitter, size_t n, random_stream& random);
+	// rate*dt particles, the fractions being carried over to the next call
+	size_t emit_continuous(particle_emitter& emitter, float dt, random_stream& random);
+
+	// Advance by dt and remove the particles older than their lifetime
+	void update(float dt, particle_parameters const& parameters, thread_pool* workers = nullptr);
+
+	// particles not emitted because the pool was full
+	uint64_t dropped() const { return dropped_count; }
+
+	// columns, valid on [0,size())
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> age, lifetime;
+
+private:
+	void update_range(float dt, particle_parameters const& parameters, size_t begin, size_t end);
+	void move(size_t from, size_t to, size_t n);
+
+	size_t max_count = 0;
+	size_t count = 0;
+	uint64_t dropped_count = 0;
+	std::vector<size_t> survivors; // per chunk of the update
+};
+
+// Vertices of the draw call: the particles from the farthest to the nearest along the view
+// direction, 4 floats each (position, and age relative to the lifetime in [0,1]).
+// Counting sort on the depth quantized to particle_depth_bits over the depth range of the
+// particles: every chunk of particles counts its depths, then scatters its vertices at their
+// place, in parallel and with the same result whatever the number of threads.
+int const particle_depth_bits = 12; // at most 16
+
+class particle_draw_list
+{
+public:
+	void build(particle_pool const& particles, vec3 const& eye, vec3 const& forward, thread_pool* workers = nullptr);
+	float const* vertices() const { return vertex_data.data(); }
+	size_t size() const { return count; }
+
+private:
+	size_t count = 0;
+	std::vector<float> depth;
+	std::vector<uint16_t> bucket;
+	std::vector<float> chunk_min, chunk_max;
+	std::vector<uint32_t> histograms;  // per chunk, then offsets
+	std::vector<float> vertex_data;
+};
+
+}
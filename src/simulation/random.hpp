@@ -0,0 +1,70 @@
+#pragma once
+
+/**
+Deterministic random streams.
+Each Monte Carlo run gets its own stream derived from (campaign seed, run index), so the
+samples do not depend on the number of threads nor on the order in which runs are executed.
+The normal distribution is computed here (Box-Muller) instead of std::normal_distribution,
+whose output differs between standard library implementations.
+*/
+
+#include <cmath>
+#include <cstdint>
+
+namespace sim {
+
+// SplitMix64 finalizer, also used to derive independent seeds
+inline uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// xoshiro256** generator
+struct random_stream
+{
+	uint64_t s[4];
+
+	random_stream(uint64_t seed, uint64_t stream_index)
+	{
+		uint64_t x = splitmix64(seed) ^ splitmix64(stream_index + 0x632BE59BD9B4E019ull);
+		for(int k=0; k<4; ++k){
+			x = splitmix64(x);
+			s[k] = x;
+		}
+	}
+
+	uint64_t next()
+	{
+		uint64_t const result = rotl(s[1]*5, 7)*9;
+		uint64_t const t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// uniform in [0,1)
+	double uniform()
+	{
+		return static_cast<double>(next() >> 11) * (1.0/9007199254740992.0);
+	}
+
+	// normal distribution with the given mean and standard deviation
+	double normal(double mean, double sigma)
+	{
+		double const u1 = 1.0 - uniform(); // in (0,1]
+		double const u2 = uniform();
+		return mean + sigma*std::sqrt(-2.0*std::log(u1))*std::cos(2.0*3.14159265358979323846*u2);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64-k)); }
+};
+
+}
@@ -0,0 +1,288 @@
+#include "simulation/shared_telemetry.hpp"
+
+#include "simulation/mission.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sim {
+
+static_assert(shared_body_count==mission_body_count, "a shared_mission_state holds the rows of mission_body");
+// the same atomics are used by processes mapping the segment at different addresses
+static_assert(ATOMIC_LLONG_LOCK_FREE==2, "shared telemetry needs lock-free 64-bit atomics");
+
+struct shared_event_slot
+{
+	std::atomic<uint64_t> sequence;  // 2n+1 while event n is written, 2n+2 once it is
+	uint64_t reserved;
+	shared_event event;
+};
+
+struct shared_segment
+{
+	shared_telemetry_header header;
+	alignas(64) std::atomic<uint64_t> state_sequence; // odd while the state is written, 0: never published
+	shared_mission_state state;
+	alignas(64) std::atomic<uint64_t> event_head;     // events published
+	alignas(64) shared_event_slot slots[shared_event_capacity];
+};
+
+int64_t shared_telemetry_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ****************************************** //
+// Publisher
+// ****************************************** //
+
+shared_telemetry_publisher::~shared_telemetry_publisher()
+{
+	close();
+}
+
+bool shared_telemetry_publisher::open(std::string const& name)
+{
+	close();
+#ifdef _WIN32
+	(void)name;
+	return false;
+#else
+	shm_unlink(name.c_str()); // left by a run that did not close it
+	int const fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd<0)
+		return false;
+	void* mapping = MAP_FAILED;
+	if(ftruncate(fd, sizeof(shared_segment))==0)
+		mapping = mmap(nullptr, sizeof(shared_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(mapping==MAP_FAILED){
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// zero-filled by ftruncate: no state, no events
+	segment = new (mapping) shared_segment;
+	shared_telemetry_header& header = segment->header;
+	header.version = shared_telemetry_version;
+	header.state_size = sizeof(shared_mission_state);
+	header.event_size = sizeof(shared_event);
+	header.event_capacity = shared_event_capacity;
+	header.body_count = shared_body_count;
+	header.segment_size = sizeof(shared_segment);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header.magic, "RKSM", 4); // the readers check it first
+
+	segment_name = name;
+	state_count = 0;
+	event_count = 0;
+	has_previous = false;
+	return true;
+#endif
+}
+
+void shared_telemetry_publisher::close()
+{
+	if(segment==nullptr)
+		return;
+#ifndef _WIN32
+	munmap(segment, sizeof(shared_segment));
+	shm_unlink(segment_name.c_str());
+#endif
+	segment = nullptr;
+}
+
+void shared_telemetry_publisher::event(uint64_t step, double t, uint32_t body, telemetry_event_type type)
+{
+	if(segment==nullptr)
+		return;
+	shared_event e;
+	e.step = step;
+	e.t = t;
+	e.publish_ns = shared_telemetry_now();
+	e.body = body;
+	e.type = type;
+
+	uint64_t const n = segment->event_head.load(std::memory_order_relaxed);
+	shared_event_slot& slot = segment->slots[n % shared_event_capacity];
+	slot.sequence.store(2*n+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(&slot.event, &e, sizeof(e));
+	slot.sequence.store(2*n+2, std::memory_order_release);
+	segment->event_head.store(n+1, std::memory_order_release);
+	event_count++;
+}
+
+void shared_telemetry_publisher::publish(mission_state const& state, uint64_t tick)
+{
+	if(segment==nullptr)
+		return;
+	body_table const& table = state.bodies;
+
+	// events since the previous state, as the telemetry files record them (see telemetry_writer::record)
+	if(has_previous && static_cast<double>(state.t) >= previous_t){
+		for(uint32_t b=0; b<shared_body_count; ++b){
+			int32_t const phase = table.phase[b];
+			if(phase==previous_phase[b])
+				continue;
+			if(phase==body_ballistic)
+				event(state.step_count, state.t, b, telemetry_separation);
+			else if(phase==body_landed)
+				event(state.step_count, state.t, b, telemetry_ground_contact);
+		}
+		if(state.radius_set && !previous_in_orbit)
+			event(state.step_count, state.t, body_satellite, telemetry_orbit_start);
+	}
+	has_previous = true;
+	previous_t = state.t;
+	for(uint32_t b=0; b<shared_body_count; ++b)
+		previous_phase[b] = table.phase[b];
+	previous_in_orbit = state.radius_set;
+
+	shared_mission_state s;
+	s.tick = tick;
+	s.step = state.step_count;
+	s.t = state.t;
+	s.rocket_p[0] = state.rocket_p.x; s.rocket_p[1] = state.rocket_p.y; s.rocket_p[2] = state.rocket_p.z;
+	s.rocket_v[0] = state.rocket_v.x; s.rocket_v[1] = state.rocket_v.y; s.rocket_v[2] = state.rocket_v.z;
+	s.in_orbit = state.radius_set ? 1 : 0;
+	s.reserved = 0;
+	for(uint32_t b=0; b<shared_body_count; ++b){
+		shared_body& body = s.bodies[b];
+		body.p[0] = table.px[b]; body.p[1] = table.py[b]; body.p[2] = table.pz[b];
+		body.v[0] = table.vx[b]; body.v[1] = table.vy[b]; body.v[2] = table.vz[b];
+		body.phase = table.phase[b];
+		body.separated = table.separated(b) ? 1 : 0;
+	}
+	s.publish_ns = shared_telemetry_now();
+
+	// seqlock: odd during the copy
+	uint64_t const sequence = segment->state_sequence.load(std::memory_order_relaxed);
+	segment->state_sequence.store(sequence+1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(&segment->state, &s, sizeof(s));
+	segment->state_sequence.store(sequence+2, std::memory_order_release);
+	state_count++;
+}
+
+// ****************************************** //
+// Reader
+// ****************************************** //
+
+shared_telemetry_reader::~shared_telemetry_reader()
+{
+	detach();
+}
+
+bool shared_telemetry_reader::attach(std::string const& name)
+{
+	detach();
+#ifdef _WIN32
+	(void)name;
+	return false;
+#else
+	int const fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(fd<0)
+		return false;
+	struct stat info;
+	void* mapping = MAP_FAILED;
+	if(fstat(fd, &info)==0 && static_cast<size_t>(info.st_size)>=sizeof(shared_telemetry_header))
+		mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(mapping==MAP_FAILED)
+		return false;
+
+	// same layout as this build, or nothing
+	mapped_size = static_cast<size_t>(info.st_size);
+	shared_telemetry_header const& header = *static_cast<shared_telemetry_header const*>(mapping);
+	bool const valid = std::memcmp(header.magic, "RKSM", 4)==0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(!valid || header.version!=shared_telemetry_version || header.state_size!=sizeof(shared_mission_state) || header.event_size!=sizeof(shared_event)
+		|| header.event_capacity!=shared_event_capacity || header.body_count!=shared_body_count
+		|| header.segment_size!=sizeof(shared_segment) || mapped_size<sizeof(shared_segment)){
+		munmap(mapping, mapped_size);
+		return false;
+	}
+	segment = static_cast<shared_segment const*>(mapping);
+
+	// the events still in the ring
+	uint64_t const head = segment->event_head.load(std::memory_order_acquire);
+	cursor = head>shared_event_capacity ? head-shared_event_capacity : 0;
+	retry_count = 0;
+	lost_count = 0;
+	return true;
+#endif
+}
+
+void shared_telemetry_reader::detach()
+{
+	if(segment==nullptr)
+		return;
+#ifndef _WIN32
+	munmap(const_cast<shared_segment*>(segment), mapped_size);
+#endif
+	segment = nullptr;
+}
+
+uint64_t shared_telemetry_reader::sequence() const
+{
+	return segment!=nullptr ? segment->state_sequence.load(std::memory_order_acquire) : 0;
+}
+
+bool shared_telemetry_reader::read_state(shared_mission_state& state)
+{
+	if(segment==nullptr)
+		return false;
+	// a publisher stopped in the middle of a copy would keep the sequence odd: give up after a while
+	for(int attempt=0; attempt<(1 << 16); ++attempt){
+		uint64_t const before = segment->state_sequence.load(std::memory_order_acquire);
+		if(before==0)
+			return false;
+		if((before & 1)==0){
+			std::memcpy(&state, &segment->state, sizeof(state));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(segment->state_sequence.load(std::memory_order_relaxed)==before)
+				return true;
+		}
+		retry_count++;
+	}
+	return false;
+}
+
+bool shared_telemetry_reader::next_event(shared_event& event)
+{
+	if(segment==nullptr)
+		return false;
+	uint64_t const head = segment->event_head.load(std::memory_order_acquire);
+	while(cursor<head){
+		if(head-cursor > shared_event_capacity){
+			lost_count += head - shared_event_capacity - cursor;
+			cursor = head - shared_event_capacity;
+		}
+		shared_event_slot const& slot = segment->slots[cursor % shared_event_capacity];
+		uint64_t const expected = 2*cursor+2;
+		if(slot.sequence.load(std::memory_order_acquire)==expected){
+			std::memcpy(&event, &slot.event, sizeof(event));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(slot.sequence.load(std::memory_order_relaxed)==expected){
+				cursor++;
+				return true;
+			}
+		}
+		// overwritten by a newer event meanwhile
+		lost_count++;
+		cursor++;
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+/**
+Live telemetry in POSIX shared memory, for the other processes of the host (dashboards, analysis).
+Segment layout (version 1, fixed sizes, native byte order), checked by the readers from the header:
+ - shared_telemetry_header: magic "RKSM", version, sizes of the blocks
+ - state block: latest shared_mission_state, under a seqlock. The publisher makes the sequence odd,
+   writes the state and makes it even again; a reader copies the state between two loads of the
+   sequence and retries if they differ or if the first one is odd
+ - event ring: shared_event_capacity slots, one producer and any number of readers. The head
+   counts the events published, each slot carries the sequence of the event it holds (odd while
+   written); every reader keeps its own position, and skips (and counts) the events overwritten
+   before it read them
+The publisher never waits for the readers. The readers take no lock and make no system call per
+sample, they only load from their mapping: any number of them can come and go during the flight.
+The times are those of the steady clock (CLOCK_MONOTONIC), the same for all the processes.
+Not available on Windows (open and attach fail).
+*/
+
+#include "simulation/telemetry.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace sim {
+
+struct mission_state;
+
+uint32_t const shared_telemetry_version = 1;
+uint32_t const shared_event_capacity = 256;
+uint32_t const shared_body_count = 4; // rows of mission_body
+char const* const shared_telemetry_default_name = "/rocket_telemetry";
+
+struct shared_body
+{
+	float p[3];
+	float v[3];
+	int32_t phase;       // body_phase
+	uint32_t separated;  // 1 once it left the rocket
+};
+
+struct shared_mission_state
+{
+	uint64_t tick;       // of the publisher (e.g. simulation thread), +1 per state
+	uint64_t step;       // of the mission
+	double t;            // mission time
+	int64_t publish_ns;  // steady clock
+	float rocket_p[3];
+	float rocket_v[3];
+	uint32_t in_orbit;
+	uint32_t reserved;
+	shared_body bodies[shared_body_count]; // first stage, second stage, fairing, satellite
+};
+
+struct shared_event
+{
+	uint64_t step;
+	double t;
+	int64_t publish_ns;
+	uint32_t body;
+	uint32_t type;       // telemetry_event_type
+};
+
+struct shared_telemetry_header
+{
+	char magic[4];       // "RKSM", written last by the publisher
+	uint32_t version;
+	uint32_t state_size;
+	uint32_t event_size;
+	uint32_t event_capacity;
+	uint32_t body_count;
+	uint64_t segment_size;
+};
+
+static_assert(sizeof(shared_body)==32, "shared_body must not be padded");
+static_assert(sizeof(shared_mission_state)==32+24+8+4*sizeof(shared_body), "shared_mission_state must not be padded");
+static_assert(sizeof(shared_event)==32, "shared_event must not be padded");
+static_assert(sizeof(shared_telemetry_header)==32, "shared_telemetry_header must not be padded");
+
+// Steady clock in ns, as publish_ns
+int64_t shared_telemetry_now();
+
+struct shared_segment; // layout of the mapping (shared_telemetry.cpp)
+
+// ****************************************** //
+// Publisher
+// ****************************************** //
+
+class shared_telemetry_publisher
+{
+public:
+	shared_telemetry_publisher() = default;
+	~shared_telemetry_publisher();
+
+	shared_telemetry_publisher(shared_telemetry_publisher const&) = delete;
+	shared_telemetry_publisher& operator=(shared_telemetry_publisher const&) = delete;
+
+	// Create the segment (replacing one left by a previous run), name as for shm_open: "/name"
+	bool open(std::string const& name = shared_telemetry_default_name);
+	// Unmap and unlink: the readers keep their mapping, and see no more updates
+	void close();
+	bool is_open() const { return segment!=nullptr; }
+	std::string const& name() const { return segment_name; }
+
+	// Latest state, and the events since the previous one (separations, ground contacts, orbit
+	// start). Going back in time (seek, restart) publishes no events
+	void publish(mission_state const& state, uint64_t tick);
+	void event(uint64_t step, double t, uint32_t body, telemetry_event_type type);
+
+	uint64_t states() const { return state_count; }
+	uint64_t events() const { return event_count; }
+
+private:
+	shared_segment* segment = nullptr;
+	std::string segment_name;
+	uint64_t state_count = 0;
+	uint64_t event_count = 0;
+
+	// previous state, to find the events
+	bool has_previous = false;
+	double previous_t = 0;
+	int32_t previous_phase[shared_body_count] = {};
+	bool previous_in_orbit = false;
+};
+
+// ****************************************** //
+// Reader
+// ****************************************** //
+
+class shared_telemetry_reader
+{
+public:
+	shared_telemetry_reader() = default;
+	~shared_telemetry_reader();
+
+	shared_telemetry_reader(shared_telemetry_reader const&) = delete;
+	shared_telemetry_reader& operator=(shared_telemetry_reader const&) = delete;
+
+	// Map the segment read-only: false if there is none, or with another layout
+	bool attach(std::string const& name = shared_telemetry_default_name);
+	void detach();
+	bool attached() const { return segment!=nullptr; }
+
+	// Version of the state, changed by each publication (0: nothing published yet)
+	uint64_t sequence() const;
+	// Copy of the latest state, false if nothing was published yet. Never waits for the publisher
+	bool read_state(shared_mission_state& state);
+
+	// Next event not read yet (from the oldest one still in the ring at attach), false if none
+	bool next_event(shared_event& event);
+
+	uint64_t retries() const { return retry_count; }      // state reads started again
+	uint64_t lost_events() const { return lost_count; }   // overwritten before they were read
+
+private:
+	shared_segment const* segment = nullptr;
+	size_t mapped_size = 0;
+	uint64_t cursor = 0;
+	uint64_t retry_count = 0;
+	uint64_t lost_count = 0;
+};
+
+}
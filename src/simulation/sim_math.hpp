@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+Minimal vector type used by the headless simulation core.
+The simulation must not depend on VCL/OpenGL, so it carries its own tiny vec3.
+main.cpp converts to vcl::vec3 when it needs to draw.
+*/
+
+#include <cmath>
+
+namespace sim {
+
+struct vec3
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+
+	vec3() = default;
+	constexpr vec3(float x_arg, float y_arg, float z_arg) : x(x_arg), y(y_arg), z(z_arg) {}
+};
+
+inline vec3 operator+(vec3 const& a, vec3 const& b) { return {a.x+b.x, a.y+b.y, a.z+b.z}; }
+inline vec3 operator-(vec3 const& a, vec3 const& b) { return {a.x-b.x, a.y-b.y, a.z-b.z}; }
+inline vec3 operator-(vec3 const& a) { return {-a.x, -a.y, -a.z}; }
+inline vec3 operator*(float s, vec3 const& a) { return {s*a.x, s*a.y, s*a.z}; }
+inline vec3 operator*(vec3 const& a, float s) { return {a.x*s, a.y*s, a.z*s}; }
+inline vec3 operator/(vec3 const& a, float s) { return {a.x/s, a.y/s, a.z/s}; }
+inline vec3& operator+=(vec3& a, vec3 const& b) { a.x+=b.x; a.y+=b.y; a.z+=b.z; return a; }
+inline vec3& operator-=(vec3& a, vec3 const& b) { a.x-=b.x; a.y-=b.y; a.z-=b.z; return a; }
+inline vec3& operator*=(vec3& a, float s) { a.x*=s; a.y*=s; a.z*=s; return a; }
+
+inline float dot(vec3 const& a, vec3 const& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+inline vec3 cross(vec3 const& a, vec3 const& b) { return {a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b.y-a.y*b.x}; }
+inline float norm(vec3 const& a) { return std::sqrt(dot(a,a)); }
+
+}
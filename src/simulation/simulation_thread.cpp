@@ -0,0 +1,368 @@
+#include "simulation/simulation_thread.hpp"
+
+#include "simulation/timeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace sim {
+
+// ****************************************** //
+// Jitter
+// ****************************************** //
+
+void jitter_meter::tick(double now, double deadline)
+{
+	if(last>=0){
+		double const period = now - last;
+		int const k = static_cast<int>(ticks % window);
+		periods[k] = static_cast<float>(1000*period);
+		lateness[k] = deadline>=0 ? static_cast<float>(1000*std::max(now - deadline, 0.0)) : 0.0f;
+		if(nominal>0 && period>2*nominal)
+			overruns++;
+		ticks++;
+	}
+	last = now;
+}
+
+jitter_statistics jitter_meter::statistics() const
+{
+	jitter_statistics s;
+	s.ticks = ticks;
+	s.overruns = overruns;
+	int const n = static_cast<int>(std::min<uint64_t>(ticks, window));
+	if(n==0)
+		return s;
+	double sum = 0, sum2 = 0;
+	for(int k=0; k<n; ++k){
+		sum += periods[k];
+		sum2 += static_cast<double>(periods[k])*periods[k];
+		s.period_max = std::max(s.period_max, periods[k]);
+		s.lateness_max = std::max(s.lateness_max, lateness[k]);
+	}
+	double const mean = sum/n;
+	s.period_mean = static_cast<float>(mean);
+	s.period_stddev = static_cast<float>(std::sqrt(std::max(sum2/n - mean*mean, 0.0)));
+	return s;
+}
+
+// ****************************************** //
+// Simulation thread
+// ****************************************** //
+
+simulation_thread::~simulation_thread()
+{
+	stop();
+}
+
+void simulation_thread::start(mission_parameters const& parameters_arg, simulation_thread_settings const& settings)
+{
+	stop();
+	current_settings = settings;
+	parameters = parameters_arg;
+	mission_initialize(mission, parameters);
+	exact = true;
+	t = 0;
+	warp = time_warp_statistics();
+	ticks = 0;
+	jitter = jitter_meter(period());
+	origin = std::chrono::steady_clock::now();
+	if(!settings.shared_memory.empty() && !shared.open(settings.shared_memory))
+		std::cerr << "Cannot create the shared memory " << settings.shared_memory << std::endl;
+
+	// first snapshot before the thread starts: the render thread always has a state to draw
+	tick(0);
+	snapshots.update();
+	previous = latest = snapshots.read_buffer();
+
+	quit = false;
+	thread = std::thread(&simulation_thread::loop, this);
+}
+
+void simulation_thread::stop()
+{
+	if(!thread.joinable())
+		return;
+	quit = true;
+	thread.join();
+	if(telemetry.is_open())
+		telemetry.close();
+	shared.close();
+}
+
+double simulation_thread::now() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void simulation_thread::loop()
+{
+	typedef std::chrono::steady_clock clock;
+	double const dt = period();
+	clock::duration const step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(dt));
+	clock::time_point deadline = clock::now();
+	double deadline_s = now();
+	while(!quit){
+		double const wall = now();
+		jitter.tick(wall, deadline_s);
+
+		// far behind (e.g. the process was suspended): skip the missed ticks, not the mission time
+		double elapsed = dt;
+		double const late = wall - deadline_s;
+		if(late > current_settings.max_catch_up*dt){
+			double const skipped = std::floor(late/dt);
+			elapsed += skipped*dt;
+			deadline += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(skipped*dt));
+			deadline_s += skipped*dt;
+		}
+
+		simulation_command command;
+		while(commands.pop(command))
+			apply(command);
+		advance(elapsed);
+		tick(wall);
+
+		// fixed rate: the late ticks run back to back until the loop is on time again
+		deadline += step;
+		deadline_s += dt;
+		std::this_thread::sleep_until(deadline);
+	}
+}
+
+void simulation_thread::apply(simulation_command const& command)
+{
+	switch(command.type){
+	case simulation_command_type::seek:
+		if(!telemetry.is_open()) // the recorded mission is only stepped forward
+			t = std::max(command.value, 0.0f);
+		break;
+	case simulation_command_type::time_scale:
+		scale = std::min(std::max(command.value, 0.0f), current_settings.warp.max_warp);
+		break;
+	case simulation_command_type::parameters:
+		parameters = command.parameters;
+		timeline.set_parameters(parameters);
+		if(!telemetry.is_open())
+			exact = false; // stepped again from the timeline with the new parameters
+		break;
+	case simulation_command_type::restart:
+		parameters = command.parameters;
+		timeline.set_parameters(parameters); // e.g. another flight model: recomputed from t=0
+		mission_initialize(mission, parameters);
+		exact = true;
+		t = 0;
+		if(telemetry.is_open()){
+			// a new launch starts a new file
+			telemetry.close();
+			apply({simulation_command_type::record_start, 0, parameters});
+		}
+		break;
+	case simulation_command_type::record_start:
+		if(telemetry.is_open())
+			break;
+		if(!telemetry.open(current_settings.telemetry_filename, mission_body_count, parameters.dt)){
+			std::cerr << "Cannot write " << current_settings.telemetry_filename << std::endl;
+			break;
+		}
+		mission_initialize(mission, parameters);
+		exact = true;
+		t = 0;
+		recorder.reset();
+		recorder.record(mission);
+		break;
+	case simulation_command_type::record_stop:
+		if(telemetry.is_open())
+			telemetry.close();
+		break;
+	}
+}
+
+void simulation_thread::advance(double elapsed)
+{
+	time_warp_settings const& settings = current_settings.warp;
+	double const t_before = t;
+	bool const recording = telemetry.is_open();
+	warp.requested = scale;
+	warp.steps = 0;
+
+	if(!recording && scale<=settings.timeline_max && t<=settings.timeline_horizon){
+		// any time, backwards included: the state keeps its last value until the timeline reaches it
+		t += elapsed*scale;
+		timeline.sample(static_cast<float>(t), mission);
+		exact = false;
+		warp.mode = time_warp_mode::timeline;
+		warp.allowed = scale;
+		warp.limit = time_warp_limit::none;
+		warp.next_event = std::numeric_limits<float>::infinity();
+	}
+	else{
+		double const dt = parameters.dt;
+		auto const step_time = [dt](unsigned int step){ return static_cast<double>(step)*dt; };
+
+		// exact state at or before t: from the timeline checkpoint before it, or from the launch
+		if(!exact || step_time(mission.step_count) > t){
+			if(!timeline.checkpoint(static_cast<float>(t), mission))
+				mission_initialize(mission, parameters);
+			exact = true;
+		}
+
+		// slower before the next event, so that it is shown (and stepped) at a speed that can be followed
+		double const next_event = mission_next_event(mission, parameters);
+		warp.next_event = static_cast<float>(next_event);
+		warp.allowed = time_warp_allowed(scale, t, next_event, settings);
+		warp.limit = warp.allowed < std::min(scale, settings.max_warp) ? time_warp_limit::event : time_warp_limit::none;
+		t = std::min(t + elapsed*warp.allowed, step_time(std::numeric_limits<unsigned int>::max() - 1));
+
+		// last step at or before t
+		unsigned int target = static_cast<unsigned int>(t/dt);
+		if(target>0 && step_time(target) > t)
+			target--;
+
+		warp.mode = !recording && mission_on_rails(mission) ? time_warp_mode::on_rails : time_warp_mode::stepped;
+		double const budget_end = now() + settings.step_budget*period();
+		while(mission.step_count < target){
+			if(!recording && mission_on_rails(mission)){
+				// nothing left to step: straight to the target
+				mission_jump(mission, parameters, target);
+				warp.mode = time_warp_mode::on_rails;
+				warp.jumps++;
+				break;
+			}
+			mission_step(mission, parameters);
+			if(recording)
+				recorder.record(mission);
+			warp.steps++;
+			if(warp.steps % settings.budget_check==0 && now() > budget_end){
+				// out of time for this tick: the mission time stops at the last step
+				t = step_time(mission.step_count);
+				warp.limit = time_warp_limit::budget;
+				break;
+			}
+		}
+	}
+
+	// achieved warp, over ~100 ticks
+	double const achieved = elapsed>0 ? (t - t_before)/elapsed : 0;
+	warp.achieved += static_cast<float>(0.01*(achieved - warp.achieved));
+}
+
+void simulation_thread::tick(double wall)
+{
+	simulation_snapshot& s = snapshots.write_buffer();
+	s.tick = ticks++;
+	s.wall = wall;
+	s.t = static_cast<float>(t);
+	s.scale = scale;
+	s.mission = mission; // same sizes every tick: the vectors of the body table are not reallocated
+	s.warp = warp;
+	s.recording = telemetry.is_open();
+	s.telemetry_samples = telemetry.samples();
+	s.telemetry_stalls = telemetry.stalls();
+	s.telemetry_failed = telemetry.failed();
+	s.jitter = jitter.statistics();
+	if(shared.is_open())
+		shared.publish(mission, s.tick);
+	s.shared = shared.is_open();
+	s.shared_states = shared.states();
+	s.shared_events = shared.events();
+	snapshots.publish();
+
+	control_feed& c = control.write_buffer();
+	c.tick = s.tick;
+	c.input = attitude_input_from(mission, parameters);
+	c.parameters = parameters;
+	control.publish();
+}
+
+bool simulation_thread::read_control(control_feed& feed)
+{
+	if(!control.update())
+		return false;
+	feed = control.read_buffer();
+	return true;
+}
+
+bool simulation_thread::send(simulation_command const& command)
+{
+	return commands.push(command);
+}
+
+bool simulation_thread::seek(float t_arg)
+{
+	simulation_command c;
+	c.type = simulation_command_type::seek;
+	c.value = t_arg;
+	return send(c);
+}
+
+bool simulation_thread::set_time_scale(float scale_arg)
+{
+	simulation_command c;
+	c.type = simulation_command_type::time_scale;
+	c.value = scale_arg;
+	return send(c);
+}
+
+bool simulation_thread::set_parameters(mission_parameters const& parameters_arg)
+{
+	simulation_command c;
+	c.type = simulation_command_type::parameters;
+	c.parameters = parameters_arg;
+	return send(c);
+}
+
+bool simulation_thread::restart(mission_parameters const& parameters_arg)
+{
+	simulation_command c;
+	c.type = simulation_command_type::restart;
+	c.parameters = parameters_arg;
+	return send(c);
+}
+
+bool simulation_thread::record(bool on)
+{
+	simulation_command c;
+	c.type = on ? simulation_command_type::record_start : simulation_command_type::record_stop;
+	return send(c);
+}
+
+simulation_snapshot const& simulation_thread::interpolate(mission_state& state, float& t_out)
+{
+	if(snapshots.update()){
+		previous = latest; // copies into the same sizes, as in tick()
+		latest = snapshots.read_buffer();
+	}
+
+	// one tick behind the clock, so that the time is between the two snapshots
+	double const h = latest.wall - previous.wall;
+	double const u = h>0 ? std::min(1.0, std::max(0.0, (now() - period() - previous.wall)/h)) : 1.0;
+
+	// no blending across a seek, a restart or a discontinuity of the mission (separation, landing, orbit start),
+	mission_state const& a = previous.mission;
+	mission_state const& b = latest.mission;
+	// nor across a time warp: a blend between states far apart on the orbit would cut through the earth
+	bool hold = u>=1.0 || latest.t<previous.t || latest.t-previous.t > 0.1f || a.radius_set!=b.radius_set;
+	for(int k=0; k<mission_body_count && !hold; ++k)
+		hold = a.bodies.phase[k]!=b.bodies.phase[k];
+
+	state = b;
+	t_out = latest.t;
+	if(hold)
+		return latest;
+
+	float const w = static_cast<float>(u);
+	auto blend = [w](vec3 const& x, vec3 const& y){ return x + w*(y - x); };
+	t_out = previous.t + w*(latest.t - previous.t);
+	state.t = t_out;
+	state.rocket_p = blend(a.rocket_p, b.rocket_p);
+	state.rocket_v = blend(a.rocket_v, b.rocket_v);
+	for(int k=0; k<mission_body_count; ++k){
+		state.bodies.set_position(k, blend(a.bodies.position(k), b.bodies.position(k)));
+		state.bodies.set_velocity(k, blend(a.bodies.velocity(k), b.bodies.velocity(k)));
+	}
+	return latest;
+}
+
+}
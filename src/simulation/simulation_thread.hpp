@@ -0,0 +1,189 @@
+#pragma once
+
+/**
+Mission simulated on its own thread at a fixed rate (1 kHz by default), whatever the frame rate.
+Every tick, the thread applies the commands of the render thread, advances the mission time by
+scale/rate, takes the state at that time from the timeline (or steps the mission exactly at high
+time warp and while the telemetry is recorded, see time_warp.hpp and telemetry.hpp) and publishes
+it as a snapshot in a triple buffer: the thread never waits for the render thread, nor the render
+thread for it.
+The render thread draws the state interpolated between the two latest snapshots, one tick behind
+its clock, and sends its changes (time, time scale, parameters, restart, recording) through a
+lock-free command queue. Both loops measure the jitter of their period (jitter_meter).
+Each state can also be published in shared memory for the other processes (shared_telemetry.hpp),
+and is given to the guidance and autopilot of the control thread (control_thread.hpp).
+*/
+
+#include "simulation/attitude.hpp"
+#include "simulation/command_queue.hpp"
+#include "simulation/mission.hpp"
+#include "simulation/shared_telemetry.hpp"
+#include "simulation/telemetry.hpp"
+#include "simulation/time_warp.hpp"
+#include "simulation/triple_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace sim {
+
+class mission_timeline;
+
+// ****************************************** //
+// Jitter
+// ****************************************** //
+
+struct jitter_statistics
+{
+	uint64_t ticks = 0;
+	// over the last jitter_meter::window periods, in ms
+	float period_mean = 0;
+	float period_stddev = 0;
+	float period_max = 0;
+	float lateness_max = 0;  // wake-up after the deadline (fixed rate loops)
+	uint64_t overruns = 0;   // periods longer than twice the nominal one, since the start
+};
+
+class jitter_meter
+{
+public:
+	static int const window = 256;
+
+	// nominal_period (s): 0 for a loop without a rate of its own (e.g. paced by vsync)
+	explicit jitter_meter(double nominal_period = 0) : nominal(nominal_period) {}
+
+	// Start of an iteration at time now (s), which was due at deadline (s, fixed rate loops)
+	void tick(double now, double deadline = -1);
+	jitter_statistics statistics() const;
+
+private:
+	double nominal;
+	double last = -1;
+	float periods[window] = {};
+	float lateness[window] = {};
+	uint64_t ticks = 0;
+	uint64_t overruns = 0;
+};
+
+// ****************************************** //
+// Simulation thread
+// ****************************************** //
+
+struct simulation_thread_settings
+{
+	double rate = 1000.0;          // ticks per second
+	int max_catch_up = 50;         // late ticks run back to back, beyond them the loop skips ahead
+	std::string telemetry_filename = "telemetry.rktl";
+	std::string shared_memory;     // segment of the live telemetry (e.g. "/rocket_telemetry"), empty: not published
+	time_warp_settings warp;
+};
+
+enum class simulation_command_type { seek, time_scale, parameters, restart, record_start, record_stop };
+
+struct simulation_command
+{
+	simulation_command_type type = simulation_command_type::seek;
+	float value = 0;                // seek: mission time, time_scale: requested warp
+	mission_parameters parameters;  // parameters, restart
+};
+
+// State published by the simulation thread
+struct simulation_snapshot
+{
+	uint64_t tick = 0;
+	double wall = 0;         // s, clock of the thread when the state was computed
+	float t = 0;             // mission time
+	float scale = 1;         // requested
+	mission_state mission;
+	time_warp_statistics warp;
+
+	bool recording = false;
+	uint64_t telemetry_samples = 0;
+	uint64_t telemetry_stalls = 0;
+	bool telemetry_failed = false; // a write failed, the file is truncated
+
+	bool shared = false;     // published in shared memory
+	uint64_t shared_states = 0;
+	uint64_t shared_events = 0;
+
+	jitter_statistics jitter; // of the simulation loop
+};
+
+// State of the mission for the control thread
+struct control_feed
+{
+	uint64_t tick = 0;
+	attitude_input input;
+	mission_parameters parameters;
+};
+
+class simulation_thread
+{
+public:
+	explicit simulation_thread(mission_timeline& timeline_arg) : timeline(timeline_arg) {}
+	~simulation_thread();
+
+	simulation_thread(simulation_thread const&) = delete;
+	simulation_thread& operator=(simulation_thread const&) = delete;
+
+	void start(mission_parameters const& parameters, simulation_thread_settings const& settings = simulation_thread_settings());
+	void stop();
+	bool running() const { return thread.joinable(); }
+
+	// Render thread: false when the queue is full (the command is dropped)
+	bool send(simulation_command const& command);
+	bool seek(float t);
+	bool set_time_scale(float scale);
+	bool set_parameters(mission_parameters const& parameters);
+	bool restart(mission_parameters const& parameters);
+	bool record(bool on);
+
+	// Render thread: state one tick before now, between the two latest snapshots (positions and
+	// velocities blended, the rest from the latest one), and its mission time. Returns the latest one
+	simulation_snapshot const& interpolate(mission_state& state, float& t);
+	simulation_snapshot const& snapshot() const { return latest; }
+	double now() const; // s, clock of the snapshots
+
+	// Control thread: latest state of the mission, false if none was published since the last call
+	bool read_control(control_feed& feed);
+
+	simulation_thread_settings const& settings() const { return current_settings; }
+	double period() const { return 1.0/current_settings.rate; }
+
+private:
+	void loop();
+	void apply(simulation_command const& command);
+	void advance(double elapsed);
+	void tick(double wall);
+
+	mission_timeline& timeline;
+	simulation_thread_settings current_settings;
+	std::chrono::steady_clock::time_point origin;
+	std::thread thread;
+	std::atomic<bool> quit{false};
+
+	// simulation thread
+	mission_parameters parameters;
+	mission_state mission;
+	bool exact = false;      // mission stepped by this thread (otherwise sampled from the timeline)
+	double t = 0;
+	float scale = 1;
+	time_warp_statistics warp;
+	uint64_t ticks = 0;
+	jitter_meter jitter;
+	telemetry_writer telemetry;
+	mission_recorder recorder{telemetry};
+	shared_telemetry_publisher shared;
+
+	triple_buffer<simulation_snapshot> snapshots;
+	triple_buffer<control_feed> control;
+	command_queue<simulation_command, 64> commands;
+
+	// render thread
+	simulation_snapshot previous, latest;
+};
+
+}
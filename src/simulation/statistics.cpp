@@ -0,0 +1,91 @@
+#include "simulation/statistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+
+namespace sim {
+
+double percentile_sorted(std::vector<double> const& sorted, double p)
+{
+	if(sorted.empty())
+		return 0.0;
+	double const rank = p/100.0*(sorted.size()-1);
+	size_t const k = static_cast<size_t>(rank);
+	if(k+1>=sorted.size())
+		return sorted.back();
+	double const alpha = rank - k;
+	return (1-alpha)*sorted[k] + alpha*sorted[k+1];
+}
+
+sample_summary summarize(std::vector<double> samples)
+{
+	sample_summary s;
+	s.count = samples.size();
+	if(samples.empty())
+		return s;
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for(double x : samples)
+		sum += x;
+	s.mean = sum/s.count;
+	double variance = 0;
+	for(double x : samples)
+		variance += (x-s.mean)*(x-s.mean);
+	s.sigma = s.count>1 ? std::sqrt(variance/(s.count-1)) : 0.0;
+
+	s.min = samples.front();
+	s.max = samples.back();
+	s.p01 = percentile_sorted(samples, 1);
+	s.p05 = percentile_sorted(samples, 5);
+	s.p25 = percentile_sorted(samples, 25);
+	s.p50 = percentile_sorted(samples, 50);
+	s.p75 = percentile_sorted(samples, 75);
+	s.p95 = percentile_sorted(samples, 95);
+	s.p99 = percentile_sorted(samples, 99);
+	return s;
+}
+
+histogram compute_histogram(std::vector<double> const& samples, size_t bin_count)
+{
+	histogram h;
+	h.counts.assign(std::max<size_t>(bin_count,1), 0);
+	if(samples.empty())
+		return h;
+
+	auto const range = std::minmax_element(samples.begin(), samples.end());
+	h.min = *range.first;
+	h.max = *range.second;
+	if(h.max<=h.min)
+		h.max = h.min + 1e-6; // all the samples are equal: one non-empty bin
+
+	double const scale = h.counts.size()/(h.max-h.min);
+	for(double x : samples){
+		size_t k = static_cast<size_t>((x-h.min)*scale);
+		k = std::min(k, h.counts.size()-1); // the max goes in the last bin
+		h.counts[k]++;
+	}
+	return h;
+}
+
+void print_histogram(std::ostream& out, histogram const& h, size_t bar_width)
+{
+	size_t const largest = h.counts.empty() ? 0 : *std::max_element(h.counts.begin(), h.counts.end());
+	double const width = h.bin_width();
+	for(size_t k=0; k<h.counts.size(); ++k){
+		size_t const bar = largest==0 ? 0 : h.counts[k]*bar_width/largest;
+		out << "  [" << std::setw(12) << h.min+k*width << ", " << std::setw(12) << h.min+(k+1)*width << ") "
+			<< std::setw(8) << h.counts[k] << " " << std::string(bar,'#') << "\n";
+	}
+}
+
+void print_summary(std::ostream& out, char const* name, sample_summary const& s)
+{
+	out << name << ": n=" << s.count << " mean=" << s.mean << " sigma=" << s.sigma << "\n"
+		<< "  min=" << s.min << " p1=" << s.p01 << " p5=" << s.p05 << " p25=" << s.p25 << " p50=" << s.p50
+		<< " p75=" << s.p75 << " p95=" << s.p95 << " p99=" << s.p99 << " max=" << s.max << "\n";
+}
+
+}
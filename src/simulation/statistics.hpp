@@ -0,0 +1,45 @@
+#pragma once
+
+/**
+Summary statistics of a set of samples: mean, standard deviation, percentiles and histogram.
+*/
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace sim {
+
+struct sample_summary
+{
+	size_t count = 0;
+	double mean = 0;
+	double sigma = 0;
+	double min = 0;
+	double max = 0;
+	double p01 = 0, p05 = 0, p25 = 0, p50 = 0, p75 = 0, p95 = 0, p99 = 0;
+};
+
+struct histogram
+{
+	double min = 0;
+	double max = 0;
+	std::vector<size_t> counts; // counts[k] for [min + k*width, min + (k+1)*width)
+
+	double bin_width() const { return counts.empty() ? 0.0 : (max-min)/counts.size(); }
+};
+
+// Percentile p in [0,100] of sorted samples, linear interpolation between the closest ranks
+double percentile_sorted(std::vector<double> const& sorted, double p);
+
+// Summary of the samples (taken by copy since they have to be sorted)
+sample_summary summarize(std::vector<double> samples);
+
+// Histogram with bin_count bins between the min and max of the samples
+histogram compute_histogram(std::vector<double> const& samples, size_t bin_count);
+
+// Text display: one line per bin with a bar proportional to the count
+void print_histogram(std::ostream& out, histogram const& h, size_t bar_width = 50);
+void print_summary(std::ostream& out, char const* name, sample_summary const& s);
+
+}
@@ -0,0 +1,505 @@
+#include "simulation/telemetry.hpp"
+
+#include "simulation/mission.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sim {
+
+char const* telemetry_event_name(telemetry_event_type type)
+{
+	switch(type){
+	case telemetry_separation: return "separation";
+	case telemetry_ground_contact: return "ground contact";
+	case telemetry_orbit_start: return "orbit start";
+	default: return "unknown";
+	}
+}
+
+// ****************************************** //
+// Encoding helpers
+// ****************************************** //
+
+// LEB128: 7 bits per byte, high bit set when more bytes follow. Returns the end of the written bytes.
+static uint8_t* put_varint(uint8_t* p, uint64_t value)
+{
+	while(value >= 0x80){
+		*p++ = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = static_cast<uint8_t>(value);
+	return p;
+}
+
+// Reads one varint before end. false if it is cut by end or longer than 64 bits (corrupt data)
+static bool get_varint(uint8_t const*& p, uint8_t const* end, uint64_t& value)
+{
+	value = 0;
+	for(int shift=0; shift<64 && p<end; shift+=7){
+		uint8_t const byte = *p++;
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if(byte < 0x80)
+			return true;
+	}
+	return false;
+}
+
+static uint32_t float_bits(float f) { uint32_t u; std::memcpy(&u, &f, sizeof(u)); return u; }
+static float bits_float(uint32_t u) { float f; std::memcpy(&f, &u, sizeof(f)); return f; }
+
+// Small deltas of either sign map to small unsigned values: 0,-1,1,-2,... -> 0,1,2,3,...
+static uint32_t zigzag(int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+static int32_t unzigzag(uint32_t u) { return static_cast<int32_t>(u >> 1) ^ -static_cast<int32_t>(u & 1); }
+
+// ****************************************** //
+// Writer
+// ****************************************** //
+
+telemetry_writer::~telemetry_writer()
+{
+	close();
+}
+
+bool telemetry_writer::open(std::string const& filename, uint32_t body_count_arg, double dt_arg, telemetry_writer_options const& options_arg)
+{
+	close();
+	file = std::fopen(filename.c_str(), "wb");
+	if(file==nullptr)
+		return false;
+
+	body_count = body_count_arg;
+	dt = dt_arg;
+	options = options_arg;
+	size_t const sample_bytes = sizeof(float)*telemetry_component_count*std::max(1u, body_count);
+	options.chunk_samples = uint32_t(std::min<size_t>(options.chunk_samples, options.chunk_bytes/sample_bytes));
+	options.chunk_samples = std::max(1u, options.chunk_samples);
+	options.queue_depth = std::max<size_t>(1, options.queue_depth);
+	sample_total = stall_count = bytes = chunks = 0;
+	write_failed = false;
+	previous_phase.clear();
+	stop = false;
+
+	telemetry_file_header header;
+	std::memcpy(header.magic, "RKTL", 4);
+	header.version = telemetry_version;
+	header.body_count = body_count;
+	header.column_count = 1 + telemetry_component_count*body_count;
+	header.dt = dt;
+	header.chunk_samples = options.chunk_samples;
+	header.reserved = 0;
+	bytes = std::fwrite(&header, 1, sizeof(header), file);
+	if(bytes!=sizeof(header))
+		write_failed = true;
+
+	// all the buffers are allocated here: recording does not allocate
+	free.clear();
+	full.clear();
+	for(size_t k=0; k<options.queue_depth+1; ++k){
+		std::unique_ptr<raw_chunk> chunk(new raw_chunk());
+		chunk->steps.resize(options.chunk_samples);
+		chunk->values.resize(size_t(options.chunk_samples)*telemetry_component_count*body_count);
+		free.push_back(std::move(chunk));
+	}
+	current = std::move(free.back());
+	free.pop_back();
+
+	thread = std::thread(&telemetry_writer::writer_loop, this);
+	return true;
+}
+
+void telemetry_writer::close()
+{
+	if(file==nullptr)
+		return;
+
+	if(current->sample_count>0 || !current->events.empty())
+		submit_current();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	queue_changed.notify_all();
+	thread.join();
+
+	if(std::fclose(file)!=0)
+		write_failed = true; // the last buffered bytes were not written
+	file = nullptr;
+	current.reset();
+	free.clear();
+}
+
+void telemetry_writer::record(uint64_t step, body_table const& bodies)
+{
+	size_t const n = std::min<size_t>(body_count, bodies.size());
+
+	// phase changes since the last sample
+	if(previous_phase.size()!=n)
+		previous_phase.assign(bodies.phase.begin(), bodies.phase.begin()+n);
+	for(size_t b=0; b<n; ++b){
+		int32_t const phase = bodies.phase[b];
+		if(phase==previous_phase[b])
+			continue;
+		if(phase==body_ballistic)
+			event(step, uint32_t(b), telemetry_separation);
+		else if(phase==body_landed)
+			event(step, uint32_t(b), telemetry_ground_contact);
+		previous_phase[b] = phase;
+	}
+
+	raw_chunk& chunk = *current;
+	uint32_t const i = chunk.sample_count;
+	size_t const stride = options.chunk_samples;
+	chunk.steps[i] = step;
+	float* values = chunk.values.data() + i;
+	std::vector<float> const* columns[telemetry_component_count] = {&bodies.px, &bodies.py, &bodies.pz, &bodies.vx, &bodies.vy, &bodies.vz};
+	for(size_t b=0; b<n; ++b)
+		for(int c=0; c<telemetry_component_count; ++c)
+			values[(b*telemetry_component_count + c)*stride] = (*columns[c])[b];
+	for(size_t b=n; b<body_count; ++b)
+		for(int c=0; c<telemetry_component_count; ++c)
+			values[(b*telemetry_component_count + c)*stride] = 0.0f;
+
+	chunk.sample_count++;
+	sample_total++;
+	if(chunk.sample_count==options.chunk_samples)
+		submit_current();
+}
+
+void telemetry_writer::event(uint64_t step, uint32_t body, telemetry_event_type type)
+{
+	telemetry_event e;
+	e.step = step;
+	e.body = body;
+	e.type = type;
+	current->events.push_back(e);
+}
+
+void telemetry_writer::submit_current()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	full.push_back(std::move(current));
+	queue_changed.notify_all();
+
+	// the writer thread is behind: wait for one of the buffers it recycles
+	if(free.empty()){
+		stall_count++;
+		queue_changed.wait(lock, [this](){ return !free.empty(); });
+	}
+	current = std::move(free.back());
+	free.pop_back();
+	current->sample_count = 0;
+	current->events.clear();
+}
+
+void telemetry_writer::writer_loop()
+{
+	std::vector<uint8_t> encoded;
+	for(;;){
+		std::unique_ptr<raw_chunk> chunk;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queue_changed.wait(lock, [this](){ return stop || !full.empty(); });
+			if(full.empty())
+				return;
+			chunk = std::move(full.front());
+			full.pop_front();
+		}
+
+		// after a failed write the chunks are only recycled: the file keeps its complete chunks
+		size_t written = 0;
+		if(!write_failed){
+			encode(*chunk, encoded);
+			written = std::fwrite(encoded.data(), 1, encoded.size(), file);
+			if(written!=encoded.size())
+				write_failed = true;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			free.push_back(std::move(chunk));
+			bytes += written;
+			if(!write_failed)
+				chunks++;
+		}
+		queue_changed.notify_all();
+	}
+}
+
+void telemetry_writer::encode(raw_chunk const& chunk, std::vector<uint8_t>& out) const
+{
+	uint32_t const column_count = 1 + telemetry_component_count*body_count;
+	uint32_t const n = chunk.sample_count;
+
+	telemetry_chunk_header header;
+	std::memcpy(header.magic, "CHNK", 4);
+	header.sample_count = n;
+	header.event_count = uint32_t(chunk.events.size());
+	header.reserved = 0;
+	// a chunk of events only (e.g. the last events before close) takes their steps: the time
+	//  ranges of the chunks stay ordered for find_chunk
+	if(n>0){
+		header.first_step = chunk.steps[0];
+		header.last_step = chunk.steps[n-1];
+	}
+	else if(!chunk.events.empty()){
+		header.first_step = chunk.events.front().step;
+		header.last_step = chunk.events.back().step;
+	}
+	else
+		header.first_step = header.last_step = 0;
+	header.t_begin = double(header.first_step)*dt;
+	header.t_end = double(header.last_step)*dt;
+
+	// header and offsets are written in place once the columns are encoded.
+	//  The buffer is sized for the worst case (10 bytes per step, 5 per value) and shrunk at the end.
+	size_t const table_size = sizeof(telemetry_chunk_header) + (column_count+2)*sizeof(uint64_t);
+	out.resize(table_size + 10*size_t(n) + 5*size_t(n)*(column_count-1) + 30*chunk.events.size() + 8);
+	std::vector<uint64_t> offsets(column_count+2);
+	uint8_t* const begin = out.data();
+	uint8_t* p = begin + table_size;
+
+	offsets[0] = uint64_t(p-begin);
+	uint64_t previous_step = 0;
+	for(uint32_t i=0; i<n; ++i){
+		p = put_varint(p, chunk.steps[i] - previous_step);
+		previous_step = chunk.steps[i];
+	}
+
+	size_t const stride = options.chunk_samples;
+	for(uint32_t column=1; column<column_count; ++column){
+		offsets[column] = uint64_t(p-begin);
+		float const* values = chunk.values.data() + (column-1)*stride;
+		uint32_t previous = 0;
+		for(uint32_t i=0; i<n; ++i){
+			uint32_t const bits = float_bits(values[i]);
+			p = put_varint(p, zigzag(static_cast<int32_t>(bits - previous)));
+			previous = bits;
+		}
+	}
+
+	offsets[column_count] = uint64_t(p-begin);
+	uint64_t previous_event = 0;
+	for(telemetry_event const& e : chunk.events){
+		p = put_varint(p, e.step - previous_event);
+		p = put_varint(p, e.body);
+		p = put_varint(p, e.type);
+		previous_event = e.step;
+	}
+	offsets[column_count+1] = uint64_t(p-begin);
+	out.resize(size_t(p-begin));
+
+	// chunks are 8-byte aligned so that the reader maps their headers in place
+	out.resize((out.size()+7)/8*8, 0);
+	header.size = out.size();
+	std::memcpy(out.data(), &header, sizeof(header));
+	std::memcpy(out.data()+sizeof(header), offsets.data(), offsets.size()*sizeof(uint64_t));
+}
+
+void mission_recorder::record(mission_state const& state)
+{
+	if(state.radius_set && !in_orbit){
+		writer.event(state.step_count, body_satellite, telemetry_orbit_start);
+		in_orbit = true;
+	}
+	writer.record(state.step_count, state.bodies);
+}
+
+// ****************************************** //
+// Reader
+// ****************************************** //
+
+telemetry_reader::~telemetry_reader()
+{
+	close();
+}
+
+bool telemetry_reader::open(std::string const& filename)
+{
+	close();
+
+#ifdef _WIN32
+	FILE* f = std::fopen(filename.c_str(), "rb");
+	if(f==nullptr)
+		return false;
+	std::fseek(f, 0, SEEK_END);
+	buffer.resize(size_t(std::ftell(f)));
+	std::fseek(f, 0, SEEK_SET);
+	size_t const read = std::fread(buffer.data(), 1, buffer.size(), f);
+	std::fclose(f);
+	if(read!=buffer.size())
+		return false;
+	data = buffer.data();
+	size = buffer.size();
+#else
+	int const fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd<0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st)!=0 || st.st_size<0){
+		::close(fd);
+		return false;
+	}
+	size = size_t(st.st_size);
+	void* mapping = size>0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	::close(fd); // the mapping stays valid
+	if(mapping==MAP_FAILED){
+		size = 0;
+		return false;
+	}
+	data = static_cast<uint8_t const*>(mapping);
+#endif
+
+	if(size<sizeof(telemetry_file_header)){
+		close();
+		return false;
+	}
+	file_header = reinterpret_cast<telemetry_file_header const*>(data);
+	if(std::memcmp(file_header->magic, "RKTL", 4)!=0 || file_header->version>telemetry_version){
+		close();
+		return false;
+	}
+
+	// index the chunks by walking their headers only
+	size_t const table_size = sizeof(telemetry_chunk_header) + (size_t(file_header->column_count)+2)*sizeof(uint64_t);
+	size_t offset = sizeof(telemetry_file_header);
+	while(offset + table_size <= size){
+		telemetry_chunk_header const* chunk = reinterpret_cast<telemetry_chunk_header const*>(data+offset);
+		if(std::memcmp(chunk->magic, "CHNK", 4)!=0 || chunk->size<table_size || offset+chunk->size>size)
+			break;
+		chunks.push_back(chunk);
+		offset += chunk->size;
+	}
+	return true;
+}
+
+void telemetry_reader::close()
+{
+#ifdef _WIN32
+	buffer.clear();
+#else
+	if(data!=nullptr)
+		munmap(const_cast<uint8_t*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+	file_header = nullptr;
+	chunks.clear();
+}
+
+size_t telemetry_reader::find_chunk(double t) const
+{
+	auto it = std::lower_bound(chunks.begin(), chunks.end(), t, [](telemetry_chunk_header const* c, double time){ return c->t_end < time; });
+	return size_t(it-chunks.begin());
+}
+
+bool telemetry_reader::column_range(size_t chunk_index, uint32_t column, uint8_t const*& begin, uint8_t const*& end) const
+{
+	telemetry_chunk_header const* header = chunks[chunk_index];
+	uint8_t const* chunk = reinterpret_cast<uint8_t const*>(header);
+	uint64_t offsets[2];
+	std::memcpy(offsets, chunk + sizeof(telemetry_chunk_header) + column*sizeof(uint64_t), sizeof(offsets));
+	uint64_t const table_size = sizeof(telemetry_chunk_header) + (uint64_t(file_header->column_count)+2)*sizeof(uint64_t);
+	if(offsets[0]<table_size || offsets[0]>offsets[1] || offsets[1]>header->size)
+		return false;
+	begin = chunk + offsets[0];
+	end = chunk + offsets[1];
+	return true;
+}
+
+bool telemetry_reader::decode_steps(size_t chunk_index, std::vector<uint64_t>& steps) const
+{
+	uint32_t const n = chunks[chunk_index]->sample_count;
+	steps.clear();
+	uint8_t const *p, *end;
+	if(!column_range(chunk_index, 0, p, end))
+		return false;
+	steps.reserve(n);
+	uint64_t step = 0;
+	for(uint32_t i=0; i<n; ++i){
+		uint64_t delta;
+		if(!get_varint(p, end, delta))
+			return false;
+		step += delta;
+		steps.push_back(step);
+	}
+	return true;
+}
+
+bool telemetry_reader::decode_column(size_t chunk_index, uint32_t column, std::vector<float>& values) const
+{
+	uint32_t const n = chunks[chunk_index]->sample_count;
+	values.clear();
+	uint8_t const *p, *end;
+	if(column>=file_header->column_count || !column_range(chunk_index, column, p, end))
+		return false;
+	values.reserve(n);
+	uint32_t bits = 0;
+	for(uint32_t i=0; i<n; ++i){
+		uint64_t delta;
+		if(!get_varint(p, end, delta))
+			return false;
+		bits += static_cast<uint32_t>(unzigzag(static_cast<uint32_t>(delta)));
+		values.push_back(bits_float(bits));
+	}
+	return true;
+}
+
+bool telemetry_reader::decode_events(size_t chunk_index, std::vector<telemetry_event>& events) const
+{
+	uint32_t const n = chunks[chunk_index]->event_count;
+	uint8_t const *p, *end;
+	if(!column_range(chunk_index, file_header->column_count, p, end))
+		return false;
+	uint64_t step = 0;
+	for(uint32_t i=0; i<n; ++i){
+		uint64_t delta, body, type;
+		if(!get_varint(p, end, delta) || !get_varint(p, end, body) || !get_varint(p, end, type))
+			return false;
+		step += delta;
+		telemetry_event e;
+		e.step = step;
+		e.body = static_cast<uint32_t>(body);
+		e.type = static_cast<telemetry_event_type>(type);
+		events.push_back(e);
+	}
+	return true;
+}
+
+bool telemetry_reader::read_column(uint32_t column, double t_begin, double t_end, std::vector<double>& times, std::vector<float>& values) const
+{
+	times.clear();
+	values.clear();
+	std::vector<uint64_t> chunk_steps;
+	std::vector<float> chunk_values;
+	for(size_t k=find_chunk(t_begin); k<chunks.size() && chunks[k]->t_begin<=t_end; ++k){
+		if(!decode_steps(k, chunk_steps) || !decode_column(k, column, chunk_values))
+			return false;
+		for(size_t i=0; i<chunk_steps.size(); ++i){
+			double const t = double(chunk_steps[i])*file_header->dt;
+			if(t>=t_begin && t<=t_end){
+				times.push_back(t);
+				values.push_back(chunk_values[i]);
+			}
+		}
+	}
+	return true;
+}
+
+bool telemetry_reader::read_events(std::vector<telemetry_event>& events) const
+{
+	events.clear();
+	for(size_t k=0; k<chunks.size(); ++k)
+		if(!decode_events(k, events))
+			return false;
+	return true;
+}
+
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+/**
+Binary telemetry stream: positions/velocities of the bodies at every step, and mission events.
+
+File layout (little-endian, version 1):
+ - telemetry_file_header
+ - chunks, each made of a telemetry_chunk_header, a table of column offsets and the encoded columns
+   column 0           : step indices, varint of the delta to the previous step
+   column 1+6*b+c     : component c (px,py,pz,vx,vy,vz) of body b, float bits stored as the
+                        zigzag varint of the delta to the previous sample of the same column
+   last block         : events (step delta, body, type) as varints
+Every chunk is decoded on its own (deltas restart at 0) and its header holds its time range,
+so that the reader seeks by time with a binary search and decodes only the columns it needs.
+
+The writer only copies the values in a raw chunk buffer: encoding and file output happen on a
+background thread, fed through a bounded queue of recycled buffers. A failed write (e.g. a full
+disk) stops the output and is reported by failed(): the file ends with the last complete chunk.
+The reader checks every varint against the end of its column: a corrupt chunk fails to decode
+instead of reading past the mapping.
+*/
+
+#include "simulation/body_table.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+struct mission_state;
+
+uint32_t const telemetry_version = 1;
+
+enum telemetry_component { telemetry_px, telemetry_py, telemetry_pz, telemetry_vx, telemetry_vy, telemetry_vz, telemetry_component_count };
+
+enum telemetry_event_type : uint32_t
+{
+	telemetry_separation = 0,     // body left the rocket
+	telemetry_ground_contact = 1, // body landed
+	telemetry_orbit_start = 2     // satellite orbit phase
+};
+
+char const* telemetry_event_name(telemetry_event_type type);
+
+// Column holding the component of a body (column 0 holds the steps)
+inline uint32_t telemetry_column(uint32_t body, telemetry_component component) { return 1 + body*telemetry_component_count + component; }
+
+struct telemetry_event
+{
+	uint64_t step;
+	uint32_t body;
+	telemetry_event_type type;
+};
+
+struct telemetry_file_header
+{
+	char magic[4];          // "RKTL"
+	uint32_t version;
+	uint32_t body_count;
+	uint32_t column_count;  // 1 + 6*body_count
+	double dt;              // time of a sample = step*dt
+	uint32_t chunk_samples; // maximum number of samples of a chunk
+	uint32_t reserved;
+};
+
+struct telemetry_chunk_header
+{
+	char magic[4];          // "CHNK"
+	uint32_t sample_count;
+	uint32_t event_count;
+	uint32_t reserved;
+	uint64_t first_step;
+	uint64_t last_step;
+	double t_begin;         // first_step*dt
+	double t_end;           // last_step*dt (steps of the events for a chunk without samples)
+	uint64_t size;          // bytes of the chunk, header included
+	// followed by uint64_t offsets[column_count+2] from the beginning of the chunk:
+	//  column k is in [offsets[k], offsets[k+1]), events in [offsets[column_count], offsets[column_count+1])
+};
+
+static_assert(sizeof(telemetry_file_header)==32, "telemetry_file_header must not be padded");
+static_assert(sizeof(telemetry_chunk_header)==56, "telemetry_chunk_header must not be padded");
+
+// ****************************************** //
+// Writer
+// ****************************************** //
+
+struct telemetry_writer_options
+{
+	uint32_t chunk_samples = 1024; // samples per chunk
+	size_t chunk_bytes = 4 << 20;  // limit of the raw values of a chunk: fewer samples per chunk for large tables
+	size_t queue_depth = 8;        // raw chunks in flight between the simulation and the writer thread
+};
+
+class telemetry_writer
+{
+public:
+	telemetry_writer() = default;
+	~telemetry_writer();
+
+	telemetry_writer(telemetry_writer const&) = delete;
+	telemetry_writer& operator=(telemetry_writer const&) = delete;
+
+	bool open(std::string const& filename, uint32_t body_count, double dt, telemetry_writer_options const& options = telemetry_writer_options());
+	// Flush the last chunk and wait for the writer thread
+	void close();
+	bool is_open() const { return file!=nullptr; }
+
+	// Sample of all the bodies at the given step. Phase changes of the table are recorded as events.
+	void record(uint64_t step, body_table const& bodies);
+	void event(uint64_t step, uint32_t body, telemetry_event_type type);
+
+	uint64_t samples() const { return sample_total; }
+	uint64_t stalls() const { return stall_count; }   // times record() waited for a free buffer
+	bool failed() const { return write_failed; }       // a write failed: the file is truncated (until the next open)
+	uint64_t bytes_written() const { return bytes; }   // valid after close()
+	uint64_t chunks_written() const { return chunks; } // valid after close()
+
+private:
+	struct raw_chunk
+	{
+		uint32_t sample_count = 0;
+		std::vector<uint64_t> steps;
+		std::vector<float> values;              // column-major: values[(column-1)*chunk_samples + sample]
+		std::vector<telemetry_event> events;
+	};
+
+	void submit_current();
+	void writer_loop();
+	void encode(raw_chunk const& chunk, std::vector<uint8_t>& out) const;
+
+	FILE* file = nullptr;
+	uint32_t body_count = 0;
+	double dt = 0;
+	telemetry_writer_options options;
+
+	std::unique_ptr<raw_chunk> current;
+	std::vector<int32_t> previous_phase;
+	uint64_t sample_total = 0;
+	uint64_t stall_count = 0;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable queue_changed;
+	std::deque<std::unique_ptr<raw_chunk>> full;  // waiting to be encoded
+	std::vector<std::unique_ptr<raw_chunk>> free; // recycled buffers
+	bool stop = false;
+	uint64_t bytes = 0;
+	uint64_t chunks = 0;
+	std::atomic<bool> write_failed{false};
+};
+
+// Record the bodies of a mission at its current step, and the start of the orbit phase
+class mission_recorder
+{
+public:
+	explicit mission_recorder(telemetry_writer& writer_arg) : writer(writer_arg) {}
+	void record(mission_state const& state);
+	void reset() { in_orbit = false; } // new launch
+
+private:
+	telemetry_writer& writer;
+	bool in_orbit = false;
+};
+
+// ****************************************** //
+// Reader
+// ****************************************** //
+
+// Read-only view of a telemetry file mapped in memory: columns are decoded straight from the mapping
+class telemetry_reader
+{
+public:
+	telemetry_reader() = default;
+	~telemetry_reader();
+
+	telemetry_reader(telemetry_reader const&) = delete;
+	telemetry_reader& operator=(telemetry_reader const&) = delete;
+
+	// Map the file and index its chunks (a truncated last chunk is ignored)
+	bool open(std::string const& filename);
+	void close();
+
+	telemetry_file_header const& header() const { return *file_header; }
+	size_t chunk_count() const { return chunks.size(); }
+	telemetry_chunk_header const& chunk(size_t k) const { return *chunks[k]; }
+	size_t file_size() const { return size; }
+
+	// First chunk ending at or after time t (chunk_count() if none)
+	size_t find_chunk(double t) const;
+
+	// Decode one column of a chunk, without touching the other columns.
+	//  false if the chunk is corrupt (the values decoded before the error are kept)
+	bool decode_steps(size_t chunk_index, std::vector<uint64_t>& steps) const;
+	bool decode_column(size_t chunk_index, uint32_t column, std::vector<float>& values) const;
+	bool decode_events(size_t chunk_index, std::vector<telemetry_event>& events) const;
+
+	// Samples of one column with a time in [t_begin, t_end]. false if a chunk is corrupt
+	bool read_column(uint32_t column, double t_begin, double t_end, std::vector<double>& times, std::vector<float>& values) const;
+	bool read_events(std::vector<telemetry_event>& events) const;
+
+private:
+	// Bytes of column (column_count: the events) of a chunk, false if its offsets are out of the chunk
+	bool column_range(size_t chunk_index, uint32_t column, uint8_t const*& begin, uint8_t const*& end) const;
+
+	uint8_t const* data = nullptr;
+	size_t size = 0;
+	telemetry_file_header const* file_header = nullptr;
+	std::vector<telemetry_chunk_header const*> chunks;
+#ifdef _WIN32
+	std::vector<uint8_t> buffer; // no mmap: the file is read in memory
+#endif
+};
+
+}
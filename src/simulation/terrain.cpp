@@ -0,0 +1,412 @@
+#include "simulation/terrain.hpp"
+
+#include "simulation/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sim {
+
+static double const infinity = std::numeric_limits<double>::infinity();
+
+// ****************************************** //
+// Quadratics
+// ****************************************** //
+
+static double evaluate(double const* q, double t)
+{
+	return q[0] + t*(q[1] + t*q[2]);
+}
+
+// Real roots of q0 + q1 t + q2 t^2 = 0 in ascending order, returns their number
+static int solve_quadratic(double q0, double q1, double q2, double roots[2])
+{
+	if(q2==0){
+		if(q1==0)
+			return 0;
+		roots[0] = -q0/q1;
+		return 1;
+	}
+	double const discriminant = q1*q1 - 4*q2*q0;
+	if(discriminant<0)
+		return 0;
+	// without the cancellation of -q1 + sqrt(discriminant)
+	double const s = -0.5*(q1 + std::copysign(std::sqrt(discriminant), q1));
+	if(s==0){
+		roots[0] = 0;
+		return 1;
+	}
+	roots[0] = s/q2;
+	roots[1] = q0/s;
+	if(roots[0]>roots[1])
+		std::swap(roots[0], roots[1]);
+	return 2;
+}
+
+// Insertion sort of the few elements of a node (std::sort is meant for larger ranges)
+template <typename T, typename Less>
+static void sort_small(T* begin, int count, Less less)
+{
+	for(int k=1; k<count; ++k){
+		T const x = begin[k];
+		int m = k;
+		for(; m>0 && less(x, begin[m-1]); --m)
+			begin[m] = begin[m-1];
+		begin[m] = x;
+	}
+}
+
+// Smallest interval of [ta,tb] holding the t where lo <= q(t) <= hi (no lower bound without has_lo)
+static bool clip(double const* q, bool has_lo, double lo, double hi, double& ta, double& tb)
+{
+	auto const inside = [&](double t){
+		double const x = evaluate(q, t);
+		return (!has_lo || x>=lo) && x<=hi;
+	};
+	if(ta==tb)
+		return inside(ta);
+
+	// the side of the bounds only changes at the roots
+	double points[6];
+	int count = 0;
+	points[count++] = ta;
+	for(int b=has_lo ? 0 : 1; b<2; ++b){
+		double roots[2];
+		int const k = solve_quadratic(q[0] - (b==0 ? lo : hi), q[1], q[2], roots);
+		for(int m=0; m<k; ++m){
+			if(roots[m]>ta && roots[m]<tb)
+				points[count++] = roots[m];
+		}
+	}
+	points[count++] = tb;
+	sort_small(points, count, [](double a, double b){ return a < b; });
+
+	double first = infinity, last = -infinity;
+	for(int m=0; m+1<count; ++m){
+		if(inside(0.5*(points[m] + points[m+1]))){
+			first = std::min(first, points[m]);
+			last = std::max(last, points[m+1]);
+		}
+	}
+	if(!(first<=last))
+		return false;
+	ta = first;
+	tb = last;
+	return true;
+}
+
+// ****************************************** //
+// Generation
+// ****************************************** //
+
+static uint32_t lattice_hash(int32_t x, int32_t y, uint32_t seed)
+{
+	uint32_t h = seed ^ (static_cast<uint32_t>(x)*0x8da6b343u) ^ (static_cast<uint32_t>(y)*0xd8163841u);
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	h ^= h >> 15;
+	return h;
+}
+
+// Value noise in [-1,1], smoothly interpolated between the integer points
+static float value_noise(float x, float y, uint32_t seed)
+{
+	float const fx = std::floor(x), fy = std::floor(y);
+	int32_t const ix = static_cast<int32_t>(fx), iy = static_cast<int32_t>(fy);
+	float const u = x - fx, v = y - fy;
+	float const su = u*u*(3 - 2*u), sv = v*v*(3 - 2*v);
+	auto const value = [seed](int32_t i, int32_t j){ return static_cast<float>(lattice_hash(i, j, seed))/4294967295.0f*2 - 1; };
+	float const a = value(ix, iy) + su*(value(ix+1, iy) - value(ix, iy));
+	float const b = value(ix, iy+1) + su*(value(ix+1, iy+1) - value(ix, iy+1));
+	return a + sv*(b - a);
+}
+
+static float smoothstep(float x)
+{
+	x = std::min(std::max(x, 0.0f), 1.0f);
+	return x*x*(3 - 2*x);
+}
+
+// Height of the generated terrain at (x,y)
+static float generated_height(terrain_settings const& s, float x, float y)
+{
+	// sum of octaves, normalized to [-1,1]
+	float noise = 0, amplitude = 1, total = 0, frequency = 1/s.feature_size;
+	for(int o=0; o<s.octaves; ++o){
+		noise += amplitude*value_noise(x*frequency, y*frequency, s.seed + static_cast<uint32_t>(o));
+		total += amplitude;
+		amplitude *= 0.5f;
+		frequency *= 2;
+	}
+	noise = total>0 ? noise/total : 0.0f;
+	float const hills = s.relief*std::max(noise - s.sea_level, 0.0f)/(1 - s.sea_level);
+
+	// flat launch area, and the sea along the border of the grid
+	float const r = std::sqrt(x*x + y*y);
+	if(r <= s.flat_radius)
+		return 0.0f;
+	float const rise = smoothstep((r - s.flat_radius)/s.blend);
+	float const edge = smoothstep((s.half_extent - std::max(std::abs(x), std::abs(y)))/s.blend);
+	return hills*rise*edge;
+}
+
+// ****************************************** //
+// Heightfield
+// ****************************************** //
+
+struct heightfield::path
+{
+	double c[9];     // axis k: c[3k] + c[3k+1] tau + c[3k+2] tau^2
+	double t_end;    // end of the query, before the sea level
+};
+
+terrain_query terrain_parabola(vec3 const& p, vec3 const& v, vec3 const& g)
+{
+	return {p, v, -g, std::numeric_limits<float>::infinity()};
+}
+
+terrain_query terrain_segment(vec3 const& a, vec3 const& b, float duration)
+{
+	return {a, (b - a)/duration, vec3(0,0,0), duration};
+}
+
+heightfield::heightfield(terrain_settings const& settings) : current_settings(settings)
+{
+	n = 1;
+	while(n < settings.resolution)
+		n *= 2;
+	cell = 2*settings.half_extent/static_cast<float>(n);
+	x0 = -settings.half_extent;
+	y0 = -settings.half_extent;
+	heights.resize(static_cast<size_t>(n+1)*(n+1));
+	for(int j=0; j<=n; ++j){
+		for(int i=0; i<=n; ++i){
+			float const x = x0 + static_cast<float>(i)*cell;
+			float const y = y0 + static_cast<float>(j)*cell;
+			heights[static_cast<size_t>(j)*(n+1) + i] = settings.relief>0 ? generated_height(settings, x, y) : 0.0f;
+		}
+	}
+	build_quadtree();
+}
+
+void heightfield::build_quadtree()
+{
+	levels.clear();
+	std::vector<range> cells(static_cast<size_t>(n)*n);
+	for(int j=0; j<n; ++j){
+		for(int i=0; i<n; ++i){
+			float const h[4] = {vertex_height(i,j), vertex_height(i+1,j), vertex_height(i,j+1), vertex_height(i+1,j+1)};
+			cells[static_cast<size_t>(j)*n + i] = {*std::min_element(h, h+4), *std::max_element(h, h+4)};
+		}
+	}
+	levels.push_back(std::move(cells));
+	for(int size=n/2; size>=1; size/=2){
+		std::vector<range> const& children = levels.back();
+		std::vector<range> nodes(static_cast<size_t>(size)*size);
+		for(int j=0; j<size; ++j){
+			for(int i=0; i<size; ++i){
+				range r = {std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+				for(int c=0; c<4; ++c){
+					range const& child = children[static_cast<size_t>(2*j + c/2)*(2*size) + 2*i + c%2];
+					r.min = std::min(r.min, child.min);
+					r.max = std::max(r.max, child.max);
+				}
+				nodes[static_cast<size_t>(j)*size + i] = r;
+			}
+		}
+		levels.push_back(std::move(nodes));
+	}
+}
+
+vec3 heightfield::vertex_position(int i, int j) const
+{
+	return {x0 + static_cast<float>(i)*cell, y0 + static_cast<float>(j)*cell, vertex_height(i,j)};
+}
+
+float heightfield::height(float x, float y) const
+{
+	float const fu = (x - x0)/cell, fv = (y - y0)/cell;
+	if(!(fu>=0 && fv>=0 && fu<=n && fv<=n))
+		return 0.0f;
+	int const i = std::min(static_cast<int>(fu), n-1);
+	int const j = std::min(static_cast<int>(fv), n-1);
+	float const u = fu - static_cast<float>(i), v = fv - static_cast<float>(j);
+	float const h00 = vertex_height(i,j);
+	// the two triangles of the cell, split along the diagonal u=v
+	if(u>=v)
+		return h00 + (vertex_height(i+1,j) - h00)*u + (vertex_height(i+1,j+1) - vertex_height(i+1,j))*v;
+	return h00 + (vertex_height(i+1,j+1) - vertex_height(i,j+1))*u + (vertex_height(i,j+1) - h00)*v;
+}
+
+vec3 heightfield::normal(float x, float y) const
+{
+	float const fu = (x - x0)/cell, fv = (y - y0)/cell;
+	if(!(fu>=0 && fv>=0 && fu<=n && fv<=n))
+		return {0,0,1};
+	int const i = std::min(static_cast<int>(fu), n-1);
+	int const j = std::min(static_cast<int>(fv), n-1);
+	float const u = fu - static_cast<float>(i), v = fv - static_cast<float>(j);
+	float du, dv;
+	if(u>=v){
+		du = vertex_height(i+1,j) - vertex_height(i,j);
+		dv = vertex_height(i+1,j+1) - vertex_height(i+1,j);
+	}
+	else{
+		du = vertex_height(i+1,j+1) - vertex_height(i,j+1);
+		dv = vertex_height(i,j+1) - vertex_height(i,j);
+	}
+	vec3 const d(-du/cell, -dv/cell, 1);
+	return d/norm(d);
+}
+
+bool heightfield::node_interval(int level, int i, int j, path const& q, double& ta, double& tb) const
+{
+	// box of the node, a little larger so that the paths along its faces are kept
+	double const size = static_cast<double>(cell)*(1 << level);
+	double const margin = 1e-3*cell;
+	range const& r = levels[level][static_cast<size_t>(j)*(n >> level) + i];
+	double const x_min = x0 + i*size, y_min = y0 + j*size;
+	return clip(q.c, true, x_min - margin, x_min + size + margin, ta, tb)
+		&& clip(q.c+3, true, y_min - margin, y_min + size + margin, ta, tb)
+		&& clip(q.c+6, false, 0, r.max + margin, ta, tb);
+}
+
+bool heightfield::descend(int level, int i, int j, path const& q, double ta, double tb, double& best) const
+{
+	if(level==0)
+		return intersect_cell(i, j, q, best);
+
+	// children front to back: one with an earlier impact cannot start after it
+	struct child
+	{
+		int i, j;
+		double ta, tb;
+	};
+	child children[4];
+	int count = 0;
+	for(int c=0; c<4; ++c){
+		child k = {2*i + c%2, 2*j + c/2, ta, tb};
+		if(node_interval(level-1, k.i, k.j, q, k.ta, k.tb))
+			children[count++] = k;
+	}
+	sort_small(children, count, [](child const& a, child const& b){ return a.ta < b.ta; });
+	bool found = false;
+	for(int c=0; c<count; ++c){
+		if(children[c].ta >= best)
+			break;
+		found = descend(level-1, children[c].i, children[c].j, q, children[c].ta, children[c].tb, best) || found;
+	}
+	return found;
+}
+
+bool heightfield::intersect_cell(int i, int j, path const& q, double& best) const
+{
+	double const h00 = vertex_height(i,j), h10 = vertex_height(i+1,j), h01 = vertex_height(i,j+1), h11 = vertex_height(i+1,j+1);
+	// coordinates of the path in the cell, u and v in [0,1]
+	double const inv = 1.0/cell;
+	double const u[3] = {(q.c[0] - (x0 + static_cast<double>(i)*cell))*inv, q.c[1]*inv, q.c[2]*inv};
+	double const v[3] = {(q.c[3] - (y0 + static_cast<double>(j)*cell))*inv, q.c[4]*inv, q.c[5]*inv};
+	double const e = 1e-6;
+
+	bool found = false;
+	for(int triangle=0; triangle<2; ++triangle){
+		// plane of the triangle: h00 + du u + dv v
+		double const du = triangle==0 ? h10 - h00 : h11 - h01;
+		double const dv = triangle==0 ? h11 - h10 : h01 - h00;
+		// height of the path above the plane
+		double const f[3] = {q.c[6] - h00 - du*u[0] - dv*v[0], q.c[7] - du*u[1] - dv*v[1], q.c[8] - du*u[2] - dv*v[2]};
+		double roots[2];
+		int const k = solve_quadratic(f[0], f[1], f[2], roots);
+		for(int m=0; m<k; ++m){
+			double const t = roots[m];
+			if(t < -e || t > q.t_end || t >= best)
+				continue;
+			double const uu = evaluate(u, t), vv = evaluate(v, t);
+			bool const in_cell = uu>=-e && uu<=1+e && vv>=-e && vv<=1+e;
+			bool const in_triangle = triangle==0 ? uu-vv>=-e : vv-uu>=-e;
+			if(in_cell && in_triangle){
+				best = std::max(t, 0.0);
+				found = true;
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+terrain_impact heightfield::intersect(terrain_query const& query) const
+{
+	path q;
+	vec3 const a = 0.5f*query.a;
+	double const c[9] = {query.p.x, query.v.x, a.x, query.p.y, query.v.y, a.y, query.p.z, query.v.z, a.z};
+	std::copy(c, c+9, q.c);
+
+	// no height is below the sea level: the path ends there at the latest
+	double t_sea = infinity;
+	if(q.c[6] <= 0)
+		t_sea = 0;
+	else{
+		double roots[2];
+		int const k = solve_quadratic(q.c[6], q.c[7], q.c[8], roots);
+		for(int m=k; m-- > 0;){
+			if(roots[m] >= 0)
+				t_sea = roots[m]; // the first positive root, where the path comes down
+		}
+	}
+	q.t_end = std::min<double>(query.t_max, t_sea);
+
+	terrain_impact impact;
+	if(!(q.t_end < infinity))
+		return impact;
+
+	double best = infinity;
+	int const root = static_cast<int>(levels.size()) - 1;
+	double ta = 0, tb = q.t_end;
+	bool found = node_interval(root, 0, 0, q, ta, tb) && descend(root, 0, 0, q, ta, tb, best);
+	if(!found && t_sea <= query.t_max){
+		// on the sea, or on the launch area along an edge of the cells
+		best = t_sea;
+		found = true;
+	}
+	if(!found)
+		return impact;
+
+	impact.t = static_cast<float>(best);
+	impact.p = vec3(static_cast<float>(evaluate(q.c, best)), static_cast<float>(evaluate(q.c+3, best)), 0);
+	impact.p.z = height(impact.p.x, impact.p.y);
+	impact.normal = normal(impact.p.x, impact.p.y);
+	return impact;
+}
+
+heightfield const& launch_site_terrain()
+{
+	static heightfield const terrain;
+	return terrain;
+}
+
+heightfield const& flat_terrain()
+{
+	static heightfield const terrain = [](){
+		terrain_settings flat;
+		flat.resolution = 1;
+		flat.relief = 0;
+		return heightfield(flat);
+	}();
+	return terrain;
+}
+
+void terrain_intersect(heightfield const& terrain, terrain_query const* queries, terrain_impact* impacts, size_t count, thread_pool* pool)
+{
+	size_t const grain = 4096;
+	auto const body = [&](size_t begin, size_t end){
+		for(size_t k=begin; k<end; ++k)
+			impacts[k] = terrain.intersect(queries[k]);
+	};
+	if(pool!=nullptr && count>grain)
+		pool->parallel_for(count, grain, body);
+	else
+		body(0, count);
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+Terrain of the launch site: heightfield around the pad, and continuous collision of the falling
+bodies with it.
+ - heightfield: (n+1)^2 heights on a square grid centered on the pad, each cell split in two
+   triangles along its diagonal (the surface drawn by the scene). The launch area (pads of the
+   fleet included) is flat at z=0, the hills rise around it, the sea fills the rest at z=0: no
+   height is below 0, and the plane z=0 continues the terrain outside the grid
+ - min/max quadtree: the lowest and highest height of each block of 2^l x 2^l cells, level 0
+   being the cells and the last level the whole grid
+ - queries: path p(tau) = p + v tau + a tau^2/2 over [0,t_max], parabola of a falling body (a=-g),
+   ray or segment (a=0). The quadtree is descended front to back, each node clipping the interval
+   of tau where the path can be inside its box (the path is quadratic on every axis: the bounds
+   are roots of quadratics). In a cell, the height of the path above the plane of a triangle is a
+   quadratic in tau as well: the impact time is its first root inside the triangle, exact
+   whatever the length of the step that asked for it
+*/
+
+#include "simulation/sim_math.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace sim {
+
+class thread_pool;
+
+struct terrain_settings
+{
+	float half_extent = 256.0f;  // the grid covers [-half_extent, half_extent]^2
+	int resolution = 256;        // cells per side, a power of two
+	float relief = 120.0f;       // height scale of the hills
+	float feature_size = 160.0f; // wavelength of the largest hills
+	int octaves = 5;
+	float sea_level = 0.1f;      // fraction of the noise under the sea
+	float flat_radius = 100.0f;  // launch area at z=0, around the pad and the pads of the fleet
+	float blend = 60.0f;         // distance over which the hills rise from the launch area
+	uint32_t seed = 1976;
+};
+
+// Path of a query: p(tau) = p + v*tau + 0.5*a*tau^2, tau in [0,t_max] (t_max infinite: down to
+// the sea level, the path must come down to it)
+struct terrain_query
+{
+	vec3 p;
+	vec3 v;
+	vec3 a;
+	float t_max = 0;
+};
+
+struct terrain_impact
+{
+	float t = std::numeric_limits<float>::infinity(); // tau of the impact, infinity if none
+	vec3 p;          // point of the surface
+	vec3 normal;
+	bool hit() const { return t < std::numeric_limits<float>::infinity(); }
+};
+
+// Parabola of a body falling from (p,v) under the uniform gravity, down to the sea level (g points
+// up, as in mission_parameters: the acceleration is -g)
+terrain_query terrain_parabola(vec3 const& p, vec3 const& v, vec3 const& g);
+// Straight path from a to b, tau in [0,duration]
+terrain_query terrain_segment(vec3 const& a, vec3 const& b, float duration);
+
+class heightfield
+{
+public:
+	explicit heightfield(terrain_settings const& settings = terrain_settings());
+
+	terrain_settings const& settings() const { return current_settings; }
+	int resolution() const { return n; }
+	float cell_size() const { return cell; }
+	float min_height() const { return levels.back()[0].min; }
+	float max_height() const { return levels.back()[0].max; }
+
+	// Height of the vertex (i,j), i along x, j along y, in [0,resolution]
+	float vertex_height(int i, int j) const { return heights[static_cast<size_t>(j)*(n+1) + i]; }
+	vec3 vertex_position(int i, int j) const;
+	// Height of the surface at (x,y) (0 outside the grid), and its normal
+	float height(float x, float y) const;
+	vec3 normal(float x, float y) const;
+
+	// First impact of the path with the surface
+	terrain_impact intersect(terrain_query const& query) const;
+
+private:
+	struct range
+	{
+		float min;
+		float max;
+	};
+
+	struct path; // coefficients of the query, in double
+
+	void build_quadtree();
+	bool node_interval(int level, int i, int j, path const& q, double& ta, double& tb) const;
+	bool descend(int level, int i, int j, path const& q, double ta, double tb, double& best) const;
+	bool intersect_cell(int i, int j, path const& q, double& best) const;
+
+	terrain_settings current_settings;
+	int n = 1;
+	float cell = 1.0f;
+	float x0 = 0, y0 = 0; // corner of the grid
+	std::vector<float> heights;
+	std::vector<std::vector<range>> levels; // min/max quadtree, levels[0] the cells
+};
+
+// Terrain of the launch site (default settings), and the plane z=0, built once
+heightfield const& launch_site_terrain();
+heightfield const& flat_terrain();
+
+// Batched queries, split over the pool when there are enough of them
+void terrain_intersect(heightfield const& terrain, terrain_query const* queries, terrain_impact* impacts, size_t count, thread_pool* pool = nullptr);
+
+}
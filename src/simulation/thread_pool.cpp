@@ -0,0 +1,129 @@
+#include "simulation/thread_pool.hpp"
+
+#include <algorithm>
+
+namespace sim {
+
+thread_pool::thread_pool(unsigned int thread_count)
+	: queued(0), steals(0)
+{
+	if(thread_count==0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	// the calling thread also works, so only thread_count-1 threads are created
+	for(unsigned int k=0; k<thread_count; ++k)
+		queues.push_back(std::unique_ptr<task_queue>(new task_queue()));
+	for(unsigned int k=0; k+1<thread_count; ++k)
+		workers.push_back(std::thread(&thread_pool::worker_loop, this, k));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stop = true;
+	}
+	wake_up.notify_all();
+	for(std::thread& worker : workers)
+		worker.join();
+}
+
+bool thread_pool::pop_task(size_t index, task& t)
+{
+	// own queue, last in first out (the chunk most likely to be in cache)
+	{
+		task_queue& own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.tasks.empty()){
+			t = own.tasks.back();
+			own.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// steal from the other queues, first in first out
+	size_t const n = queues.size();
+	for(size_t k=1; k<n; ++k){
+		task_queue& victim = *queues[(index+k)%n];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(!victim.tasks.empty()){
+			t = victim.tasks.front();
+			victim.tasks.pop_front();
+			queued--;
+			steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void thread_pool::run_task(task const& t)
+{
+	(*t.body)(t.begin, t.end);
+	// the batch may be gone as soon as its count reaches 0: only the pool is touched afterwards
+	if(--t.owner->pending==0){
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		all_done.notify_all();
+	}
+}
+
+void thread_pool::worker_loop(size_t index)
+{
+	for(;;){
+		task t;
+		if(pop_task(index, t)){
+			run_task(t);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		wake_up.wait(lock, [this](){ return stop || queued.load()>0; });
+		if(stop)
+			return;
+	}
+}
+
+void thread_pool::parallel_for(size_t count, size_t grain, std::function<void(size_t,size_t)> const& body)
+{
+	if(count==0)
+		return;
+	grain = std::max<size_t>(grain, 1);
+
+	// spread the chunks over the queues, consecutive chunks on the same queue
+	size_t const chunk_count = (count+grain-1)/grain;
+	size_t const n = queues.size();
+	batch calls;
+	calls.pending = chunk_count;
+	queued += chunk_count;
+	for(size_t q=0; q<n; ++q){
+		size_t const first = chunk_count*q/n;
+		size_t const last = chunk_count*(q+1)/n;
+		std::lock_guard<std::mutex> lock(queues[q]->mutex);
+		for(size_t c=first; c<last; ++c){
+			task t;
+			t.body = &body;
+			t.owner = &calls;
+			t.begin = c*grain;
+			t.end = std::min(count, (c+1)*grain);
+			queues[q]->tasks.push_back(t);
+		}
+	}
+	{
+		// taking the lock makes sure no worker is between its check and its wait
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	wake_up.notify_all();
+
+	// the calling thread works on the last queue (and steals, possibly the tasks of other calls)
+	//  until the queues are empty, then waits for its chunks still running on other threads
+	size_t const caller = n-1;
+	task t;
+	while(calls.pending.load()>0 && pop_task(caller, t))
+		run_task(t);
+
+	std::unique_lock<std::mutex> lock(sleep_mutex);
+	all_done.wait(lock, [&calls](){ return calls.pending.load()==0; });
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+Work-stealing thread pool used by the headless tools (Monte Carlo, optimization, ...) and the
+propagation of the satellite constellations.
+Each worker owns a queue of tasks: it pops its own tasks from the back and, once it is empty,
+steals from the front of the other queues. parallel_for() splits a range in chunks, spreads
+them over the queues and waits for all of them, the calling thread helping in the meantime.
+Each call counts its own chunks: calls from several threads may run at once, and a task may
+call parallel_for itself (its thread runs the queued tasks until its own chunks are done).
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+class thread_pool
+{
+public:
+	// thread_count = 0 uses all the hardware threads
+	explicit thread_pool(unsigned int thread_count = 0);
+	~thread_pool();
+
+	thread_pool(thread_pool const&) = delete;
+	thread_pool& operator=(thread_pool const&) = delete;
+
+	// Number of threads working on a parallel_for (workers + calling thread)
+	unsigned int size() const { return static_cast<unsigned int>(workers.size())+1; }
+
+	// Call body(begin,end) on chunks of at most grain elements covering [0,count), and wait for all of them.
+	//  body can be called concurrently from any thread of the pool. Reentrant, see above.
+	void parallel_for(size_t count, size_t grain, std::function<void(size_t,size_t)> const& body);
+
+	// Number of tasks executed by another thread than the one they were queued on
+	size_t steal_count() const { return steals.load(); }
+
+private:
+	// chunks of one parallel_for not finished yet, on the stack of its caller
+	struct batch
+	{
+		std::atomic<size_t> pending{0};
+	};
+
+	struct task
+	{
+		std::function<void(size_t,size_t)> const* body;
+		batch* owner;
+		size_t begin;
+		size_t end;
+	};
+
+	struct task_queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	void worker_loop(size_t index);
+	bool pop_task(size_t index, task& t);   // own queue first, then steal
+	void run_task(task const& t);
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<task_queue>> queues; // one per worker + one for the calling thread
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;     // new tasks or stop
+	std::condition_variable all_done;    // the pending count of a batch reached 0
+	std::atomic<size_t> queued;          // tasks waiting in the queues
+	std::atomic<size_t> steals;
+	bool stop = false;
+};
+
+}
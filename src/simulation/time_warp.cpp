@@ -0,0 +1,67 @@
+#include "simulation/time_warp.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sim {
+
+char const* time_warp_mode_name(time_warp_mode mode)
+{
+	switch(mode){
+	case time_warp_mode::timeline: return "timeline";
+	case time_warp_mode::stepped: return "stepped";
+	case time_warp_mode::on_rails: return "on rails";
+	}
+	return "?";
+}
+
+char const* time_warp_limit_name(time_warp_limit limit)
+{
+	switch(limit){
+	case time_warp_limit::none: return "none";
+	case time_warp_limit::event: return "next event";
+	case time_warp_limit::budget: return "CPU budget";
+	}
+	return "?";
+}
+
+double mission_next_event(mission_state const& state, mission_parameters const& parameters)
+{
+	// in orbit, the stages are not moved anymore: no event left
+	if(state.radius_set)
+		return std::numeric_limits<double>::infinity();
+	double const t = state.t;
+	double const t_orbit = parameters.t_satellite_orbit_start;
+	double next = t_orbit;
+
+	body_table const& b = state.bodies;
+	for(size_t k=0; k<b.size(); ++k){
+		if(b.phase[k]==body_attached && std::isfinite(b.t_separation[k]))
+			next = std::min(next, std::max<double>(b.t_separation[k], t));
+		else if(b.phase[k]==body_ballistic && k<mission_body_count){
+			// impact on the terrain: predicted at the separation by the scripted model, from the
+			// parabola of the current state for the dynamic one
+			terrain_impact impact = state.impacts[k];
+			if(!impact.hit()){
+				impact = mission_terrain(parameters).intersect(terrain_parabola(b.position(k), b.velocity(k), parameters.g));
+				impact.t += state.t;
+			}
+			if(impact.hit())
+				next = std::min<double>(next, std::max<double>(impact.t, t));
+		}
+	}
+	return next;
+}
+
+float time_warp_allowed(float requested, double t, double t_event, time_warp_settings const& settings)
+{
+	float const warp = std::min(requested, settings.max_warp);
+	if(!std::isfinite(t_event))
+		return warp;
+	// the event stays event_lead of wall time away at least, down to the warps of the timeline
+	double const limit = std::max<double>(settings.timeline_max, (t_event - t)/settings.event_lead);
+	return static_cast<float>(std::min<double>(warp, limit));
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/**
+Time warp of the simulation thread, up to 10000x.
+Up to timeline_max, the thread samples the precomputed timeline (timeline.hpp) as before. Above,
+or while the telemetry is recorded, it advances its own mission with the exact fixed steps:
+ - stepped: powered flight and falling stages, as many steps per tick as the CPU budget of the
+   tick allows (the clock is read every budget_check steps). When the budget runs out, the mission
+   time stops where the steps got and the achieved warp is lower than the requested one
+ - on rails: once the satellite is in orbit nothing else moves (mission_on_rails), the mission
+   jumps to the step of the tick in O(1) whatever the warp (mission_jump)
+Before each scheduled event (separations, orbit start, landing of a falling stage, see
+mission_next_event), the warp is lowered so that the event is event_lead seconds of wall time
+away at least, down to timeline_max: the events are shown at the speeds of the timeline, and as
+the mission is stepped (not jumped) until the orbit start, none is ever skipped.
+*/
+
+#include "simulation/mission.hpp"
+
+#include <cstdint>
+
+namespace sim {
+
+struct time_warp_settings
+{
+	float max_warp = 10000.0f;
+	float timeline_max = 3.0f;      // sampled from the timeline up to this warp
+	float timeline_horizon = 600.0f; // s of mission time, the timeline is not computed past it
+	double step_budget = 0.5;       // fraction of the tick spent stepping the mission
+	int budget_check = 16;          // steps between two reads of the clock
+	double event_lead = 0.5;        // s of wall time before an event at most
+};
+
+enum class time_warp_mode { timeline, stepped, on_rails };
+enum class time_warp_limit { none, event, budget };
+
+char const* time_warp_mode_name(time_warp_mode mode);
+char const* time_warp_limit_name(time_warp_limit limit);
+
+struct time_warp_statistics
+{
+	float requested = 1;
+	float allowed = 1;      // after the event limit
+	float achieved = 1;     // mission time over wall time, averaged over ~100 ticks
+	time_warp_mode mode = time_warp_mode::timeline;
+	time_warp_limit limit = time_warp_limit::none;
+	float next_event = 0;   // mission time of the next scheduled event, infinity if none
+	uint32_t steps = 0;     // mission steps of the last tick
+	uint64_t jumps = 0;     // on rails, since the start
+};
+
+// Time of the next event of the mission after state.t (separation, orbit start, landing of a
+// falling stage on the terrain before the orbit start), infinity if none. The landings of the
+// dynamic model are predicted under uniform gravity, earlier than under its own gravity
+double mission_next_event(mission_state const& state, mission_parameters const& parameters);
+
+// Warp allowed at mission time t with the next event at t_event
+float time_warp_allowed(float requested, double t, double t_event, time_warp_settings const& settings);
+
+}
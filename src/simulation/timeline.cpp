@@ -0,0 +1,420 @@
+#include "simulation/timeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sim {
+
+char const* mission_event_name(mission_event_type type)
+{
+	switch(type){
+	case mission_event_type::separation: return "separation";
+	case mission_event_type::landing: return "landing";
+	case mission_event_type::orbit_start: return "orbit start";
+	default: return "phase change";
+	}
+}
+
+static bool same(vec3 const& a, vec3 const& b)
+{
+	return a.x==b.x && a.y==b.y && a.z==b.z;
+}
+
+static bool same(engine_parameters const& a, engine_parameters const& b)
+{
+	return a.dry_mass==b.dry_mass && a.propellant_mass==b.propellant_mass && a.thrust==b.thrust && a.mass_flow==b.mass_flow;
+}
+
+static bool same(vehicle_parameters const& a, vehicle_parameters const& b)
+{
+	return same(a.first_stage, b.first_stage) && same(a.second_stage, b.second_stage) && same(a.upper_stage, b.upper_stage)
+		&& a.drag_area==b.drag_area && a.air_density_sea_level==b.air_density_sea_level && a.atmosphere_scale_height==b.atmosphere_scale_height
+		&& a.atmosphere==b.atmosphere;
+}
+
+static bool same(integration_settings const& a, integration_settings const& b)
+{
+	rk45_options const& x = a.ascent;
+	rk45_options const& y = b.ascent;
+	return x.rtol==y.rtol && x.atol==y.atol && x.h_initial==y.h_initial && x.h_min==y.h_min && x.h_max==y.h_max
+		&& a.coast==b.coast && a.coast_step==b.coast_step && a.orbit==b.orbit && a.orbit_step==b.orbit_step;
+}
+
+float mission_divergence_time(mission_parameters const& a, mission_parameters const& b)
+{
+	float const never = std::numeric_limits<float>::infinity();
+	// everything from the launch
+	if(a.model!=b.model || a.dt!=b.dt || !same(a.rocket_p0, b.rocket_p0) || !same(a.rocket_v0, b.rocket_v0))
+		return 0.0f;
+	bool const dynamic = a.model==flight_model::dynamic;
+	if(dynamic && (!same(a.g, b.g) || a.earth_radius!=b.earth_radius || !same(a.vehicle, b.vehicle) || !same(a.integration, b.integration)))
+		return 0.0f;
+
+	// otherwise the mission only changes at its events: the earlier of the old and new times
+	float t = never;
+	auto event = [&t](float old_time, float new_time){
+		if(old_time!=new_time)
+			t = std::min(t, std::min(old_time, new_time));
+	};
+	event(a.t_separation_first, b.t_separation_first);
+	event(a.t_separation_second, b.t_separation_second);
+	event(a.t_satellite_orbit_start, b.t_satellite_orbit_start);
+	// scripted: gravity moves the separated stages, the planet and the angular velocity the orbit
+	if(!dynamic && !same(a.g, b.g))
+		t = std::min(t, std::min(a.t_separation_first, a.t_separation_second));
+	if(a.earth_radius!=b.earth_radius || a.orbit_angular_velocity!=b.orbit_angular_velocity)
+		t = std::min(t, a.t_satellite_orbit_start);
+	// dynamic: the pitch program from the earlier of its starts
+	pitch_program const& pa = a.pitch;
+	pitch_program const& pb = b.pitch;
+	if(dynamic && (pa.start_time!=pb.start_time || pa.rate!=pb.rate || pa.max_angle!=pb.max_angle))
+		t = std::min(t, std::min(pa.start_time, pb.start_time));
+	return t;
+}
+
+// ****************************************** //
+// Timeline
+// ****************************************** //
+
+mission_timeline::~mission_timeline()
+{
+	stop_worker();
+}
+
+void mission_timeline::reset(mission_parameters const& parameters, timeline_settings const& settings_arg)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	current = parameters;
+	settings = settings_arg;
+	settings.keyframe_steps = std::max(1u, settings.keyframe_steps);
+	settings.checkpoint_steps = std::max(1u, settings.checkpoint_steps/settings.keyframe_steps)*settings.keyframe_steps;
+	generation++;
+
+	keyframes.clear();
+	extra_keyframes.clear();
+	event_list.clear();
+	checkpoints.resize(1);
+	mission_initialize(checkpoints[0], parameters);
+	stats = timeline_statistics();
+	wake_up.notify_all();
+}
+
+void mission_timeline::set_parameters(mission_parameters const& parameters)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	float const t_divergence = mission_divergence_time(current, parameters);
+	current = parameters;
+	if(checkpoints.empty() || !(t_divergence < std::numeric_limits<float>::infinity()))
+		return;
+
+	// last checkpoint still valid: before the divergence, and the integrators not past it
+	size_t keep = 0;
+	for(size_t c=checkpoints.size(); c-- > 1;){
+		mission_state const& s = checkpoints[c];
+		if(s.t < t_divergence
+			&& (parameters.model!=flight_model::dynamic || s.flight.ascent.t < t_divergence)){
+			keep = c;
+			break;
+		}
+	}
+	mission_state& start = checkpoints[keep];
+	if(keep==0)
+		mission_initialize(start, parameters);
+	else{
+		// separation times are copied in the body table by mission_initialize
+		body_table& b = start.bodies;
+		if(b.phase[body_first_stage]==body_attached)
+			b.t_separation[body_first_stage] = parameters.t_separation_first;
+		if(b.phase[body_second_stage]==body_attached)
+			b.t_separation[body_second_stage] = parameters.t_separation_second;
+	}
+
+	// drop what follows
+	checkpoints.resize(keep+1);
+	uint32_t const step = static_cast<uint32_t>(keep)*settings.checkpoint_steps;
+	size_t const kept_keyframes = step/settings.keyframe_steps;
+	if(kept_keyframes < keyframes.size()){
+		extra_keyframes.resize(keyframes[kept_keyframes].extra_begin);
+		keyframes.resize(kept_keyframes);
+	}
+	event_list.erase(std::remove_if(event_list.begin(), event_list.end(), [step](mission_event const& e){ return e.step > step; }), event_list.end());
+
+	generation++;
+	stats.recomputations++;
+	stats.kept_until = static_cast<float>(static_cast<double>(step)*parameters.dt);
+	wake_up.notify_all();
+}
+
+mission_parameters mission_timeline::parameters() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+
+void mission_timeline::start_worker()
+{
+	if(worker.joinable())
+		return;
+	stopping = false;
+	worker = std::thread(&mission_timeline::worker_loop, this);
+}
+
+void mission_timeline::stop_worker()
+{
+	if(!worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake_up.notify_all();
+	worker.join();
+}
+
+// The two regular keyframes around t must be there
+bool mission_timeline::computed(float t) const
+{
+	double const interval = static_cast<double>(settings.keyframe_steps)*current.dt;
+	return !keyframes.empty() && t>=0 && static_cast<double>(t) < static_cast<double>(keyframes.size()-1)*interval;
+}
+
+mission_timeline::keyframe mission_timeline::make_keyframe(mission_state const& state, mission_parameters const& parameters)
+{
+	keyframe k;
+	k.step = state.step_count;
+	k.in_orbit = mission_in_orbit(state, parameters);
+	k.radius = state.radius;
+	k.rocket_p = state.rocket_p;
+	k.rocket_v = state.rocket_v;
+	for(int b=0; b<mission_body_count; ++b){
+		k.p[b] = state.bodies.position(b);
+		k.v[b] = state.bodies.velocity(b);
+		k.phase[b] = state.bodies.phase[b];
+	}
+	return k;
+}
+
+bool mission_timeline::take_work(chunk& c, mission_state& start, mission_parameters& p)
+{
+	if(checkpoints.empty() || computed(requested))
+		return false;
+	c.generation = generation;
+	c.settings = settings;
+	c.from_checkpoint = checkpoints.size()-1;
+	start = checkpoints.back();
+	p = current;
+	return true;
+}
+
+// One checkpoint interval: keyframes every keyframe_steps, and the two steps around each event
+void mission_timeline::simulate(chunk& c, mission_state& state, mission_parameters const& p)
+{
+	uint32_t const K = c.settings.keyframe_steps;
+	c.regular.clear();
+	c.extra.clear();
+	c.events.clear();
+
+	keyframe previous = make_keyframe(state, p);
+	for(uint32_t n=0; n<c.settings.checkpoint_steps; ++n){
+		if(n%K==0){
+			previous.extra_begin = previous.extra_end = static_cast<uint32_t>(c.extra.size());
+			c.regular.push_back(previous);
+		}
+		mission_step(state, p);
+		keyframe const next = make_keyframe(state, p);
+
+		bool discontinuity = false;
+		for(int b=0; b<mission_body_count; ++b){
+			if(next.phase[b]==previous.phase[b])
+				continue;
+			mission_event_type type = mission_event_type::phase_change;
+			if(next.phase[b]==body_ballistic)
+				type = mission_event_type::separation;
+			else if(next.phase[b]==body_landed)
+				type = mission_event_type::landing;
+			c.events.push_back({state.t, next.step, type, b});
+			discontinuity = true;
+		}
+		if(next.in_orbit!=previous.in_orbit){
+			c.events.push_back({state.t, next.step, mission_event_type::orbit_start, -1});
+			discontinuity = true;
+		}
+		if(discontinuity){
+			// the regular keyframes already hold the steps that fall on them
+			if(previous.step%K!=0 && (c.extra.empty() || c.extra.back().step!=previous.step))
+				c.extra.push_back(previous);
+			if(next.step%K!=0)
+				c.extra.push_back(next);
+			c.regular.back().extra_end = static_cast<uint32_t>(c.extra.size());
+		}
+		previous = next;
+	}
+	c.end = state;
+}
+
+void mission_timeline::merge(chunk& c)
+{
+	size_t const keyframes_per_checkpoint = c.settings.checkpoint_steps/c.settings.keyframe_steps;
+	// parameters changed meanwhile, or the same interval was merged by another thread
+	if(c.generation!=generation || c.from_checkpoint+1!=checkpoints.size() || keyframes.size()!=c.from_checkpoint*keyframes_per_checkpoint)
+		return;
+
+	uint32_t const offset = static_cast<uint32_t>(extra_keyframes.size());
+	for(keyframe k : c.regular){
+		k.extra_begin += offset;
+		k.extra_end += offset;
+		keyframes.push_back(k);
+	}
+	extra_keyframes.insert(extra_keyframes.end(), c.extra.begin(), c.extra.end());
+	event_list.insert(event_list.end(), c.events.begin(), c.events.end());
+	checkpoints.push_back(c.end);
+	stats.steps_computed += c.settings.checkpoint_steps;
+}
+
+void mission_timeline::worker_loop()
+{
+	chunk c;
+	mission_state state;
+	mission_parameters p;
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!stopping){
+		if(!take_work(c, state, p)){
+			wake_up.wait(lock);
+			continue;
+		}
+		lock.unlock();
+		simulate(c, state, p);
+		lock.lock();
+		merge(c);
+	}
+}
+
+void mission_timeline::compute_until(float t)
+{
+	chunk c;
+	mission_state state;
+	mission_parameters p;
+	std::unique_lock<std::mutex> lock(mutex);
+	requested = std::max(requested, t);
+	while(!computed(t) && take_work(c, state, p)){
+		lock.unlock();
+		simulate(c, state, p);
+		lock.lock();
+		merge(c);
+	}
+}
+
+// ****************************************** //
+// Sampling
+// ****************************************** //
+
+bool mission_timeline::sample(float t, mission_state& state)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	float const ahead = std::max(t, 0.0f) + settings.lookahead;
+	if(ahead > requested){
+		requested = ahead;
+		wake_up.notify_all();
+	}
+	if(!computed(t))
+		return false;
+
+	// regular keyframe at or before t, compared with the times of the steps (mission_state::t)
+	double const dt = current.dt;
+	uint32_t const K = settings.keyframe_steps;
+	auto step_time = [dt](uint32_t step){ return static_cast<float>(static_cast<double>(step)*dt); };
+	size_t i = std::min(static_cast<size_t>(static_cast<double>(t)/(K*dt)), keyframes.size()-2);
+	if(i+2 < keyframes.size() && step_time(keyframes[i+1].step) <= t)
+		i++;
+	if(i>0 && step_time(keyframes[i].step) > t)
+		i--;
+
+	// bracketing keyframes, with the extra ones around the events of this interval
+	keyframe const* a = &keyframes[i];
+	keyframe const* b = &keyframes[i+1];
+	for(uint32_t k=keyframes[i].extra_begin; k<keyframes[i].extra_end; ++k){
+		keyframe const& e = extra_keyframes[k];
+		if(step_time(e.step) <= t)
+			a = &e;
+		else{
+			b = &e;
+			break;
+		}
+	}
+
+	// full state of the checkpoint before, then the kinematics at t
+	uint32_t const C = settings.checkpoint_steps;
+	state = checkpoints[a->step/C];
+	body_table& table = state.bodies;
+
+	bool hold = a->in_orbit!=b->in_orbit;
+	for(int k=0; k<mission_body_count; ++k)
+		hold = hold || a->phase[k]!=b->phase[k];
+
+	double const h = static_cast<double>(b->step - a->step)*dt;
+	float const u = hold ? 0.0f : static_cast<float>(std::min(1.0, std::max(0.0, static_cast<double>(t - step_time(a->step))/h)));
+	float const hf = static_cast<float>(h);
+	// cubic Hermite basis and its derivative
+	float const u2 = u*u, u3 = u2*u;
+	float const h00 = 2*u3 - 3*u2 + 1, h10 = u3 - 2*u2 + u, h01 = -2*u3 + 3*u2, h11 = u3 - u2;
+	float const d00 = (6*u2 - 6*u)/hf, d10 = 3*u2 - 4*u + 1, d01 = (-6*u2 + 6*u)/hf, d11 = 3*u2 - 2*u;
+	auto position = [&](vec3 const& p0, vec3 const& v0, vec3 const& p1, vec3 const& v1){
+		return h00*p0 + (h10*hf)*v0 + h01*p1 + (h11*hf)*v1;
+	};
+	auto velocity = [&](vec3 const& p0, vec3 const& v0, vec3 const& p1, vec3 const& v1){
+		return d00*p0 + d10*v0 + d01*p1 + d11*v1;
+	};
+
+	state.t = hold ? step_time(a->step) : t;
+	state.step_count = hold ? a->step : static_cast<unsigned int>(static_cast<double>(t)/dt);
+	// bodies left where they are (e.g. the stack during the orbit phase) keep their velocity
+	bool const rocket_still = same(a->rocket_p, b->rocket_p);
+	state.rocket_p = rocket_still ? a->rocket_p : position(a->rocket_p, a->rocket_v, b->rocket_p, b->rocket_v);
+	state.rocket_v = rocket_still ? a->rocket_v : velocity(a->rocket_p, a->rocket_v, b->rocket_p, b->rocket_v);
+	for(int k=0; k<mission_body_count; ++k){
+		bool const still = same(a->p[k], b->p[k]);
+		table.set_position(k, still ? a->p[k] : position(a->p[k], a->v[k], b->p[k], b->v[k]));
+		table.set_velocity(k, still ? a->v[k] : velocity(a->p[k], a->v[k], b->p[k], b->v[k]));
+		table.phase[k] = a->phase[k];
+	}
+	state.radius_set = a->in_orbit;
+	state.radius = a->radius;
+	if(a->in_orbit){
+		vec3 const p = table.position(body_satellite);
+		state.angle_of_rotation = std::atan2(p.x, p.z + current.earth_radius);
+	}
+	return true;
+}
+
+bool mission_timeline::checkpoint(float t, mission_state& state) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(checkpoints.empty() || t<0)
+		return false;
+	double const interval = static_cast<double>(settings.checkpoint_steps)*current.dt;
+	size_t c = std::min(static_cast<size_t>(static_cast<double>(t)/interval), checkpoints.size()-1);
+	if(c>0 && static_cast<double>(checkpoints[c].step_count)*current.dt > t)
+		c--;
+	state = checkpoints[c];
+	return true;
+}
+
+std::vector<mission_event> mission_timeline::events() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return event_list;
+}
+
+timeline_statistics mission_timeline::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	timeline_statistics s = stats;
+	s.keyframes = keyframes.size() + extra_keyframes.size();
+	s.checkpoints = checkpoints.size();
+	s.events = event_list.size();
+	s.computed_until = keyframes.size()>1 ? static_cast<float>(static_cast<double>((keyframes.size()-1)*settings.keyframe_steps)*current.dt) : 0.0f;
+	return s;
+}
+
+}
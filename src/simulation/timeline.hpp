@@ -0,0 +1,144 @@
+#pragma once
+
+/**
+Mission precomputed as a timeline, so that the scene can seek, pause and rewind.
+The mission is simulated once with its fixed steps and kept as
+ - keyframes: positions and velocities of the rocket and of the bodies every keyframe_steps steps.
+   A time is sampled in O(1): index t/(keyframe_steps*dt), then cubic Hermite interpolation between
+   the two keyframes (exact for the attached and ballistic bodies of the scripted model).
+ - events: separations, landings, orbit start. The steps just before and at each event are kept as
+   extra keyframes of their interval, and the state before an event is held until its step, as the
+   stepped mission does: no interpolation across a discontinuity.
+ - checkpoints: full mission states (integrators included) every checkpoint_steps steps.
+When the parameters change (e.g. t_separation_second), the timeline is kept up to the earliest
+time they can affect, and recomputed from the checkpoint before it. The computation runs by chunks
+of checkpoint_steps steps, on a worker thread that stays lookahead seconds ahead of the sampled
+times, or on the calling thread with compute_until(). A chunk computed with old parameters is dropped.
+*/
+
+#include "simulation/mission.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+enum class mission_event_type { separation, landing, orbit_start, phase_change };
+
+char const* mission_event_name(mission_event_type type);
+
+struct mission_event
+{
+	float t;          // time of the first step in the new state
+	uint32_t step;
+	mission_event_type type;
+	int body;         // mission_body, -1 for the orbit start
+};
+
+struct timeline_settings
+{
+	uint32_t keyframe_steps = 5;      // steps between two keyframes
+	uint32_t checkpoint_steps = 100;  // steps between two full states (multiple of keyframe_steps)
+	float lookahead = 30.0f;          // seconds computed past the last sampled time
+};
+
+struct timeline_statistics
+{
+	size_t keyframes = 0;       // regular and around the events
+	size_t checkpoints = 0;
+	size_t events = 0;
+	float computed_until = 0;   // s
+	uint64_t steps_computed = 0; // since reset, recomputations included
+	unsigned int recomputations = 0; // changes of parameters that dropped a part of the timeline
+	float kept_until = 0;       // time kept by the last change of parameters
+};
+
+// Earliest time at which missions with these parameters can differ (0: from the start, +infinity: never)
+float mission_divergence_time(mission_parameters const& a, mission_parameters const& b);
+
+class mission_timeline
+{
+public:
+	mission_timeline() = default;
+	~mission_timeline();
+
+	mission_timeline(mission_timeline const&) = delete;
+	mission_timeline& operator=(mission_timeline const&) = delete;
+
+	// Drop everything and start again from t=0 with these parameters
+	void reset(mission_parameters const& parameters, timeline_settings const& settings = timeline_settings());
+	// New parameters: the timeline before their divergence time is kept
+	void set_parameters(mission_parameters const& parameters);
+	mission_parameters parameters() const;
+
+	// Worker thread computing the timeline ahead of the sampled times
+	void start_worker();
+	void stop_worker();
+
+	// Compute up to time t on the calling thread
+	void compute_until(float t);
+
+	// Mission state at time t, interpolated: false if t is not computed yet (the worker is asked to).
+	// The fields other than the kinematics (integrators, radius) come from the checkpoint before t
+	bool sample(float t, mission_state& state);
+
+	// Latest full state (a checkpoint) at or before time t, to step the mission exactly from there.
+	// Computes nothing: false if no checkpoint of the current parameters is available
+	bool checkpoint(float t, mission_state& state) const;
+
+	std::vector<mission_event> events() const;
+	timeline_statistics statistics() const;
+
+private:
+	struct keyframe
+	{
+		uint32_t step;
+		bool in_orbit;
+		float radius;             // of the orbit, once in orbit
+		vec3 rocket_p, rocket_v;
+		vec3 p[mission_body_count];
+		vec3 v[mission_body_count];
+		int32_t phase[mission_body_count];
+		// extra keyframes (around the events) until the next regular keyframe
+		uint32_t extra_begin = 0, extra_end = 0;
+	};
+
+	// Result of the simulation of one checkpoint interval
+	struct chunk
+	{
+		uint64_t generation;
+		timeline_settings settings;
+		size_t from_checkpoint;
+		std::vector<keyframe> regular;
+		std::vector<keyframe> extra;
+		std::vector<mission_event> events;
+		mission_state end;
+	};
+
+	static keyframe make_keyframe(mission_state const& state, mission_parameters const& parameters);
+	bool computed(float t) const;
+	bool take_work(chunk& c, mission_state& start, mission_parameters& p); // under the lock
+	static void simulate(chunk& c, mission_state& state, mission_parameters const& p);
+	void merge(chunk& c);  // under the lock
+	void worker_loop();
+
+	mutable std::mutex mutex;
+	std::condition_variable wake_up;
+	std::thread worker;
+	bool stopping = false;
+
+	mission_parameters current;
+	timeline_settings settings;
+	uint64_t generation = 0;     // changed with the parameters: the chunks in progress are dropped
+	std::vector<keyframe> keyframes;  // regular: keyframes[i] at step i*keyframe_steps
+	std::vector<keyframe> extra_keyframes;
+	std::vector<mission_state> checkpoints; // checkpoints[c] at step c*checkpoint_steps
+	std::vector<mission_event> event_list;
+	float requested = 0;         // compute up to this time
+	timeline_statistics stats;
+};
+
+}
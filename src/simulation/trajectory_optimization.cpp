@@ -0,0 +1,384 @@
+#include "simulation/trajectory_optimization.hpp"
+
+#include "simulation/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace sim {
+
+char const* trajectory_variable_name(int variable)
+{
+	switch(variable){
+	case variable_t_separation_first: return "t_separation_first";
+	case variable_t_separation_second: return "t_separation_second";
+	case variable_t_satellite_orbit_start: return "t_satellite_orbit_start";
+	case variable_ascent_speed: return "ascent_speed";
+	case variable_ascent_tilt: return "ascent_tilt";
+	case variable_pitch_start: return "pitch_start";
+	case variable_pitch_rate: return "pitch_rate";
+	default: return "unknown";
+	}
+}
+
+void trajectory_default_variables(trajectory_problem& problem)
+{
+	bool const dynamic = problem.nominal.model==flight_model::dynamic;
+	// the dynamic model starts at rest: only the direction of rocket_v0 matters
+	problem.bounds[variable_ascent_speed].enabled = !dynamic;
+	problem.bounds[variable_ascent_tilt].enabled = dynamic;
+	problem.bounds[variable_pitch_start].enabled = dynamic;
+	problem.bounds[variable_pitch_rate].enabled = dynamic;
+}
+
+size_t trajectory_dimension(trajectory_problem const& problem)
+{
+	size_t n = 0;
+	for(variable_bounds const& b : problem.bounds)
+		n += b.enabled ? 1 : 0;
+	return n;
+}
+
+// Values of the variables in the nominal mission
+static void nominal_values(mission_parameters const& p, float values[trajectory_variable_count])
+{
+	vec3 const v = p.rocket_v0;
+	values[variable_t_separation_first] = p.t_separation_first;
+	values[variable_t_separation_second] = p.t_separation_second;
+	values[variable_t_satellite_orbit_start] = p.t_satellite_orbit_start;
+	values[variable_ascent_speed] = norm(v);
+	values[variable_ascent_tilt] = std::atan2(std::sqrt(v.x*v.x + v.y*v.y), v.z);
+	values[variable_pitch_start] = p.pitch.start_time;
+	values[variable_pitch_rate] = p.pitch.rate;
+}
+
+point trajectory_nominal_point(trajectory_problem const& problem)
+{
+	float values[trajectory_variable_count];
+	nominal_values(problem.nominal, values);
+	point x;
+	for(int k=0; k<trajectory_variable_count; ++k){
+		variable_bounds const& b = problem.bounds[k];
+		if(b.enabled)
+			x.push_back(std::min(1.0, std::max(0.0, static_cast<double>((values[k]-b.low)/(b.high-b.low)))));
+	}
+	return x;
+}
+
+// Values given to the mission by a point, clamped to the bounds
+static void point_values(trajectory_problem const& problem, point const& x, float values[trajectory_variable_count])
+{
+	nominal_values(problem.nominal, values);
+	size_t i = 0;
+	for(int k=0; k<trajectory_variable_count; ++k){
+		variable_bounds const& b = problem.bounds[k];
+		if(!b.enabled)
+			continue;
+		double const u = std::min(1.0, std::max(0.0, x[i++]));
+		values[k] = static_cast<float>(b.low + u*(b.high - b.low));
+	}
+}
+
+static double bound_violation(point const& x)
+{
+	double v = 0;
+	for(double u : x)
+		v += std::max(0.0, -u) + std::max(0.0, u-1);
+	return v;
+}
+
+mission_parameters trajectory_parameters(trajectory_problem const& problem, point const& x)
+{
+	float values[trajectory_variable_count];
+	point_values(problem, x, values);
+	mission_parameters p = problem.nominal;
+	p.t_separation_first = values[variable_t_separation_first];
+	p.t_separation_second = values[variable_t_separation_second];
+	p.t_satellite_orbit_start = values[variable_t_satellite_orbit_start];
+	if(problem.bounds[variable_ascent_speed].enabled || problem.bounds[variable_ascent_tilt].enabled){
+		// same azimuth as the nominal ascent (+x when vertical)
+		vec3 const v = p.rocket_v0;
+		float const azimuth = v.x!=0 || v.y!=0 ? std::atan2(v.y, v.x) : 0.0f;
+		float const speed = values[variable_ascent_speed];
+		float const tilt = values[variable_ascent_tilt];
+		p.rocket_v0 = speed*vec3(std::sin(tilt)*std::cos(azimuth), std::sin(tilt)*std::sin(azimuth), std::cos(tilt));
+	}
+	p.pitch.start_time = values[variable_pitch_start];
+	p.pitch.rate = values[variable_pitch_rate];
+	return p;
+}
+
+// Objective and constraints of one mission, without the bounds
+static trajectory_evaluation evaluate_mission(trajectory_problem const& problem, mission_parameters const& p, mission_state& state)
+{
+	trajectory_evaluation e;
+	mission_initialize(state, p);
+	while(!state.radius_set)
+		mission_step(state, p);
+	e.altitude = state.radius - p.earth_radius;
+	if(p.model==flight_model::dynamic)
+		e.propellant = static_cast<float>(flight_propellant_burnt(state.flight, p, p.t_satellite_orbit_start));
+
+	double violation = 0;
+	violation += std::max(0.0f, p.t_separation_first + problem.min_stage_gap - p.t_separation_second);
+	violation += std::max(0.0f, p.t_separation_second + problem.min_stage_gap - p.t_satellite_orbit_start);
+	violation += std::max(0.0f, problem.min_altitude - e.altitude);
+	if(e.propellant > problem.max_propellant)
+		violation += e.propellant - problem.max_propellant;
+
+	double const objective = problem.objective==trajectory_objective::max_altitude ? -static_cast<double>(e.altitude) : static_cast<double>(e.propellant);
+	e.fitness = objective + problem.penalty*violation;
+	e.feasible = violation==0;
+	if(!std::isfinite(e.fitness)){
+		e.fitness = 1e6*problem.penalty;
+		e.feasible = false;
+	}
+	return e;
+}
+
+trajectory_evaluation trajectory_evaluate(trajectory_problem const& problem, point const& x, mission_state& state)
+{
+	trajectory_evaluation e = evaluate_mission(problem, trajectory_parameters(problem, x), state);
+	double const outside = bound_violation(x);
+	e.fitness += problem.penalty*outside;
+	e.feasible = e.feasible && outside==0;
+	return e;
+}
+
+bool save_mission_design(std::string const& filename, mission_parameters const& p)
+{
+	std::ofstream out(filename);
+	out.precision(9);
+	out << "model " << (p.model==flight_model::dynamic ? "dynamic" : "scripted") << '\n'
+		<< "t_separation_first " << p.t_separation_first << '\n'
+		<< "t_separation_second " << p.t_separation_second << '\n'
+		<< "t_satellite_orbit_start " << p.t_satellite_orbit_start << '\n'
+		<< "rocket_v0 " << p.rocket_v0.x << ' ' << p.rocket_v0.y << ' ' << p.rocket_v0.z << '\n'
+		<< "pitch " << p.pitch.start_time << ' ' << p.pitch.rate << ' ' << p.pitch.max_angle << '\n';
+	return static_cast<bool>(out);
+}
+
+bool load_mission_design(std::string const& filename, mission_parameters& p)
+{
+	std::ifstream in(filename);
+	if(!in)
+		return false;
+	std::string name;
+	while(in >> name){
+		if(name=="model"){
+			std::string model;
+			in >> model;
+			p.model = model=="dynamic" ? flight_model::dynamic : flight_model::scripted;
+		}
+		else if(name=="t_separation_first")
+			in >> p.t_separation_first;
+		else if(name=="t_separation_second")
+			in >> p.t_separation_second;
+		else if(name=="t_satellite_orbit_start")
+			in >> p.t_satellite_orbit_start;
+		else if(name=="rocket_v0")
+			in >> p.rocket_v0.x >> p.rocket_v0.y >> p.rocket_v0.z;
+		else if(name=="pitch")
+			in >> p.pitch.start_time >> p.pitch.rate >> p.pitch.max_angle;
+		else
+			return false;
+		if(!in)
+			return false;
+	}
+	return true;
+}
+
+// ****************************************** //
+// Search
+// ****************************************** //
+
+trajectory_optimizer::trajectory_optimizer(trajectory_problem const& problem_arg, optimization_settings const& settings_arg)
+	:problem(problem_arg), settings(settings_arg), active(settings_arg.method)
+{
+	point const x0 = trajectory_nominal_point(problem);
+	done = x0.empty();
+	if(active==optimization_method::cma_es){
+		cma_es_options options;
+		options.population = settings.population;
+		options.seed = settings.seed;
+		cma.initialize(x0, settings.sigma, options);
+	}
+	else
+		simplex.initialize(x0, settings.sigma);
+}
+
+trajectory_optimizer::cache_key trajectory_optimizer::key(point const& x) const
+{
+	float values[trajectory_variable_count];
+	point_values(problem, x, values);
+	cache_key k;
+	for(int v=0; v<trajectory_variable_count; ++v)
+		if(problem.bounds[v].enabled)
+			k.push_back(values[v]);
+	return k;
+}
+
+void trajectory_optimizer::evaluate(std::vector<point> const& batch, std::vector<double>& values, thread_pool& pool)
+{
+	// missions not in the cache, once each
+	std::vector<cache_key> keys(batch.size());
+	std::vector<size_t> missing;
+	std::map<cache_key, size_t> pending;
+	for(size_t k=0; k<batch.size(); ++k){
+		keys[k] = key(batch[k]);
+		if(cache.count(keys[k])>0 || pending.count(keys[k])>0){
+			stats.cache_hits++;
+			continue;
+		}
+		pending[keys[k]] = missing.size();
+		missing.push_back(k);
+	}
+
+	std::vector<trajectory_evaluation> results(missing.size());
+	pool.parallel_for(missing.size(), 1, [&](size_t begin, size_t end){
+		mission_state state;
+		for(size_t i=begin; i<end; ++i)
+			results[i] = evaluate_mission(problem, trajectory_parameters(problem, batch[missing[i]]), state);
+	});
+	for(size_t i=0; i<missing.size(); ++i)
+		cache[keys[missing[i]]] = results[i];
+	stats.evaluations += missing.size();
+
+	values.resize(batch.size());
+	for(size_t k=0; k<batch.size(); ++k){
+		// the optimizer sees the way back inside the bounds, the best is the clamped mission simulated
+		trajectory_evaluation const& e = cache[keys[k]];
+		values[k] = e.fitness + problem.penalty*bound_violation(batch[k]);
+		if(!has_best || e.fitness < best_evaluation.fitness){
+			best_evaluation = e;
+			best_x = batch[k];
+			for(double& u : best_x)
+				u = std::min(1.0, std::max(0.0, u));
+			has_best = true;
+		}
+	}
+}
+
+bool trajectory_optimizer::step(thread_pool& pool)
+{
+	if(finished())
+		return false;
+	std::vector<double> values;
+	if(active==optimization_method::cma_es){
+		std::vector<point> const batch = cma.ask();
+		evaluate(batch, values, pool);
+		cma.tell(values);
+	}
+	else{
+		std::vector<point> const batch = simplex.ask();
+		evaluate(batch, values, pool);
+		simplex.tell(values);
+	}
+	stats.generations++;
+
+	if(active==optimization_method::cma_es && cma.converged()){
+		// breakdown of the covariance: Nelder-Mead goes on from the best point, otherwise it polishes it
+		stats.fallback = cma.degenerate();
+		if(stats.fallback || settings.polish){
+			active = optimization_method::nelder_mead;
+			simplex.initialize(best_x, stats.fallback ? settings.sigma : std::max(1e-3, 2*cma.sigma()));
+		}
+		else
+			done = true;
+	}
+	else if(active==optimization_method::nelder_mead && simplex.converged())
+		done = true;
+	return !finished();
+}
+
+// ****************************************** //
+// Checkpoints
+// ****************************************** //
+
+bool trajectory_optimizer::save(std::string const& filename) const
+{
+	// written aside then renamed: an interrupted write leaves the previous checkpoint
+	std::string const temporary = filename + ".tmp";
+	{
+		std::ofstream out(temporary);
+		if(!out)
+			return false;
+		out.precision(17);
+		out << "rocket_optimize 1 " << trajectory_dimension(problem) << ' ' << static_cast<int>(problem.objective) << '\n';
+		out << "state " << static_cast<int>(active) << ' ' << (done ? 1 : 0) << ' ' << stats.generations << ' ' << stats.evaluations << ' '
+			<< stats.cache_hits << ' ' << (stats.fallback ? 1 : 0) << '\n';
+		out << "best " << (has_best ? 1 : 0) << ' ' << best_evaluation.fitness << ' ' << (best_evaluation.feasible ? 1 : 0) << ' '
+			<< best_evaluation.altitude << ' ' << best_evaluation.propellant << ' ' << best_x.size();
+		for(double v : best_x)
+			out << ' ' << v;
+		out << '\n';
+		cma.save(out);
+		simplex.save(out);
+		out << "cache " << cache.size() << '\n';
+		for(auto const& entry : cache){
+			for(float v : entry.first)
+				out << v << ' ';
+			trajectory_evaluation const& e = entry.second;
+			out << e.fitness << ' ' << (e.feasible ? 1 : 0) << ' ' << e.altitude << ' ' << e.propellant << '\n';
+		}
+		if(!out)
+			return false;
+	}
+	return std::rename(temporary.c_str(), filename.c_str())==0;
+}
+
+bool trajectory_optimizer::load(std::string const& filename)
+{
+	std::ifstream in(filename);
+	std::string key_name;
+	int version = 0, objective = 0, method = 0, finished = 0, fallback = 0, best_flag = 0, feasible = 0;
+	size_t dimension = 0, best_size = 0, cache_size = 0;
+	if(!(in >> key_name >> version >> dimension >> objective) || key_name!="rocket_optimize" || version!=1)
+		return false;
+	size_t const n = trajectory_dimension(problem);
+	if(dimension!=n || objective!=static_cast<int>(problem.objective))
+		return false;
+
+	optimization_statistics s;
+	if(!(in >> key_name >> method >> finished >> s.generations >> s.evaluations >> s.cache_hits >> fallback) || key_name!="state")
+		return false;
+	trajectory_evaluation b;
+	if(!(in >> key_name >> best_flag >> b.fitness >> feasible >> b.altitude >> b.propellant >> best_size) || key_name!="best")
+		return false;
+	point x(best_size);
+	for(double& v : x)
+		in >> v;
+	if(!cma.load(in) || !simplex.load(in))
+		return false;
+
+	std::map<cache_key, trajectory_evaluation> entries;
+	if(!(in >> key_name >> cache_size) || key_name!="cache")
+		return false;
+	for(size_t k=0; k<cache_size; ++k){
+		cache_key entry_key(n);
+		for(float& v : entry_key)
+			in >> v;
+		trajectory_evaluation e;
+		int entry_feasible = 0;
+		in >> e.fitness >> entry_feasible >> e.altitude >> e.propellant;
+		e.feasible = entry_feasible!=0;
+		entries[entry_key] = e;
+	}
+	if(!in)
+		return false;
+
+	active = static_cast<optimization_method>(method);
+	done = finished!=0;
+	s.fallback = fallback!=0;
+	stats = s;
+	has_best = best_flag!=0;
+	b.feasible = feasible!=0;
+	best_evaluation = b;
+	best_x = x;
+	cache.swap(entries);
+	return true;
+}
+
+}
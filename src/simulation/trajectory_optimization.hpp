@@ -0,0 +1,156 @@
+#pragma once
+
+/**
+Search of the staging and ascent parameters of a mission (rocket_optimize).
+The design variables (separation times, orbit start, ascent speed and tilt, pitch program) are
+scaled to [0,1] between their bounds, and the mission is simulated headless until the orbit
+insertion, as in the dispersion runs. The objective is to maximize the insertion altitude or to
+minimize the propellant burnt until the insertion (dynamic model), subject to constraints:
+ - bounds: a point outside is clamped before the simulation,
+ - order of the events: min_stage_gap between the separations and before the orbit start,
+ - insertion altitude above min_altitude, propellant below max_propellant.
+The violations are added to the objective as penalties, so that the search is led back to the
+feasible set. Each generation is evaluated on a thread_pool; the evaluations are cached by the
+float values given to the mission (the simulation only sees these), so that the points repeated by
+the clamping, by Nelder-Mead and by a resumed search are not simulated again. The search, its
+best point and the cache can be saved to a checkpoint file after every generation and resumed.
+*/
+
+#include "simulation/mission.hpp"
+#include "simulation/optimizer.hpp"
+
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+class thread_pool;
+
+enum class trajectory_objective { max_altitude, min_propellant };
+
+enum trajectory_variable
+{
+	variable_t_separation_first = 0,
+	variable_t_separation_second,
+	variable_t_satellite_orbit_start,
+	variable_ascent_speed,     // norm of rocket_v0 (scripted ascent)
+	variable_ascent_tilt,      // angle of rocket_v0 from the vertical, towards +x (rad)
+	variable_pitch_start,      // pitch_program::start_time (dynamic model)
+	variable_pitch_rate,       // pitch_program::rate (dynamic model)
+	trajectory_variable_count
+};
+
+char const* trajectory_variable_name(int variable);
+
+struct variable_bounds
+{
+	float low;
+	float high;
+	bool enabled;  // otherwise kept at its nominal value
+};
+
+struct trajectory_problem
+{
+	mission_parameters nominal;
+	trajectory_objective objective = trajectory_objective::max_altitude;
+	variable_bounds bounds[trajectory_variable_count] = {
+		{2.0f, 30.0f, true},   // t_separation_first
+		{3.0f, 35.0f, true},   // t_separation_second
+		{5.0f, 40.0f, true},   // t_satellite_orbit_start
+		{1.0f, 20.0f, false},  // ascent_speed
+		{0.0f, 0.5f, false},   // ascent_tilt
+		{0.0f, 20.0f, false},  // pitch_start
+		{0.0f, 0.1f, false},   // pitch_rate
+	};
+	float min_stage_gap = 0.5f;  // s between two events
+	float min_altitude = 10.0f;
+	float max_propellant = std::numeric_limits<float>::infinity(); // kg
+	double penalty = 1e4;        // per unit of violation (s, scene units, kg, or unit box)
+};
+
+// Variables of the flight model: speed for the scripted model, tilt and pitch program for the dynamic one
+void trajectory_default_variables(trajectory_problem& problem);
+
+struct trajectory_evaluation
+{
+	double fitness = 0;     // objective + penalties, minimized
+	bool feasible = false;
+	float altitude = 0;     // of the orbit insertion
+	float propellant = 0;   // burnt until the insertion, kg
+};
+
+// Number of enabled variables, and the nominal mission in the scaled coordinates
+size_t trajectory_dimension(trajectory_problem const& problem);
+point trajectory_nominal_point(trajectory_problem const& problem);
+
+// Mission of a point (clamped to the bounds)
+mission_parameters trajectory_parameters(trajectory_problem const& problem, point const& x);
+
+// Simulate the mission of a point until its orbit insertion
+trajectory_evaluation trajectory_evaluate(trajectory_problem const& problem, point const& x, mission_state& state);
+
+// Parameters found by a search, as "name value" lines (read by the application with --mission)
+bool save_mission_design(std::string const& filename, mission_parameters const& parameters);
+bool load_mission_design(std::string const& filename, mission_parameters& parameters);
+
+enum class optimization_method { cma_es, nelder_mead };
+
+struct optimization_settings
+{
+	optimization_method method = optimization_method::cma_es;
+	size_t population = 0;     // CMA-ES samples per generation (0: default of the dimension)
+	size_t max_generations = 200; // generations of CMA-ES + iterations of Nelder-Mead
+	uint64_t seed = 1;
+	double sigma = 0.3;        // initial step, in the scaled coordinates
+	bool polish = true;        // Nelder-Mead from the result of CMA-ES
+};
+
+struct optimization_statistics
+{
+	size_t generations = 0;
+	size_t evaluations = 0;    // simulated missions
+	size_t cache_hits = 0;
+	bool fallback = false;     // CMA-ES broke down and Nelder-Mead took over
+};
+
+class trajectory_optimizer
+{
+public:
+	trajectory_optimizer(trajectory_problem const& problem, optimization_settings const& settings);
+
+	// One generation (or iteration) evaluated on the pool. Returns false once the search is over
+	bool step(thread_pool& pool);
+	bool finished() const { return done || stats.generations>=settings.max_generations; }
+	optimization_method method() const { return active; }
+
+	point const& best_point() const { return best_x; }
+	trajectory_evaluation const& best() const { return best_evaluation; }
+	mission_parameters best_parameters() const { return trajectory_parameters(problem, best_x); }
+	optimization_statistics const& statistics() const { return stats; }
+
+	// Checkpoint of the search and of the cache (the problem and settings are given again to resume)
+	bool save(std::string const& filename) const;
+	bool load(std::string const& filename);
+
+private:
+	using cache_key = std::vector<float>;
+	cache_key key(point const& x) const;
+	void evaluate(std::vector<point> const& batch, std::vector<double>& values, thread_pool& pool);
+
+	trajectory_problem problem;
+	optimization_settings settings;
+	optimization_method active;
+	cma_es cma;
+	nelder_mead simplex;
+	bool done = false;   // converged (a resumed search can go on with more generations otherwise)
+
+	std::map<cache_key, trajectory_evaluation> cache;
+	point best_x;
+	trajectory_evaluation best_evaluation;
+	bool has_best = false;
+	optimization_statistics stats;
+};
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+Wait-free triple buffer: one thread writes values, another reads the latest one, neither waits.
+The writer fills its back slot and publishes it by swapping it with the middle slot; the reader
+takes the middle slot in exchange of its front slot when a new value was published there. The
+three slots are never shared, so the values can be copied in and out without locks (a value is
+only skipped when the writer publishes faster than the reader looks).
+*/
+
+#include <atomic>
+
+namespace sim {
+
+template <typename T>
+class triple_buffer
+{
+public:
+	triple_buffer() = default;
+	triple_buffer(triple_buffer const&) = delete;
+	triple_buffer& operator=(triple_buffer const&) = delete;
+
+	// Writer: slot to fill, then publish() it
+	T& write_buffer() { return slots[back]; }
+	void publish() { back = middle.exchange(back | fresh, std::memory_order_acq_rel) & index_mask; }
+
+	// Reader: true if a value was published since the last update, which read_buffer() then returns
+	bool update()
+	{
+		if((middle.load(std::memory_order_relaxed) & fresh)==0)
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+	T const& read_buffer() const { return slots[front]; }
+
+private:
+	static unsigned int const index_mask = 3;
+	static unsigned int const fresh = 4; // set with the index of the middle slot by publish()
+
+	T slots[3];
+	unsigned int back = 0;  // writer only
+	alignas(64) std::atomic<unsigned int> middle{1};
+	alignas(64) unsigned int front = 2; // reader only
+};
+
+}
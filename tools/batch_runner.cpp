@@ -0,0 +1,262 @@
+/**
+Batch runner: simulate N missions back to back without any window, as fast as the CPU allows.
+
+Usage: rocket_batch [--missions N] [--dt seconds] [--duration seconds]
+                    [--model scripted|dynamic] [--rtol r] [--coast method] [--orbit method]
+                    [--coast-step seconds] [--orbit-step seconds]
+                    [--atmosphere us1976|exponential] [--telemetry file]
+       rocket_batch --bodies N [--dt seconds] [--duration seconds] [--telemetry file]
+
+method is rk45, velocity_verlet or yoshida4; --coast-step and --orbit-step are the fixed steps of
+the symplectic methods, independent of --dt. With the dynamic model, the steps, rejected steps
+and function evaluations of the integrator of each phase are reported, with the max-Q of the
+ascent; --atmosphere chooses the density of the air for the drag.
+
+The same engine as the interactive scene is used (simulation/mission.hpp), so the final
+states printed here are identical to the ones reached in the GLFW application.
+With --bodies, N stages are advanced together in one body table with each instruction set
+supported by the CPU (scalar, SSE, AVX2), and the results of the code paths are compared.
+With --telemetry, every step of the first mission (or of all the bodies) is also written to a
+binary telemetry file (simulation/telemetry.hpp), which can be read back with rocket_telemetry.
+*/
+
+#include "simulation/mission.hpp"
+#include "simulation/telemetry.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// FNV-1a hash on the raw bytes of the final states, used to check that runs are bit-identical
+static uint64_t hash_bytes(uint64_t h, void const* data, size_t size)
+{
+	unsigned char const* bytes = static_cast<unsigned char const*>(data);
+	for(size_t k=0; k<size; ++k){
+		h ^= bytes[k];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static uint64_t hash_state(uint64_t h, sim::mission_state const& state)
+{
+	for(int k=0; k<sim::mission_body_count; ++k){
+		sim::vec3 const p = sim::mission_position(state, sim::mission_body(k));
+		h = hash_bytes(h, &p, sizeof(sim::vec3));
+	}
+	return h;
+}
+
+static uint64_t hash_bodies(sim::body_table const& bodies)
+{
+	uint64_t h = 14695981039346656037ull;
+	h = hash_bytes(h, bodies.px.data(), bodies.size()*sizeof(float));
+	h = hash_bytes(h, bodies.py.data(), bodies.size()*sizeof(float));
+	h = hash_bytes(h, bodies.pz.data(), bodies.size()*sizeof(float));
+	h = hash_bytes(h, bodies.phase.data(), bodies.size()*sizeof(int32_t));
+	return h;
+}
+
+static void print_telemetry(sim::telemetry_writer const& writer, int body_count, double elapsed, double flush)
+{
+	double const raw = static_cast<double>(writer.samples())*(body_count*6*sizeof(float) + sizeof(uint64_t));
+	std::cout << "Telemetry: " << writer.samples() << " samples of " << body_count << " bodies in " << elapsed << "s ("
+		<< writer.samples()/elapsed << " samples/sec), " << writer.chunks_written() << " chunks, "
+		<< writer.bytes_written() << " bytes (" << raw/writer.bytes_written() << "x smaller than raw floats), "
+		<< writer.stalls() << " stalls, " << flush << "s to flush at close" << std::endl;
+	if(writer.failed())
+		std::cerr << "Telemetry write failed (disk full?): the file is truncated" << std::endl;
+}
+
+// Advance a table of N stages separating at different times, once per instruction set
+static int run_bodies(int body_count, sim::mission_parameters const& parameters, float duration, std::string const& telemetry)
+{
+	sim::body_table reference;
+	for(int k=0; k<body_count; ++k){
+		// spread the separation times and lateral velocities so that all the phases are exercised
+		float const t_separation = 1.0f + 0.001f*static_cast<float>(k%10000);
+		sim::vec3 const v = parameters.rocket_v0 + sim::vec3(0.01f*static_cast<float>(k%7), -0.01f*static_cast<float>(k%5), 0);
+		reference.add(parameters.rocket_p0, v, t_separation);
+	}
+
+	int const steps = static_cast<int>(duration/parameters.dt);
+	// bytes touched per body and per step: 12 float columns read/written + phase and t_separation read
+	double const bytes_per_body = 2*12*sizeof(float) + 2*sizeof(int32_t) + sizeof(float);
+
+	sim::simd_level const best = sim::body_table_detect_simd();
+	uint64_t scalar_hash = 0;
+	int status = 0;
+	for(sim::simd_level level : {sim::simd_level::scalar, sim::simd_level::sse, sim::simd_level::avx2}){
+		if(static_cast<int>(level) > static_cast<int>(best))
+			break;
+
+		sim::body_table bodies = reference;
+		auto const start = std::chrono::steady_clock::now();
+		for(int n=1; n<=steps; ++n){
+			float const t = static_cast<float>(static_cast<double>(n)*parameters.dt);
+			sim::body_table_advance(bodies, t, parameters.g, level);
+		}
+		auto const end = std::chrono::steady_clock::now();
+		double const elapsed = std::chrono::duration<double>(end-start).count();
+
+		uint64_t const h = hash_bodies(bodies);
+		if(level==sim::simd_level::scalar)
+			scalar_hash = h;
+		double const body_steps = static_cast<double>(body_count)*steps;
+		std::cout << sim::simd_level_name(level) << ": " << body_steps/elapsed << " bodies/sec, "
+			<< body_steps*bytes_per_body/elapsed*1e-9 << " GB/s, checksum " << std::hex << h << std::dec
+			<< (h==scalar_hash ? "" : " (DIFFERS FROM SCALAR)") << std::endl;
+		if(h!=scalar_hash)
+			status = 1;
+	}
+
+	if(!telemetry.empty()){
+		// same run with the best instruction set, logging every step
+		sim::telemetry_writer writer;
+		if(!writer.open(telemetry, static_cast<uint32_t>(body_count), parameters.dt)){
+			std::cerr << "Cannot write " << telemetry << std::endl;
+			return 1;
+		}
+		sim::body_table bodies = reference;
+		auto const start = std::chrono::steady_clock::now();
+		writer.record(0, bodies);
+		for(int n=1; n<=steps; ++n){
+			float const t = static_cast<float>(static_cast<double>(n)*parameters.dt);
+			sim::body_table_advance(bodies, t, parameters.g, best);
+			writer.record(static_cast<uint64_t>(n), bodies);
+		}
+		auto const recorded = std::chrono::steady_clock::now();
+		writer.close();
+		auto const end = std::chrono::steady_clock::now();
+		print_telemetry(writer, body_count, std::chrono::duration<double>(recorded-start).count(), std::chrono::duration<double>(end-recorded).count());
+		if(writer.failed())
+			status = 1;
+	}
+	return status;
+}
+
+static bool parse_integrator(char const* name, sim::integrator_type& type)
+{
+	for(sim::integrator_type t : {sim::integrator_type::rk45, sim::integrator_type::velocity_verlet, sim::integrator_type::yoshida4}){
+		if(std::strcmp(name, sim::integrator_name(t))==0){
+			type = t;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_counters(char const* phase, char const* method, sim::integrator_counters const& c, int missions)
+{
+	std::cout << "  " << phase << " (" << method << "): " << c.steps/missions << " steps, "
+		<< c.rejected/missions << " rejected, " << c.evaluations/missions << " evaluations per mission" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int missions = 10000;
+	int bodies = 0;
+	std::string telemetry;
+	sim::mission_parameters parameters;
+	float duration = parameters.t_satellite_orbit_start + 10.0f;
+
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--missions")==0 && k+1<argc)
+			missions = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--bodies")==0 && k+1<argc)
+			bodies = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--dt")==0 && k+1<argc)
+			parameters.dt = static_cast<float>(std::atof(argv[++k]));
+		else if(std::strcmp(argv[k],"--duration")==0 && k+1<argc)
+			duration = static_cast<float>(std::atof(argv[++k]));
+		else if(std::strcmp(argv[k],"--model")==0 && k+1<argc && (std::strcmp(argv[k+1],"scripted")==0 || std::strcmp(argv[k+1],"dynamic")==0))
+			parameters.model = std::strcmp(argv[++k],"dynamic")==0 ? sim::flight_model::dynamic : sim::flight_model::scripted;
+		else if(std::strcmp(argv[k],"--rtol")==0 && k+1<argc)
+			parameters.integration.ascent.rtol = parameters.integration.ascent.atol = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--telemetry")==0 && k+1<argc)
+			telemetry = argv[++k];
+		else if(std::strcmp(argv[k],"--coast")==0 && k+1<argc && parse_integrator(argv[k+1], parameters.integration.coast))
+			++k;
+		else if(std::strcmp(argv[k],"--orbit")==0 && k+1<argc && parse_integrator(argv[k+1], parameters.integration.orbit))
+			++k;
+		else if(std::strcmp(argv[k],"--coast-step")==0 && k+1<argc)
+			parameters.integration.coast_step = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--orbit-step")==0 && k+1<argc)
+			parameters.integration.orbit_step = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--atmosphere")==0 && k+1<argc && (std::strcmp(argv[k+1],"us1976")==0 || std::strcmp(argv[k+1],"exponential")==0))
+			parameters.vehicle.atmosphere = std::strcmp(argv[++k],"us1976")==0 ? sim::atmosphere_model::us1976 : sim::atmosphere_model::exponential;
+		else{
+			std::cout << "Usage: " << argv[0] << " [--missions N | --bodies N] [--dt seconds] [--duration seconds]"
+				<< " [--model scripted|dynamic] [--rtol r] [--coast method] [--orbit method] [--coast-step seconds] [--orbit-step seconds]"
+				<< " [--atmosphere us1976|exponential] [--telemetry file]" << std::endl;
+			return 1;
+		}
+	}
+
+	if(bodies>0){
+		std::cout << "Advance " << bodies << " bodies for " << duration << "s with dt=" << parameters.dt << "s" << std::endl;
+		return run_bodies(bodies, parameters, duration, telemetry);
+	}
+
+	std::cout << "Run " << missions << " missions of " << duration << "s with dt=" << parameters.dt << "s" << std::endl;
+
+	uint64_t checksum = 14695981039346656037ull;
+	uint64_t total_steps = 0;
+	sim::mission_state state;
+	sim::integrator_counters ascent, coast, orbit;
+
+	sim::telemetry_writer writer;
+	if(!telemetry.empty() && !writer.open(telemetry, sim::mission_body_count, parameters.dt)){
+		std::cerr << "Cannot write " << telemetry << std::endl;
+		return 1;
+	}
+
+	auto const start = std::chrono::steady_clock::now();
+	for(int k=0; k<missions; ++k){
+		sim::mission_initialize(state, parameters);
+		if(k==0 && writer.is_open()){
+			// first mission step by step, to record every state
+			sim::mission_recorder recorder(writer);
+			recorder.record(state);
+			while(static_cast<double>(state.step_count+1)*parameters.dt <= duration){
+				sim::mission_step(state, parameters);
+				recorder.record(state);
+				total_steps++;
+			}
+		}
+		else
+			total_steps += sim::mission_advance_to(state, parameters, duration);
+		checksum = hash_state(checksum, state);
+		ascent += sim::flight_ascent_counters(state.flight);
+		coast += sim::flight_coast_counters(state.flight);
+		orbit += sim::flight_orbit_counters(state.flight);
+	}
+	auto const end = std::chrono::steady_clock::now();
+	double const elapsed = std::chrono::duration<double>(end-start).count();
+
+	if(writer.is_open()){
+		writer.close();
+		std::cout << "First mission written to " << telemetry << " (" << writer.samples() << " samples, " << writer.bytes_written() << " bytes)" << std::endl;
+		if(writer.failed())
+			std::cerr << "Telemetry write failed (disk full?): the file is truncated" << std::endl;
+	}
+
+	sim::vec3 const satellite_p = sim::mission_position(state, sim::body_satellite);
+	std::cout << "Final satellite position: (" << satellite_p.x << ", " << satellite_p.y << ", " << satellite_p.z << "), orbit radius " << state.radius << std::endl;
+	std::cout << "Steps: " << total_steps << " in " << elapsed << "s" << std::endl;
+	std::cout << "Trajectories/sec: " << missions/elapsed << std::endl;
+	std::cout << "Steps/sec: " << total_steps/elapsed << std::endl;
+	std::cout << "Checksum: " << std::hex << checksum << std::dec << std::endl;
+	if(parameters.model==sim::flight_model::dynamic && missions>0){
+		std::cout << "Integrators:" << std::endl;
+		print_counters("ascent", "rk45", ascent, missions);
+		print_counters("coast", sim::integrator_name(parameters.integration.coast), coast, missions);
+		print_counters("orbit", sim::integrator_name(parameters.integration.orbit), orbit, missions);
+		std::cout << "Max-Q: " << state.flight.max_dynamic_pressure << " Pa at " << state.flight.max_dynamic_pressure_time << " s" << std::endl;
+	}
+
+	return writer.failed() ? 1 : 0;
+}
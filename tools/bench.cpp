@@ -0,0 +1,773 @@
+/**
+Benchmark suite: physics step, atmosphere tables, mission timeline, constellation propagation, particles, fleet of
+vehicles, simulation thread, time warp, control thread, terrain collision, shared-memory telemetry, mesh generation and
+headless frame loop.
+
+Usage: rocket_bench [--warmup N] [--repetitions N] [--filter text] [--json file]
+
+Every benchmark runs N warmup samples, then the timed samples; a sample repeats the measured
+operation a fixed number of times and its duration is divided by this count. The median and the
+99th percentile of the samples are printed (ns per operation) and written as JSON, one benchmark
+per line, so that the results of two commits can be compared with diff. The atmosphere benchmarks
+also print the largest relative error of the tables against the formulas of the standard, the
+simulation thread benchmarks the jitter of its 1 kHz loop while it was measured, the control thread
+benchmark the deadline misses and the latency histogram of its own 1 kHz loop, the terrain benchmarks
+the largest difference of the impact times with a fine sampling of the paths.
+shared_telemetry/publish_to_observe is a latency: its samples are the delays between the
+publication of a state and its observation by a reader thread, not durations per operation.
+
+The mesh_primitive_* benchmarks are only built with the VCL library (ROCKET_BENCH_VCL, see
+CMakeLists.txt). "make bench" runs the suite and writes bench.json in the build directory.
+*/
+
+#include "simulation/atmosphere.hpp"
+#include "simulation/body_table.hpp"
+#include "simulation/constellation.hpp"
+#include "simulation/control_thread.hpp"
+#include "simulation/fleet.hpp"
+#include "simulation/mission.hpp"
+#include "simulation/particles.hpp"
+#include "simulation/shared_telemetry.hpp"
+#include "simulation/simulation_thread.hpp"
+#include "simulation/statistics.hpp"
+#include "simulation/terrain.hpp"
+#include "simulation/thread_pool.hpp"
+#include "simulation/timeline.hpp"
+
+#ifdef ROCKET_BENCH_VCL
+#include "vcl/vcl.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct bench_options
+{
+	int warmup = 3;
+	int repetitions = 50;
+	std::string filter; // only the benchmarks whose name contains this text
+};
+
+struct bench_result
+{
+	std::string name;
+	size_t operations; // per sample
+	sim::sample_summary summary; // ns per operation
+};
+
+// Results are accumulated here so that the compiler cannot remove the measured work
+static volatile double sink = 0;
+
+// Print and keep the summary of the samples (ns) of a benchmark
+static void report(std::vector<bench_result>& results, std::string const& name, size_t operations, std::vector<double> const& samples)
+{
+	bench_result r;
+	r.name = name;
+	r.operations = operations;
+	r.summary = sim::summarize(samples);
+	std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+		<< " median " << std::setw(12) << r.summary.p50 << " ns   p99 " << std::setw(12) << r.summary.p99 << " ns" << std::endl;
+	results.push_back(r);
+}
+
+// Time a benchmark: setup() is not timed, body() performs `operations` operations
+template <typename S, typename B>
+static void run(std::vector<bench_result>& results, bench_options const& options, std::string const& name, size_t operations, S setup, B body)
+{
+	if(!options.filter.empty() && name.find(options.filter)==std::string::npos)
+		return;
+
+	std::vector<double> samples;
+	for(int k=0; k<options.warmup+options.repetitions; ++k){
+		setup();
+		auto const start = std::chrono::steady_clock::now();
+		body();
+		auto const stop = std::chrono::steady_clock::now();
+		if(k>=options.warmup)
+			samples.push_back(std::chrono::duration<double, std::nano>(stop-start).count()/static_cast<double>(operations));
+	}
+	report(results, name, operations, samples);
+}
+
+static void run_physics(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::mission_parameters parameters;
+	sim::mission_state state;
+
+	// fixed steps of the launch: both separations and the fall of the stages
+	unsigned int const ascent_steps = static_cast<unsigned int>(parameters.t_satellite_orbit_start/parameters.dt) - 1;
+	run(results, options, "mission_step/scripted_ascent", ascent_steps,
+		[&]{ sim::mission_initialize(state, parameters); },
+		[&]{
+			for(unsigned int k=0; k<ascent_steps; ++k)
+				sim::mission_step(state, parameters);
+			sink = sink + state.bodies.pz[sim::body_first_stage];
+		});
+
+	// satellite position on its orbit
+	unsigned int const orbit_steps = 2000;
+	run(results, options, "mission_step/scripted_orbit", orbit_steps,
+		[&]{
+			sim::mission_initialize(state, parameters);
+			sim::mission_advance_to(state, parameters, parameters.t_satellite_orbit_start);
+		},
+		[&]{
+			for(unsigned int k=0; k<orbit_steps; ++k)
+				sim::mission_step(state, parameters);
+			sink = sink + state.bodies.px[sim::body_satellite];
+		});
+
+	sim::mission_parameters dynamic = parameters;
+	dynamic.model = sim::flight_model::dynamic;
+	run(results, options, "mission_step/dynamic_ascent", ascent_steps,
+		[&]{ sim::mission_initialize(state, dynamic); },
+		[&]{
+			for(unsigned int k=0; k<ascent_steps; ++k)
+				sim::mission_step(state, dynamic);
+			sink = sink + state.bodies.pz[sim::body_first_stage];
+		});
+
+	// stage/separation kernel on a large table, with each instruction set supported by the CPU
+	sim::body_table reference;
+	for(int k=0; k<4096; ++k)
+		reference.add(parameters.rocket_p0, parameters.rocket_v0, 1.0f + 0.005f*static_cast<float>(k%2000));
+	sim::body_table bodies;
+	sim::simd_level const best = sim::body_table_detect_simd();
+	sim::simd_level const levels[] = {sim::simd_level::scalar, sim::simd_level::sse, sim::simd_level::avx2};
+	for(sim::simd_level level : levels){
+		if(level>best)
+			break;
+		unsigned int const evaluations = 100;
+		run(results, options, std::string("body_table_advance/4096/") + sim::simd_level_name(level), evaluations,
+			[&]{ bodies = reference; },
+			[&]{
+				for(unsigned int k=0; k<evaluations; ++k)
+					sim::body_table_advance(bodies, 0.2f*static_cast<float>(k), parameters.g, level);
+				sink = sink + bodies.pz[0];
+			});
+	}
+}
+
+// Standard atmosphere: lookup in the constexpr tables against the formulas they replace
+static void run_atmosphere(std::vector<bench_result>& results, bench_options const& options)
+{
+	// accuracy of the tables every metre up to their top, printed with the benchmark of the tables
+	std::string const table_name = "atmosphere_us1976/table";
+	if(options.filter.empty() || table_name.find(options.filter)!=std::string::npos){
+		double density = 0, pressure = 0, temperature = 0, sound = 0;
+		for(int k=0; k<=static_cast<int>(sim::us1976_top); ++k){
+			float const altitude = static_cast<float>(k);
+			sim::atmosphere_sample const a = sim::us1976(altitude);
+			sim::atmosphere_sample const b = sim::us1976_analytic(altitude);
+			density = std::max(density, std::abs(static_cast<double>(a.density)/b.density - 1));
+			pressure = std::max(pressure, std::abs(static_cast<double>(a.pressure)/b.pressure - 1));
+			temperature = std::max(temperature, std::abs(static_cast<double>(a.temperature)/b.temperature - 1));
+			sound = std::max(sound, std::abs(static_cast<double>(a.speed_of_sound)/b.speed_of_sound - 1));
+		}
+		std::cout << std::scientific << std::setprecision(2) << "US1976 tables, largest relative error: density " << density
+			<< ", pressure " << pressure << ", temperature " << temperature << ", speed of sound " << sound << std::endl;
+	}
+
+	std::vector<float> altitudes(4096);
+	for(size_t k=0; k<altitudes.size(); ++k)
+		altitudes[k] = static_cast<float>((k*7919u)%90000u) + 0.5f;
+	run(results, options, "atmosphere_us1976/table", altitudes.size(), []{},
+		[&]{
+			float sum = 0;
+			for(float h : altitudes){
+				sim::atmosphere_sample const a = sim::us1976(h);
+				sum += a.density + a.pressure + a.speed_of_sound;
+			}
+			sink = sink + sum;
+		});
+	run(results, options, "atmosphere_us1976/density", altitudes.size(), []{},
+		[&]{
+			float sum = 0;
+			for(float h : altitudes)
+				sum += sim::us1976_density(h);
+			sink = sink + sum;
+		});
+	run(results, options, "atmosphere_us1976/analytic", altitudes.size(), []{},
+		[&]{
+			float sum = 0;
+			for(float h : altitudes){
+				sim::atmosphere_sample const a = sim::us1976_analytic(h);
+				sum += a.density + a.pressure + a.speed_of_sound;
+			}
+			sink = sink + sum;
+		});
+	run(results, options, "atmosphere_exponential/density", altitudes.size(), []{},
+		[&]{
+			float sum = 0;
+			for(float h : altitudes)
+				sum += 1.225f*std::exp(-h/8500.0f);
+			sink = sink + sum;
+		});
+}
+
+// Seeking in the mission: timeline lookup against the replay from the launch it replaces
+static void run_timeline(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::mission_parameters parameters;
+	sim::mission_state state;
+	sim::mission_timeline timeline;
+	timeline.reset(parameters);
+	timeline.compute_until(60.0f);
+
+	unsigned int const seeks = 1000;
+	auto seek_time = [](unsigned int k){ return static_cast<float>((k*7919u)%6000u)*0.01f + 0.003f; };
+	run(results, options, "timeline_sample/60s", seeks, []{},
+		[&]{
+			for(unsigned int k=0; k<seeks; ++k)
+				timeline.sample(seek_time(k), state);
+			sink = sink + state.rocket_p.z;
+		});
+	unsigned int const replays = 20;
+	run(results, options, "mission_replay/60s", replays, []{},
+		[&]{
+			for(unsigned int k=0; k<replays; ++k){
+				sim::mission_initialize(state, parameters);
+				sim::mission_advance_to(state, parameters, seek_time(k));
+			}
+			sink = sink + state.rocket_p.z;
+		});
+
+	// edit of the second separation: recomputed from the checkpoint before it
+	run(results, options, "timeline_recompute/separation", 1,
+		[&]{
+			parameters.t_separation_second = parameters.t_separation_second==15.0f ? 14.0f : 15.0f;
+		},
+		[&]{
+			timeline.set_parameters(parameters);
+			timeline.compute_until(60.0f);
+			sink = sink + static_cast<double>(timeline.statistics().computed_until);
+		});
+}
+
+// Positions of a 50k satellites Walker constellation (one epoch: no rebase in the timed part)
+static void run_constellation(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::constellation c;
+	sim::walker_pattern pattern;
+	pattern.satellites = 50000;
+	pattern.planes = 250;
+	sim::constellation_add_walker(c, pattern);
+	c.rebase(0);
+
+	sim::simd_level const best = sim::body_table_detect_simd();
+	sim::simd_level const levels[] = {sim::simd_level::scalar, sim::simd_level::sse, sim::simd_level::avx2};
+	for(sim::simd_level level : levels){
+		if(level>best)
+			break;
+		unsigned int const steps = 10;
+		run(results, options, std::string("constellation_propagate/50000/") + sim::simd_level_name(level), steps,
+			[]{},
+			[&]{
+				for(unsigned int k=0; k<steps; ++k)
+					sim::constellation_propagate(c, 20.0*k, level);
+				sink = sink + c.px[0];
+			});
+	}
+}
+
+// Particle update and back to front vertices of 500k exhaust particles, on one thread and on
+// all of them
+static void run_particles(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::particle_pool reference(500000);
+	sim::random_stream random(1, 0);
+	sim::particle_emitter emitter;
+	emitter.position = {0,0,5};
+	emitter.lifetime = 1e6f; // none dies during the benchmark
+	reference.emit(emitter, reference.capacity(), random);
+	sim::particle_parameters parameters;
+	sim::particle_pool particles;
+	sim::particle_draw_list draw_list;
+	sim::thread_pool pool;
+
+	for(sim::thread_pool* workers : {static_cast<sim::thread_pool*>(nullptr), &pool}){
+		std::string const threads = workers==nullptr ? "/1_thread" : "/pool";
+		unsigned int const frames = 10;
+		run(results, options, "particles_update/500000" + threads, frames,
+			[&]{ particles = reference; },
+			[&]{
+				for(unsigned int k=0; k<frames; ++k)
+					particles.update(1.0f/60, parameters, workers);
+				sink = sink + particles.pz[0];
+			});
+		run(results, options, "particles_draw_list/500000" + threads, frames,
+			[]{},
+			[&]{
+				for(unsigned int k=0; k<frames; ++k)
+					draw_list.build(reference, {10,15,10+static_cast<float>(k)}, {-0.5f,-0.7f,-0.5f}, workers);
+				sink = sink + draw_list.vertices()[0];
+			});
+	}
+}
+
+// Systems of a fleet of 10k vehicles launched from 100 pads, a frame at 60 Hz: the launches, separations,
+// landings and orbit insertions happen in the benchmarked interval
+static void run_fleet(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::mission_parameters parameters;
+	sim::fleet_settings settings;
+	settings.vehicles = 10000;
+	settings.pads = 100;
+	settings.cadence = 0.5f;
+	settings.include_mission = false;
+	sim::fleet vehicles;
+	vehicles.reset(settings, parameters);
+	sim::thread_pool pool;
+
+	for(sim::thread_pool* workers : {static_cast<sim::thread_pool*>(nullptr), &pool}){
+		std::string const threads = workers==nullptr ? "/1_thread" : "/pool";
+		unsigned int const frames = 60;
+		float t = 0;
+		run(results, options, "fleet_update/10000" + threads, frames,
+			[&]{
+				if(t > 90.0f){
+					vehicles.reset(settings, parameters);
+					t = 0;
+				}
+			},
+			[&]{
+				for(unsigned int k=0; k<frames; ++k){
+					t += 1.0f/60;
+					vehicles.update(t, workers);
+				}
+				sink = sink + static_cast<double>(vehicles.statistics().orbiting);
+			});
+		vehicles.reset(settings, parameters);
+	}
+}
+
+// Render side of the simulation thread running at 1 kHz: state of a frame interpolated between the
+// two latest snapshots, and the queue of the commands sent back (time scale, as the slider of the GUI)
+static void run_simulation_thread(std::vector<bench_result>& results, bench_options const& options)
+{
+	std::string const prefix = "simulation_thread/";
+	if(!options.filter.empty() && prefix.find(options.filter)==std::string::npos && options.filter.find(prefix)==std::string::npos)
+		return;
+	sim::mission_parameters parameters;
+	sim::mission_timeline timeline;
+	timeline.reset(parameters);
+	timeline.start_worker();
+	sim::simulation_thread simulation(timeline);
+	simulation.start(parameters);
+
+	sim::mission_state state;
+	float t = 0;
+	unsigned int const frames = 1000;
+	run(results, options, "simulation_thread/interpolate", frames, []{},
+		[&]{
+			for(unsigned int k=0; k<frames; ++k){
+				simulation.interpolate(state, t);
+				sink = sink + state.rocket_p.z;
+			}
+		});
+	// a few hundred ticks for the jitter, the render thread drawing meanwhile
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	// one producer and one consumer, here the same thread: cost of the queue itself
+	sim::command_queue<sim::simulation_command, 64> queue;
+	sim::simulation_command command;
+	command.type = sim::simulation_command_type::time_scale;
+	unsigned int const commands = 64;
+	run(results, options, "simulation_thread/command_push_pop", commands, []{},
+		[&]{
+			for(unsigned int k=0; k<commands; ++k){
+				command.value = static_cast<float>(k);
+				queue.push(command);
+			}
+			sim::simulation_command popped;
+			float sum = 0;
+			while(queue.pop(popped))
+				sum += popped.value;
+			sink = sink + sum;
+		});
+
+	sim::jitter_statistics const jitter = simulation.interpolate(state, t).jitter;
+	std::cout << std::fixed << std::setprecision(3) << "simulation thread at " << 1/simulation.period() << " Hz: " << jitter.ticks << " ticks, period "
+		<< jitter.period_mean << " ms (stddev " << jitter.period_stddev << " ms, max " << jitter.period_max << " ms), "
+		<< jitter.overruns << " overruns" << std::endl;
+	simulation.stop();
+	timeline.stop_worker();
+}
+
+// Time warp: cost of a fixed step of the dynamic model (what the CPU budget of a tick buys), of a jump
+// on rails of 1000 steps (one tick at 10000x) for both models, and the warp the thread achieves
+static void run_time_warp(std::vector<bench_result>& results, bench_options const& options)
+{
+	std::string const prefix = "time_warp/";
+	if(!options.filter.empty() && prefix.find(options.filter)==std::string::npos && options.filter.find(prefix)==std::string::npos)
+		return;
+	sim::mission_parameters parameters;
+	parameters.model = sim::flight_model::dynamic;
+	sim::mission_state ascent;
+	unsigned int const steps = 100;
+	run(results, options, "time_warp/step_dynamic", steps,
+		[&]{ sim::mission_initialize(ascent, parameters); },
+		[&]{
+			for(unsigned int k=0; k<steps; ++k)
+				sim::mission_step(ascent, parameters);
+			sink = sink + ascent.rocket_p.z;
+		});
+
+	for(sim::flight_model const model : {sim::flight_model::scripted, sim::flight_model::dynamic}){
+		parameters.model = model;
+		sim::mission_state orbit;
+		sim::mission_initialize(orbit, parameters);
+		sim::mission_advance_to(orbit, parameters, parameters.t_satellite_orbit_start + 1);
+		unsigned int const jumps = 100;
+		std::string const name = model==sim::flight_model::dynamic ? "time_warp/jump_on_rails_dynamic" : "time_warp/jump_on_rails_scripted";
+		run(results, options, name, jumps, []{},
+			[&]{
+				for(unsigned int k=0; k<jumps; ++k)
+					sim::mission_jump(orbit, parameters, orbit.step_count + 1000);
+				sink = sink + orbit.bodies.px[sim::body_satellite];
+			});
+	}
+
+	// requested 10000x from the launch: slowed down before each event, then on rails
+	parameters.model = sim::flight_model::dynamic;
+	sim::mission_timeline timeline;
+	timeline.reset(parameters);
+	timeline.start_worker();
+	sim::simulation_thread simulation(timeline);
+	simulation.start(parameters);
+	simulation.set_time_scale(10000);
+	sim::mission_state state;
+	float t = 0;
+	auto const start = std::chrono::steady_clock::now();
+	while(simulation.interpolate(state, t).warp.mode!=sim::time_warp_mode::on_rails && std::chrono::steady_clock::now()-start < std::chrono::seconds(10))
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	double const to_orbit = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	sim::simulation_snapshot const& snapshot = simulation.interpolate(state, t);
+	sim::time_warp_statistics const& warp = snapshot.warp;
+	std::cout << std::fixed << std::setprecision(1) << "time warp 10000x requested: orbit start reached after " << to_orbit << " s (3 events), then t=" << t
+		<< " s, achieved " << warp.achieved << "x (" << sim::time_warp_mode_name(warp.mode) << ", " << warp.jumps << " jumps, "
+		<< snapshot.jitter.overruns << " overruns)" << std::endl;
+	simulation.stop();
+	timeline.stop_worker();
+}
+
+// Guidance and control: cost of a control step of the autopilot (the stack during the ascent of the
+// dynamic model), and the timing of the 1 kHz control thread following a running simulation thread
+static void run_control_thread(std::vector<bench_result>& results, bench_options const& options)
+{
+	std::string const prefix = "control_thread/";
+	if(!options.filter.empty() && prefix.find(options.filter)==std::string::npos && options.filter.find(prefix)==std::string::npos)
+		return;
+	sim::mission_parameters parameters;
+	parameters.model = sim::flight_model::dynamic;
+	sim::mission_state ascent;
+	sim::mission_initialize(ascent, parameters);
+	sim::mission_advance_to(ascent, parameters, 2);
+	sim::attitude_input const input = sim::attitude_input_from(ascent, parameters);
+	sim::attitude_settings const settings;
+	sim::attitude_state attitude;
+	unsigned int const steps = 1000;
+	run(results, options, "control_thread/attitude_step", steps,
+		[&]{ sim::attitude_reset(attitude, input, parameters, settings); },
+		[&]{
+			for(unsigned int k=0; k<steps; ++k)
+				sim::attitude_step(attitude, input, parameters, settings, 0.001f);
+			sink = sink + attitude.stack.q.w;
+		});
+
+	// one second of the launch, the control thread pinned to its default core
+	sim::mission_timeline timeline;
+	timeline.reset(parameters);
+	timeline.start_worker();
+	sim::simulation_thread simulation(timeline);
+	simulation.start(parameters);
+	sim::control_thread control(simulation);
+	control.start();
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	sim::control_snapshot const snapshot = control.latest();
+	control.stop();
+	simulation.stop();
+	timeline.stop_worker();
+	sim::control_statistics const& statistics = snapshot.statistics;
+	std::cout << std::fixed << std::setprecision(1) << "control thread at " << 1/control.period() << " Hz on core " << statistics.cpu << ": "
+		<< statistics.ticks << " ticks, " << statistics.deadline_misses << " deadline misses, latency p50 < " << statistics.latency.percentile(50)
+		<< " us, p99 < " << statistics.latency.percentile(99) << " us, max " << statistics.latency.max << " us, attitude error "
+		<< snapshot.attitude.error*180/3.14159265f << " deg" << std::endl;
+}
+
+// Terrain: construction of the heightfield and its quadtree, and the impact of falling stages
+// (parabolas down to the ground) and of the steps of the dynamic model (segments)
+static void run_terrain(std::vector<bench_result>& results, bench_options const& options)
+{
+	std::string const prefix = "terrain/";
+	if(!options.filter.empty() && prefix.find(options.filter)==std::string::npos && options.filter.find(prefix)==std::string::npos)
+		return;
+	sim::terrain_settings const settings;
+	run(results, options, "terrain/generate", 1, []{},
+		[&]{
+			sim::heightfield const terrain(settings);
+			sink = sink + terrain.max_height();
+		});
+
+	sim::heightfield const& terrain = sim::launch_site_terrain();
+	sim::vec3 const g = sim::mission_parameters().g;
+	sim::random_stream random(1976, 0);
+	auto uniform = [&](float a, float b){ return a + (b-a)*static_cast<float>(random.uniform()); };
+	std::vector<sim::terrain_query> parabolas(16384), segments(16384);
+	for(sim::terrain_query& q : parabolas){
+		sim::vec3 const p(uniform(-240, 240), uniform(-240, 240), uniform(20, 600));
+		sim::vec3 const v(uniform(-40, 40), uniform(-40, 40), uniform(-80, 40));
+		q = sim::terrain_parabola(p, v, g);
+	}
+	for(sim::terrain_query& q : segments){
+		sim::vec3 const a(uniform(-240, 240), uniform(-240, 240), uniform(0, 40));
+		sim::vec3 const b = a + sim::vec3(uniform(-20, 20), uniform(-20, 20), uniform(-40, 0));
+		q = sim::terrain_segment(a, b, 1.0f);
+	}
+
+	// impact times against the first sample of the path under the surface, every 0.1 ms
+	if(options.filter.empty() || std::string("terrain/parabola_query").find(options.filter)!=std::string::npos){
+		double const step = 1e-4;
+		double error = 0;
+		int hits = 0;
+		for(size_t k=0; k<200; ++k){
+			sim::terrain_query const& q = parabolas[k];
+			sim::terrain_impact const impact = terrain.intersect(q);
+			double t = 0;
+			for(; t < 60; t += step){
+				sim::vec3 const p = q.p + static_cast<float>(t)*q.v + static_cast<float>(0.5*t*t)*q.a;
+				if(p.z <= terrain.height(p.x, p.y))
+					break;
+			}
+			error = std::max(error, std::abs(t - impact.t));
+			hits += impact.hit() ? 1 : 0;
+		}
+		std::cout << std::scientific << std::setprecision(2) << "terrain impacts of 200 parabolas: " << hits
+			<< " hits, largest difference with a sampling every " << step << " s: " << error << " s" << std::endl;
+	}
+
+	std::vector<sim::terrain_impact> impacts(parabolas.size());
+	unsigned int const queries = 1024;
+	size_t offset = 0;
+	run(results, options, "terrain/parabola_query", queries, []{},
+		[&]{
+			for(unsigned int k=0; k<queries; ++k)
+				sink = sink + terrain.intersect(parabolas[(offset + k)%parabolas.size()]).t;
+			offset += queries;
+		});
+	run(results, options, "terrain/segment_query", queries, []{},
+		[&]{
+			for(unsigned int k=0; k<queries; ++k){
+				sim::terrain_impact const impact = terrain.intersect(segments[(offset + k)%segments.size()]);
+				sink = sink + (impact.hit() ? impact.t : 0.0f);
+			}
+			offset += queries;
+		});
+
+	sim::thread_pool pool;
+	for(sim::thread_pool* workers : {static_cast<sim::thread_pool*>(nullptr), &pool}){
+		std::string const threads = workers==nullptr ? "/1_thread" : "/pool";
+		run(results, options, "terrain/parabola_batch/16384" + threads, static_cast<unsigned int>(parabolas.size()), []{},
+			[&]{
+				sim::terrain_intersect(terrain, parabolas.data(), impacts.data(), parabolas.size(), workers);
+				sink = sink + impacts.back().t;
+			});
+	}
+}
+
+// Live telemetry in shared memory: cost of a publication and of a read, and latency from the
+// publication of a state to its observation by a reader spinning on another thread (its own mapping)
+static void run_shared_telemetry(std::vector<bench_result>& results, bench_options const& options)
+{
+	std::string const prefix = "shared_telemetry/";
+	if(!options.filter.empty() && prefix.find(options.filter)==std::string::npos && options.filter.find(prefix)==std::string::npos)
+		return;
+	std::string const name = "/rocket_bench_telemetry";
+	sim::shared_telemetry_publisher publisher;
+	sim::shared_telemetry_reader reader;
+	if(!publisher.open(name) || !reader.attach(name)){
+		std::cout << "shared_telemetry: cannot create " << name << std::endl;
+		return;
+	}
+	sim::mission_parameters parameters;
+	sim::mission_state state;
+	sim::mission_initialize(state, parameters);
+	sim::mission_advance_to(state, parameters, 12.0f);
+
+	unsigned int const states = 1000;
+	uint64_t tick = 0;
+	run(results, options, "shared_telemetry/publish", states, []{},
+		[&]{
+			for(unsigned int k=0; k<states; ++k)
+				publisher.publish(state, tick++);
+		});
+	sim::shared_mission_state copy;
+	run(results, options, "shared_telemetry/read_state", states, []{},
+		[&]{
+			double sum = 0;
+			for(unsigned int k=0; k<states; ++k){
+				reader.read_state(copy);
+				sum += copy.t;
+			}
+			sink = sink + sum;
+		});
+
+	// one state every 20 us, each one waited for by the reader before the next
+	std::atomic<bool> ready(false);
+	std::atomic<bool> observed(false);
+	std::vector<double> latencies;
+	size_t const count = static_cast<size_t>(std::max(options.repetitions, 1))*20;
+	std::thread observer([&]{
+		sim::shared_telemetry_reader spinning;
+		spinning.attach(name);
+		uint64_t last = spinning.sequence();
+		sim::shared_mission_state seen;
+		ready = true;
+		while(latencies.size()<count){
+			uint64_t const sequence = spinning.sequence();
+			if(sequence==last || (sequence & 1)!=0 || !spinning.read_state(seen))
+				continue;
+			latencies.push_back(static_cast<double>(sim::shared_telemetry_now() - seen.publish_ns));
+			last = sequence;
+			observed = true;
+		}
+	});
+	while(!ready)
+		std::this_thread::yield();
+	for(size_t k=0; k<count; ++k){
+		observed = false;
+		publisher.publish(state, tick++);
+		auto const next = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+		while(!observed || std::chrono::steady_clock::now()<next)
+			std::this_thread::yield();
+	}
+	observer.join();
+	report(results, "shared_telemetry/publish_to_observe", 1, latencies);
+}
+
+// CPU side of the frame loop of the application, without window: advance the mission to the time
+// of the frame and read the positions of the displayed bodies
+static void run_frame(std::vector<bench_result>& results, bench_options const& options)
+{
+	sim::mission_parameters parameters;
+	sim::mission_state state;
+	float const frame_dt = 1.0f/60.0f;
+	unsigned int const frames = 1800; // 30s: launch, separations and orbit
+
+	run(results, options, "frame/headless_60hz", frames,
+		[&]{ sim::mission_initialize(state, parameters); },
+		[&]{
+			double checksum = 0;
+			for(unsigned int k=1; k<=frames; ++k){
+				sim::mission_advance_to(state, parameters, frame_dt*static_cast<float>(k));
+				bool const orbit = sim::mission_in_orbit(state, parameters);
+				for(int b=0; b<sim::mission_body_count; ++b){
+					sim::vec3 const p = sim::mission_position(state, sim::mission_body(b));
+					checksum += orbit ? p.x : p.z;
+				}
+			}
+			sink = sink + checksum;
+		});
+}
+
+#ifdef ROCKET_BENCH_VCL
+// Meshes generated by initialize_data (same calls and resolutions)
+static void run_meshes(std::vector<bench_result>& results, bench_options const& options)
+{
+	using namespace vcl;
+	auto const none = []{};
+	auto const keep = [](mesh const& m){ sink = sink + static_cast<double>(m.position.size()); };
+
+	run(results, options, "mesh_primitive_sphere/120x60", 1, none, [&]{ keep(mesh_primitive_sphere(1000.0f, vec3{0,0,-1000.0f}, 120, 60)); });
+	run(results, options, "mesh_primitive_cylinder/60x60", 1, none, [&]{ keep(mesh_primitive_cylinder(0.4f, vec3(0,0,0.001f), vec3(0,0,5), 60, 60, true)); });
+	run(results, options, "mesh_primitive_cone/60x60", 1, none, [&]{ keep(mesh_primitive_cone(0.6f, 1.0f, vec3(0,0,7), vec3(0,0,1), true, 60, 60)); });
+	run(results, options, "mesh_primitive_disc/60", 10, none, [&]{
+		for(int k=0; k<10; ++k)
+			keep(mesh_primitive_disc(5.0f, vec3(0,0,0.01f), vec3(0,0,1), 60));
+	});
+	run(results, options, "mesh_primitive_quadrangle", 100, none, [&]{
+		for(int k=0; k<100; ++k)
+			keep(mesh_primitive_quadrangle(vec3(10,10,0), vec3(10,-10,0), vec3(-10,-10,0), vec3(-10,10,0)));
+	});
+}
+#endif
+
+static bool write_json(std::string const& filename, bench_options const& options, std::vector<bench_result> const& results)
+{
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+	out << std::setprecision(6);
+	out << "{\n\"warmup\": " << options.warmup << ",\n\"repetitions\": " << options.repetitions
+		<< ",\n\"simd\": \"" << sim::simd_level_name(sim::body_table_detect_simd()) << "\",\n\"unit\": \"ns\",\n\"benchmarks\": [\n";
+	for(size_t k=0; k<results.size(); ++k){
+		sim::sample_summary const& s = results[k].summary;
+		out << "{\"name\": \"" << results[k].name << "\", \"operations\": " << results[k].operations
+			<< ", \"median\": " << s.p50 << ", \"p99\": " << s.p99 << ", \"mean\": " << s.mean
+			<< ", \"min\": " << s.min << ", \"max\": " << s.max << "}" << (k+1<results.size() ? ",\n" : "\n");
+	}
+	out << "]\n}\n";
+	return bool(out);
+}
+
+int main(int argc, char* argv[])
+{
+	bench_options options;
+	std::string json;
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--warmup")==0 && k+1<argc)
+			options.warmup = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--repetitions")==0 && k+1<argc)
+			options.repetitions = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--filter")==0 && k+1<argc)
+			options.filter = argv[++k];
+		else if(std::strcmp(argv[k],"--json")==0 && k+1<argc)
+			json = argv[++k];
+		else{
+			std::cout << "Usage: " << argv[0] << " [--warmup N] [--repetitions N] [--filter text] [--json file]" << std::endl;
+			return 1;
+		}
+	}
+	if(options.warmup<0 || options.repetitions<1){
+		std::cerr << "Invalid number of warmup samples or repetitions" << std::endl;
+		return 1;
+	}
+
+	std::cout << options.warmup << " warmup samples, " << options.repetitions << " repetitions, ns per operation" << std::endl;
+	std::vector<bench_result> results;
+	run_physics(results, options);
+	run_atmosphere(results, options);
+	run_timeline(results, options);
+	run_constellation(results, options);
+	run_particles(results, options);
+	run_fleet(results, options);
+	run_simulation_thread(results, options);
+	run_time_warp(results, options);
+	run_control_thread(results, options);
+	run_terrain(results, options);
+	run_shared_telemetry(results, options);
+	run_frame(results, options);
+#ifdef ROCKET_BENCH_VCL
+	run_meshes(results, options);
+#endif
+
+	if(!json.empty()){
+		if(!write_json(json, options, results)){
+			std::cerr << "Cannot write " << json << std::endl;
+			return 1;
+		}
+		std::cout << "Results written to " << json << std::endl;
+	}
+	return 0;
+}
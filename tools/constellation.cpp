@@ -0,0 +1,146 @@
+/**
+Throughput and accuracy of the constellation propagator.
+
+Usage: rocket_constellation [--satellites N] [--planes N] [--phasing F] [--altitude km] [--inclination deg]
+                            [--eccentric N] [--days D] [--steps N] [--threads N] [--no-j2]
+
+Builds a Walker pattern (plus N random eccentric orbits with --eccentric), propagates it at
+`steps` times spread over `days` with each instruction set supported by the CPU, and reports:
+ - satellites per second, single thread and on the thread pool,
+ - whether all the paths give bit-identical positions,
+ - the largest distance to the double precision reference (orbit_propagate),
+ - the drift of the ascending node over one day against the J2 formula.
+*/
+
+#include "simulation/constellation.hpp"
+#include "simulation/thread_pool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+static double const pi = 3.141592653589793;
+
+// Seconds to propagate the constellation at the given times
+static double time_propagation(sim::constellation& c, std::vector<double> const& times, sim::simd_level level, sim::thread_pool* pool)
+{
+	auto const start = std::chrono::steady_clock::now();
+	for(double t : times)
+		sim::constellation_propagate(c, t, level, pool);
+	auto const end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end-start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	sim::walker_pattern pattern;
+	pattern.satellites = 50000;
+	pattern.planes = 250;
+	size_t eccentric = 0;
+	double days = 1;
+	int steps = 200;
+	unsigned int threads = 0;
+	bool j2 = true;
+
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--satellites")==0 && k+1<argc)
+			pattern.satellites = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--planes")==0 && k+1<argc)
+			pattern.planes = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--phasing")==0 && k+1<argc)
+			pattern.phasing = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--altitude")==0 && k+1<argc)
+			pattern.altitude = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--inclination")==0 && k+1<argc)
+			pattern.inclination = std::atof(argv[++k])*pi/180;
+		else if(std::strcmp(argv[k],"--eccentric")==0 && k+1<argc)
+			eccentric = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--days")==0 && k+1<argc)
+			days = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--steps")==0 && k+1<argc)
+			steps = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--threads")==0 && k+1<argc)
+			threads = static_cast<unsigned int>(std::atoi(argv[++k]));
+		else if(std::strcmp(argv[k],"--no-j2")==0)
+			j2 = false;
+		else{
+			std::cout << "Usage: " << argv[0] << " [--satellites N] [--planes N] [--phasing F] [--altitude km] [--inclination deg]"
+				<< " [--eccentric N] [--days D] [--steps N] [--threads N] [--no-j2]" << std::endl;
+			return 1;
+		}
+	}
+	if(pattern.planes<1 || pattern.satellites<pattern.planes || steps<1 || days<0){
+		std::cerr << "Invalid constellation or time steps" << std::endl;
+		return 1;
+	}
+
+	sim::constellation c;
+	c.set_j2(j2);
+	sim::constellation_add_walker(c, pattern);
+	std::mt19937_64 random(1);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	for(size_t k=0; k<eccentric; ++k){
+		sim::orbit_elements o;
+		o.eccentricity = 0.9*uniform(random);
+		o.semi_major_axis = (c.planet.radius + 300)/(1 - o.eccentricity) + 30000*uniform(random); // perigee above 300 km
+		o.inclination = pi*uniform(random);
+		o.raan = 2*pi*uniform(random);
+		o.argument_of_perigee = 2*pi*uniform(random);
+		o.mean_anomaly = 2*pi*uniform(random);
+		c.add(o);
+	}
+
+	std::vector<double> times;
+	for(int k=0; k<steps; ++k)
+		times.push_back(days*86400*k/steps);
+
+	sim::thread_pool pool(threads);
+	int const per_plane = pattern.satellites/pattern.planes;
+	int const remainder = pattern.satellites%pattern.planes;
+	std::cout << c.size() << " satellites (" << pattern.satellites << " on " << pattern.planes << " planes";
+	if(remainder>0)
+		std::cout << ": " << remainder << " of " << per_plane+1 << " and " << pattern.planes-remainder << " of " << per_plane;
+	std::cout << ", " << eccentric << " eccentric), J2 " << (j2 ? "on" : "off") << ", " << steps << " steps over " << days << " days" << std::endl;
+
+	// reference positions: scalar path at the last time
+	sim::constellation_propagate(c, times.back(), sim::simd_level::scalar);
+	std::vector<float> const rx = c.px, ry = c.py, rz = c.pz;
+
+	bool identical = true;
+	sim::simd_level const best = sim::body_table_detect_simd();
+	sim::simd_level const levels[] = {sim::simd_level::scalar, sim::simd_level::sse, sim::simd_level::avx2};
+	for(sim::simd_level level : levels){
+		if(level>best)
+			break;
+		double const single = time_propagation(c, times, level, nullptr);
+		double const parallel = time_propagation(c, times, level, &pool);
+		bool const same = c.px==rx && c.py==ry && c.pz==rz;
+		identical = identical && same;
+		double const count = static_cast<double>(c.size())*steps;
+		std::cout << std::left << std::setw(8) << sim::simd_level_name(level) << std::right << std::setprecision(4)
+			<< std::setw(10) << count/single*1e-6 << " M satellites/s, " << std::setw(10) << count/parallel*1e-6
+			<< " M satellites/s on " << pool.size() << " threads" << (same ? "" : "   (positions differ from scalar)") << std::endl;
+	}
+
+	double max_error = 0;
+	for(size_t k=0; k<c.size(); ++k){
+		sim::orbit_state const s = sim::orbit_propagate(c.elements[k], c.planet, times.back(), j2);
+		double const dx = s.position[0]-rx[k], dy = s.position[1]-ry[k], dz = s.position[2]-rz[k];
+		max_error = std::max(max_error, std::sqrt(dx*dx + dy*dy + dz*dz));
+	}
+	std::cout << "Bit-identical paths: " << (identical ? "yes" : "no") << std::endl;
+	std::cout << "Largest distance to the double precision reference: " << max_error*1000 << " m" << std::endl;
+
+	// ascending node of the first satellite after one day, from its position and velocity
+	sim::orbit_elements const& first = c.elements.front();
+	double const expected = sim::orbit_secular_rates(first, c.planet, j2).raan*86400;
+	sim::orbit_elements const after = sim::orbit_from_state(sim::orbit_propagate(first, c.planet, 86400, j2), c.planet.mu);
+	double const measured = std::remainder(after.raan - first.raan, 2*pi);
+	std::cout << "Ascending node drift over one day: " << measured*180/pi << " deg (J2 formula " << expected*180/pi << " deg)" << std::endl;
+
+	return identical ? 0 : 2;
+}
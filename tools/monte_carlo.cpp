@@ -0,0 +1,117 @@
+/**
+Monte Carlo dispersion analysis of the launch.
+
+Usage: rocket_monte_carlo [--samples N] [--threads N] [--seed S] [--bins N] [--csv file] [--model scripted|dynamic]
+
+The separation times, the orbit start time and the ascent velocity are perturbed around the
+nominal mission, and the spread of the stage impact points and of the orbit insertion radius
+is reported as percentiles and histograms. Every run has its own random stream, so the results
+are identical whatever the number of threads.
+*/
+
+#include "simulation/dispersion.hpp"
+#include "simulation/statistics.hpp"
+#include "simulation/thread_pool.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Summary and histogram of one output value
+static void report(char const* name, std::vector<double> const& values, size_t bins)
+{
+	if(values.empty()){
+		std::cout << name << ": no sample" << std::endl;
+		return;
+	}
+	sim::print_summary(std::cout, name, sim::summarize(values));
+	sim::print_histogram(std::cout, sim::compute_histogram(values, bins));
+	std::cout << std::endl;
+}
+
+static void write_csv(std::string const& filename, std::vector<sim::dispersion_sample> const& samples)
+{
+	std::ofstream out(filename);
+	if(!out){
+		std::cerr << "Cannot write " << filename << std::endl;
+		return;
+	}
+	out << "run,t_separation_first,t_separation_second,t_satellite_orbit_start,v0x,v0y,v0z,"
+		<< "first_landed,first_impact_x,first_impact_y,first_impact_t,"
+		<< "second_landed,second_impact_x,second_impact_y,second_impact_t,orbit_insertion_radius\n";
+	for(size_t k=0; k<samples.size(); ++k){
+		sim::dispersion_sample const& s = samples[k];
+		sim::mission_parameters const& p = s.parameters;
+		out << k << ',' << p.t_separation_first << ',' << p.t_separation_second << ',' << p.t_satellite_orbit_start << ','
+			<< p.rocket_v0.x << ',' << p.rocket_v0.y << ',' << p.rocket_v0.z << ','
+			<< s.first_stage_landed << ',' << s.first_stage_impact.x << ',' << s.first_stage_impact.y << ',' << s.first_stage_impact_time << ','
+			<< s.second_stage_landed << ',' << s.second_stage_impact.x << ',' << s.second_stage_impact.y << ',' << s.second_stage_impact_time << ','
+			<< s.orbit_insertion_radius << '\n';
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	sim::dispersion_parameters campaign;
+	unsigned int threads = 0;
+	size_t bins = 20;
+	std::string csv;
+
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--samples")==0 && k+1<argc)
+			campaign.sample_count = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--threads")==0 && k+1<argc)
+			threads = static_cast<unsigned int>(std::atoi(argv[++k]));
+		else if(std::strcmp(argv[k],"--seed")==0 && k+1<argc)
+			campaign.seed = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--bins")==0 && k+1<argc)
+			bins = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--csv")==0 && k+1<argc)
+			csv = argv[++k];
+		else if(std::strcmp(argv[k],"--model")==0 && k+1<argc)
+			campaign.nominal.model = std::strcmp(argv[++k],"dynamic")==0 ? sim::flight_model::dynamic : sim::flight_model::scripted;
+		else{
+			std::cout << "Usage: " << argv[0] << " [--samples N] [--threads N] [--seed S] [--bins N] [--csv file] [--model scripted|dynamic]" << std::endl;
+			return 1;
+		}
+	}
+
+	sim::thread_pool pool(threads);
+	std::cout << "Run " << campaign.sample_count << " samples on " << pool.size() << " threads (seed " << campaign.seed << ")" << std::endl;
+
+	auto const start = std::chrono::steady_clock::now();
+	std::vector<sim::dispersion_sample> const samples = sim::dispersion_campaign(campaign, pool);
+	auto const end = std::chrono::steady_clock::now();
+	double const elapsed = std::chrono::duration<double>(end-start).count();
+	std::cout << "Done in " << elapsed << "s (" << samples.size()/elapsed << " samples/sec, " << pool.steal_count() << " chunks stolen)" << std::endl << std::endl;
+
+	std::vector<double> first_x, first_y, second_x, second_y, radius;
+	for(sim::dispersion_sample const& s : samples){
+		if(s.first_stage_landed){
+			first_x.push_back(s.first_stage_impact.x);
+			first_y.push_back(s.first_stage_impact.y);
+		}
+		if(s.second_stage_landed){
+			second_x.push_back(s.second_stage_impact.x);
+			second_y.push_back(s.second_stage_impact.y);
+		}
+		radius.push_back(s.orbit_insertion_radius);
+	}
+	std::cout << "First stage landed before orbit insertion: " << first_x.size() << "/" << samples.size() << std::endl;
+	std::cout << "Second stage landed before orbit insertion: " << second_x.size() << "/" << samples.size() << std::endl << std::endl;
+
+	report("First stage impact x", first_x, bins);
+	report("First stage impact y", first_y, bins);
+	report("Second stage impact x", second_x, bins);
+	report("Second stage impact y", second_y, bins);
+	report("Orbit insertion radius", radius, bins);
+
+	if(!csv.empty()){
+		write_csv(csv, samples);
+		std::cout << "Samples written to " << csv << std::endl;
+	}
+
+	return 0;
+}
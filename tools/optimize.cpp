@@ -0,0 +1,124 @@
+/**
+Search of the staging and ascent parameters of the launch.
+
+Usage: rocket_optimize [--objective altitude|propellant] [--model scripted|dynamic] [--method cma-es|nelder-mead]
+                       [--population N] [--generations N] [--threads N] [--seed S] [--sigma s] [--no-polish]
+                       [--min-altitude h] [--max-propellant kg] [--checkpoint file] [--output file]
+
+Every generation is evaluated on all the threads, the missions running headless until their orbit
+insertion. With --checkpoint, the search and the cache of its evaluations are saved after every
+generation, and a search interrupted (or finished with fewer --generations) resumes from the file
+with the same options. --output writes the best parameters, read by the application with --mission.
+*/
+
+#include "simulation/thread_pool.hpp"
+#include "simulation/trajectory_optimization.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static void print_best(sim::trajectory_optimizer const& optimizer, sim::trajectory_problem const& problem)
+{
+	sim::trajectory_evaluation const& best = optimizer.best();
+	sim::mission_parameters const p = optimizer.best_parameters();
+	std::cout << "Best: altitude " << best.altitude << ", propellant " << best.propellant << " kg, "
+		<< (best.feasible ? "feasible" : "infeasible") << " (fitness " << best.fitness << ")" << std::endl;
+	std::cout << "  t_separation_first " << p.t_separation_first << ", t_separation_second " << p.t_separation_second
+		<< ", t_satellite_orbit_start " << p.t_satellite_orbit_start << std::endl;
+	if(problem.bounds[sim::variable_ascent_speed].enabled || problem.bounds[sim::variable_ascent_tilt].enabled)
+		std::cout << "  rocket_v0 (" << p.rocket_v0.x << ", " << p.rocket_v0.y << ", " << p.rocket_v0.z << ")" << std::endl;
+	if(problem.bounds[sim::variable_pitch_rate].enabled)
+		std::cout << "  pitch program from " << p.pitch.start_time << " s at " << p.pitch.rate << " rad/s" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	sim::trajectory_problem problem;
+	sim::optimization_settings settings;
+	unsigned int threads = 0;
+	std::string checkpoint;
+	std::string output;
+
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--objective")==0 && k+1<argc)
+			problem.objective = std::strcmp(argv[++k],"propellant")==0 ? sim::trajectory_objective::min_propellant : sim::trajectory_objective::max_altitude;
+		else if(std::strcmp(argv[k],"--model")==0 && k+1<argc)
+			problem.nominal.model = std::strcmp(argv[++k],"dynamic")==0 ? sim::flight_model::dynamic : sim::flight_model::scripted;
+		else if(std::strcmp(argv[k],"--method")==0 && k+1<argc)
+			settings.method = std::strcmp(argv[++k],"nelder-mead")==0 ? sim::optimization_method::nelder_mead : sim::optimization_method::cma_es;
+		else if(std::strcmp(argv[k],"--population")==0 && k+1<argc)
+			settings.population = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--generations")==0 && k+1<argc)
+			settings.max_generations = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--threads")==0 && k+1<argc)
+			threads = static_cast<unsigned int>(std::atoi(argv[++k]));
+		else if(std::strcmp(argv[k],"--seed")==0 && k+1<argc)
+			settings.seed = std::strtoull(argv[++k], nullptr, 10);
+		else if(std::strcmp(argv[k],"--sigma")==0 && k+1<argc)
+			settings.sigma = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--no-polish")==0)
+			settings.polish = false;
+		else if(std::strcmp(argv[k],"--min-altitude")==0 && k+1<argc)
+			problem.min_altitude = static_cast<float>(std::atof(argv[++k]));
+		else if(std::strcmp(argv[k],"--max-propellant")==0 && k+1<argc)
+			problem.max_propellant = static_cast<float>(std::atof(argv[++k]));
+		else if(std::strcmp(argv[k],"--checkpoint")==0 && k+1<argc)
+			checkpoint = argv[++k];
+		else if(std::strcmp(argv[k],"--output")==0 && k+1<argc)
+			output = argv[++k];
+		else{
+			std::cout << "Usage: " << argv[0] << " [--objective altitude|propellant] [--model scripted|dynamic] [--method cma-es|nelder-mead]" << std::endl
+				<< "       [--population N] [--generations N] [--threads N] [--seed S] [--sigma s] [--no-polish]" << std::endl
+				<< "       [--min-altitude h] [--max-propellant kg] [--checkpoint file] [--output file]" << std::endl;
+			return 1;
+		}
+	}
+	if(problem.objective==sim::trajectory_objective::min_propellant && problem.nominal.model!=sim::flight_model::dynamic){
+		std::cerr << "The scripted model burns no propellant: use --model dynamic" << std::endl;
+		return 1;
+	}
+	trajectory_default_variables(problem);
+
+	sim::thread_pool pool(threads);
+	sim::trajectory_optimizer optimizer(problem, settings);
+	if(!checkpoint.empty() && std::ifstream(checkpoint)){
+		if(!optimizer.load(checkpoint)){
+			std::cerr << "Cannot resume from " << checkpoint << " (other problem or damaged file)" << std::endl;
+			return 1;
+		}
+		std::cout << "Resumed from " << checkpoint << " after " << optimizer.statistics().generations << " generations" << std::endl;
+	}
+	std::cout << "Search over " << sim::trajectory_dimension(problem) << " variables on " << pool.size() << " threads:";
+	for(int k=0; k<sim::trajectory_variable_count; ++k)
+		if(problem.bounds[k].enabled)
+			std::cout << ' ' << sim::trajectory_variable_name(k);
+	std::cout << std::endl;
+
+	auto const start = std::chrono::steady_clock::now();
+	size_t const evaluations_before = optimizer.statistics().evaluations;
+	while(!optimizer.finished()){
+		optimizer.step(pool);
+		sim::optimization_statistics const& stats = optimizer.statistics();
+		std::cout << "generation " << stats.generations << (optimizer.method()==sim::optimization_method::cma_es ? " cma-es" : " nelder-mead")
+			<< ": best " << optimizer.best().fitness << ", " << stats.evaluations << " missions, " << stats.cache_hits << " cached" << std::endl;
+		if(!checkpoint.empty() && !optimizer.save(checkpoint))
+			std::cerr << "Cannot write " << checkpoint << std::endl;
+	}
+	double const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	size_t const evaluations = optimizer.statistics().evaluations - evaluations_before;
+	std::cout << "Done in " << elapsed << "s (" << evaluations/std::max(elapsed, 1e-9) << " missions/sec"
+		<< (optimizer.statistics().fallback ? ", Nelder-Mead after a breakdown of CMA-ES" : "") << ")" << std::endl;
+	print_best(optimizer, problem);
+
+	if(!output.empty()){
+		if(!sim::save_mission_design(output, optimizer.best_parameters())){
+			std::cerr << "Cannot write " << output << std::endl;
+			return 1;
+		}
+		std::cout << "Parameters written to " << output << " (Rocket-Launch-Simulation --mission " << output << ")" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+/**
+Reader of the binary telemetry files written by rocket_batch --telemetry.
+
+Usage: rocket_telemetry file [--body B --component px|py|pz|vx|vy|vz] [--from t] [--to t]
+
+Prints the layout of the file (chunks, compression) and the events. With --body, the values of
+one column between --from and --to are printed: only the chunks of this time range are visited,
+and only the requested column of each chunk is decoded.
+*/
+
+#include "simulation/telemetry.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+int main(int argc, char* argv[])
+{
+	if(argc<2){
+		std::cout << "Usage: " << argv[0] << " file [--body B --component px|py|pz|vx|vy|vz] [--from t] [--to t]" << std::endl;
+		return 1;
+	}
+
+	int body = -1;
+	int component = sim::telemetry_pz;
+	double t_begin = 0;
+	double t_end = std::numeric_limits<double>::infinity();
+	char const* const component_names[] = {"px", "py", "pz", "vx", "vy", "vz"};
+
+	for(int k=2; k<argc; ++k){
+		if(std::strcmp(argv[k],"--body")==0 && k+1<argc)
+			body = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--component")==0 && k+1<argc){
+			++k;
+			component = -1;
+			for(int c=0; c<sim::telemetry_component_count; ++c)
+				if(std::strcmp(argv[k], component_names[c])==0)
+					component = c;
+			if(component<0){
+				std::cout << "Unknown component " << argv[k] << std::endl;
+				std::cout << "Usage: " << argv[0] << " file [--body B --component px|py|pz|vx|vy|vz] [--from t] [--to t]" << std::endl;
+				return 1;
+			}
+		}
+		else if(std::strcmp(argv[k],"--from")==0 && k+1<argc)
+			t_begin = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--to")==0 && k+1<argc)
+			t_end = std::atof(argv[++k]);
+		else{
+			std::cout << "Unknown option " << argv[k] << std::endl;
+			return 1;
+		}
+	}
+
+	sim::telemetry_reader reader;
+	if(!reader.open(argv[1])){
+		std::cerr << "Cannot read " << argv[1] << " (missing file or not a telemetry file)" << std::endl;
+		return 1;
+	}
+
+	sim::telemetry_file_header const& header = reader.header();
+	uint64_t samples = 0;
+	for(size_t k=0; k<reader.chunk_count(); ++k)
+		samples += reader.chunk(k).sample_count;
+	double const raw = static_cast<double>(samples)*(header.body_count*sim::telemetry_component_count*sizeof(float) + sizeof(uint64_t));
+	std::cout << argv[1] << ": version " << header.version << ", " << header.body_count << " bodies, dt=" << header.dt << "s" << std::endl;
+	std::cout << samples << " samples in " << reader.chunk_count() << " chunks, " << reader.file_size() << " bytes ("
+		<< raw/reader.file_size() << "x smaller than raw floats)" << std::endl;
+	if(reader.chunk_count()>0)
+		std::cout << "Time range: [" << reader.chunk(0).t_begin << ", " << reader.chunk(reader.chunk_count()-1).t_end << "]" << std::endl;
+
+	std::vector<sim::telemetry_event> events;
+	if(!reader.read_events(events))
+		std::cerr << "Corrupt events in " << argv[1] << ", only the events before the error are printed" << std::endl;
+	std::cout << std::endl << events.size() << " events" << std::endl;
+	for(sim::telemetry_event const& e : events)
+		std::cout << "  t=" << e.step*header.dt << " body " << e.body << ": " << sim::telemetry_event_name(e.type) << std::endl;
+
+	if(body>=0){
+		if(static_cast<uint32_t>(body)>=header.body_count){
+			std::cerr << "No body " << body << " in the file" << std::endl;
+			return 1;
+		}
+		std::vector<double> times;
+		std::vector<float> values;
+		auto const start = std::chrono::steady_clock::now();
+		bool const valid = reader.read_column(sim::telemetry_column(body, sim::telemetry_component(component)), t_begin, t_end, times, values);
+		auto const end = std::chrono::steady_clock::now();
+		if(!valid)
+			std::cerr << "Corrupt chunk in " << argv[1] << ", only the samples before the error are printed" << std::endl;
+
+		std::cout << std::endl << "Body " << body << " " << component_names[component] << ": " << values.size() << " samples decoded in "
+			<< std::chrono::duration<double>(end-start).count() << "s" << std::endl;
+		for(size_t k=0; k<values.size(); ++k)
+			std::cout << times[k] << " " << values[k] << std::endl;
+	}
+
+	return 0;
+}
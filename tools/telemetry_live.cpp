@@ -0,0 +1,139 @@
+/**
+Reader of the live telemetry published in shared memory by the application (--shared-memory NAME)
+or by this tool (--publish), see src/simulation/shared_telemetry.hpp.
+
+Usage: rocket_telemetry_live [--name /rocket_telemetry] [--rate HZ] [--duration S]
+       rocket_telemetry_live --latency N [--name /rocket_telemetry]
+       rocket_telemetry_live --publish [--name /rocket_telemetry] [--duration S]
+
+By default, prints the events as they come and the state of the stages --rate times per second.
+--latency spins on the sequence of the state and measures, for N states, the time between their
+publication and the moment they are seen here (p50, p99, max). --publish runs the mission headless
+on the 1 kHz simulation thread and publishes it, for the readers without the application.
+*/
+
+#include "simulation/shared_telemetry.hpp"
+#include "simulation/simulation_thread.hpp"
+#include "simulation/statistics.hpp"
+#include "simulation/timeline.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int publish(std::string const& name, double duration)
+{
+	sim::mission_parameters parameters;
+	sim::mission_timeline timeline;
+	timeline.reset(parameters);
+	timeline.start_worker();
+	sim::simulation_thread simulation(timeline);
+	sim::simulation_thread_settings settings;
+	settings.shared_memory = name;
+	simulation.start(parameters, settings);
+
+	sim::mission_state state;
+	float t = 0;
+	if(!simulation.interpolate(state, t).shared){
+		std::cerr << "Cannot create the shared memory " << name << std::endl;
+		return 1;
+	}
+	std::cout << "Publishing the mission in " << name << " for " << duration << " s ..." << std::endl;
+	std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+	sim::simulation_snapshot const& snapshot = simulation.interpolate(state, t);
+	std::cout << snapshot.shared_states << " states, " << snapshot.shared_events << " events published" << std::endl;
+	simulation.stop();
+	timeline.stop_worker();
+	return 0;
+}
+
+static int measure_latency(sim::shared_telemetry_reader& reader, int count)
+{
+	std::vector<double> latencies;
+	latencies.reserve(static_cast<size_t>(count));
+	uint64_t last = reader.sequence();
+	sim::shared_mission_state state;
+	auto const give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while(static_cast<int>(latencies.size())<count && std::chrono::steady_clock::now()<give_up){
+		uint64_t const sequence = reader.sequence();
+		if(sequence==last || (sequence & 1)!=0)
+			continue;
+		if(reader.read_state(state)){
+			latencies.push_back(1e-3*static_cast<double>(sim::shared_telemetry_now() - state.publish_ns));
+			last = sequence;
+		}
+	}
+	if(latencies.empty()){
+		std::cerr << "No state published" << std::endl;
+		return 1;
+	}
+	sim::sample_summary const s = sim::summarize(latencies);
+	std::cout << std::fixed << std::setprecision(2) << s.count << " states, publish to observe: p50 " << s.p50 << " us, p99 " << s.p99
+		<< " us, max " << s.max << " us (" << reader.retries() << " reads retried)" << std::endl;
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string name = sim::shared_telemetry_default_name;
+	double rate = 10;
+	double duration = 60;
+	int latency = 0;
+	bool publisher = false;
+	for(int k=1; k<argc; ++k){
+		if(std::strcmp(argv[k],"--name")==0 && k+1<argc)
+			name = argv[++k];
+		else if(std::strcmp(argv[k],"--rate")==0 && k+1<argc)
+			rate = std::max(std::atof(argv[++k]), 0.1);
+		else if(std::strcmp(argv[k],"--duration")==0 && k+1<argc)
+			duration = std::atof(argv[++k]);
+		else if(std::strcmp(argv[k],"--latency")==0 && k+1<argc)
+			latency = std::atoi(argv[++k]);
+		else if(std::strcmp(argv[k],"--publish")==0)
+			publisher = true;
+		else{
+			std::cout << "Usage: " << argv[0] << " [--name /rocket_telemetry] [--rate HZ] [--duration S]" << std::endl
+				<< "       " << argv[0] << " --latency N [--name /rocket_telemetry]" << std::endl
+				<< "       " << argv[0] << " --publish [--name /rocket_telemetry] [--duration S]" << std::endl;
+			return 1;
+		}
+	}
+
+	if(publisher)
+		return publish(name, duration);
+
+	sim::shared_telemetry_reader reader;
+	if(!reader.attach(name)){
+		std::cerr << "Cannot attach " << name << " (not published, or by another version)" << std::endl;
+		return 1;
+	}
+	if(latency>0)
+		return measure_latency(reader, latency);
+
+	char const* const body_names[sim::shared_body_count] = {"first stage", "second stage", "fairing", "satellite"};
+	auto const end = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(duration));
+	while(std::chrono::steady_clock::now()<end){
+		sim::shared_event event;
+		while(reader.next_event(event)){
+			std::cout << std::fixed << std::setprecision(2) << "t=" << event.t << " s  " << sim::telemetry_event_name(static_cast<sim::telemetry_event_type>(event.type))
+				<< " " << (event.body<sim::shared_body_count ? body_names[event.body] : "?") << std::endl;
+		}
+		sim::shared_mission_state state;
+		if(reader.read_state(state)){
+			std::cout << std::fixed << std::setprecision(2) << "t=" << state.t << " s  rocket z " << state.rocket_p[2];
+			for(uint32_t b=0; b<sim::shared_body_count; ++b)
+				std::cout << "  " << body_names[b] << " (" << state.bodies[b].p[0] << ", " << state.bodies[b].p[1] << ", " << state.bodies[b].p[2] << ")";
+			std::cout << (state.in_orbit ? "  in orbit" : "") << std::endl;
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(1/rate));
+	}
+	if(reader.lost_events()>0)
+		std::cout << reader.lost_events() << " events lost (read too late)" << std::endl;
+	return 0;
+}